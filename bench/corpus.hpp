@@ -0,0 +1,338 @@
+// Generates reproducible synthetic audio files for the benchmarks: each file is a tag of
+// the requested shape plus a few KiB of pseudo-random "audio" data, and the same seed
+// always produces the same bytes.
+//
+// Note that the APE items and all integers in APE headers are little-endian, as per
+// the specification.
+#ifndef ATAG_BENCH_CORPUS_HEADER
+#define ATAG_BENCH_CORPUS_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace corpus {
+
+enum class text_encoding { latin1, utf16 };
+
+struct file
+{
+    std::string data;
+    // The number of bytes taken up by tags (as opposed to audio).
+    std::size_t tag_size;
+};
+
+struct id3v2_options
+{
+    int version = 4;
+    int num_frames = 10;
+    text_encoding encoding = text_encoding::latin1;
+    // The size of an attached picture frame, or 0 for none.
+    int picture_size = 0;
+    int padding = 1024;
+};
+
+struct flac_options
+{
+    int num_comments = 20;
+    int picture_size = 0;
+    int padding = 1024;
+};
+
+struct ape_options
+{
+    int num_items = 10;
+    bool has_id3v1 = false;
+};
+
+class generator
+{
+    std::mt19937 rng_;
+
+public:
+    explicit generator(const uint32_t seed) : rng_(seed) {}
+
+    // Mostly ASCII words, with the occasional Latin-1 character (in ISO-8859-1).
+    std::string text(const int min_length, const int max_length)
+    {
+        static const char extra[] = "\xe9\xfc\xf1\xf8\xdf\xe5";
+        const int length = min_length + rng_() % (max_length - min_length + 1);
+        std::string s;
+        while(int(s.length()) < length)
+        {
+            if(!s.empty()) { s += ' '; }
+            const int word_length = 2 + rng_() % 8;
+            for(int i = 0; i < word_length; ++i)
+            {
+                s += rng_() % 20 == 0 ? extra[rng_() % 6] : char('a' + rng_() % 26);
+            }
+        }
+        s.resize(length);
+        return s;
+    }
+
+    std::string bytes(const int n)
+    {
+        std::string s(n, 0);
+        for(auto& c : s) { c = char(rng_()); }
+        return s;
+    }
+
+    int number(const int min, const int max) { return min + rng_() % (max - min + 1); }
+
+    file id3v2(const id3v2_options& options);
+    file flac(const flac_options& options);
+    file ape(const ape_options& options);
+    file id3v1();
+
+private:
+    std::string id3v1_tag();
+};
+
+namespace detail {
+
+inline void put_be32(std::string& out, const uint32_t v)
+{
+    for(int shift = 24; shift >= 0; shift -= 8) { out += char(v >> shift); }
+}
+
+inline void put_le32(std::string& out, const uint32_t v)
+{
+    for(int shift = 0; shift <= 24; shift += 8) { out += char(v >> shift); }
+}
+
+inline void put_syncsafe(std::string& out, const uint32_t v)
+{
+    for(int shift = 21; shift >= 0; shift -= 7) { out += char((v >> shift) & 0x7f); }
+}
+
+// Vorbis comments and APE items are in UTF-8.
+inline std::string to_utf8(const std::string& latin1)
+{
+    std::string out;
+    for(const char c : latin1)
+    {
+        const auto b = static_cast<unsigned char>(c);
+        if(b < 0x80)
+        {
+            out += c;
+        }
+        else
+        {
+            out += char(0xc0 | (b >> 6));
+            out += char(0x80 | (b & 0x3f));
+        }
+    }
+    return out;
+}
+
+// Encodes ISO-8859-1 `s` in the frame's text encoding, with its encoding byte.
+inline std::string encode_text(const std::string& s, const text_encoding encoding)
+{
+    std::string out;
+    if(encoding == text_encoding::latin1)
+    {
+        out += char(0);
+        out += s;
+    }
+    else
+    {
+        out += char(1);
+        out += "\xff\xfe";
+        for(const char c : s)
+        {
+            out += c;
+            out += char(0);
+        }
+    }
+    return out;
+}
+
+inline std::string id3v2_frame(const int version, const char* id,
+    const std::string& body)
+{
+    std::string frame(id, 4);
+    if(version == 4)
+        put_syncsafe(frame, body.size());
+    else
+        put_be32(frame, body.size());
+    frame += std::string(2, 0);
+    return frame + body;
+}
+
+} // namespace detail
+
+inline file generator::id3v2(const id3v2_options& options)
+{
+    using namespace detail;
+    const int v = options.version;
+    const auto enc = options.encoding;
+    const std::string terminator(enc == text_encoding::utf16 ? 2 : 1, 0);
+
+    std::string frames;
+    const auto add = [&frames, v](const char* id, const std::string& body)
+        { frames += id3v2_frame(v, id, body); };
+    add("TIT2", encode_text(text(8, 40), enc));
+    add("TPE1", encode_text(text(6, 24), enc));
+    add("TALB", encode_text(text(8, 32), enc));
+    add("TRCK", encode_text(std::to_string(number(1, 20)) + "/20", enc));
+    add(v == 4 ? "TDRC" : "TYER", encode_text(std::to_string(number(1960, 2020)), enc));
+    add("TCON", encode_text("(" + std::to_string(number(0, 79)) + ")", enc));
+    for(int i = 6; i < options.num_frames; ++i)
+    {
+        if(i % 2 == 0)
+        {
+            std::string body = encode_text("", enc).substr(0, 1) + "eng";
+            body += encode_text(text(4, 12), enc).substr(1) + terminator;
+            body += encode_text(text(20, 200), enc).substr(1);
+            add("COMM", body);
+        }
+        else
+        {
+            std::string body = encode_text(text(4, 16), enc) + terminator;
+            body += encode_text(text(8, 64), enc).substr(1);
+            add("TXXX", body);
+        }
+    }
+    if(options.picture_size > 0)
+    {
+        std::string body(1, 0);
+        body += "image/jpeg";
+        body += std::string(1, 0) + char(3) + std::string(1, 0);
+        add("APIC", body + bytes(options.picture_size));
+    }
+
+    std::string tag = "ID3";
+    tag += char(v);
+    tag += std::string(2, 0);
+    put_syncsafe(tag, frames.size() + options.padding);
+    tag += frames + std::string(options.padding, 0);
+    return file{tag + bytes(number(4096, 16384)), tag.size()};
+}
+
+inline file generator::flac(const flac_options& options)
+{
+    using namespace detail;
+    std::string blocks;
+    const auto add_block = [&blocks](const int type, const std::string& body,
+        const bool is_last)
+    {
+        blocks += char((is_last ? 0x80 : 0) | type);
+        blocks += char(body.size() >> 16);
+        blocks += char(body.size() >> 8);
+        blocks += char(body.size());
+        blocks += body;
+    };
+
+    // STREAMINFO: block sizes, frame sizes, then sample rate (20 bits), channels - 1
+    // (3 bits), bits per sample - 1 (5 bits) and the number of samples (36 bits).
+    std::string info("\x10\x00\x10\x00", 4);
+    info += std::string(6, 0);
+    const uint64_t sample_rate = 44100;
+    const uint64_t num_samples = 44100ull * number(60, 600);
+    const uint64_t packed = (sample_rate << 44) | (uint64_t(1) << 41)
+        | (uint64_t(15) << 36) | num_samples;
+    for(int shift = 56; shift >= 0; shift -= 8) { info += char(packed >> shift); }
+    info += bytes(16);
+    add_block(0, info, false);
+
+    static const char* keys[] = { "TITLE", "ARTIST", "ALBUM", "DATE", "TRACKNUMBER",
+        "GENRE", "COMMENT", "COMPOSER", "PERFORMER", "DESCRIPTION" };
+    std::string comments;
+    const std::string vendor = "reference libFLAC 1.3.2 20170101";
+    put_le32(comments, vendor.size());
+    comments += vendor;
+    put_le32(comments, options.num_comments);
+    for(int i = 0; i < options.num_comments; ++i)
+    {
+        std::string comment = i < 10 ? keys[i] : "CUSTOM" + std::to_string(i);
+        comment += '=';
+        if(i == 3)
+            comment += std::to_string(number(1960, 2020));
+        else if(i == 4)
+            comment += std::to_string(number(1, 20));
+        else
+            comment += to_utf8(text(6, 48));
+        put_le32(comments, comment.size());
+        comments += comment;
+    }
+    add_block(4, comments, false);
+
+    if(options.picture_size > 0)
+    {
+        std::string picture;
+        put_be32(picture, 3);
+        put_be32(picture, 10);
+        picture += "image/jpeg";
+        put_be32(picture, 0);
+        for(int i = 0; i < 4; ++i) { put_be32(picture, i < 2 ? 500 : 24); }
+        put_be32(picture, options.picture_size);
+        add_block(6, picture + bytes(options.picture_size), false);
+    }
+    add_block(1, std::string(options.padding, 0), true);
+    return file{"fLaC" + blocks + bytes(number(4096, 16384)), 4 + blocks.size()};
+}
+
+inline file generator::ape(const ape_options& options)
+{
+    using namespace detail;
+    static const char* keys[] = { "Title", "Artist", "Album", "Year", "Track",
+        "Genre", "Comment", "Composer", "Publisher", "Language" };
+    std::string items;
+    for(int i = 0; i < options.num_items; ++i)
+    {
+        const std::string key = i < 10 ? keys[i] : "Custom" + std::to_string(i);
+        const std::string value = i == 3 ? std::to_string(number(1960, 2020))
+            : i == 4 ? std::to_string(number(1, 20)) : to_utf8(text(6, 48));
+        put_le32(items, value.size());
+        put_le32(items, 0);
+        items += key;
+        items += char(0);
+        items += value;
+    }
+
+    // The header and the footer only differ in the flag marking the header.
+    const auto header = [&items, &options](const bool is_header)
+    {
+        std::string h = "APETAGEX";
+        put_le32(h, 2000);
+        put_le32(h, items.size() + 32);
+        put_le32(h, options.num_items);
+        put_le32(h, 0x80000000u | (is_header ? 0x20000000u : 0));
+        return h + std::string(8, 0);
+    };
+    std::string tag = header(true) + items + header(false);
+    if(options.has_id3v1) { tag += id3v1_tag(); }
+    return file{bytes(number(4096, 16384)) + tag, tag.size()};
+}
+
+inline file generator::id3v1()
+{
+    const std::string tag = id3v1_tag();
+    return file{bytes(number(4096, 16384)) + tag, tag.size()};
+}
+
+inline std::string generator::id3v1_tag()
+{
+    const auto field = [](std::string s, const std::size_t length)
+    {
+        s.resize(length, 0);
+        return s;
+    };
+    std::string tag = "TAG";
+    tag += field(text(8, 30), 30);
+    tag += field(text(6, 30), 30);
+    tag += field(text(8, 30), 30);
+    tag += std::to_string(number(1960, 2020));
+    tag += field(text(4, 28), 28);
+    tag += char(0);
+    tag += char(number(1, 20));
+    tag += char(number(0, 79));
+    return tag;
+}
+
+} // namespace corpus
+
+#endif // ATAG_BENCH_CORPUS_HEADER
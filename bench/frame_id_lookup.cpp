@@ -0,0 +1,72 @@
+// Compares the perfect hash based `id3v2::frame_id_from_string` against the linear
+// scan over `frame_ids_` that it replaced.
+//
+// g++ -std=c++17 -O2 -I../include frame_id_lookup.cpp -o frame_id_lookup
+#include <atag.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// The original lookup, kept here for comparison.
+int linear_frame_id_from_string(const char* s) noexcept
+{
+    using namespace atag::id3v2;
+    const auto it = std::find_if(std::begin(frame_ids_), std::end(frame_ids_),
+        [s](const auto& f) { return std::equal(f.raw, f.raw + 4, s); });
+    if(it != std::end(frame_ids_))
+        return it->id;
+    else
+        return -1;
+}
+
+template<typename F>
+double ns_per_lookup(const std::vector<std::string>& ids, const int rounds, F lookup)
+{
+    volatile int sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for(auto r = 0; r < rounds; ++r)
+    {
+        for(const auto& id : ids) { sink = sink + lookup(id.data()); }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count()
+        / (double(rounds) * ids.size());
+}
+
+int main()
+{
+    // A mix resembling real tags: mostly text frames, some unknown or padding ids.
+    std::vector<std::string> ids;
+    std::mt19937 rng(42);
+    for(auto i = 0; i < 4096; ++i)
+    {
+        const auto n = rng() % 100;
+        if(n < 90)
+            ids.emplace_back(atag::id3v2::frame_id_to_string(rng() % 78));
+        else if(n < 95)
+            ids.emplace_back("XYZW");
+        else
+            ids.emplace_back(std::string(4, '\0'));
+    }
+
+    for(const auto& id : ids)
+    {
+        if(linear_frame_id_from_string(id.data())
+            != atag::id3v2::frame_id_from_string(id.data()))
+        {
+            std::printf("mismatch for %.4s\n", id.data());
+            return 1;
+        }
+    }
+
+    const int rounds = 2000;
+    const double linear = ns_per_lookup(ids, rounds, linear_frame_id_from_string);
+    const double hashed = ns_per_lookup(ids, rounds,
+        [](const char* s) { return atag::id3v2::frame_id_from_string(s); });
+    std::printf("linear scan:  %.2f ns/lookup\nperfect hash: %.2f ns/lookup\n",
+        linear, hashed);
+}
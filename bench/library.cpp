@@ -0,0 +1,140 @@
+// Compares sorting (both byte-wise and by collated sort keys) and grouping a `library`
+// against sorting a vector of `simple_tag`s with the `atag::order` comparators, and the
+// memory either takes, over a synthetic collection of tracks in which artists and
+// albums repeat as in a real one.
+//
+// g++ -std=c++17 -O2 -I../include library.cpp -o library
+#include <atag.hpp>
+#include <atag/library.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// About 10 tracks per album and 3 albums per artist.
+std::vector<atag::simple_tag> make_collection(const int n)
+{
+    std::mt19937 rng(7);
+    const auto random_name = [&rng]
+    {
+        std::string s(6 + rng() % 20, ' ');
+        for(auto& c : s) { c = 'a' + rng() % 26; }
+        return s;
+    };
+    std::vector<std::string> artists(n / 30 + 1);
+    std::vector<std::string> albums(n / 10 + 1);
+    for(auto& a : artists) { a = random_name(); }
+    for(auto& a : albums) { a = random_name(); }
+
+    std::vector<atag::simple_tag> tags(n);
+    for(auto i = 0; i < n; ++i)
+    {
+        auto& t = tags[i];
+        t.title = random_name();
+        t.album = albums[i / 10];
+        t.artist = artists[i / 30];
+        t.track_number = i % 10 + 1;
+        t.year = 1960 + rng() % 60;
+        t.length = 120000 + rng() % 300000;
+    }
+    std::shuffle(tags.begin(), tags.end(), rng);
+    return tags;
+}
+
+std::size_t heap_bytes(const std::string& s)
+{
+    // Short strings are stored in the string itself.
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+template<typename F>
+double ms(F f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const std::chrono::duration<double, std::milli> elapsed
+        = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main()
+{
+    for(const int n : {100000, 2000000})
+    {
+        const auto tags = make_collection(n);
+        atag::library lib;
+        lib.reserve(n);
+        const double build = ms([&] { for(const auto& t : tags) { lib.push_back(t); } });
+
+        std::size_t vector_bytes = tags.size() * sizeof(atag::simple_tag);
+        for(const auto& t : tags)
+        {
+            vector_bytes += heap_bytes(t.title) + heap_bytes(t.album)
+                + heap_bytes(t.artist);
+        }
+        const std::size_t library_bytes = n * (3 * sizeof(uint32_t)
+            + sizeof(atag::genre) + 3 * sizeof(int)) + lib.title_pool().num_bytes()
+            + lib.album_pool().num_bytes() + lib.artist_pool().num_bytes()
+            + 4 * (lib.title_pool().size() + lib.album_pool().size()
+                + lib.artist_pool().size());
+
+        std::printf("%i tracks: vector %zu MiB, library %zu MiB (built in %.1f ms)\n", n,
+            vector_bytes >> 20, library_bytes >> 20, build);
+
+        std::size_t sink = 0;
+        const auto compare = [&](const char* name, auto order)
+        {
+            std::vector<atag::simple_tag> sorted = tags;
+            const double vector_ms = ms([&]
+                { std::stable_sort(sorted.begin(), sorted.end(), order); });
+            std::vector<uint32_t> rows;
+            const double library_ms = ms([&] { rows = lib.sorted_rows(order); });
+            for(std::size_t i = 0; i < rows.size(); ++i)
+            {
+                if(lib[rows[i]].title != sorted[i].title)
+                {
+                    std::printf("mismatch at %zu\n", i);
+                    std::exit(1);
+                }
+            }
+            std::printf("  sort by %-6s %8.1f -> %8.1f ms\n", name, vector_ms,
+                library_ms);
+        };
+        compare("title", atag::order::title());
+        compare("artist", atag::order::artist());
+        compare("album", atag::order::album());
+        compare("year", atag::order::year());
+
+        // With sort keys that ignore case and accents, which are made per tag for the
+        // vector, but only per distinct string for the library.
+        const atag::collation_options options;
+        std::vector<atag::collated<atag::simple_tag>> collated;
+        const double vector_collated_ms = ms([&]
+            {
+                collated.reserve(tags.size());
+                for(const auto& t : tags)
+                    collated.push_back(atag::collate(t, options));
+                std::stable_sort(collated.begin(), collated.end(), atag::order::artist());
+            });
+        const double library_collated_ms = ms([&]
+            { sink += lib.sorted_rows(atag::order::artist(), options).size(); });
+        std::printf("  collated by artist %8.1f -> %8.1f ms\n", vector_collated_ms,
+            library_collated_ms);
+
+        const double map_ms = ms([&]
+            {
+                std::map<std::string, std::vector<uint32_t>> groups;
+                for(uint32_t i = 0; i < tags.size(); ++i)
+                    groups[tags[i].artist].push_back(i);
+                sink += groups.size();
+            });
+        const double group_ms = ms([&] { sink += lib.group_by_artist().size(); });
+        std::printf("  group by artist %8.1f -> %8.1f ms (%zu)\n", map_ms, group_ms,
+            sink % 10);
+    }
+}
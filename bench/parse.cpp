@@ -0,0 +1,438 @@
+// Measures the throughput (files/s, and MB/s of tag data) and the number of heap
+// allocations per file of the parsers, over synthetic corpora of various tag shapes
+// (see corpus.hpp). The corpora are seeded, so results are comparable across runs and
+// versions of atag.
+//
+// Usage: parse [--json] [--dir DIR]
+//
+//   --json     Print the results as a JSON object instead of a table.
+//   --dir DIR  Also write the corpora to DIR (which must not exist) and time
+//              `atag::scan` over them. The files are in the page cache at that point,
+//              so this measures the CPU cost of scanning, not the disk.
+//
+// g++ -std=c++17 -O2 -I../include parse.cpp -o parse -pthread
+#include "corpus.hpp"
+
+#include <atag.hpp>
+#include <atag/scan.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every allocation goes through here, so that parsers can be charged for them. All the
+// replaceable forms are replaced, so that no pointer from the standard library's
+// operator new is freed here, or the other way round.
+static std::atomic<std::size_t> num_allocations{0};
+
+static void* allocate(const std::size_t n, const std::size_t alignment) noexcept
+{
+    ++num_allocations;
+    const std::size_t size = n > 0 ? n : 1;
+    if(alignment <= alignof(std::max_align_t)) { return std::malloc(size); }
+    // The size must be a multiple of the alignment.
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void deallocate(void* p) noexcept { std::free(p); }
+
+static void* allocate_or_throw(const std::size_t n, const std::size_t alignment)
+{
+    if(void* p = allocate(n, alignment)) { return p; }
+    throw std::bad_alloc();
+}
+
+static constexpr std::size_t default_alignment = alignof(std::max_align_t);
+
+void* operator new(std::size_t n) { return allocate_or_throw(n, default_alignment); }
+void* operator new[](std::size_t n) { return allocate_or_throw(n, default_alignment); }
+void* operator new(std::size_t n, std::align_val_t a)
+{
+    return allocate_or_throw(n, std::size_t(a));
+}
+void* operator new[](std::size_t n, std::align_val_t a)
+{
+    return allocate_or_throw(n, std::size_t(a));
+}
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept
+{
+    return allocate(n, default_alignment);
+}
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept
+{
+    return allocate(n, default_alignment);
+}
+void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept
+{
+    return allocate(n, std::size_t(a));
+}
+void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept
+{
+    return allocate(n, std::size_t(a));
+}
+
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete(void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    deallocate(p);
+}
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    deallocate(p);
+}
+
+struct corpus_case
+{
+    std::string name;
+    // The extension the files get when written to disk.
+    std::string extension;
+    std::vector<corpus::file> files;
+    std::size_t tag_bytes = 0;
+};
+
+struct function
+{
+    const char* name;
+    // Returns something derived from the tag so that the call can't be optimized out.
+    std::function<std::size_t(const std::string&)> parse;
+};
+
+struct result
+{
+    std::string corpus;
+    std::string function;
+    std::size_t num_files;
+    double files_per_s;
+    double mb_per_s;
+    double allocations_per_file;
+    // The number of files on which the parser threw.
+    std::size_t num_errors;
+    // The number of files in which the parser found nothing, which for these corpora
+    // means it failed to make sense of the tag.
+    std::size_t num_empty;
+};
+
+template<typename Generate>
+corpus_case make_case(std::string name, std::string extension, const int num_files,
+    Generate generate)
+{
+    corpus_case c;
+    c.name = std::move(name);
+    c.extension = std::move(extension);
+    corpus::generator g(42);
+    for(int i = 0; i < num_files; ++i)
+    {
+        c.files.push_back(generate(g));
+        c.tag_bytes += c.files.back().tag_size;
+    }
+    return c;
+}
+
+std::vector<corpus_case> make_corpora()
+{
+    using corpus::text_encoding;
+    std::vector<corpus_case> corpora;
+    for(const int version : {3, 4})
+    {
+        for(const auto encoding : {text_encoding::latin1, text_encoding::utf16})
+        {
+            for(const int num_frames : {10, 50})
+            {
+                const std::string name = "id3v2." + std::to_string(version) + "-"
+                    + (encoding == text_encoding::latin1 ? "latin1" : "utf16") + "-"
+                    + std::to_string(num_frames) + "-frames";
+                corpora.push_back(make_case(name, ".mp3", 500,
+                    [=](corpus::generator& g)
+                    {
+                        corpus::id3v2_options o;
+                        o.version = version;
+                        o.encoding = encoding;
+                        o.num_frames = num_frames;
+                        return g.id3v2(o);
+                    }));
+            }
+        }
+    }
+    // ID3v2.3 frame sizes are plain integers while v2.4 ones are syncsafe, which only
+    // makes a difference for frames of 128 bytes or more, such as pictures.
+    corpora.push_back(make_case("id3v2.4-picture-512k", ".mp3", 20,
+        [](corpus::generator& g)
+        {
+            corpus::id3v2_options o;
+            o.picture_size = 512 * 1024;
+            return g.id3v2(o);
+        }));
+    for(const int num_comments : {20, 200})
+    {
+        corpora.push_back(make_case("flac-" + std::to_string(num_comments)
+            + "-comments", ".flac", 500, [=](corpus::generator& g)
+            {
+                corpus::flac_options o;
+                o.num_comments = num_comments;
+                return g.flac(o);
+            }));
+    }
+    corpora.push_back(make_case("flac-picture-512k", ".flac", 20,
+        [](corpus::generator& g)
+        {
+            corpus::flac_options o;
+            o.picture_size = 512 * 1024;
+            return g.flac(o);
+        }));
+    corpora.push_back(make_case("ape-10-items+id3v1", ".ape", 500,
+        [](corpus::generator& g)
+        {
+            corpus::ape_options o;
+            o.has_id3v1 = true;
+            return g.ape(o);
+        }));
+    corpora.push_back(make_case("id3v1", ".mp3", 500,
+        [](corpus::generator& g) { return g.id3v1(); }));
+    return corpora;
+}
+
+// The arena the "/arena" functions parse into. A scanner would release it once per
+// batch, here it's released after every file so that it never has to grow.
+static char arena_buffer[2 << 20];
+static std::pmr::monotonic_buffer_resource arena(arena_buffer, sizeof arena_buffer);
+
+std::vector<function> functions_for(const corpus_case& c)
+{
+    const auto simple = [](const auto& t)
+        { return t.title.size() + t.artist.size() + t.album.size(); };
+    const function generic = { "atag::parse",
+        [simple](const std::string& s) { return simple(atag::parse(s)); } };
+    const function generic_arena = { "atag::parse/arena",
+        [simple](const std::string& s)
+        {
+            const std::size_t n = simple(atag::parse(s, &arena));
+            arena.release();
+            return n;
+        } };
+
+    if(c.name.compare(0, 5, "id3v2") == 0)
+    {
+        return {
+            { "id3v2::parse", [](const std::string& s)
+                { return atag::id3v2::parse(s).frames.size(); } },
+            { "id3v2::parse/arena", [](const std::string& s)
+                {
+                    const std::size_t n = atag::id3v2::parse(s, &arena).frames.size();
+                    arena.release();
+                    return n;
+                } },
+            { "id3v2::simple_parse", [simple](const std::string& s)
+                { return simple(atag::id3v2::simple_parse(s)); } },
+            generic,
+            generic_arena,
+        };
+    }
+    else if(c.name.compare(0, 4, "flac") == 0)
+    {
+        return {
+            { "flac::parse", [](const std::string& s)
+                { return atag::flac::parse(s).title.size(); } },
+            generic,
+            generic_arena,
+        };
+    }
+    else if(c.name.compare(0, 3, "ape") == 0)
+    {
+        return {
+            { "ape::parse", [](const std::string& s)
+                { return atag::ape::parse(s).items.size(); } },
+            { "ape::simple_parse", [simple](const std::string& s)
+                { return simple(atag::ape::simple_parse(s)); } },
+            { "atag::parse_all", [](const std::string& s)
+                {
+                    const auto tags = atag::parse_all(s);
+                    return (tags.ape ? tags.ape->items.size() : 0)
+                        + (tags.id3v1 ? tags.id3v1->title.size() : 0);
+                } },
+            generic,
+            generic_arena,
+        };
+    }
+    return {
+        { "id3v1::parse", [](const std::string& s)
+            { return atag::id3v1::parse(s).title.size(); } },
+        generic,
+        generic_arena,
+    };
+}
+
+static volatile std::size_t sink;
+
+result measure(const corpus_case& c, const function& f)
+{
+    result r;
+    r.corpus = c.name;
+    r.function = f.name;
+    r.num_files = c.files.size();
+    r.num_errors = 0;
+    r.num_empty = 0;
+
+    // The first pass warms up the caches, counts the allocations and finds the files
+    // on which the parser fails, which are then left out of the timed passes.
+    std::vector<const corpus::file*> files;
+    files.reserve(c.files.size());
+    std::size_t tag_bytes = 0;
+    const std::size_t allocations_before = num_allocations;
+    for(const auto& file : c.files)
+    {
+        try
+        {
+            const std::size_t n = f.parse(file.data);
+            sink = sink + n;
+            if(n == 0) { ++r.num_empty; }
+            files.push_back(&file);
+            tag_bytes += file.tag_size;
+        }
+        catch(...)
+        {
+            ++r.num_errors;
+        }
+    }
+    r.allocations_per_file = double(num_allocations - allocations_before)
+        / c.files.size();
+
+    // Repeat the corpus until enough time has passed for a stable measurement.
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    std::size_t num_rounds = 0;
+    std::chrono::duration<double> elapsed(0);
+    while(!files.empty() && (elapsed.count() < 0.25))
+    {
+        for(const auto* file : files) { sink = sink + f.parse(file->data); }
+        ++num_rounds;
+        elapsed = clock::now() - start;
+    }
+    const double seconds = elapsed.count() > 0 ? elapsed.count() : 1;
+    r.files_per_s = files.size() * num_rounds / seconds;
+    r.mb_per_s = tag_bytes * num_rounds / seconds / 1e6;
+    return r;
+}
+
+result measure_scan(const std::vector<corpus_case>& corpora, const std::string& dir)
+{
+    namespace fs = std::filesystem;
+    std::size_t tag_bytes = 0;
+    std::size_t num_files = 0;
+    for(const auto& c : corpora)
+    {
+        const fs::path case_dir = fs::path(dir) / c.name;
+        fs::create_directories(case_dir);
+        for(std::size_t i = 0; i < c.files.size(); ++i)
+        {
+            std::ofstream out(case_dir / (std::to_string(i) + c.extension),
+                std::ios::binary);
+            out.write(c.files[i].data.data(), c.files[i].data.size());
+        }
+        tag_bytes += c.tag_bytes;
+        num_files += c.files.size();
+    }
+
+    result r;
+    r.corpus = "all";
+    r.function = "atag::scan";
+    r.num_files = num_files;
+    std::atomic<std::size_t> num_errors{0};
+    std::error_code error;
+    const std::size_t allocations_before = num_allocations;
+    const auto start = std::chrono::steady_clock::now();
+    atag::scan(dir, atag::scan_options(), [&num_errors](atag::scan_result&& result)
+        { if(result.error) { ++num_errors; } }, error);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    r.allocations_per_file = double(num_allocations - allocations_before) / num_files;
+    r.num_errors = num_errors;
+    r.num_empty = 0;
+    r.files_per_s = num_files / elapsed.count();
+    r.mb_per_s = tag_bytes / elapsed.count() / 1e6;
+    return r;
+}
+
+void print_json(const std::vector<result>& results)
+{
+    std::printf("{\n  \"benchmark\": \"atag-parse\",\n  \"results\": [\n");
+    for(std::size_t i = 0; i < results.size(); ++i)
+    {
+        const auto& r = results[i];
+        std::printf("    {\"corpus\": \"%s\", \"function\": \"%s\", \"files\": %zu,"
+            " \"files_per_s\": %.1f, \"mb_per_s\": %.2f, \"allocations_per_file\": %.2f,"
+            " \"errors\": %zu, \"empty\": %zu}%s\n", r.corpus.c_str(),
+            r.function.c_str(), r.num_files, r.files_per_s, r.mb_per_s,
+            r.allocations_per_file, r.num_errors, r.num_empty,
+            i + 1 < results.size() ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+
+void print_table(const std::vector<result>& results)
+{
+    std::printf("%-28s %-20s %12s %10s %12s %7s %7s\n", "corpus", "function",
+        "files/s", "MB/s", "allocs/file", "errors", "empty");
+    for(const auto& r : results)
+    {
+        std::printf("%-28s %-20s %12.0f %10.1f %12.1f %7zu %7zu\n", r.corpus.c_str(),
+            r.function.c_str(), r.files_per_s, r.mb_per_s, r.allocations_per_file,
+            r.num_errors, r.num_empty);
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    bool json = false;
+    std::string dir;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(std::strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if((std::strcmp(argv[i], "--dir") == 0) && (i + 1 < argc))
+        {
+            dir = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--json] [--dir DIR]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(!dir.empty() && std::filesystem::exists(dir))
+    {
+        std::fprintf(stderr, "%s already exists\n", dir.c_str());
+        return 1;
+    }
+
+    const auto corpora = make_corpora();
+    std::vector<result> results;
+    for(const auto& c : corpora)
+    {
+        for(const auto& f : functions_for(c)) { results.push_back(measure(c, f)); }
+    }
+    if(!dir.empty()) { results.push_back(measure_scan(corpora, dir)); }
+
+    if(json)
+        print_json(results);
+    else
+        print_table(results);
+}
@@ -0,0 +1,87 @@
+// A libFuzzer harness over the ID3v2, FLAC, APE and ID3v1 parsers, which parses each
+// input with all of them (and with the views over the ID3v2 frames and the Vorbis
+// comments, which take paths of their own), so that any read outside of the input is
+// caught by the sanitizers. The parsers are also run out of memory, through an arena
+// without an upstream resource, as the `std::nothrow` overloads must not throw then.
+//
+// clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -I../include parsers.cpp -o parsers
+// ./parsers -max_len=65536 corpus/
+//
+// The same harness works with AFL++ when built with afl-clang-fast++ instead of
+// clang++. The corpora written by `bench/parse --dir` make good seeds. To replay inputs
+// (e.g. crashes) without a fuzzer, build it with ATAG_FUZZ_MAIN defined, in which case
+// each file named on the command line is parsed in turn, or stdin if there are none:
+//
+// g++ -std=c++17 -g -DATAG_FUZZ_MAIN -fsanitize=address,undefined -I../include parsers.cpp -o parsers
+#include <atag/ape.hpp>
+#include <atag/flac.hpp>
+#include <atag/id3v1.hpp>
+#include <atag/id3v2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+
+template<typename Result>
+void check(const Result& result, const std::size_t size)
+{
+    // A parser that stopped must say where, within the input.
+    if(result.error().offset > size) { __builtin_trap(); }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size)
+{
+    const std::string_view s(reinterpret_cast<const char*>(data), size);
+
+    atag::id3v2::is_tagged(s);
+    atag::flac::is_tagged(s);
+    atag::ape::is_tagged(s);
+    atag::id3v1::is_tagged(s);
+    check(atag::id3v2::simple_parse(s, std::nothrow), size);
+    check(atag::id3v2::parse(s, std::nothrow), size);
+    const auto view = atag::id3v2::make_view(s);
+    for(const auto& frame : view.frames()) { view.text(frame); }
+    check(atag::flac::parse(s, std::nothrow), size);
+    atag::flac::make_comment_view(s);
+    check(atag::ape::simple_parse(s, std::nothrow), size);
+    check(atag::ape::parse(s, std::nothrow), size);
+    check(atag::id3v1::parse(s, std::nothrow), size);
+
+    char buffer[256];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof buffer,
+        std::pmr::null_memory_resource());
+    check(atag::id3v2::parse(s, std::nothrow, &arena), size);
+    check(atag::flac::parse(s, std::nothrow, &arena), size);
+    check(atag::ape::parse(s, std::nothrow, &arena), size);
+    return 0;
+}
+
+#ifdef ATAG_FUZZ_MAIN
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+int main(int argc, const char** argv)
+{
+    const auto run = [](std::istream& in)
+    {
+        // The input is copied into a buffer of its exact size, as a read past the end of
+        // a `std::string` may hit its null terminator, which the sanitizers don't catch.
+        const std::string input(std::istreambuf_iterator<char>(in), {});
+        const std::unique_ptr<uint8_t[]> buffer(new uint8_t[input.size()]);
+        std::copy(input.begin(), input.end(), buffer.get());
+        LLVMFuzzerTestOneInput(buffer.get(), input.size());
+    };
+    if(argc < 2) { run(std::cin); }
+    for(int i = 1; i < argc; ++i)
+    {
+        std::ifstream file(argv[i], std::ios::binary);
+        run(file);
+    }
+}
+#endif // ATAG_FUZZ_MAIN
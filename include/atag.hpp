@@ -1,24 +1,128 @@
 #ifndef ATAG_HEADER
 #define ATAG_HEADER
 
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 
 #include "atag/simple_tag.hpp"
+#include "atag/collation.hpp"
 #include "atag/genres.hpp"
 #include "atag/id3v1.hpp"
 #include "atag/id3v2.hpp"
 #include "atag/flac.hpp"
 #include "atag/ape.hpp"
+#include "atag/ogg.hpp"
+#include "atag/mp4.hpp"
+#include "atag/riff.hpp"
+#include "atag/source_view.hpp"
 
 namespace atag {
 
 /**
- * Parses an APE, ID3v1, or ID3v2 tagged audio file and produces a generic tag with
- * only the most important details about the file.
+ * Where the tags of a file are, as found by `detect`. Each field is the offset of the
+ * corresponding tag, or -1 if the file has no such tag. A file may have several tags,
+ * e.g. MP3 files often have an ID3v2 tag at their start, and an APE and an ID3v1 tag at
+ * their end. The offsets are 64 bit, as the tags at the end of files larger than 2 GiB
+ * lie beyond the range of an `int`. As the ID3v2 and APE parsers take `int` offsets,
+ * such tags are skipped by `parse` and `parse_all` (which fall back to the other tags).
+ */
+struct tag_layout
+{
+    int64_t id3v2 = -1;
+    // 0 if the file is a FLAC file, whose metadata blocks follow the "fLaC" marker.
+    int64_t flac = -1;
+    // The offset of the APE tag's header if it's at the start of the file, and of its
+    // footer if it's at the end (see `ape::find_header`).
+    int64_t ape = -1;
+    int64_t id3v1 = -1;
+    // 0 if the file is an Ogg file, whose comment header is in its first few pages.
+    int64_t ogg = -1;
+    // 0 if the file is an MP4 file, whose metadata is in its moov box.
+    int64_t mp4 = -1;
+    // 0 if the file is a WAV or AIFF file, whose metadata is in its chunks. An ID3v2 tag
+    // in one of its chunks isn't located by `detect` (see `riff::basic_tag`).
+    int64_t riff = -1;
+
+    bool empty() const noexcept
+    {
+        return (id3v2 == -1) && (flac == -1) && (ape == -1) && (id3v1 == -1)
+            && (ogg == -1) && (mp4 == -1) && (riff == -1);
+    }
+};
+
+/**
+ * Finds all tags in `s` in a single pass over its first few and last few hundred bytes,
+ * i.e. without probing for each tag type separately.
+ */
+template<typename Source> tag_layout detect(const Source& s);
+
+/**
+ * Parses an APE, FLAC, ID3v1, or ID3v2 tagged audio file, an Ogg Vorbis or Opus file, an
+ * MP4 file, or a WAV or AIFF file, and produces a generic tag with only the most
+ * important details about the file. If the file has several tags, the fields are taken
+ * from the most expressive one, i.e. ID3v2, FLAC, Ogg or MP4, then the metadata chunks of
+ * WAV and AIFF files, then APE, then ID3v1.
  */
 template<typename Source> simple_tag parse(const Source& s);
 
+/**
+ * Same as above, but the strings of the returned tag are allocated from `resource`.
+ * Any intermediate, format specific tag is allocated from `resource` as well.
+ */
+template<typename Source>
+pmr::simple_tag parse(const Source& s, std::pmr::memory_resource* resource);
+
+/**
+ * All tags of a file, each of which is only present if the file has that tag. The
+ * tags' strings are allocated with `Allocator` (see `basic_simple_tag`).
+ */
+template<typename Allocator = std::allocator<char>>
+struct basic_tag_set
+{
+    tag_layout layout;
+    std::optional<atag::id3v2::basic_tag<Allocator>> id3v2;
+    std::optional<atag::flac::basic_tag<Allocator>> flac;
+    std::optional<atag::ape::basic_tag<Allocator>> ape;
+    std::optional<atag::id3v1::basic_tag<Allocator>> id3v1;
+    std::optional<atag::ogg::basic_tag<Allocator>> ogg;
+    std::optional<atag::mp4::basic_tag<Allocator>> mp4;
+    // If a WAV or AIFF file has an ID3v2 tag in one of its chunks, it's parsed into
+    // `id3v2`.
+    std::optional<atag::riff::basic_tag<Allocator>> riff;
+};
+
+using tag_set = basic_tag_set<>;
+
+namespace pmr {
+using tag_set = basic_tag_set<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
+/**
+ * Parses every tag of `s` into its format specific representation. Unlike parsing each
+ * of them with their own parser, which would have to find the tag first, the file is
+ * only probed once (see `detect`).
+ *
+ * Example:
+ * ```
+ * atag::tag_set tags = atag::parse_all(source);
+ * if(tags.id3v2) {
+ *     // tags.id3v2->frames
+ * }
+ * if(tags.ape) {
+ *     // tags.ape->items
+ * }
+ * ```
+ */
+template<typename Source> tag_set parse_all(const Source& s);
+
+/** Same as above, but the tags are allocated from `resource`. */
+template<typename Source>
+pmr::tag_set parse_all(const Source& s, std::pmr::memory_resource* resource);
+
 /**
  * A set of comparators which can be used to sort collections of tags by track number,
  * song title, album title, artist name etc.
@@ -32,6 +136,9 @@ template<typename Source> simple_tag parse(const Source& s);
  * std::sort(tags.begin(), tags.end(), atag::order::track_number());
  * std::sort(tags.begin(), tags.end(), atag::order::title());
  * ```
+ *
+ * Strings are compared byte-wise, unless the tags are `collated`, in which case their
+ * sort keys are compared instead (see `append_sort_key`).
  */
 namespace order {
 
@@ -42,6 +149,12 @@ struct track_number
     {
         return a.track_number < b.track_number;
     }
+
+    template<typename Tag>
+    bool operator()(const collated<Tag>& a, const collated<Tag>& b) const noexcept
+    {
+        return (*this)(a.tag, b.tag);
+    }
 };
 
 struct title
@@ -51,6 +164,12 @@ struct title
     {
         return a.title < b.title;
     }
+
+    template<typename Tag>
+    bool operator()(const collated<Tag>& a, const collated<Tag>& b) const noexcept
+    {
+        return compare_sort_keys(a.keys.title, b.keys.title) < 0;
+    }
 };
 
 struct album
@@ -60,6 +179,12 @@ struct album
     {
         return a.album < b.album;
     }
+
+    template<typename Tag>
+    bool operator()(const collated<Tag>& a, const collated<Tag>& b) const noexcept
+    {
+        return compare_sort_keys(a.keys.album, b.keys.album) < 0;
+    }
 };
 
 struct year
@@ -69,6 +194,12 @@ struct year
     {
         return a.year < b.year;
     }
+
+    template<typename Tag>
+    bool operator()(const collated<Tag>& a, const collated<Tag>& b) const noexcept
+    {
+        return (*this)(a.tag, b.tag);
+    }
 };
 
 struct artist
@@ -78,6 +209,12 @@ struct artist
     {
         return a.artist < b.artist;
     }
+
+    template<typename Tag>
+    bool operator()(const collated<Tag>& a, const collated<Tag>& b) const noexcept
+    {
+        return compare_sort_keys(a.keys.artist, b.keys.artist) < 0;
+    }
 };
 
 } // namespace order
@@ -1,18 +1,32 @@
 #ifndef ATAG_APE_HEADER
 #define ATAG_APE_HEADER
 
+#include "parse_result.hpp"
 #include "simple_tag.hpp"
 
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <string>
+#include <utility>
 
 namespace atag {
 namespace ape {
 
-struct tag
+/**
+ * The items and their data are allocated with `Allocator` (see `basic_simple_tag`).
+ */
+template<typename Allocator = std::allocator<char>>
+struct basic_tag
 {
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
     struct item
     {
+        using allocator_type = Allocator;
+
         enum key
         {
             abstract,
@@ -49,16 +63,55 @@ struct tag
 
         int key;
         // A UTF-8 encoded string or binary data, depending on the item type.
-        std::string data;
+        string_type data;
+
+        item() = default;
+        item(const item&) = default;
+        item(item&&) = default;
+        item& operator=(const item&) = default;
+        item& operator=(item&&) = default;
+
+        explicit item(const Allocator& alloc) : key(-1), data(alloc) {}
+
+        item(const item& other, const Allocator& alloc)
+            : key(other.key), data(other.data, alloc)
+        {}
+
+        item(item&& other, const Allocator& alloc)
+            : key(other.key), data(std::move(other.data), alloc)
+        {}
     };
 
     int version;
-    std::vector<item> items;
+    std::vector<item, typename std::allocator_traits<Allocator>
+        ::template rebind_alloc<item>> items;
+
+    basic_tag() = default;
+    basic_tag(const basic_tag&) = default;
+    basic_tag(basic_tag&&) = default;
+    basic_tag& operator=(const basic_tag&) = default;
+    basic_tag& operator=(basic_tag&&) = default;
+
+    explicit basic_tag(const Allocator& alloc) : version(), items(alloc) {}
+
+    basic_tag(const basic_tag& other, const Allocator& alloc)
+        : version(other.version), items(other.items, alloc)
+    {}
+
+    basic_tag(basic_tag&& other, const Allocator& alloc)
+        : version(other.version), items(std::move(other.items), alloc)
+    {}
 };
 
+using tag = basic_tag<>;
+
+namespace pmr {
+using tag = basic_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
 /** Returns -1 if `s` does not contain a valid item key. */
-int item_key_from_string(const std::string& s) noexcept;
-int item_key_from_string(const char* s, const int s_length) noexcept;
+inline int item_key_from_string(const std::string& s) noexcept;
+inline int item_key_from_string(const char* s, const int s_length) noexcept;
 
 /** Both return a nullptr if key is not a valid item key. */
 constexpr const char* item_key_to_string(const int key) noexcept;
@@ -69,7 +122,30 @@ template<typename Source> bool is_tagged(const Source& s);
 template<typename Source> simple_tag simple_parse(const Source& s);
 template<typename Source> tag parse(const Source& s);
 
+/** Same as above, but the strings of the returned tags are allocated from `resource`. */
+template<typename Source>
+atag::pmr::simple_tag simple_parse(const Source& s, std::pmr::memory_resource* resource);
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource);
+
+/**
+ * The same as above, but the results also have the error at which parsing stopped, if any
+ * (see `parse_result`).
+ */
+template<typename Source>
+parse_result<simple_tag> simple_parse(const Source& s, std::nothrow_t) noexcept;
+template<typename Source>
+parse_result<atag::pmr::simple_tag> simple_parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept;
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept;
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept;
+
 } // namespace ape
 } // namespace atag
 
+#include "impl/ape.ipp"
+
 #endif // ATAG_APE_HEADER
@@ -0,0 +1,162 @@
+#ifndef ATAG_ASYNC_HEADER
+#define ATAG_ASYNC_HEADER
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+# error "atag/async.hpp requires C++20 coroutines"
+#endif
+
+#include "tag_parser.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace atag {
+
+/**
+ * A lazily started coroutine producing a `T`. It may be `co_await`ed from another
+ * coroutine, which is resumed once it completes, or, at the top level, be `start`ed
+ * and polled for completion by an event loop that resumes the coroutines it suspends.
+ */
+template<typename T>
+class task
+{
+public:
+    struct promise_type
+    {
+        std::optional<T> value;
+        std::exception_ptr exception;
+        std::coroutine_handle<> continuation;
+
+        task get_return_object() noexcept
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        auto final_suspend() noexcept
+        {
+            struct awaiter
+            {
+                bool await_ready() noexcept { return false; }
+
+                std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> h) noexcept
+                {
+                    // Resume whoever awaited us, if anyone.
+                    if(h.promise().continuation) { return h.promise().continuation; }
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+            return awaiter();
+        }
+
+        void return_value(T v) { value.emplace(std::move(v)); }
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+public:
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    task(task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    task& operator=(task&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(handle_) { handle_.destroy(); }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~task()
+    {
+        if(handle_) { handle_.destroy(); }
+    }
+
+    /** Runs the coroutine until it first suspends (or completes). */
+    void start() { handle_.resume(); }
+
+    bool is_ready() const noexcept { return handle_ && handle_.done(); }
+
+    /**
+     * Returns the result of a completed task, or rethrows the exception it exited
+     * with.
+     */
+    T get()
+    {
+        auto& promise = handle_.promise();
+        if(promise.exception) { std::rethrow_exception(promise.exception); }
+        return std::move(*promise.value);
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+
+    T await_resume() { return get(); }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> h) noexcept : handle_(h) {}
+};
+
+/**
+ * Parses the tag of a file of `file_size` bytes with a `tag_parser`, reading the byte
+ * ranges it needs with `read`, which must be callable as
+ * `read(std::size_t offset, std::size_t length, char* buffer, std::error_code& error)`
+ * and return an awaitable that produces the number of bytes read (as an integer).
+ * This lets atag be driven by whatever asynchronous I/O an application already uses.
+ *
+ * If reading fails, the error is reported in `error` and an empty tag is returned. As
+ * with the other parsers, exceptions thrown while parsing malformed tags propagate.
+ *
+ * Example:
+ * ```
+ * std::error_code error;
+ * atag::simple_tag tag = co_await atag::async_parse(file_size,
+ *     [&](std::size_t offset, std::size_t length, char* buffer, std::error_code& ec) {
+ *         return my_loop.async_pread(fd, buffer, length, offset, ec);
+ *     }, error);
+ * ```
+ */
+template<typename Read>
+task<simple_tag> async_parse(const std::size_t file_size, Read read,
+    std::error_code& error)
+{
+    error.clear();
+    tag_parser parser(file_size);
+    std::vector<char> buffer;
+    for(byte_range r; parser.need_bytes(r);)
+    {
+        buffer.resize(r.length);
+        const std::size_t n = co_await read(r.offset, r.length, buffer.data(), error);
+        if(error) { co_return simple_tag(); }
+        if(n == 0)
+        {
+            // The file must have been truncated while we were reading it.
+            error = std::make_error_code(std::errc::io_error);
+            co_return simple_tag();
+        }
+        parser.feed(r.offset, buffer.data(), n);
+    }
+    co_return parser.parse();
+}
+
+} // namespace atag
+
+#endif // ATAG_ASYNC_HEADER
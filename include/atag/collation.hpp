@@ -0,0 +1,83 @@
+#ifndef ATAG_COLLATION_HEADER
+#define ATAG_COLLATION_HEADER
+
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace atag {
+
+struct collation_options
+{
+    // Whether a leading English article ("The", "A" or "An") is ignored, so that
+    // "The Beatles" is sorted among the Bs. A title that is just an article is kept.
+    bool skip_articles = false;
+};
+
+/**
+ * Appends the sort key of the UTF-8 string `s` to `key`. Sort keys are compared byte-wise
+ * (see `compare_sort_keys`), which orders the strings case-insensitively and ignoring
+ * accents:
+ *
+ * - Latin, Greek and Cyrillic letters are case folded.
+ * - Accented Latin letters (Latin-1 Supplement and Latin Extended-A) are replaced with
+ *   their base letter, and ligatures and ß with their letters ("æ" -> "ae", "ß" ->
+ *   "ss"). Combining accents (U+0300-U+036F) are dropped.
+ * - Every other character, as well as any invalid UTF-8, is kept as is.
+ *
+ * This is far from the Unicode Collation Algorithm, but it's what makes the difference
+ * for most music libraries, and making the key once per string means that a sort
+ * compares the keys with a plain `memcmp`, instead of decoding both strings on every
+ * comparison.
+ */
+inline void append_sort_key(const std::string_view s, const collation_options& options,
+    std::string& key);
+
+/** Returns the sort key of `s` (see `append_sort_key`). */
+inline std::string make_sort_key(const std::string_view s,
+    const collation_options& options = collation_options());
+
+/** Compares two sort keys like `memcmp` does, with a key that's a prefix first. */
+inline int compare_sort_keys(const std::string_view a, const std::string_view b) noexcept;
+
+/** The sort keys of the strings by which tags are ordered (see `atag::order`). */
+struct sort_keys
+{
+    std::string title;
+    std::string album;
+    std::string artist;
+};
+
+template<typename Tag>
+sort_keys make_sort_keys(const Tag& tag,
+    const collation_options& options = collation_options());
+
+/**
+ * A tag along with its sort keys. The comparators in `atag::order` order these by the
+ * keys rather than by the strings of the tag, e.g.:
+ *
+ * ```
+ * std::vector<atag::collated<atag::simple_tag>> tags;
+ * tags.push_back(atag::collate(atag::parse(source)));
+ * // ...
+ * std::stable_sort(tags.begin(), tags.end(), atag::order::artist());
+ * ```
+ *
+ * For very large collections, an `atag::library` is faster still, as it makes the key
+ * of each distinct string only once (see `library::sorted_rows`).
+ */
+template<typename Tag>
+struct collated
+{
+    Tag tag;
+    sort_keys keys;
+};
+
+template<typename Tag>
+collated<Tag> collate(Tag tag, const collation_options& options = collation_options());
+
+} // namespace atag
+
+#include "impl/collation.ipp"
+
+#endif // ATAG_COLLATION_HEADER
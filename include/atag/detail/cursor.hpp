@@ -0,0 +1,148 @@
+#ifndef ATAG_CURSOR_HEADER
+#define ATAG_CURSOR_HEADER
+
+#include "io_util.hpp"
+#include "type_traits.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace atag {
+namespace detail {
+
+/**
+ * A read position within a range of bytes that is known to lie within the source, so
+ * that reading from it needs no bounds checks of its own. A parser makes a cursor over
+ * a whole tag (or block) once, with `make_cursor`, which clips the range to the source,
+ * and then splits off the range of each frame, block or item with `take`, which is the
+ * one place where the length field of the frame is validated. Reads within a range so
+ * taken (`operator[]`, `read_be` etc.) are then unchecked, save for assertions.
+ *
+ * Lengths are only ever compared against the number of bytes left, never added to the
+ * position, so no length field, however large or negative, can make a cursor overflow.
+ *
+ * A cursor also keeps the offset in the source at which it is, for error reporting.
+ */
+template<typename Byte>
+class cursor
+{
+    const Byte* pos_ = nullptr;
+    const Byte* end_ = nullptr;
+    std::size_t offset_ = 0;
+
+public:
+    cursor() = default;
+
+    /** `offset` is that of `data` in the source. */
+    cursor(const Byte* data, const std::size_t size,
+        const std::size_t offset = 0) noexcept
+        : pos_(data), end_(data + size), offset_(offset)
+    {}
+
+    /** Returns the number of bytes left. */
+    std::size_t size() const noexcept { return end_ - pos_; }
+    bool empty() const noexcept { return pos_ == end_; }
+    bool has(const std::size_t n) const noexcept { return n <= size(); }
+
+    /** Returns the offset of the current position in the source. */
+    std::size_t offset() const noexcept { return offset_; }
+
+    const Byte* data() const noexcept { return pos_; }
+
+    const Byte& operator[](const std::size_t i) const noexcept
+    {
+        assert(i < size());
+        return pos_[i];
+    }
+
+    /** Advances past the next `n` bytes, which must be there. */
+    void advance(const std::size_t n) noexcept
+    {
+        assert(has(n));
+        pos_ += n;
+        offset_ += n;
+    }
+
+    /**
+     * Sets `range` to the next `n` bytes and advances past them, if there are as many
+     * left. Otherwise nothing is changed and false is returned.
+     */
+    bool take(const std::size_t n, cursor& range) noexcept
+    {
+        if(!has(n)) { return false; }
+        range = cursor(pos_, n, offset_);
+        advance(n);
+        return true;
+    }
+
+    /** Same as `take`, but the bytes are skipped. */
+    bool skip(const std::size_t n) noexcept
+    {
+        if(!has(n)) { return false; }
+        advance(n);
+        return true;
+    }
+
+    /** Same as `take`, but takes all bytes left. */
+    cursor take_rest() noexcept
+    {
+        cursor range(pos_, size(), offset_);
+        advance(size());
+        return range;
+    }
+
+    /** Reads a big endian `T`, which must be there, and advances past it. */
+    template<typename T>
+    T read_be() noexcept
+    {
+        assert(has(sizeof(T)));
+        const T t = parse_be<T>(pos_);
+        advance(sizeof(T));
+        return t;
+    }
+
+    /** Reads a little endian `T`, which must be there, and advances past it. */
+    template<typename T>
+    T read_le() noexcept
+    {
+        assert(has(sizeof(T)));
+        const T t = parse_le<T>(pos_);
+        advance(sizeof(T));
+        return t;
+    }
+};
+
+/** The cursor over the bytes of `Source`. */
+template<typename Source>
+using source_cursor = cursor<std::remove_cv_t<std::remove_reference_t<
+    decltype(std::declval<const Source&>()[0])>>>;
+
+/**
+ * Returns a cursor over the `length` bytes at `offset` in `s`, or over as many of them as
+ * there are (i.e. none if `offset` is past the end of `s`). If `s` only holds the ranges
+ * that were fetched (see `is_partial_source`), the cursor ends where the fetched range
+ * does, so that bytes that weren't fetched are treated as if `s` ended there, i.e. the
+ * tag is reported as truncated rather than read from memory that doesn't hold it.
+ */
+template<typename Source>
+source_cursor<Source> make_cursor(const Source& s, const std::size_t offset,
+    const std::size_t length) noexcept
+{
+    const std::size_t size = s.size();
+    std::size_t available = offset < size ? std::min(length, size - offset) : 0;
+    if constexpr(is_partial_source<Source>::value)
+    {
+        if(available > 0) { available = s.stored_length(offset, available); }
+    }
+    if(available == 0)
+        return source_cursor<Source>(nullptr, 0, std::min(offset, size));
+    return source_cursor<Source>(&s[offset], available, offset);
+}
+
+} // namespace detail
+} // namespace atag
+
+#endif // ATAG_CURSOR_HEADER
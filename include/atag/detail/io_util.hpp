@@ -1,7 +1,13 @@
 #ifndef ATAG_IO_UTIL_HEADER
 #define ATAG_IO_UTIL_HEADER
 
+#include "type_traits.hpp"
+
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <system_error>
 
 namespace atag {
 namespace detail {
@@ -32,10 +38,11 @@ T parse_syncsafe(InputIt it) noexcept
 template<typename T, typename OutputIt>
 void write_syncsafe(T t, OutputIt it) noexcept
 {
-    // TODO is this correct?
+    // Only the low 7 bits of each byte are used, so `t` must be less than
+    // 2^(7 * sizeof t).
     for(int shift = 7 * (int(sizeof t) - 1); shift >= 0; shift -= 7)
     {
-        *it++ = static_cast<uint8_t>((t >> shift) & 0xff);
+        *it++ = static_cast<uint8_t>((t >> shift) & 0x7f);
     }
 }
 
@@ -67,11 +74,54 @@ constexpr T parse_le(InputIt it) noexcept
     T h = 0;
     for(auto i = 0; i < int(sizeof h); ++i)
     {
-        h |= static_cast<uint8_t>(*it++) << i * 8;
+        h |= T(static_cast<uint8_t>(*it++)) << i * 8;
     }
     return h;
 }
 
+/**
+ * Returns the duration `ms` as an `int`, i.e. as `simple_tag::length` or
+ * `mpeg::properties::length`, which it may not fit if the file is corrupt (e.g. if the
+ * frame or sample count of a bogus header is taken at face value).
+ */
+inline int clamp_length(const int64_t ms) noexcept
+{
+    return int(std::min<int64_t>(ms, std::numeric_limits<int>::max()));
+}
+
+/**
+ * Parses the leading decimal digits of the `length` bytes at `s`, which need not be null
+ * terminated (unlike what `std::atoi` requires), and returns 0 if there are none.
+ */
+template<typename Byte>
+int parse_number(const Byte* s, const int length) noexcept
+{
+    int n = 0;
+    // Stop before overflowing, as no field this is used for has that many digits.
+    for(auto i = 0; (i < length) && (n < 100'000'000); ++i)
+    {
+        if((s[i] < '0') || (s[i] > '9')) { break; }
+        n = 10 * n + (s[i] - '0');
+    }
+    return n;
+}
+
+/**
+ * Makes the bytes in [offset, offset + length) of `s` addressable, which only incurs I/O
+ * for sources that fetch data on demand; for in-memory sources it merely tests whether
+ * the range lies within `s`. A range extending past the end of `s` is truncated, but the
+ * function returns false.
+ */
+template<typename Source>
+bool fetch(Source& s, const std::size_t offset, const std::size_t length,
+    std::error_code& error)
+{
+    if constexpr(is_fetchable_source<Source>::value)
+        return s.fetch(offset, length, error);
+    else
+        return (offset <= s.size()) && (length <= s.size() - offset);
+}
+
 } // namespace detail
 } // namespace atag
 
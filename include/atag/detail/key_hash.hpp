@@ -0,0 +1,65 @@
+#ifndef ATAG_KEY_HASH_HEADER
+#define ATAG_KEY_HASH_HEADER
+
+#include <cstdint>
+#include <cstddef>
+
+namespace atag {
+namespace detail {
+
+/**
+ * Packs a four character code (such as an ID3v2 frame id) into a big endian integer,
+ * so that it can be used as a case label and compared in a single instruction. `s`
+ * must have at least 4 characters.
+ */
+constexpr uint32_t fourcc(const char* s) noexcept
+{
+    return (uint32_t(uint8_t(s[0])) << 24) | (uint32_t(uint8_t(s[1])) << 16)
+        | (uint32_t(uint8_t(s[2])) << 8) | uint32_t(uint8_t(s[3]));
+}
+
+constexpr char ascii_to_upper(const char c) noexcept
+{
+    return (c >= 'a') && (c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+/**
+ * A case-insensitive (ASCII only) FNV-1a hash of a variable length key, such as an APE
+ * item key or a Vorbis comment field name. Since it's constexpr, the hashes of known keys
+ * can be used as case labels, which turns key lookup into a single switch. Since unknown
+ * keys may collide with known ones, a match must be confirmed with `key_equals`.
+ */
+constexpr uint32_t key_hash(const char* s, const std::size_t length) noexcept
+{
+    uint32_t h = 2166136261u;
+    for(std::size_t i = 0; i < length; ++i)
+    {
+        h ^= uint8_t(ascii_to_upper(s[i]));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/** Hashes a null-terminated key, e.g. a string literal. */
+constexpr uint32_t key_hash(const char* s) noexcept
+{
+    std::size_t length = 0;
+    while(s[length] != 0) { ++length; }
+    return key_hash(s, length);
+}
+
+/** Case-insensitively compares `s` of `length` to the null-terminated `key`. */
+constexpr bool key_equals(const char* s, const std::size_t length, const char* key) noexcept
+{
+    std::size_t i = 0;
+    for(; (i < length) && (key[i] != 0); ++i)
+    {
+        if(ascii_to_upper(s[i]) != ascii_to_upper(key[i])) { return false; }
+    }
+    return (i == length) && (key[i] == 0);
+}
+
+} // namespace detail
+} // namespace atag
+
+#endif // ATAG_KEY_HASH_HEADER
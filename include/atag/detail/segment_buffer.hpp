@@ -0,0 +1,187 @@
+#ifndef ATAG_SEGMENT_BUFFER_HEADER
+#define ATAG_SEGMENT_BUFFER_HEADER
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace atag {
+namespace detail {
+
+/**
+ * Holds the byte ranges of a file that have been read so far, and satisfies the source
+ * requirements so that it may be parsed as if it were the whole file (as long as only
+ * the stored ranges are accessed). Each stored range (merged with any ranges it
+ * overlaps or borders) is contiguous, so it's safe to do pointer arithmetic within it,
+ * but not across ranges.
+ */
+class segment_buffer
+{
+    struct segment
+    {
+        std::size_t offset;
+        std::vector<char> data;
+
+        std::size_t end() const noexcept { return offset + data.size(); }
+    };
+
+    // The stored ranges, sorted by offset. There are usually only a few of them (one
+    // at the head and one at the tail of the file), so they are searched linearly.
+    std::vector<segment> segments_;
+    // The buffers of the segments of previous files, which are reused so that a buffer
+    // used for many files in turn doesn't allocate for each of them.
+    std::vector<std::vector<char>> spare_buffers_;
+    // The index of the segment in which the last byte was accessed.
+    mutable std::size_t last_segment_ = 0;
+    std::size_t size_ = 0;
+
+public:
+    /** Drops the stored ranges (but keeps their memory) for a file of `size` bytes. */
+    void reset(const std::size_t size = 0)
+    {
+        for(auto& s : segments_) { spare_buffers_.emplace_back(std::move(s.data)); }
+        segments_.clear();
+        last_segment_ = 0;
+        size_ = size;
+    }
+
+    /** Returns the size of the file (not just the bytes stored). */
+    std::size_t size() const noexcept { return size_; }
+
+    /** Returns the number of bytes stored. */
+    std::size_t num_bytes() const noexcept
+    {
+        std::size_t n = 0;
+        for(const auto& s : segments_) { n += s.data.size(); }
+        return n;
+    }
+
+    /**
+     * Returns how many of the `length` bytes at `offset` are stored contiguously, i.e.
+     * may be read through a pointer to the byte at `offset` (see `make_cursor`).
+     */
+    std::size_t stored_length(const std::size_t offset,
+        const std::size_t length) const noexcept
+    {
+        for(const auto& s : segments_)
+        {
+            if((offset >= s.offset) && (offset < s.end()))
+                return std::min(length, s.end() - offset);
+        }
+        return 0;
+    }
+
+    /**
+     * Returns the byte at offset `i`, which must lie within a stored range (this is
+     * asserted in debug builds). Parsers read ranges through cursors, which end where
+     * the stored range does (see `stored_length`), so this only guards against misuse.
+     */
+    const char& operator[](const std::size_t i) const noexcept
+    {
+        // Note that the offset one past the end of a segment is also accepted, so that
+        // an end pointer to it may be taken.
+        const auto contains = [i](const segment& s)
+            { return i - s.offset <= s.data.size(); };
+        if((last_segment_ < segments_.size()) && (i >= segments_[last_segment_].offset)
+            && contains(segments_[last_segment_]))
+        {
+            const auto& s = segments_[last_segment_];
+            return s.data.data()[i - s.offset];
+        }
+        for(std::size_t k = 0; k < segments_.size(); ++k)
+        {
+            const auto& s = segments_[k];
+            if((i >= s.offset) && contains(s))
+            {
+                last_segment_ = k;
+                return s.data.data()[i - s.offset];
+            }
+        }
+        assert(false && "byte at offset was not stored");
+        static const char null = 0;
+        return null;
+    }
+
+    /**
+     * Shrinks [offset, end) so that it neither starts nor ends with stored bytes. Bytes
+     * stored in its middle are not excluded.
+     */
+    void trim(std::size_t& offset, std::size_t& end) const noexcept
+    {
+        for(const auto& s : segments_)
+        {
+            if((s.offset <= offset) && (s.end() > offset)) { offset = s.end(); }
+            if((s.offset < end) && (s.end() >= end)) { end = s.offset; }
+        }
+        if(offset > end) { offset = end; }
+    }
+
+    /**
+     * Stores the range [offset, end), merging it with the stored ranges it overlaps or
+     * borders. The bytes not yet stored are filled in by `fill(char* dest, size_t offset,
+     * size_t length)`, which returns false on failure, in which case nothing is stored.
+     */
+    template<typename Fill>
+    bool insert(const std::size_t offset, const std::size_t end, Fill fill)
+    {
+        if(offset >= end) { return true; }
+
+        const auto first = std::find_if(segments_.begin(), segments_.end(),
+            [offset](const segment& s) { return s.end() >= offset; });
+        if((first != segments_.end()) && (first->offset <= offset)
+            && (first->end() >= end))
+        {
+            return true;
+        }
+        auto last = first;
+        while((last != segments_.end()) && (last->offset <= end)) { ++last; }
+
+        segment merged;
+        if(!spare_buffers_.empty())
+        {
+            merged.data = std::move(spare_buffers_.back());
+            spare_buffers_.pop_back();
+        }
+        merged.offset = first != last ? std::min(offset, first->offset) : offset;
+        const std::size_t merged_end = first != last
+            ? std::max(end, (last - 1)->end()) : end;
+        merged.data.resize(merged_end - merged.offset);
+        // Only fill the gaps between the segments, the rest is already in memory.
+        std::size_t pos = merged.offset;
+        bool ok = true;
+        for(auto it = first; ok && (it != last); ++it)
+        {
+            if(pos < it->offset)
+            {
+                ok = fill(&merged.data[pos - merged.offset], pos, it->offset - pos);
+            }
+            std::copy(it->data.begin(), it->data.end(),
+                merged.data.begin() + (it->offset - merged.offset));
+            pos = it->end();
+        }
+        if(ok && (pos < merged_end))
+        {
+            ok = fill(&merged.data[pos - merged.offset], pos, merged_end - pos);
+        }
+        if(!ok)
+        {
+            spare_buffers_.emplace_back(std::move(merged.data));
+            return false;
+        }
+
+        for(auto it = first; it != last; ++it)
+        {
+            spare_buffers_.emplace_back(std::move(it->data));
+        }
+        const auto it = segments_.erase(first, last);
+        segments_.insert(it, std::move(merged));
+        last_segment_ = 0;
+        return true;
+    }
+};
+
+} // namespace detail
+} // namespace atag
+
+#endif // ATAG_SEGMENT_BUFFER_HEADER
@@ -0,0 +1,18 @@
+#ifndef ATAG_SIMD_HEADER
+#define ATAG_SIMD_HEADER
+
+// SIMD code paths are selected by the instruction set the code is compiled for (e.g.
+// -mavx2), and may be turned off altogether by defining ATAG_DISABLE_SIMD. MSVC doesn't
+// define __SSE2__, but SSE2 is always available on x86-64.
+#if !defined(ATAG_DISABLE_SIMD)
+# if defined(__SSE2__) || defined(_M_X64)
+#  define ATAG_HAS_SSE2
+#  include <emmintrin.h>
+# endif
+# if defined(__AVX2__)
+#  define ATAG_HAS_AVX2
+#  include <immintrin.h>
+# endif
+#endif
+
+#endif // ATAG_SIMD_HEADER
@@ -0,0 +1,186 @@
+#ifndef ATAG_THREAD_POOL_HEADER
+#define ATAG_THREAD_POOL_HEADER
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace atag {
+namespace detail {
+
+/**
+ * A fixed size pool of workers, each with its own queue of tasks. Tasks are distributed
+ * among the queues in a round-robin fashion, and a worker whose queue runs dry steals
+ * from the others, so that a few slow tasks (e.g. files on a slow disk) don't hold up
+ * the rest of the tasks queued behind them.
+ *
+ * At most `max_pending` tasks may be queued at any time; `submit` blocks until there is
+ * room, which bounds the memory used by a fast producer and slow workers.
+ *
+ * Every task is handled by invoking `handler(task, worker_index)`, where `worker_index`
+ * is in [0, num_workers), which may be used to index per-worker state. If a handler
+ * throws, the rest of the tasks are still handled, and the first exception is rethrown
+ * by `finish`.
+ */
+template<typename Task>
+class work_stealing_pool
+{
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::function<void(Task&, std::size_t)> handler_;
+
+    std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::condition_variable has_room_;
+    // The number of tasks submitted but not yet taken by a worker.
+    std::size_t num_pending_ = 0;
+    std::size_t max_pending_;
+    std::size_t next_queue_ = 0;
+    bool is_finishing_ = false;
+    // The first exception thrown by `handler_`.
+    std::exception_ptr error_;
+
+public:
+    template<typename Handler>
+    work_stealing_pool(const std::size_t num_workers, const std::size_t max_pending,
+        Handler handler)
+        : handler_(std::move(handler))
+        , max_pending_(max_pending > 0 ? max_pending : 1)
+    {
+        const std::size_t n = num_workers > 0 ? num_workers : 1;
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            queues_.emplace_back(std::make_unique<queue>());
+        }
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            workers_.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool() { stop(); }
+
+    std::size_t num_workers() const noexcept { return workers_.size(); }
+
+    /** Queues `task`, blocking while there are `max_pending` tasks queued. */
+    void submit(Task task)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_room_.wait(lock, [this] { return num_pending_ < max_pending_; });
+            // The task is queued before it's counted (under the same lock), so that a
+            // worker woken up by the count is sure to find it.
+            auto& q = *queues_[next_queue_++ % queues_.size()];
+            {
+                std::lock_guard<std::mutex> queue_lock(q.mutex);
+                q.tasks.emplace_back(std::move(task));
+            }
+            ++num_pending_;
+        }
+        has_work_.notify_one();
+    }
+
+    /**
+     * Waits for all submitted tasks to be handled, then stops the workers. Rethrows the
+     * first exception thrown by the handler, if any.
+     */
+    void finish()
+    {
+        stop();
+        if(error_)
+        {
+            auto error = std::move(error_);
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(is_finishing_ && workers_.empty()) { return; }
+            is_finishing_ = true;
+        }
+        has_work_.notify_all();
+        for(auto& worker : workers_) { worker.join(); }
+        workers_.clear();
+    }
+
+    void run(const std::size_t worker)
+    {
+        for(;;)
+        {
+            Task task;
+            if(try_pop(worker, task))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    --num_pending_;
+                }
+                has_room_.notify_one();
+                try
+                {
+                    handler_(task, worker);
+                }
+                catch(...)
+                {
+                    // Letting it escape the thread would terminate the program.
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if(!error_) { error_ = std::current_exception(); }
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_work_.wait(lock, [this] { return (num_pending_ > 0) || is_finishing_; });
+            if((num_pending_ == 0) && is_finishing_) { return; }
+        }
+    }
+
+    /**
+     * Takes the most recently queued task from the worker's own queue, or if it's empty,
+     * the least recently queued task from another worker's queue.
+     */
+    bool try_pop(const std::size_t worker, Task& task)
+    {
+        for(std::size_t i = 0; i < queues_.size(); ++i)
+        {
+            auto& q = *queues_[(worker + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if(q.tasks.empty()) { continue; }
+            if(i == 0)
+            {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
+} // namespace detail
+} // namespace atag
+
+#endif // ATAG_THREAD_POOL_HEADER
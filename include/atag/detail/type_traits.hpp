@@ -1,6 +1,8 @@
 #ifndef ATAG_TYPE_TRAITS_HEADER
 #define ATAG_TYPE_TRAITS_HEADER
 
+#include <cstddef>
+#include <system_error>
 #include <type_traits>
 
 namespace atag {
@@ -20,8 +22,38 @@ struct is_source : std::false_type {};
 
 template<typename T>
 struct is_source<T, void_t<
-        decltype(std::declval<T&>().operator[]()),
-        decltype(std::declval<T&>().size())>>
+        decltype(std::declval<const T&>()[0]),
+        decltype(std::declval<const T&>().size())>>
+    : std::true_type {};
+
+/**
+ * Sources that don't hold the entire file in memory (such as `atag::file_source`) must
+ * be told which byte ranges will be accessed before parsing, through a member function
+ * with the signature
+ * `bool fetch(std::size_t offset, std::size_t length, std::error_code& error)`.
+ */
+template<typename T, typename = void>
+struct is_fetchable_source : std::false_type {};
+
+template<typename T>
+struct is_fetchable_source<T, void_t<
+        decltype(std::declval<T&>().fetch(std::size_t(), std::size_t(),
+            std::declval<std::error_code&>()))>>
+    : std::true_type {};
+
+/**
+ * Sources that only hold the byte ranges of the file that were fetched (such as
+ * `atag::file_source`) tell how many of the `length` bytes at `offset` were fetched
+ * contiguously, i.e. may be read through a pointer to the byte at `offset` (none if
+ * that byte wasn't fetched), through a member function with the signature
+ * `std::size_t stored_length(std::size_t offset, std::size_t length)`.
+ */
+template<typename T, typename = void>
+struct is_partial_source : std::false_type {};
+
+template<typename T>
+struct is_partial_source<T, void_t<
+        decltype(std::declval<const T&>().stored_length(std::size_t(), std::size_t()))>>
     : std::true_type {};
 
 } // namespace detail
@@ -1,100 +1,105 @@
 #ifndef ATAG_ENCODING_HEADER
 #define ATAG_ENCODING_HEADER
 
+#include <cstddef>
 #include <string>
-#include <codecvt>
-#include <locale>
 
 namespace atag {
 namespace encoding {
 
-std::string utf16le_to_utf8(const char16_t* src, const int size)
-{
-    static std::wstring_convert<std::codecvt_utf8_utf16<char16_t,
-        0x10ffff, std::little_endian>, char16_t> convert;
-    return convert.to_bytes(src, src + size);
-}
+/**
+ * The routines below are stateless and thus reentrant, i.e. they may be called from
+ * several threads at once. Those that take a `dst` argument write into a buffer
+ * provided by the caller, which must be large enough to hold the worst case output size,
+ * as returned by the corresponding `max_*_length` function, and return the number of
+ * bytes actually written. On x86-64, runs of ASCII characters are converted 16 (SSE2) or
+ * 32 (AVX2) bytes at a time, depending on the instruction set the code is compiled for.
+ *
+ * Conversion stops at the first null character, as text in tags is often null
+ * terminated and there is no use for anything after it.
+ */
 
-std::string utf16le_to_utf8(const std::u16string& src)
+enum class byte_order
 {
-    return utf16le_to_utf8(src.data(), src.length());
-}
+    little_endian,
+    big_endian,
+};
 
-std::string utf16be_to_utf8(const char16_t* src, const int size)
+constexpr std::size_t max_utf8_length_of_iso_8859_1(const std::size_t length) noexcept
 {
-    static std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
-    return convert.to_bytes(src, src + size);
+    return 2 * length;
 }
 
-std::string utf16be_to_utf8(const std::u16string& src)
+/** A UTF-16 code unit is never encoded in more than 3 UTF-8 bytes. */
+constexpr std::size_t max_utf8_length_of_utf16(const std::size_t num_bytes) noexcept
 {
-    return utf16be_to_utf8(src.data(), src.length());
+    return num_bytes / 2 * 3;
 }
 
-std::u16string utf8_to_utf16le(const char* src, const int length)
+/** Returns the maximum number of UTF-16 *bytes* `length` UTF-8 bytes may produce. */
+constexpr std::size_t max_utf16_length_of_utf8(const std::size_t length) noexcept
 {
-    static std::wstring_convert<std::codecvt_utf8_utf16<char16_t,
-        0x10ffff, std::little_endian>, char16_t> convert;
-    return convert.from_bytes(src, src + length);
+    return 2 * length;
 }
 
-std::u16string utf8_to_utf16le(const std::string& src)
-{
-    return utf8_to_utf16le(src.data(), src.length());
-}
+/** `dst` must have room for `max_utf8_length_of_iso_8859_1(length)` bytes. */
+inline std::size_t iso_8859_1_to_utf8(const char* src, const std::size_t length,
+    char* dst) noexcept;
 
-std::u16string utf8_to_utf16be(const char* src, const int length)
-{
-    static std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
-    return convert.from_bytes(src, src + length);
-}
+/**
+ * Converts UTF-16 of the given byte order to UTF-8. `num_bytes` is the size of `src` in
+ * bytes. Unpaired surrogates are replaced with U+FFFD. `dst` must have room for
+ * `max_utf8_length_of_utf16(num_bytes)` bytes.
+ */
+inline std::size_t utf16_to_utf8(const char* src, const std::size_t num_bytes,
+    const byte_order order, char* dst) noexcept;
 
-std::u16string utf8_to_utf16be(const std::string& src)
-{
-    return utf8_to_utf16be(src.data(), src.length());
-}
+/**
+ * Same as above, but if `src` starts with a byte order mark, it is used to determine the
+ * byte order (and is skipped), otherwise `default_order` is assumed.
+ */
+inline std::size_t utf16_bom_to_utf8(const char* src, const std::size_t num_bytes,
+    const byte_order default_order, char* dst) noexcept;
 
-std::string iso_8859_1_to_utf8(const char* src, const int length)
-{
-    if(!src || (length <= 0)) { return {}; }
-    std::string utf8;
-    // Reserve the resulting UTF-8 string in advance to allocate only once.
-    const int utf8_length = [src, length]
-    {
-        int size = 0;
-        for(auto i = 0; (i < length) && src[i]; ++i)
-        {
-            if(src[i] < 128)
-                ++size;
-            else
-                size += 2;
-        }
-        return size;
-    }();
-    utf8.reserve(utf8_length);
-    // TODO should we terminate early if we encounter a null character (currently we do)
-    for(auto i = 0; (i < length) && (*src != 0); ++i)
-    {
-        // ISO-8859-1 and UTF-8 are the same for the first 127 characters.
-        if(*src < 128)
-        {
-            utf8.push_back(*src++);
-        }
-        else
-        {
-            utf8.push_back(192 | *src++ >> 6);
-            utf8.push_back(128 | (*src++ & 63));
-        }
-    }
-    return utf8;
-}
+inline std::size_t utf16le_to_utf8(const char* src, const std::size_t num_bytes,
+    char* dst) noexcept;
+inline std::size_t utf16be_to_utf8(const char* src, const std::size_t num_bytes,
+    char* dst) noexcept;
 
-std::string iso_8859_1_to_utf8(const std::string& src)
-{
-    return iso_8859_1_to_utf8(src.data(), src.length());
-}
+/**
+ * Converts UTF-8 to UTF-16 of the given byte order, without a byte order mark. Invalid
+ * sequences are replaced with U+FFFD. `dst` must have room for
+ * `max_utf16_length_of_utf8(length)` bytes.
+ */
+inline std::size_t utf8_to_utf16(const char* src, const std::size_t length,
+    const byte_order order, char* dst) noexcept;
+
+/**
+ * Tests whether `src` is well-formed UTF-8, i.e. that it contains no overlong
+ * encodings, surrogates or code points above U+10FFFF. Null characters are allowed.
+ */
+inline bool is_valid_utf8(const char* src, const std::size_t length) noexcept;
+
+// -- convenience overloads that allocate the result --
+
+/** `src` holds `size` UTF-16 code units, laid out in little endian byte order. */
+inline std::string utf16le_to_utf8(const char16_t* src, const int size);
+inline std::string utf16le_to_utf8(const std::u16string& src);
+/** `src` holds `size` UTF-16 code units, laid out in big endian byte order. */
+inline std::string utf16be_to_utf8(const char16_t* src, const int size);
+inline std::string utf16be_to_utf8(const std::u16string& src);
+
+inline std::u16string utf8_to_utf16le(const char* src, const int length);
+inline std::u16string utf8_to_utf16le(const std::string& src);
+inline std::u16string utf8_to_utf16be(const char* src, const int length);
+inline std::u16string utf8_to_utf16be(const std::string& src);
+
+inline std::string iso_8859_1_to_utf8(const char* src, const int length);
+inline std::string iso_8859_1_to_utf8(const std::string& src);
 
 } // namespace encoding
 } // namespace atag
 
+#include "impl/encoding.ipp"
+
 #endif // ATAG_ENCODING_HEADER
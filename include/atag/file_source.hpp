@@ -0,0 +1,141 @@
+#ifndef ATAG_FILE_SOURCE_HEADER
+#define ATAG_FILE_SOURCE_HEADER
+
+#include "tag_parser.hpp"
+#include "detail/segment_buffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+namespace atag {
+
+/**
+ * Tags take up a tiny fraction of an audio file, so reading the whole file into memory
+ * to parse them is mostly wasted I/O. The sources below satisfy the same requirements as
+ * in-memory sources (`operator[]` and `size()`, where `size()` is the size of the file),
+ * but only make the byte ranges that were `fetch`ed addressable, which `prefetch_tags`
+ * does for all the regions in which a tag may be found.
+ *
+ * Example:
+ * ```
+ * std::error_code error;
+ * atag::file_source source;
+ * source.open(path, error);
+ * if(!error && atag::prefetch_tags(source, error)) {
+ *     atag::simple_tag tag = atag::parse(source);
+ * }
+ * ```
+ *
+ * These are only available on POSIX systems.
+ */
+
+/**
+ * Reads the requested ranges with pread(2) into memory owned by the source. Each fetched
+ * range (merged with any ranges it overlaps or borders) is stored contiguously, so it's
+ * safe to do pointer arithmetic within it, but not across fetched ranges.
+ */
+class file_source
+{
+    detail::segment_buffer buffer_;
+    int fd_ = -1;
+
+public:
+    file_source() = default;
+    file_source(const file_source&) = delete;
+    file_source& operator=(const file_source&) = delete;
+    file_source(file_source&& other) noexcept;
+    file_source& operator=(file_source&& other) noexcept;
+    ~file_source();
+
+    /**
+     * Opens the file at `path`, but doesn't read anything from it yet. If another file
+     * was open, it's closed first, but the memory used to store its fetched ranges is
+     * kept and reused for this one.
+     */
+    void open(const std::string& path, std::error_code& error);
+    void close() noexcept;
+
+    bool is_open() const noexcept { return fd_ != -1; }
+
+    /** Returns the size of the file (not just the bytes fetched from it). */
+    std::size_t size() const noexcept { return buffer_.size(); }
+
+    /**
+     * Returns the byte at offset `i`, which must lie within a fetched range (this is
+     * asserted in debug builds).
+     */
+    const char& operator[](const std::size_t i) const noexcept { return buffer_[i]; }
+
+    /** Returns how many of the `length` bytes at `offset` were fetched contiguously. */
+    std::size_t stored_length(const std::size_t offset,
+        const std::size_t length) const noexcept
+    {
+        return buffer_.stored_length(offset, length);
+    }
+
+    /**
+     * Reads the bytes in [offset, offset + length) from the file unless they were
+     * already fetched. If the range extends past the end of the file, it is truncated
+     * and false is returned. On I/O errors, `error` is set and false is returned.
+     */
+    bool fetch(const std::size_t offset, const std::size_t length,
+        std::error_code& error);
+
+    /** Returns the total number of bytes read from the file since it was opened. */
+    std::size_t num_bytes_fetched() const noexcept { return buffer_.num_bytes(); }
+};
+
+/**
+ * Memory maps the entire file. Since only the pages that are accessed are read in, and
+ * the mapping is advised to be accessed randomly (so that the kernel doesn't read ahead
+ * into the audio data), parsing a mapped file incurs about as little I/O as a
+ * `file_source`. `fetch` only advises the kernel to read in the range ahead of use.
+ */
+class mapped_source
+{
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+
+public:
+    mapped_source() = default;
+    mapped_source(const mapped_source&) = delete;
+    mapped_source& operator=(const mapped_source&) = delete;
+    mapped_source(mapped_source&& other) noexcept;
+    mapped_source& operator=(mapped_source&& other) noexcept;
+    ~mapped_source();
+
+    void open(const std::string& path, std::error_code& error);
+    void close() noexcept;
+
+    bool is_open() const noexcept { return data_ != nullptr; }
+    std::size_t size() const noexcept { return size_; }
+    const char* data() const noexcept { return data_; }
+    const char& operator[](const std::size_t i) const noexcept { return data_[i]; }
+
+    bool fetch(const std::size_t offset, const std::size_t length,
+        std::error_code& error);
+};
+
+/**
+ * Fetches every region of `s` that may contain a tag: the ID3v2 tag, FLAC metadata
+ * blocks or Ogg header pages at the head of the file, and the ID3v1, APE or appended
+ * ID3v2 tags (or the last Ogg page, which gives the duration) at its tail. For MP4,
+ * WAV and AIFF files, the box or chunk headers on the way to the metadata and the
+ * metadata itself are fetched, wherever it is. For in-memory sources this is a no-op.
+ *
+ * Only the FLAC metadata blocks that are parsed are fetched with `flac_blocks::parsed`,
+ * so that e.g. embedded pictures aren't read when scanning a library.
+ *
+ * Returns false if an I/O error occurred, which is reported in `error`.
+ */
+template<typename Source>
+bool prefetch_tags(Source& s, std::error_code& error,
+    const flac_blocks blocks = flac_blocks::all);
+
+} // namespace atag
+
+#include "impl/file_source.ipp"
+
+#endif // ATAG_FILE_SOURCE_HEADER
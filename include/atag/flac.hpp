@@ -1,32 +1,128 @@
 #ifndef ATAG_FLAC_HEADER
 #define ATAG_FLAC_HEADER
 
+#include "parse_result.hpp"
+#include "vorbis.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <string>
+#include <utility>
 
 namespace atag {
 namespace flac {
 
-struct tag
+/** The contents of the STREAMINFO block, which is the first block of every FLAC file. */
+struct streaminfo
 {
-    std::string title;
-    std::string album;
-    std::string artist;
-    std::string genre;
-    int year;
-    int track_number;
+    int min_block_size; // in samples
+    int max_block_size; // in samples
+    int min_frame_size; // in bytes, 0 if unknown
+    int max_frame_size; // in bytes, 0 if unknown
     int sample_rate; // in Hz
     int num_channels;
-    int num_samples;
+    int bits_per_sample;
+    // The number of samples per channel, 0 if unknown.
+    uint64_t num_samples;
+    // The MD5 signature of the unencoded audio.
+    std::array<uint8_t, 16> md5;
+
+    /** Returns the exact duration in ms, or 0 if it's unknown. */
+    int64_t length() const noexcept
+    {
+        return sample_rate > 0 ? int64_t(num_samples * 1000 / sample_rate) : 0;
+    }
 };
 
+/**
+ * The strings are allocated with `Allocator` (see `basic_simple_tag`).
+ */
+template<typename Allocator = std::allocator<char>>
+struct basic_tag
+{
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
+    string_type title;
+    string_type album;
+    string_type artist;
+    string_type genre;
+    int year;
+    int track_number;
+    struct streaminfo streaminfo;
+
+    basic_tag() = default;
+    basic_tag(const basic_tag&) = default;
+    basic_tag(basic_tag&&) = default;
+    basic_tag& operator=(const basic_tag&) = default;
+    basic_tag& operator=(basic_tag&&) = default;
+
+    explicit basic_tag(const Allocator& alloc)
+        : title(alloc), album(alloc), artist(alloc), genre(alloc)
+        , year(), track_number(), streaminfo()
+    {}
+
+    basic_tag(const basic_tag& other, const Allocator& alloc)
+        : title(other.title, alloc), album(other.album, alloc)
+        , artist(other.artist, alloc), genre(other.genre, alloc)
+        , year(other.year), track_number(other.track_number)
+        , streaminfo(other.streaminfo)
+    {}
+
+    basic_tag(basic_tag&& other, const Allocator& alloc)
+        : title(std::move(other.title), alloc), album(std::move(other.album), alloc)
+        , artist(std::move(other.artist), alloc), genre(std::move(other.genre), alloc)
+        , year(other.year), track_number(other.track_number)
+        , streaminfo(other.streaminfo)
+    {}
+};
+
+using tag = basic_tag<>;
+
+namespace pmr {
+using tag = basic_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
 /** Tests whether `s` contains a FLAC tag. */
 template<typename Source>
 bool is_tagged(const Source& s) noexcept;
 
-/** Parses and extracts all frames found in `s`. */
+/**
+ * Parses the STREAMINFO and VORBIS_COMMENT blocks of `s`. Since these are all that is
+ * parsed, parsing stops as soon as both have been found, and the bodies of the other
+ * blocks (e.g. pictures) are skipped, so they need not be in `s` at all (see
+ * `flac_blocks::parsed`).
+ */
 template<typename Source>
 tag parse(const Source& s);
 
+/** Same as above, but the strings of the returned tag are allocated from `resource`. */
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource);
+
+/**
+ * The same as above, but the result also has the error at which parsing stopped, if any
+ * (see `parse_result`). E.g. a source that ends before the last metadata block is
+ * `parse_errc::truncated`.
+ */
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept;
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept;
+
+/**
+ * Returns a view of every comment in the VORBIS_COMMENT block of `s`, i.e. also of those
+ * that `parse` doesn't read, such as the MUSICBRAINZ_* and REPLAYGAIN_* ones. The view
+ * refers into `s`, so `s` must outlive it. If `s` has no (complete) VORBIS_COMMENT
+ * block, an empty view is returned.
+ */
+template<typename Source>
+vorbis::comment_view make_comment_view(const Source& s);
+
 } // namespace flac
 } // namespace atag
 
@@ -1,26 +1,82 @@
 #ifndef ATAG_ID3V1_HEADER
 #define ATAG_ID3V1_HEADER
 
+#include "parse_result.hpp"
+
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <string>
+#include <utility>
 
 namespace atag {
 namespace id3v1 {
 
-struct tag
+/**
+ * The strings are allocated with `Allocator` (see `basic_simple_tag`).
+ */
+template<typename Allocator = std::allocator<char>>
+struct basic_tag
 {
-    std::string title;
-    std::string artist;
-    std::string album;
-    std::string comment;
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
+    string_type title;
+    string_type artist;
+    string_type album;
+    string_type comment;
     int track_number;
     int year;
     int genre;
+
+    basic_tag() = default;
+    basic_tag(const basic_tag&) = default;
+    basic_tag(basic_tag&&) = default;
+    basic_tag& operator=(const basic_tag&) = default;
+    basic_tag& operator=(basic_tag&&) = default;
+
+    explicit basic_tag(const Allocator& alloc)
+        : title(alloc), artist(alloc), album(alloc), comment(alloc)
+        , track_number(), year(), genre()
+    {}
+
+    basic_tag(const basic_tag& other, const Allocator& alloc)
+        : title(other.title, alloc), artist(other.artist, alloc)
+        , album(other.album, alloc), comment(other.comment, alloc)
+        , track_number(other.track_number), year(other.year), genre(other.genre)
+    {}
+
+    basic_tag(basic_tag&& other, const Allocator& alloc)
+        : title(std::move(other.title), alloc), artist(std::move(other.artist), alloc)
+        , album(std::move(other.album), alloc), comment(std::move(other.comment), alloc)
+        , track_number(other.track_number), year(other.year), genre(other.genre)
+    {}
 };
 
+using tag = basic_tag<>;
+
+namespace pmr {
+using tag = basic_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
 template<typename Source> bool is_tagged(const Source& s);
 
 template<typename Source> tag parse(const Source& s);
 
+/** Same as above, but the strings of the returned tag are allocated from `resource`. */
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource);
+
+/**
+ * The same as above, but the result also has the error, which can only be
+ * `parse_errc::not_tagged` (see `parse_result`).
+ */
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept;
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept;
+
 } // namespace id3v1
 } // namespace atag
 
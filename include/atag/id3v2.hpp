@@ -3,11 +3,18 @@
 
 #include "simple_tag.hpp"
 #include "genres.hpp"
+#include "parse_result.hpp"
 
 #include <vector>
 #include <array>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <initializer_list>
+#include <utility>
 
 namespace atag {
 namespace id3v2 {
@@ -26,11 +33,19 @@ enum encoding
  * correspond to how the tag is represented in memory (i.e. the raw data). For instance,
  * the extended header is not included, nor the footer, if one is present (as it's
  * mostly just a copy of the header, i.e. holds no relevant information).
+ *
+ * The frames and their data are allocated with `Allocator` (see `basic_simple_tag`).
  */
-struct tag
+template<typename Allocator = std::allocator<char>>
+struct basic_tag
 {
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
     struct frame
     {
+        using allocator_type = Allocator;
+
         /**
          * So as to remain unambiguous with the official ID3 documentation, the original 
          * cryptic frame names have been preserved. To see what an individual frame
@@ -68,15 +83,36 @@ struct tag
             length_indicator  = 1 << 0,
         };
 
-        std::string data;
+        string_type data;
         uint16_t flags;
         // Identifies what type of frame this is.
         uint8_t id;
         // The encoding of data if it's a text, irrelevant otherwise.
         uint8_t encoding;
+
+        frame() = default;
+        frame(const frame&) = default;
+        frame(frame&&) = default;
+        frame& operator=(const frame&) = default;
+        frame& operator=(frame&&) = default;
+
+        explicit frame(const Allocator& alloc)
+            : data(alloc), flags(), id(), encoding()
+        {}
+
+        frame(const frame& other, const Allocator& alloc)
+            : data(other.data, alloc), flags(other.flags), id(other.id)
+            , encoding(other.encoding)
+        {}
+
+        frame(frame&& other, const Allocator& alloc)
+            : data(std::move(other.data), alloc), flags(other.flags), id(other.id)
+            , encoding(other.encoding)
+        {}
     };
 
-    std::vector<frame> frames;
+    std::vector<frame, typename std::allocator_traits<Allocator>
+        ::template rebind_alloc<frame>> frames;
 
     enum flags : uint8_t
     {
@@ -89,6 +125,105 @@ struct tag
     uint8_t version;
     uint8_t revision;
     uint8_t flags;
+
+    basic_tag() = default;
+    basic_tag(const basic_tag&) = default;
+    basic_tag(basic_tag&&) = default;
+    basic_tag& operator=(const basic_tag&) = default;
+    basic_tag& operator=(basic_tag&&) = default;
+
+    explicit basic_tag(const Allocator& alloc)
+        : frames(alloc), version(), revision(), flags()
+    {}
+
+    basic_tag(const basic_tag& other, const Allocator& alloc)
+        : frames(other.frames, alloc), version(other.version)
+        , revision(other.revision), flags(other.flags)
+    {}
+
+    basic_tag(basic_tag&& other, const Allocator& alloc)
+        : frames(std::move(other.frames), alloc), version(other.version)
+        , revision(other.revision), flags(other.flags)
+    {}
+};
+
+using tag = basic_tag<>;
+
+namespace pmr {
+using tag = basic_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
+/**
+ * The tag's header, as found at the start of the tag. `size` is the size of the tag
+ * excluding the 10 byte header (and the footer, if present).
+ */
+struct tag_header
+{
+    char version;
+    char revision;
+    unsigned char flags;
+    int size;
+    int extended_header_size;
+};
+
+/**
+ * A non-owning index over the frames of an ID3v2 tag. Unlike `tag`, creating a view
+ * does not copy or decode any frame bodies: only the frame headers are walked and an
+ * entry is recorded for each frame, so the cost is independent of how large the frames
+ * are (e.g. attached pictures). A frame's body is only touched when it is requested,
+ * which is why the source from which the view was created must outlive it.
+ *
+ * Example:
+ * ```
+ * mio::mmap_source source(path);
+ * const id3v2::tag_view view = id3v2::make_view(source);
+ * if(const auto* frame = view.find(id3v2::title)) {
+ *     std::string title = view.text(*frame);
+ * }
+ * ```
+ */
+class tag_view
+{
+public:
+    struct frame
+    {
+        // The offset of the frame body relative to the start of the tag.
+        uint32_t offset;
+        // The size of the frame body in bytes.
+        uint32_t size;
+        uint16_t flags;
+        // Identifies what type of frame this is (a `tag::frame::id` value).
+        uint8_t id;
+    };
+
+    tag_view() = default;
+    tag_view(const char* tag_begin, const tag_header& header, std::vector<frame> frames);
+
+    /** Returns whether the view was created from a source that has no (valid) tag. */
+    bool empty() const noexcept { return tag_begin_ == nullptr; }
+
+    const tag_header& header() const noexcept { return header_; }
+    const std::vector<frame>& frames() const noexcept { return frames_; }
+
+    /** Returns the first frame with `id`, or nullptr if the tag has no such frame. */
+    const frame* find(const int id) const noexcept;
+
+    /**
+     * Returns the frame's raw body as it appears in the source, i.e. text frames still
+     * begin with their encoding byte and are in their original encoding.
+     */
+    std::string_view data(const frame& f) const noexcept;
+
+    /**
+     * Returns the body of a text frame (or comment) converted to UTF-8. Other frames
+     * are returned as is.
+     */
+    std::string text(const frame& f) const;
+
+private:
+    const char* tag_begin_ = nullptr;
+    tag_header header_{};
+    std::vector<frame> frames_;
 };
 
 inline bool is_text_frame(const int id) noexcept
@@ -101,6 +236,65 @@ inline bool is_url_frame(const int id) noexcept
     return (id >= tag::frame::wcom) && (id <= tag::frame::wxxx);
 }
 
+/**
+ * A set of frame ids, represented as a bitmask over the `tag::frame::id` values, so
+ * testing whether a frame is wanted is O(1). It is constexpr, so the set of wanted
+ * frames may be built at compile time.
+ *
+ * Example:
+ * ```
+ * using namespace atag;
+ * constexpr id3v2::frame_set wanted{id3v2::title, id3v2::album, id3v2::lead_artist};
+ * static_assert(wanted.contains(id3v2::title), "");
+ * ```
+ */
+class frame_set
+{
+public:
+    constexpr frame_set() noexcept = default;
+
+    constexpr frame_set(std::initializer_list<int> ids) noexcept
+    {
+        for(const int id : ids) { insert(id); }
+    }
+
+    /** Ids that are not valid `tag::frame::id` values are ignored. */
+    constexpr frame_set& insert(const int id) noexcept
+    {
+        if(is_valid(id)) { bits_[id / 64] |= uint64_t(1) << (id % 64); }
+        return *this;
+    }
+
+    constexpr bool contains(const int id) const noexcept
+    {
+        return is_valid(id) && (bits_[id / 64] & (uint64_t(1) << (id % 64)));
+    }
+
+    constexpr bool empty() const noexcept
+    {
+        return (bits_[0] == 0) && (bits_[1] == 0);
+    }
+
+    /** Returns whether every id in `other` is also in this set. */
+    constexpr bool contains_all(const frame_set& other) const noexcept
+    {
+        return ((bits_[0] & other.bits_[0]) == other.bits_[0])
+            && ((bits_[1] & other.bits_[1]) == other.bits_[1]);
+    }
+
+    /** So that a frame set may be used as a predicate. */
+    constexpr bool operator()(const int id) const noexcept { return contains(id); }
+
+private:
+    static constexpr bool is_valid(const int id) noexcept
+    {
+        return (id >= tag::frame::aenc) && (id <= tag::frame::wxxx);
+    }
+
+    static_assert(tag::frame::wxxx < 128, "frame ids don't fit in frame_set");
+    uint64_t bits_[2] = {0, 0};
+};
+
 /**
  * Returns -1 if s does not contain a valid frame id.
  *
@@ -129,10 +323,37 @@ bool is_tagged(const Source& s) noexcept;
 template<typename Source>
 simple_tag simple_parse(const Source& s);
 
+/**
+ * Same as above, but the strings of the returned tag are allocated from `resource`.
+ *
+ * Example:
+ * ```
+ * // Parse a batch of files into a single arena, which is released in one go.
+ * std::pmr::monotonic_buffer_resource arena;
+ * std::pmr::vector<atag::pmr::simple_tag> tags(&arena);
+ * for(const auto& source : batch) {
+ *     tags.push_back(atag::id3v2::simple_parse(source, &arena));
+ * }
+ * ```
+ */
+template<typename Source>
+atag::pmr::simple_tag simple_parse(const Source& s, std::pmr::memory_resource* resource);
+
+/**
+ * Walks the frame headers of the tag in `s` and returns an index over them, without
+ * copying or decoding any frame bodies. If `s` is not tagged, an empty view is returned.
+ */
+template<typename Source>
+tag_view make_view(const Source& s);
+
 /** Parses and extracts all frames found in s. */
 template<typename Source>
 tag parse(const Source& s);
 
+/** Same as above, but the frames are allocated from `resource`. */
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource);
+
 /**
  * This overload provides a way to parse only the frames specified in wanted_frames.
  *
@@ -149,6 +370,40 @@ tag parse(const Source& s);
 template<typename Source>
 tag parse(const Source& s, const std::initializer_list<int>& wanted_frames);
 
+/**
+ * Parses only the frames in `wanted_frames`, and stops as soon as at least one of each
+ * has been found, so the rest of the tag is not even looked at. Thus if the tag has
+ * several frames with the same id (e.g. comments), only those preceding the last
+ * wanted frame are parsed.
+ *
+ * Example:
+ * ```
+ * using namespace atag;
+ * constexpr id3v2::frame_set wanted{id3v2::title, id3v2::album, id3v2::lead_artist};
+ * id3v2::tag tag = id3v2::parse(source, wanted);
+ * ```
+ */
+template<typename Source>
+tag parse(const Source& s, const frame_set& wanted_frames);
+
+/** Same as above, but the frames are allocated from `resource`. */
+template<typename Source>
+pmr::tag parse(const Source& s, const frame_set& wanted_frames,
+    std::pmr::memory_resource* resource);
+
+/**
+ * Same as above, but the set of wanted frames is built at compile time from the
+ * template arguments.
+ *
+ * Example:
+ * ```
+ * using namespace atag;
+ * auto tag = id3v2::parse<id3v2::title, id3v2::album, id3v2::lead_artist>(source);
+ * ```
+ */
+template<int Frame, int... Frames, typename Source>
+tag parse(const Source& s);
+
 /**
  * This overload expects a user defined predicate which takes a single int or a
  * `tag::frame::id` argument and returns true if the frame satisfies the user's criteria.
@@ -162,9 +417,34 @@ tag parse(const Source& s, const std::initializer_list<int>& wanted_frames);
  * auto tag2 = id3v2::parse(source2, [](const auto frame_id) { // ...  });
  * ```
  */
-template<typename Source, typename Predicate>
+template<typename Source, typename Predicate, typename = std::enable_if_t<
+    !std::is_convertible<Predicate, std::pmr::memory_resource*>::value>>
 tag parse(const Source& s, Predicate pred);
 
+/**
+ * The same as `simple_parse` and `parse`, but instead of throwing if `s` is shorter than
+ * 10 bytes, these return a result with the error at which parsing stopped, if any (see
+ * `parse_result`). The other formats have the same overloads.
+ *
+ * Example:
+ * ```
+ * auto result = atag::id3v2::simple_parse(source, std::nothrow);
+ * if(result.error().code == atag::parse_errc::truncated) {
+ *     // `*result` holds the frames before `result.error().offset`.
+ * }
+ * ```
+ */
+template<typename Source>
+parse_result<simple_tag> simple_parse(const Source& s, std::nothrow_t) noexcept;
+template<typename Source>
+parse_result<atag::pmr::simple_tag> simple_parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept;
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept;
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept;
+
 enum hrid
 {
     audio_encryption = tag::frame::aenc,
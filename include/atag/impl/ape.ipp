@@ -2,8 +2,12 @@
 #define ATAG_APE_IMPL
 
 #include "../detail/type_traits.hpp"
+#include "../detail/cursor.hpp"
 #include "../detail/io_util.hpp"
+#include "../detail/key_hash.hpp"
 #include "../ape.hpp"
+#include "../id3v1.hpp"
+#include "../instrumentation.hpp"
 
 #include <algorithm>
 
@@ -12,15 +16,16 @@ namespace ape {
 
 struct header
 {
-    enum
+    enum : uint32_t
     {
-        contains_header = 1 << 31,
-        contains_footer = 1 << 30,
-        this_is_the_header = 1 << 30,
+        contains_header = 1u << 31,
+        contains_no_footer = 1u << 30,
+        this_is_the_header = 1u << 29,
         read_only = 1,
     };
 
     int version;
+    // The size of the items and the footer, excluding the header.
     int tag_size;
     int num_items;
     uint32_t flags;
@@ -28,22 +33,24 @@ struct header
     enum { size = 32 };
 };
 
+/**
+ * `p` must point to a tag header or footer, which have the same layout. All fields are
+ * little endian.
+ */
 template<typename Ptr>
 header parse_header(Ptr p)
 {
     header h;
-    h.version = detail::parse_be<int>(p + 8);
-    h.tag_size = detail::parse_be<int>(p + 12);
-    h.num_items = detail::parse_be<int>(p + 16);
-    h.flags = detail::parse_be<uint32_t>(p + 20);
+    h.version = detail::parse_le<int>(p + 8);
+    h.tag_size = detail::parse_le<int>(p + 12);
+    h.num_items = detail::parse_le<int>(p + 16);
+    h.flags = detail::parse_le<uint32_t>(p + 20);
     return h;
 }
 
 inline bool is_header_valid(const header& h)
 {
-    // TODO
-    return h.size > 0
-        && h.num_items > 0;
+    return (h.tag_size > 0) && (h.num_items >= 0);
 }
 
 struct item_header
@@ -56,170 +63,289 @@ struct item_header
         read_only = 1,
     };
 
-    int value_size;
+    uint32_t value_size;
     uint32_t flags;
+
+    enum { size = 8 };
 };
 
-template<typename Ptr>
-item_header parse_item_header(Ptr p)
+/** Reads the header of the item at `items`, which must have at least 8 bytes left. */
+template<typename Cursor>
+item_header read_item_header(Cursor& items) noexcept
 {
     item_header h;
-    h.value_size = detail::parse_be<int>(p);
-    h.flags = detail::parse_be<int>(p + 4);
+    h.value_size = items.template read_le<uint32_t>();
+    h.flags = items.template read_le<uint32_t>();
     return h;
 }
 
-template<typename Source>
-int find_tag_start(const Source& s)
+/** Tests whether the 32 bytes at `p` are a tag header or footer. */
+template<typename Byte>
+bool matches_header(const Byte* p) noexcept
 {
-    const auto matches_header = [](const auto* p)
-    {
-        if(!std::equal(p, p + 8, "APETAGEX")) { return false; }
-        for(auto i = 0; i < 8; ++i)
-        {
-            if(p[i+24] != 0) { return false; }
-        }
-        return true;
-    };
-
-    if(matches_header(&s[0]))
-    {
-        return 0;
-    }
-    else if(matches_header(&s[s.size() - header::size]))
+    if(!std::equal(p, p + 8, "APETAGEX")) { return false; }
+    // The last 8 bytes are reserved and must be zero.
+    for(auto i = 24; i < header::size; ++i)
     {
-        // If the tag is appended, the size field in footer/header contains the size of
-        // all items and the footer, but not the initial header size.
-        const int size = detail::parse_be<int>(&s[s.size() - 20]);
-        if(size <= 0) { return -1; }
-        return s.size() - size - header::size;
+        if(p[i] != 0) { return false; }
     }
-    else
+    return true;
+}
+
+/**
+ * Returns the offset of the header or footer that describes the tag in `s`, or -1 if
+ * there is none. A tag at the start of `s` is described by its header, while a tag at
+ * the end of `s`, which may only be followed by an ID3v1 tag, is described by its
+ * footer (since it need not have a header).
+ */
+template<typename Source>
+int find_header(const Source& s) noexcept
+{
+    const int n = s.size();
+    if(n < header::size) { return -1; }
+    if(matches_header(&s[0])) { return 0; }
+    if(matches_header(&s[n-header::size])) { return n - header::size; }
+    // Otherwise the footer may precede an ID3v1 tag.
+    const int footer_offset = n - int(id3v1::tag_size) - int(header::size);
+    if(id3v1::is_tagged(s) && (footer_offset >= 0) && matches_header(&s[footer_offset]))
     {
-        return -1;
+        return footer_offset;
     }
+    return -1;
+}
+
+/**
+ * Returns the offset of the first item of the tag described by the header or footer
+ * `h`, which is at `header_offset` (an `int`, or a wider type for offsets into files
+ * larger than 2 GiB).
+ */
+template<typename Offset>
+Offset items_offset(const header& h, const Offset header_offset) noexcept
+{
+    if(h.flags & header::this_is_the_header) { return header_offset + header::size; }
+    // The tag size includes the footer but not the header.
+    return header_offset + header::size - h.tag_size;
 }
 
+/** Returns the offset at which the tag in `s` begins (with its header, if any), or -1. */
 template<typename Source>
-bool is_tagged(const Source& s)
+int find_tag_start(const Source& s) noexcept
 {
-    static_assert(detail::is_source<Source>::value, "Source requirements not met");
-    return (s.size() >= header::size) && (find_tag_start(s) != -1);
+    const int header_offset = find_header(s);
+    if(header_offset == -1) { return -1; }
+    const auto h = parse_header(&s[header_offset]);
+    if(h.flags & header::this_is_the_header) { return header_offset; }
+    const int tag_start = items_offset(h, header_offset)
+        - ((h.flags & header::contains_header) ? header::size : 0);
+    return tag_start >= 0 ? tag_start : -1;
 }
 
 template<typename Source>
-tag parse(const Source& s)
+bool is_tagged(const Source& s)
 {
     static_assert(detail::is_source<Source>::value, "Source requirements not met");
+    return find_header(s) != -1;
+}
 
-    if(s.size() < header::size) { return {}; }
-
-    const int tag_start = find_tag_start(s);
-    if(tag_start == -1) { return {}; }
-
-    tag tag;
-    const auto header = parse_header(&s[tag_start]);
-    if(!is_header_valid(header)) { return {}; }
-
-    tag.version = header.version;
-    tag.items.reserve(header.num_items);
-    for(auto i = 0, offset = tag_start + header::size;
-        (offset < s.size()) && (i < header.num_items);
-        ++ i)
+/**
+ * Invokes `f(key, value_begin, value_length)` for each item of the tag described by the
+ * header or footer at `header_offset`, which returns whether it parsed the item, and
+ * returns the error at which it stopped before the last item, if any.
+ */
+template<typename Source, typename Function>
+parse_error for_each_item(const Source& s, const int header_offset, Function f)
+{
+    detail::parse_probe probe(instrumentation::format::ape);
+    const auto header = parse_header(&s[header_offset]);
+    const parse_error header_error{parse_errc::invalid_header,
+        std::size_t(header_offset)};
+    if(!is_header_valid(header)) { return probe.fail(header_error); }
+
+    const int offset = items_offset(header, header_offset);
+    if(offset < 0) { return probe.fail(header_error); }
+    // The items end where the footer begins, or if the tag is described by its header,
+    // after the items and the footer at the latest. Don't trust the size field further
+    // than the end of the source.
+    const bool is_described_by_header = header.flags & header::this_is_the_header;
+    auto items = detail::make_cursor(s, offset,
+        is_described_by_header ? header.tag_size : header_offset - offset);
+    // If the items are cut off by the end of the source, the tag is truncated rather
+    // than malformed.
+    const bool is_truncated = is_described_by_header
+        && (items.size() < std::size_t(header.tag_size));
+    const std::error_code item_error = make_error_code(is_truncated
+        ? parse_errc::truncated : parse_errc::invalid_frame);
+    for(auto i = 0; i < header.num_items; ++i)
     {
-        const auto item_begin = &s[offset];
-        const auto item_header = parse_item_header(item_begin);
+        const std::size_t item_offset = items.offset();
+        // The key must be followed by at least its terminating null byte.
+        if(!items.has(item_header::size + 1))
+            return probe.fail({item_error, item_offset});
+        const auto item = read_item_header(items);
         // A 0x00 byte separates the item key from its value.
-        const auto key_begin = item_begin + 8;
-        const auto sep_pos = std::find(key_begin, &s[s.size()], 0); 
-        if(sep_pos == &s[s.size()]) { break; }
-
-        const auto value_begin = sep_pos + 1;
-        const int key_length = sep_pos - key_begin;
-        const int value_length = std::min(item_header.value_size,
-            s.size() - offset + 8 + key_length + 1);
-
-        const auto key = item_key_from_string(key_begin, key_length);
-        if(key != -1)
-            tag.items.emplace_back(tag::item{std::string(key_begin, key_length),
-                std::string(value_begin, value_length)});
-        
-        offset += 8 + key_length + 1 + value_length;
+        const auto key_begin = items.data();
+        const auto key_end = key_begin + items.size();
+        const auto sep_pos = std::find(key_begin, key_end, 0);
+        if(sep_pos == key_end) { return probe.fail({item_error, item_offset}); }
+        const std::size_t key_length = sep_pos - key_begin;
+        items.advance(key_length + 1);
+        probe.visit(item_header::size + key_length + 1);
+
+        // A value that extends past the items is cut short.
+        detail::source_cursor<Source> value;
+        const bool is_value_whole = items.take(item.value_size, value);
+        if(!is_value_whole) { value = items.take_rest(); }
+        if(f(item_key_from_string(key_begin, int(key_length)), value.data(),
+            int(value.size())))
+        {
+            probe.decode(value.size());
+        }
+        if(!is_value_whole) { return probe.fail({item_error, item_offset}); }
     }
-    return tag;
+    return {};
 }
 
-template<typename Source>
-simple_tag simple_parse(const Source& s)
+/** Parses the items of the tag described by the header or footer at `header_offset`. */
+template<typename Source, typename Tag>
+parse_error parse_into(const Source& s, const int header_offset, Tag& tag)
 {
-    static_assert(detail::is_source<Source>::value, "Source requirements not met");
-
-    if(s.size() < header::size) { return {}; }
-
-    const int tag_start = find_tag_start(s);
-    if(tag_start == -1) { return {}; }
+    tag.version = parse_header(&s[header_offset]).version;
+    return for_each_item(s, header_offset,
+        [&tag](const int key, const auto* value, const int value_length)
+        {
+            if(key == -1) { return false; }
+            // Constructed in place so that the data uses the tag's allocator.
+            tag.items.emplace_back();
+            tag.items.back().key = key;
+            tag.items.back().data.assign(value, value_length);
+            return true;
+        });
+}
 
-    simple_tag tag;
-    const auto header = parse_header(&s[tag_start]);
-    if(!is_header_valid(header)) { return {}; }
+/** Same as above, but the tag is first located in `s`. */
+template<typename Source, typename Tag>
+parse_error parse_into(const Source& s, Tag& tag)
+{
+    static_assert(detail::is_source<Source>::value, "Source requirements not met");
+    const int header_offset = find_header(s);
+    if(header_offset == -1) { return {parse_errc::not_tagged, 0}; }
+    return parse_into(s, header_offset, tag);
+}
 
-    for(auto i = 0, offset = tag_start + header::size;
-        (offset < s.size()) && (i < header.num_items);
-        ++ i)
-    {
-        const auto item_begin = &s[offset];
-        const auto item_header = parse_item_header(item_begin);
-        // A 0x00 byte separates the item key from its value.
-        const auto key_begin = item_begin + 8;
-        const auto sep_pos = std::find(key_begin, &s[s.size()], 0); 
-        if(sep_pos == &s[s.size()]) { break; }
-
-        const auto value_begin = sep_pos + 1;
-        const int key_length = sep_pos - key_begin;
-        const int value_length = std::min(item_header.value_size,
-            s.size() - offset + 8 + key_length + 1);
-        switch(key_length) {
-#define KEY_EQUALS(s) std::equal(key_begin, key_begin + sizeof(s) - 1, s)
-        case 4:
-            if(KEY_EQUALS("YEAR"))
-                tag.year = std::atoi(value_begin);
-            break;
-        case 5:
-            if(KEY_EQUALS("ALBUM"))
-                tag.album = std::string(value_begin,  value_length);
-            else if(KEY_EQUALS("TITLE"))
-                tag.title = std::string(value_begin,  value_length);
-            else if(KEY_EQUALS("GENRE"))
-                tag.genre/* = TODO*/;
-            else if(KEY_EQUALS("TRACK"))
+/** Parses the fields of `tag` from the tag described by the header at `header_offset`. */
+template<typename Source, typename SimpleTag>
+parse_error simple_parse_into(const Source& s, const int header_offset, SimpleTag& tag)
+{
+    return for_each_item(s, header_offset,
+        [&tag](const int key, const auto* value, const int value_length)
+        {
+            switch(key) {
+            case tag::item::year:
+                tag.year = detail::parse_number(value, value_length);
+                return true;
+            case tag::item::album:
+                tag.album.assign(value, value_length);
+                return true;
+            case tag::item::title:
+                tag.title.assign(value, value_length);
+                return true;
+            case tag::item::genre:
+                // `atag::genre` has no values to map the text to yet, so the item is
+                // skipped, as in the other formats' simple tags.
+                return false;
+            case tag::item::track:
                 // Track number may be a single integer of track/total, but since
                 // simple tag only has a track number field, we ignore the rest.
-                tag.track_number = std::atoi(value_begin);
-            break;
-        case 6:
-            if(KEY_EQUALS("ARTIST"))
+                tag.track_number = detail::parse_number(value, value_length);
+                return true;
+            case tag::item::artist:
                 // TODO FIXME values may be a list instead of a string, which means that
                 // entries are separated by 0x00 bytes. this is used if multiple artists
                 // worked on the song
-                tag.artist = std::string(value_begin, value_length);
-            break;
-        case 8:
-            // TODO is this correct?
-            if(!tag.artist.empty() && KEY_EQUALS("COMPOSER"))
-                tag.artist = std::string(value_begin, value_length);
-            break;
-        case 9:
-            // TODO is this correct?
-            if(!tag.artist.empty() && KEY_EQUALS("CONDUCTOR"))
-                tag.artist = std::string(value_begin, value_length);
-            break;
-#undef KEY_EQUALS
-        }
-        offset += 8 + key_length + 1 + value_length;
-    }
+                tag.artist.assign(value, value_length);
+                return true;
+            case tag::item::composer: case tag::item::conductor:
+                // Only fall back to these if there is no artist (yet).
+                if(!tag.artist.empty()) { return false; }
+                tag.artist.assign(value, value_length);
+                return true;
+            }
+            return false;
+        });
+}
+
+/** Same as above, but the tag is first located in `s`. */
+template<typename Source, typename SimpleTag>
+parse_error simple_parse_into(const Source& s, SimpleTag& tag)
+{
+    static_assert(detail::is_source<Source>::value, "Source requirements not met");
+    const int header_offset = find_header(s);
+    if(header_offset == -1) { return {parse_errc::not_tagged, 0}; }
+    return simple_parse_into(s, header_offset, tag);
+}
+
+template<typename Source>
+tag parse(const Source& s)
+{
+    tag tag{};
+    parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+simple_tag simple_parse(const Source& s)
+{
+    simple_tag tag{};
+    simple_parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+atag::pmr::simple_tag simple_parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    atag::pmr::simple_tag tag(resource);
+    simple_parse_into(s, tag);
     return tag;
 }
 
+template<typename Source>
+parse_result<simple_tag> simple_parse(const Source& s, std::nothrow_t) noexcept
+{
+    return detail::make_parse_result(simple_tag{},
+        [&s](simple_tag& tag) { return simple_parse_into(s, tag); });
+}
+
+template<typename Source>
+parse_result<atag::pmr::simple_tag> simple_parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept
+{
+    return detail::make_parse_result(atag::pmr::simple_tag(resource),
+        [&s](atag::pmr::simple_tag& tag) { return simple_parse_into(s, tag); });
+}
+
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept
+{
+    return detail::make_parse_result(tag{},
+        [&s](tag& tag) { return parse_into(s, tag); });
+}
+
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept
+{
+    return detail::make_parse_result(pmr::tag(resource),
+        [&s](pmr::tag& tag) { return parse_into(s, tag); });
+}
+
 constexpr static const struct {
     int key;
     const char* raw;
@@ -260,30 +386,50 @@ constexpr static const struct {
 
 inline int item_key_from_string(const std::string& s) noexcept
 {
-    /*
-    const auto it = std::find_if(std::begin(item_keys), std::end(item_keys),
-        [&s](const auto& f) { return std::equal(f.raw, f.raw + 4, &s[0]); });
-    if(it != std::end(item_keys))
-        return it->key;
-    else
-        return -1;
-    */
+    return item_key_from_string(s.data(), s.length());
 }
 
 inline int item_key_from_string(const char* s, const int s_length) noexcept
 {
-    /*
-    const auto it = std::find_if(std::begin(item_keys), std::end(item_keys),
-        [s, s_length](const auto& f)
-        {
-            // TODO how to compare variable length const char* s without segfaulting?
-            return false;
-        });
-    if(it != std::end(item_keys))
-        return it->key;
-    else
-        return -1;
-    */
+    if(!s || (s_length <= 0)) { return -1; }
+    // Keys are case-insensitive and of variable length, so switch on their hash. Since
+    // any key may collide with a known one, the match must be confirmed.
+    switch(detail::key_hash(s, s_length)) {
+#define ATAG_APE_KEY(key, raw) \
+    case detail::key_hash(raw): return detail::key_equals(s, s_length, raw) ? key : -1
+    ATAG_APE_KEY(tag::item::abstract, "ABSTRACT");
+    ATAG_APE_KEY(tag::item::album, "ALBUM");
+    ATAG_APE_KEY(tag::item::artist, "ARTIST");
+    ATAG_APE_KEY(tag::item::bibliography, "BIBLIOGRAPHY");
+    ATAG_APE_KEY(tag::item::catalog_number, "CATALOG");
+    ATAG_APE_KEY(tag::item::comment, "COMMENT");
+    ATAG_APE_KEY(tag::item::composer, "COMPOSER");
+    ATAG_APE_KEY(tag::item::conductor, "CONDUCTOR");
+    ATAG_APE_KEY(tag::item::copyright, "COPYRIGHT");
+    ATAG_APE_KEY(tag::item::debut_album, "DEBUT ALBUM");
+    ATAG_APE_KEY(tag::item::dummy, "DUMMY");
+    ATAG_APE_KEY(tag::item::ean_upc, "EAN/UPC");
+    ATAG_APE_KEY(tag::item::file_location, "FILE");
+    ATAG_APE_KEY(tag::item::genre, "GENRE");
+    ATAG_APE_KEY(tag::item::index, "INDEX");
+    ATAG_APE_KEY(tag::item::introplay, "INTROPLAY");
+    ATAG_APE_KEY(tag::item::isbn, "ISBN");
+    ATAG_APE_KEY(tag::item::isrc, "ISRC");
+    ATAG_APE_KEY(tag::item::label_code, "LC");
+    ATAG_APE_KEY(tag::item::language, "LANGUAGE");
+    ATAG_APE_KEY(tag::item::media, "MEDIA");
+    ATAG_APE_KEY(tag::item::publication_right_holder, "PUBLICATION RIGHT HOLDER");
+    ATAG_APE_KEY(tag::item::publisher, "PUBLISHER");
+    ATAG_APE_KEY(tag::item::record_date, "RECORD DATE");
+    ATAG_APE_KEY(tag::item::record_location, "RECORD LOCATION");
+    ATAG_APE_KEY(tag::item::related, "RELATED");
+    ATAG_APE_KEY(tag::item::subtitle, "SUBTITLE");
+    ATAG_APE_KEY(tag::item::title, "TITLE");
+    ATAG_APE_KEY(tag::item::track, "TRACK");
+    ATAG_APE_KEY(tag::item::year, "YEAR");
+#undef ATAG_APE_KEY
+    default: return -1;
+    }
 }
 
 constexpr const char* item_key_to_string(const int key) noexcept
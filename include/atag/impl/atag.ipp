@@ -4,21 +4,78 @@
 #include "../../atag.hpp"
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <limits>
 
 namespace atag {
 
 template<typename Source>
-simple_tag parse(const Source& s)
+tag_layout detect(const Source& s)
+{
+    static_assert(detail::is_source<Source>::value, "Source requirements not met");
+
+    tag_layout layout;
+    const uint64_t n = s.size();
+
+    // A file may only start with one of these.
+    if((n >= 10) && id3v2::matches_tag_header(&s[0], "ID3"))
+        layout.id3v2 = 0;
+    else if((n >= 4) && std::equal(&s[0], &s[4], "fLaC"))
+        layout.flac = 0;
+    else if((n >= ape::header::size) && ape::matches_header(&s[0]))
+        layout.ape = 0;
+    else if(ogg::is_tagged(s))
+        layout.ogg = 0;
+    else if(mp4::is_tagged(s))
+        layout.mp4 = 0;
+    else if(riff::is_tagged(s))
+        layout.riff = 0;
+
+    // While the tags at the end are stacked in this order: an appended ID3v2 tag or an
+    // APE tag, followed by an ID3v1 tag.
+    int64_t end = n;
+    if((n >= id3v1::tag_size) && std::equal(&s[n-id3v1::tag_size], &s[n-125], "TAG"))
+    {
+        layout.id3v1 = n - id3v1::tag_size;
+        end = layout.id3v1;
+    }
+    if((layout.ape == -1) && (end >= ape::header::size)
+       && ape::matches_header(&s[end-ape::header::size]))
+    {
+        layout.ape = end - ape::header::size;
+    }
+    else if((layout.id3v2 == -1) && (end >= 20)
+            && id3v2::matches_tag_header(&s[end-10], "3DI"))
+    {
+        layout.id3v2 = id3v2::appended_tag_start(s, end - 10);
+    }
+    return layout;
+}
+
+namespace detail {
+
+/**
+ * Whether `offset` is that of a tag the ID3v2 and APE parsers can address, as they take
+ * `int` offsets.
+ */
+inline bool is_int_offset(const int64_t offset) noexcept
+{
+    return (offset >= 0) && (offset <= std::numeric_limits<int>::max());
+}
+
+template<typename Source, typename SimpleTag>
+void parse_into(const Source& s, const tag_layout& layout, SimpleTag& t)
 {
-    simple_tag t;
-    if(id3v2::is_tagged(s))
+    const auto alloc = t.title.get_allocator();
+    if(is_int_offset(layout.id3v2))
     {
-        t = id3v2::simple_parse(s);
+        id3v2::simple_parse_into(s, int(layout.id3v2), t);
     }
-    else if(flac::is_tagged(s))
+    else if(layout.flac != -1)
     {
-        flac::tag f = flac::parse(s);
+        flac::basic_tag<typename SimpleTag::allocator_type> f(alloc);
+        flac::parse_into(s, f);
         t.title = std::move(f.title);
         t.album = std::move(f.album);
         t.artist = std::move(f.artist);
@@ -26,10 +83,56 @@ simple_tag parse(const Source& s)
         //t.genre = std::move(d.genre);
         t.year = f.year;
         t.track_number = f.track_number;
+        t.length = clamp_length(f.streaminfo.length());
+    }
+    else if(layout.ogg != -1)
+    {
+        ogg::basic_tag<typename SimpleTag::allocator_type> o(alloc);
+        ogg::parse_into(s, o);
+        t.title = std::move(o.title);
+        t.album = std::move(o.album);
+        t.artist = std::move(o.artist);
+        t.year = o.year;
+        t.track_number = o.track_number;
+        t.length = clamp_length(o.length);
+    }
+    else if(layout.mp4 != -1)
+    {
+        mp4::basic_tag<typename SimpleTag::allocator_type> m(alloc);
+        mp4::parse_into(s, m);
+        t.title = std::move(m.title);
+        t.album = std::move(m.album);
+        t.artist = std::move(m.artist);
+        t.year = m.year;
+        t.track_number = m.track_number;
+        t.length = clamp_length(m.length);
+    }
+    else if(layout.riff != -1)
+    {
+        riff::basic_tag<typename SimpleTag::allocator_type> r(alloc);
+        riff::parse_into(s, r);
+        // An embedded ID3v2 tag is parsed in place, and the other chunks fill in what it
+        // lacks.
+        if(r.id3v2_length >= 10)
+        {
+            const source_view<Source> id3(s, r.id3v2_offset, r.id3v2_length);
+            id3v2::simple_parse_into(id3, t);
+        }
+        if(t.title.empty()) { t.title = std::move(r.title); }
+        if(t.album.empty()) { t.album = std::move(r.album); }
+        if(t.artist.empty()) { t.artist = std::move(r.artist); }
+        if(t.year <= 0) { t.year = r.year; }
+        if(t.track_number <= 0) { t.track_number = r.track_number; }
+        if(t.length <= 0) { t.length = r.length; }
     }
-    else if(id3v1::is_tagged(s))
+    else if(is_int_offset(layout.ape))
     {
-        id3v1::tag d = id3v1::parse(s);
+        ape::simple_parse_into(s, int(layout.ape), t);
+    }
+    else if(layout.id3v1 != -1)
+    {
+        id3v1::basic_tag<typename SimpleTag::allocator_type> d(alloc);
+        id3v1::parse_into(s, d);
         t.title = std::move(d.title);
         t.album = std::move(d.album);
         t.artist = std::move(d.artist);
@@ -37,15 +140,93 @@ simple_tag parse(const Source& s)
         t.track_number = d.track_number;
         t.year = d.year;
     }
-    /*
-    if(ape::is_tagged(s))
+}
+
+template<typename Source, typename Allocator>
+void parse_all_into(const Source& s, const Allocator& alloc,
+    basic_tag_set<Allocator>& tags)
+{
+    tags.layout = detect(s);
+    if(is_int_offset(tags.layout.id3v2))
+    {
+        tags.id3v2.emplace(alloc);
+        id3v2::parse_frames(s, int(tags.layout.id3v2), [](int) { return true; },
+            [] { return false; }, *tags.id3v2);
+    }
+    if(tags.layout.flac != -1)
     {
-        // TODO
+        tags.flac.emplace(alloc);
+        flac::parse_into(s, *tags.flac);
     }
-    */
+    if(is_int_offset(tags.layout.ape))
+    {
+        tags.ape.emplace(alloc);
+        ape::parse_into(s, int(tags.layout.ape), *tags.ape);
+    }
+    if(tags.layout.id3v1 != -1)
+    {
+        tags.id3v1.emplace(alloc);
+        id3v1::parse_into(s, *tags.id3v1);
+    }
+    if(tags.layout.ogg != -1)
+    {
+        tags.ogg.emplace(alloc);
+        ogg::parse_into(s, *tags.ogg);
+    }
+    if(tags.layout.mp4 != -1)
+    {
+        tags.mp4.emplace(alloc);
+        mp4::parse_into(s, *tags.mp4);
+    }
+    if(tags.layout.riff != -1)
+    {
+        tags.riff.emplace(alloc);
+        riff::parse_into(s, *tags.riff);
+        const auto& r = *tags.riff;
+        if(r.id3v2_length >= 10)
+        {
+            tags.id3v2.emplace(alloc);
+            const source_view<Source> id3(s, r.id3v2_offset, r.id3v2_length);
+            id3v2::parse_frames(id3, [](int) { return true; }, [] { return false; },
+                *tags.id3v2);
+        }
+    }
+}
+
+} // namespace detail
+
+template<typename Source>
+simple_tag parse(const Source& s)
+{
+    simple_tag t{};
+    detail::parse_into(s, detect(s), t);
     return t;
 }
 
+template<typename Source>
+pmr::simple_tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::simple_tag t(resource);
+    detail::parse_into(s, detect(s), t);
+    return t;
+}
+
+template<typename Source>
+tag_set parse_all(const Source& s)
+{
+    tag_set tags;
+    detail::parse_all_into(s, std::allocator<char>(), tags);
+    return tags;
+}
+
+template<typename Source>
+pmr::tag_set parse_all(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag_set tags;
+    detail::parse_all_into(s, std::pmr::polymorphic_allocator<char>(resource), tags);
+    return tags;
+}
+
 } // namespace atag
 
 #endif // ATAG_IMPL_HEADER
@@ -0,0 +1,145 @@
+#ifndef ATAG_COLLATION_IMPL_HEADER
+#define ATAG_COLLATION_IMPL_HEADER
+
+#include "../collation.hpp"
+#include "../encoding.hpp"
+#include "../detail/key_hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+
+namespace atag {
+namespace detail {
+
+/**
+ * The base letter of each code point from U+00C0 to U+017F (Latin-1 Supplement and
+ * Latin Extended-A), where '*' marks a letter that expands to two letters (see
+ * `expand_letter`), and '.' a character that is kept as is (× and ÷).
+ */
+constexpr char latin_base_letters[] =
+    "aaaaaa*ceeeeiiiidnooooo.ouuuuy**aaaaaa*ceeeeiiiidnooooo.ouuuuy*y"
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii**jjkkkllllllllll"
+    "nnnnnnnnnoooooo**rrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+static_assert(sizeof latin_base_letters == 0x180 - 0xc0 + 1);
+
+inline const char* expand_letter(const int32_t c) noexcept
+{
+    switch(c) {
+    case 0xc6: case 0xe6: return "ae";
+    case 0xde: case 0xfe: return "th";
+    case 0xdf: return "ss";
+    case 0x132: case 0x133: return "ij";
+    case 0x152: case 0x153: return "oe";
+    default: return "";
+    }
+}
+
+/** Returns the lower case of `c` if it's an upper case Greek or Cyrillic letter. */
+constexpr int32_t fold_greek_or_cyrillic(const int32_t c) noexcept
+{
+    if((c >= 0x391) && (c <= 0x3a9) && (c != 0x3a2)) { return c + 0x20; }
+    if((c >= 0x400) && (c <= 0x40f)) { return c + 0x50; }
+    if((c >= 0x410) && (c <= 0x42f)) { return c + 0x20; }
+    return c;
+}
+
+/**
+ * Returns the length of the leading article of `s` (including the space after it) that
+ * is to be skipped, or 0 if there is none.
+ */
+inline std::size_t article_length(const std::string_view s) noexcept
+{
+    for(const char* article : {"the ", "a ", "an "})
+    {
+        const std::size_t n = std::strlen(article);
+        if((s.size() > n) && key_equals(s.data(), n, article)) { return n; }
+    }
+    return 0;
+}
+
+} // namespace detail
+
+inline void append_sort_key(const std::string_view s, const collation_options& options,
+    std::string& key)
+{
+    std::size_t i = 0;
+    if(options.skip_articles)
+    {
+        while((i < s.size()) && (s[i] == ' ')) { ++i; }
+        i += detail::article_length(s.substr(i));
+    }
+    key.reserve(key.size() + s.size() - i);
+    while(i < s.size())
+    {
+        // Runs of ASCII are the common case, and are only lowered.
+        const char a = s[i];
+        if(uint8_t(a) < 0x80)
+        {
+            key.push_back((a >= 'A') && (a <= 'Z') ? a + ('a' - 'A') : a);
+            ++i;
+            continue;
+        }
+        const std::size_t start = i;
+        const int32_t c = encoding::detail::decode_utf8(s.data(), s.size(), i);
+        if(c == -1)
+        {
+            key.push_back(s[start]);
+        }
+        else if((c >= 0xc0) && (c < 0x180))
+        {
+            const char base = detail::latin_base_letters[c - 0xc0];
+            if(base == '*')
+                key.append(detail::expand_letter(c));
+            else if(base == '.')
+                key.append(s.data() + start, i - start);
+            else
+                key.push_back(base);
+        }
+        else if((c < 0x300) || (c > 0x36f))
+        {
+            char buffer[4];
+            key.append(buffer, encoding::detail::encode_utf8(
+                detail::fold_greek_or_cyrillic(c), buffer));
+        }
+    }
+}
+
+inline std::string make_sort_key(const std::string_view s,
+    const collation_options& options)
+{
+    std::string key;
+    append_sort_key(s, options, key);
+    return key;
+}
+
+inline int compare_sort_keys(const std::string_view a, const std::string_view b) noexcept
+{
+    const std::size_t n = std::min(a.size(), b.size());
+    if(n > 0)
+    {
+        if(const int c = std::memcmp(a.data(), b.data(), n); c != 0) { return c; }
+    }
+    return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+}
+
+template<typename Tag>
+sort_keys make_sort_keys(const Tag& tag, const collation_options& options)
+{
+    sort_keys keys;
+    append_sort_key(tag.title, options, keys.title);
+    append_sort_key(tag.album, options, keys.album);
+    append_sort_key(tag.artist, options, keys.artist);
+    return keys;
+}
+
+template<typename Tag>
+collated<Tag> collate(Tag tag, const collation_options& options)
+{
+    sort_keys keys = make_sort_keys(tag, options);
+    return {std::move(tag), std::move(keys)};
+}
+
+} // namespace atag
+
+#endif // ATAG_COLLATION_IMPL_HEADER
@@ -0,0 +1,414 @@
+#ifndef ATAG_ENCODING_IMPL_HEADER
+#define ATAG_ENCODING_IMPL_HEADER
+
+#include "../encoding.hpp"
+#include "../detail/simd.hpp"
+#include "../instrumentation.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace atag {
+namespace encoding {
+namespace detail {
+
+constexpr uint64_t repeat_byte(const uint8_t b) noexcept
+{
+    return uint64_t(b) * 0x0101010101010101ull;
+}
+
+/** Returns whether any of the 8 bytes in `w` has its high bit set or is zero. */
+constexpr bool has_non_ascii_or_null(const uint64_t w, const bool stop_at_null) noexcept
+{
+    return (w & repeat_byte(0x80))
+        || (stop_at_null && ((w - repeat_byte(0x01)) & ~w & repeat_byte(0x80)));
+}
+
+/**
+ * Returns the length of the longest prefix of `s` that consists only of ASCII
+ * characters (and no null characters if `StopAtNull` is set). If `Copy` is set, the
+ * prefix is also copied to `dst` as it is scanned.
+ */
+template<bool StopAtNull, bool Copy>
+std::size_t ascii_prefix(const char* s, const std::size_t length, char* dst) noexcept
+{
+    std::size_t i = 0;
+#if defined(ATAG_HAS_AVX2)
+    for(; i + 32 <= length; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        int mask = _mm256_movemask_epi8(v);
+        if(StopAtNull)
+            mask |= _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        if(mask != 0) { break; }
+        if(Copy) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v); }
+    }
+#endif
+#if defined(ATAG_HAS_SSE2)
+    for(; i + 16 <= length; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        int mask = _mm_movemask_epi8(v);
+        if(StopAtNull)
+            mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        if(mask != 0) { break; }
+        if(Copy) { _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v); }
+    }
+#endif
+    // Portable fallback which also handles the remainder: test 8 bytes at a time.
+    for(; i + 8 <= length; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, s + i, 8);
+        if(has_non_ascii_or_null(w, StopAtNull)) { break; }
+        if(Copy) { std::memcpy(dst + i, &w, 8); }
+    }
+    for(; i < length; ++i)
+    {
+        const auto c = uint8_t(s[i]);
+        if((c >= 0x80) || (StopAtNull && (c == 0))) { break; }
+        if(Copy) { dst[i] = char(c); }
+    }
+    return i;
+}
+
+inline uint16_t load_utf16(const char* p, const byte_order order) noexcept
+{
+    const auto lo = uint8_t(p[0]);
+    const auto hi = uint8_t(p[1]);
+    return order == byte_order::little_endian ? lo | (hi << 8) : (lo << 8) | hi;
+}
+
+inline void store_utf16(const uint16_t u, const byte_order order, char* p) noexcept
+{
+    if(order == byte_order::little_endian)
+    {
+        p[0] = char(u & 0xff);
+        p[1] = char(u >> 8);
+    }
+    else
+    {
+        p[0] = char(u >> 8);
+        p[1] = char(u & 0xff);
+    }
+}
+
+/**
+ * Narrows the longest prefix of `src` (of `num_units` UTF-16 code units) that consists
+ * only of non-null ASCII characters into `dst`, and returns its length in code units.
+ */
+inline std::size_t narrow_ascii_utf16(const char* src, const std::size_t num_units,
+    const byte_order order, char* dst) noexcept
+{
+    std::size_t i = 0;
+#if defined(ATAG_HAS_SSE2)
+    // Since the x86 is little endian, loading LE code units gives their values, while
+    // for BE the two bytes of each unit need to be swapped. Packing with unsigned
+    // saturation then maps units above 0xff to 0xff and (as the input is treated as
+    // signed) those above 0x7fff to 0, so that both are caught by testing the narrowed
+    // bytes for a set high bit or null.
+    const bool swap = order == byte_order::big_endian;
+# if defined(ATAG_HAS_AVX2)
+    for(; i + 16 <= num_units; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+        if(swap)
+            v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+        // Packing works within 128 bit lanes, so gather the low 64 bits of both lanes.
+        const __m128i packed = _mm256_castsi256_si128(
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0b1000));
+        const int mask = _mm_movemask_epi8(packed)
+            | _mm_movemask_epi8(_mm_cmpeq_epi8(packed, _mm_setzero_si128()));
+        if(mask != 0) { break; }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+# endif
+    for(; i + 8 <= num_units; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        if(swap) { v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)); }
+        const __m128i packed = _mm_packus_epi16(v, v);
+        // Only the lower 8 bytes are relevant, the upper 8 are the same.
+        const int mask = (_mm_movemask_epi8(packed)
+            | _mm_movemask_epi8(_mm_cmpeq_epi8(packed, _mm_setzero_si128()))) & 0xff;
+        if(mask != 0) { break; }
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#endif
+    for(; i < num_units; ++i)
+    {
+        const uint16_t u = load_utf16(src + 2 * i, order);
+        if((u >= 0x80) || (u == 0)) { break; }
+        dst[i] = char(u);
+    }
+    return i;
+}
+
+inline std::size_t encode_utf8(const uint32_t c, char* dst) noexcept
+{
+    if(c < 0x80)
+    {
+        dst[0] = char(c);
+        return 1;
+    }
+    else if(c < 0x800)
+    {
+        dst[0] = char(0xc0 | (c >> 6));
+        dst[1] = char(0x80 | (c & 0x3f));
+        return 2;
+    }
+    else if(c < 0x10000)
+    {
+        dst[0] = char(0xe0 | (c >> 12));
+        dst[1] = char(0x80 | ((c >> 6) & 0x3f));
+        dst[2] = char(0x80 | (c & 0x3f));
+        return 3;
+    }
+    else
+    {
+        dst[0] = char(0xf0 | (c >> 18));
+        dst[1] = char(0x80 | ((c >> 12) & 0x3f));
+        dst[2] = char(0x80 | ((c >> 6) & 0x3f));
+        dst[3] = char(0x80 | (c & 0x3f));
+        return 4;
+    }
+}
+
+enum { replacement_character = 0xfffd };
+
+/**
+ * Decodes a single UTF-8 sequence starting at `s[i]` (which must be less than `length`)
+ * and advances `i` past it. Returns -1 if the sequence is invalid, in which case `i` is
+ * advanced by one byte.
+ */
+inline int32_t decode_utf8(const char* s, const std::size_t length,
+    std::size_t& i) noexcept
+{
+    const auto c = uint8_t(s[i++]);
+    if(c < 0x80) { return c; }
+
+    // The number of continuation bytes and the valid range of the first of them, which
+    // is narrower than 0x80-0xbf for some lead bytes to exclude overlong encodings,
+    // surrogates and code points above U+10FFFF.
+    int num_cont;
+    uint8_t lo = 0x80, hi = 0xbf;
+    int32_t cp;
+    if((c >= 0xc2) && (c <= 0xdf)) { num_cont = 1; cp = c & 0x1f; }
+    else if(c == 0xe0) { num_cont = 2; lo = 0xa0; cp = c & 0x0f; }
+    else if(c == 0xed) { num_cont = 2; hi = 0x9f; cp = c & 0x0f; }
+    else if((c >= 0xe1) && (c <= 0xef)) { num_cont = 2; cp = c & 0x0f; }
+    else if(c == 0xf0) { num_cont = 3; lo = 0x90; cp = c & 0x07; }
+    else if(c == 0xf4) { num_cont = 3; hi = 0x8f; cp = c & 0x07; }
+    else if((c >= 0xf1) && (c <= 0xf3)) { num_cont = 3; cp = c & 0x07; }
+    else { return -1; }
+
+    if(i + num_cont > length) { return -1; }
+    for(auto n = 0; n < num_cont; ++n, lo = 0x80, hi = 0xbf)
+    {
+        const auto b = uint8_t(s[i + n]);
+        if((b < lo) || (b > hi)) { return -1; }
+        cp = (cp << 6) | (b & 0x3f);
+    }
+    i += num_cont;
+    return cp;
+}
+
+} // namespace detail
+
+inline std::size_t iso_8859_1_to_utf8(const char* src, const std::size_t length,
+    char* dst) noexcept
+{
+    atag::detail::conversion_probe probe(
+        instrumentation::conversion::iso_8859_1_to_utf8, length);
+    std::size_t i = 0;
+    std::size_t n = 0;
+    while(i < length)
+    {
+        // ISO-8859-1 and UTF-8 are the same for the first 128 characters.
+        const auto ascii_length = detail::ascii_prefix<true, true>(
+            src + i, length - i, dst + n);
+        i += ascii_length;
+        n += ascii_length;
+        if((i == length) || (src[i] == 0)) { break; }
+
+        // The rest map to U+0080-U+00FF, which are encoded in two bytes.
+        const auto c = uint8_t(src[i++]);
+        dst[n++] = char(0xc0 | (c >> 6));
+        dst[n++] = char(0x80 | (c & 0x3f));
+    }
+    return n;
+}
+
+inline std::size_t utf16_to_utf8(const char* src, const std::size_t num_bytes,
+    const byte_order order, char* dst) noexcept
+{
+    atag::detail::conversion_probe probe(
+        instrumentation::conversion::utf16_to_utf8, num_bytes);
+    const std::size_t num_units = num_bytes / 2;
+    std::size_t i = 0;
+    std::size_t n = 0;
+    while(i < num_units)
+    {
+        const auto ascii_length = detail::narrow_ascii_utf16(
+            src + 2 * i, num_units - i, order, dst + n);
+        i += ascii_length;
+        n += ascii_length;
+        if(i == num_units) { break; }
+
+        uint32_t c = detail::load_utf16(src + 2 * i++, order);
+        if(c == 0) { break; }
+        if((c >= 0xd800) && (c <= 0xdbff) && (i < num_units))
+        {
+            const uint32_t low = detail::load_utf16(src + 2 * i, order);
+            if((low >= 0xdc00) && (low <= 0xdfff))
+            {
+                c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                ++i;
+            }
+        }
+        if((c >= 0xd800) && (c <= 0xdfff)) { c = detail::replacement_character; }
+        n += detail::encode_utf8(c, dst + n);
+    }
+    return n;
+}
+
+inline std::size_t utf16_bom_to_utf8(const char* src, const std::size_t num_bytes,
+    const byte_order default_order, char* dst) noexcept
+{
+    if(num_bytes >= 2)
+    {
+        const auto b0 = uint8_t(src[0]);
+        const auto b1 = uint8_t(src[1]);
+        if((b0 == 0xff) && (b1 == 0xfe))
+            return utf16_to_utf8(src + 2, num_bytes - 2, byte_order::little_endian, dst);
+        else if((b0 == 0xfe) && (b1 == 0xff))
+            return utf16_to_utf8(src + 2, num_bytes - 2, byte_order::big_endian, dst);
+    }
+    return utf16_to_utf8(src, num_bytes, default_order, dst);
+}
+
+inline std::size_t utf16le_to_utf8(const char* src, const std::size_t num_bytes,
+    char* dst) noexcept
+{
+    return utf16_to_utf8(src, num_bytes, byte_order::little_endian, dst);
+}
+
+inline std::size_t utf16be_to_utf8(const char* src, const std::size_t num_bytes,
+    char* dst) noexcept
+{
+    return utf16_to_utf8(src, num_bytes, byte_order::big_endian, dst);
+}
+
+inline std::size_t utf8_to_utf16(const char* src, const std::size_t length,
+    const byte_order order, char* dst) noexcept
+{
+    atag::detail::conversion_probe probe(
+        instrumentation::conversion::utf8_to_utf16, length);
+    std::size_t i = 0;
+    std::size_t n = 0;
+    while(i < length)
+    {
+        int32_t c = detail::decode_utf8(src, length, i);
+        if(c == 0) { break; }
+        if(c < 0) { c = detail::replacement_character; }
+        if(c >= 0x10000)
+        {
+            c -= 0x10000;
+            detail::store_utf16(uint16_t(0xd800 + (c >> 10)), order, dst + n);
+            detail::store_utf16(uint16_t(0xdc00 + (c & 0x3ff)), order, dst + n + 2);
+            n += 4;
+        }
+        else
+        {
+            detail::store_utf16(uint16_t(c), order, dst + n);
+            n += 2;
+        }
+    }
+    return n;
+}
+
+inline bool is_valid_utf8(const char* src, const std::size_t length) noexcept
+{
+    std::size_t i = 0;
+    while(i < length)
+    {
+        i += detail::ascii_prefix<false, false>(src + i, length - i, nullptr);
+        if(i == length) { break; }
+        if(detail::decode_utf8(src, length, i) < 0) { return false; }
+    }
+    return true;
+}
+
+inline std::string utf16le_to_utf8(const char16_t* src, const int size)
+{
+    if(!src || (size <= 0)) { return {}; }
+    std::string utf8(max_utf8_length_of_utf16(2 * size), 0);
+    utf8.resize(utf16le_to_utf8(reinterpret_cast<const char*>(src), 2 * size, &utf8[0]));
+    return utf8;
+}
+
+inline std::string utf16le_to_utf8(const std::u16string& src)
+{
+    return utf16le_to_utf8(src.data(), src.length());
+}
+
+inline std::string utf16be_to_utf8(const char16_t* src, const int size)
+{
+    if(!src || (size <= 0)) { return {}; }
+    std::string utf8(max_utf8_length_of_utf16(2 * size), 0);
+    utf8.resize(utf16be_to_utf8(reinterpret_cast<const char*>(src), 2 * size, &utf8[0]));
+    return utf8;
+}
+
+inline std::string utf16be_to_utf8(const std::u16string& src)
+{
+    return utf16be_to_utf8(src.data(), src.length());
+}
+
+inline std::u16string utf8_to_utf16le(const char* src, const int length)
+{
+    if(!src || (length <= 0)) { return {}; }
+    std::u16string utf16(max_utf16_length_of_utf8(length) / 2, 0);
+    const auto num_bytes = utf8_to_utf16(src, length, byte_order::little_endian,
+        reinterpret_cast<char*>(&utf16[0]));
+    utf16.resize(num_bytes / 2);
+    return utf16;
+}
+
+inline std::u16string utf8_to_utf16le(const std::string& src)
+{
+    return utf8_to_utf16le(src.data(), src.length());
+}
+
+inline std::u16string utf8_to_utf16be(const char* src, const int length)
+{
+    if(!src || (length <= 0)) { return {}; }
+    std::u16string utf16(max_utf16_length_of_utf8(length) / 2, 0);
+    const auto num_bytes = utf8_to_utf16(src, length, byte_order::big_endian,
+        reinterpret_cast<char*>(&utf16[0]));
+    utf16.resize(num_bytes / 2);
+    return utf16;
+}
+
+inline std::u16string utf8_to_utf16be(const std::string& src)
+{
+    return utf8_to_utf16be(src.data(), src.length());
+}
+
+inline std::string iso_8859_1_to_utf8(const char* src, const int length)
+{
+    if(!src || (length <= 0)) { return {}; }
+    std::string utf8(max_utf8_length_of_iso_8859_1(length), 0);
+    utf8.resize(iso_8859_1_to_utf8(src, std::size_t(length), &utf8[0]));
+    return utf8;
+}
+
+inline std::string iso_8859_1_to_utf8(const std::string& src)
+{
+    return iso_8859_1_to_utf8(src.data(), src.length());
+}
+
+} // namespace encoding
+} // namespace atag
+
+#endif // ATAG_ENCODING_IMPL_HEADER
@@ -0,0 +1,270 @@
+#ifndef ATAG_FILE_SOURCE_IMPL_HEADER
+#define ATAG_FILE_SOURCE_IMPL_HEADER
+
+#include "../file_source.hpp"
+#include "../detail/io_util.hpp"
+#include "../id3v2.hpp"
+#include "../flac.hpp"
+#include "../ape.hpp"
+#include "../tag_parser.hpp"
+#include "../instrumentation.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace atag {
+namespace detail {
+
+inline std::error_code last_error() noexcept
+{
+    return std::error_code(errno, std::system_category());
+}
+
+/** Reads exactly `length` bytes at `offset`, retrying on interrupts and short reads. */
+inline bool pread_all(const int fd, char* buffer, std::size_t length, std::size_t offset,
+    std::error_code& error) noexcept
+{
+    while(length > 0)
+    {
+        const ssize_t n = ::pread(fd, buffer, length, offset);
+        if(n == -1)
+        {
+            if(errno == EINTR) { continue; }
+            error = last_error();
+            return false;
+        }
+        else if(n == 0)
+        {
+            // The file must have been truncated since it was opened.
+            error = std::make_error_code(std::errc::io_error);
+            return false;
+        }
+        buffer += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+/** Writes exactly `length` bytes at `offset`, retrying on interrupts. */
+inline bool pwrite_all(const int fd, const char* buffer, std::size_t length,
+    std::size_t offset, std::error_code& error) noexcept
+{
+    while(length > 0)
+    {
+        const ssize_t n = ::pwrite(fd, buffer, length, offset);
+        if(n == -1)
+        {
+            if(errno == EINTR) { continue; }
+            error = last_error();
+            return false;
+        }
+        buffer += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+/** Opens `path` for reading and returns its descriptor and size, or -1 on error. */
+inline int open_file(const std::string& path, std::size_t& size, std::error_code& error)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
+    {
+        error = last_error();
+        return -1;
+    }
+    struct stat st;
+    if(::fstat(fd, &st) == -1)
+    {
+        error = last_error();
+        ::close(fd);
+        return -1;
+    }
+    size = st.st_size;
+    return fd;
+}
+
+} // namespace detail
+
+// -- file_source --
+
+inline file_source::file_source(file_source&& other) noexcept
+    : buffer_(std::move(other.buffer_))
+    , fd_(other.fd_)
+{
+    other.buffer_.reset();
+    other.fd_ = -1;
+}
+
+inline file_source& file_source::operator=(file_source&& other) noexcept
+{
+    if(this != &other)
+    {
+        close();
+        buffer_ = std::move(other.buffer_);
+        fd_ = other.fd_;
+        other.buffer_.reset();
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+inline file_source::~file_source()
+{
+    close();
+}
+
+inline void file_source::open(const std::string& path, std::error_code& error)
+{
+    close();
+    error.clear();
+    std::size_t size = 0;
+    fd_ = detail::open_file(path, size, error);
+    if(fd_ != -1) { buffer_.reset(size); }
+}
+
+inline void file_source::close() noexcept
+{
+    if(fd_ != -1) { ::close(fd_); }
+    fd_ = -1;
+    buffer_.reset();
+}
+
+inline bool file_source::fetch(const std::size_t offset, const std::size_t length,
+    std::error_code& error)
+{
+    if(fd_ == -1)
+    {
+        error = std::make_error_code(std::errc::bad_file_descriptor);
+        return false;
+    }
+    const std::size_t size = buffer_.size();
+    if(offset > size) { return false; }
+    const bool is_truncated = length > size - offset;
+    const std::size_t end = is_truncated ? size : offset + length;
+    const bool ok = buffer_.insert(offset, end,
+        [this, &error](char* dest, const std::size_t pos, const std::size_t n)
+        {
+            detail::read_probe probe(n);
+            return detail::pread_all(fd_, dest, n, pos, error);
+        });
+    return ok && !is_truncated;
+}
+
+// -- mapped_source --
+
+inline mapped_source::mapped_source(mapped_source&& other) noexcept
+    : data_(other.data_)
+    , size_(other.size_)
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+inline mapped_source& mapped_source::operator=(mapped_source&& other) noexcept
+{
+    if(this != &other)
+    {
+        close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+    return *this;
+}
+
+inline mapped_source::~mapped_source()
+{
+    close();
+}
+
+inline void mapped_source::open(const std::string& path, std::error_code& error)
+{
+    close();
+    error.clear();
+    std::size_t size = 0;
+    const int fd = detail::open_file(path, size, error);
+    if(fd == -1) { return; }
+
+    if(size == 0)
+    {
+        // Empty files can't be mapped.
+        static const char empty = 0;
+        data_ = &empty;
+        ::close(fd);
+        return;
+    }
+
+    void* p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file open.
+    ::close(fd);
+    if(p == MAP_FAILED)
+    {
+        error = detail::last_error();
+        return;
+    }
+    // Tags are at the head and tail of the file, so reading ahead is counterproductive.
+    ::madvise(p, size, MADV_RANDOM);
+    data_ = static_cast<const char*>(p);
+    size_ = size;
+}
+
+inline void mapped_source::close() noexcept
+{
+    if(data_ && (size_ > 0))
+    {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
+
+inline bool mapped_source::fetch(const std::size_t offset, const std::size_t length,
+    std::error_code& error)
+{
+    if(!is_open())
+    {
+        error = std::make_error_code(std::errc::bad_file_descriptor);
+        return false;
+    }
+    if(offset > size_) { return false; }
+    const bool is_truncated = length > size_ - offset;
+    const std::size_t end = is_truncated ? size_ : offset + length;
+    if(offset < end)
+    {
+        // madvise requires a page aligned address.
+        static const std::size_t page_size = ::sysconf(_SC_PAGESIZE);
+        const std::size_t aligned_offset = offset - offset % page_size;
+        ::madvise(const_cast<char*>(data_) + aligned_offset, end - aligned_offset,
+            MADV_WILLNEED);
+    }
+    return !is_truncated;
+}
+
+// -- prefetch_tags --
+
+template<typename Source>
+bool prefetch_tags(Source& s, std::error_code& error, const flac_blocks blocks)
+{
+    static_assert(detail::is_source<Source>::value, "Source requirements not met");
+
+    detail::tag_locator locator(blocks);
+    for(byte_range r; locator.next(s, r);)
+    {
+        if(!detail::fetch(s, r.offset, r.length, error) && error) { return false; }
+    }
+    return true;
+}
+
+} // namespace atag
+
+#endif // ATAG_FILE_SOURCE_IMPL_HEADER
@@ -2,8 +2,12 @@
 #define ATAG_FLAC_IMPL_HEADER
 
 #include "../detail/type_traits.hpp"
+#include "../detail/cursor.hpp"
 #include "../detail/io_util.hpp"
+#include "../detail/key_hash.hpp"
 #include "../flac.hpp"
+#include "../instrumentation.hpp"
+#include "../vorbis.hpp"
 
 #include <algorithm>
 #include <array>
@@ -26,7 +30,8 @@ namespace flac {
 
 struct block_header
 {
-    enum type
+    // The type is 7 bits, so the enum must be able to hold the unknown ones as well.
+    enum type : uint8_t
     {
         streaminfo,
         padding,
@@ -65,7 +70,7 @@ block_header parse_block_header(const Byte* s)
     h.type = static_cast<enum block_header::type>(s[0] & 0b0111'1111);
     h.length = detail::parse_be<int>(&s[0]);
     // Only the last 3 bytes are used for the length field.
-    h.length &= 0b0000'0000'1111'1111'1111'1111;
+    h.length &= 0x00ff'ffff;
 #ifdef ATAG_ENABLE_DEBUGGING
     std::printf("block header:: is_last_block: %d, type: %i, length: %i\n",
         h.is_last_block, h.type, h.length);
@@ -75,114 +80,53 @@ block_header parse_block_header(const Byte* s)
 
 /* `s` must be a buffer or pointer to a buffer starting at the streaminfo block's data. */
 template<typename Byte>
-void parse_streaminfo(const Byte* s, tag& tag)
+void parse_streaminfo(const Byte* s, streaminfo& info)
 {
-    // sample_rate is stored in 2.5 bytes/20 bits
-    tag.sample_rate = detail::parse_be<int>(&s[10]);
-    tag.sample_rate >>= 12;
-    // num_channels is stored in 3 bits
-    tag.num_channels = (s[12] & 0b0000'1110) >> 1;
-    // total samples is stored in 5 bits, with 1 bit in another byte
-    tag.num_samples = 0;
-    tag.num_samples |= (s[12] & 0b0000'0001) << 4; 
-    tag.num_samples |= (s[13] & 0b1111'0000) >> 4; 
+    info.min_block_size = detail::parse_be<uint16_t>(&s[0]);
+    info.max_block_size = detail::parse_be<uint16_t>(&s[2]);
+    info.min_frame_size = detail::parse_be<uint32_t>(&s[3]) & 0xff'ffff;
+    info.max_frame_size = detail::parse_be<uint32_t>(&s[6]) & 0xff'ffff;
+    // The next 64 bits are the sample rate (20 bits), the number of channels - 1
+    // (3 bits), the bits per sample - 1 (5 bits) and the number of samples (36 bits).
+    const auto packed = detail::parse_be<uint64_t>(&s[10]);
+    info.sample_rate = packed >> 44;
+    info.num_channels = ((packed >> 41) & 0b111) + 1;
+    info.bits_per_sample = ((packed >> 36) & 0b1'1111) + 1;
+    info.num_samples = packed & 0xf'ffff'ffffull;
+    std::copy(&s[18], &s[34], info.md5.begin());
 }
 
 /**
  * `s` must be a buffer or pointer to a buffer starting at the vorbis comment
- * block's data.
+ * block's data, which is `length` bytes long.
  */
-template<typename Byte>
-void parse_vorbis_comment(const Byte* s, tag& tag)
+template<typename Byte, typename Tag>
+void parse_vorbis_comment(const Byte* s, const int length, Tag& tag)
 {
-    // TODO refactor
-    const int vendor_length = detail::parse_le<uint32_t>(&s[0]);
-#ifdef ATAG_ENABLE_DEBUGGING
-    if(vendor_length > 0)
-    {
-        const std::string vendor_string(&s[4], vendor_length);
-        std::printf("vendor string: %s (%i bytes)\n",
-            vendor_string.c_str(), vendor_length);
-    }
-#endif
-    int offset = vendor_length + 4;
-    const int comment_list_size = detail::parse_le<uint32_t>(&s[offset]);
-    offset += 4;
-    // TODO also make sure we don't iterate out of s
-    for(auto i = 0; i < comment_list_size; ++i)
-    {
-        const uint32_t comment_length = detail::parse_le<uint32_t>(&s[offset]);
-        offset += 4;
-        const auto comment_begin = &s[offset];
-        const auto comment_end = comment_begin + comment_length;
-        const auto sep_pos = std::find(comment_begin, comment_end, '=');
-        // There must always be a '=' separator between the comment's key and value
-        // TODO or must there?
-        if(sep_pos == comment_end) { break; }
-
-        const auto value_begin = sep_pos + 1;
-        const int key_length = sep_pos - comment_begin;
-        const int value_length = comment_end - value_begin;
-        switch(key_length) {
-#define KEY_EQUALS(s) std::equal(comment_begin, comment_begin + sizeof(s) - 1, s)
-        case 4:
-            // Only parse date if it's 4 chars long representing the year.
-            // TODO more flexibility
-            if(KEY_EQUALS("DATE") && (value_length == 4))
-                tag.year = std::atoi(value_begin);
-            break;
-        case 5:
-            if(KEY_EQUALS("ALBUM"))
-                tag.album = std::string(value_begin, value_length);
-            else if(KEY_EQUALS("GENRE"))
-                tag.genre = std::string(value_begin, value_length);
-            else if(KEY_EQUALS("TITLE"))
-                tag.title = std::string(value_begin, value_length);
-            break;
-        case 6:
-            if(KEY_EQUALS("ARTIST"))
-            {
-                // Vorbis allows multiple comments with the same key.
-                if(tag.artist.empty())
-                    tag.artist = std::string(value_begin, value_length);
-                else
-                    tag.artist += ", " + std::string(value_begin, value_length);
-            }
-            break;
-        case 9:
-            // TODO does it make sense to treat 'performer' as 'artist'?
-            if(KEY_EQUALS("PERFORMER"))
-            {
-                if(tag.artist.empty())
-                    tag.artist = std::string(value_begin, value_length);
-                else
-                    tag.artist += ", " + std::string(value_begin, value_length);
-            }
-            break;
-        case 11:
-            if(KEY_EQUALS("TRACKNUMBER"))
-                tag.track_number = std::atoi(value_begin);
-            break;
-#undef KEY_EQUALS
-        }
-        offset += comment_length;
-    }
+    vorbis::detail::parse_fields(reinterpret_cast<const char*>(s), length, tag);
 }
 
-/** Parses and extracts all frames found in `s`. */
-template<typename Source>
-tag parse(const Source& s)
+/**
+ * Parses the STREAMINFO and VORBIS_COMMENT blocks of `s` into `tag`, and stops as soon as
+ * both have been parsed. Returns the error at which parsing stopped before that, if any.
+ */
+template<typename Source, typename Tag>
+parse_error parse_into(const Source& s, Tag& tag)
 {
     static_assert(detail::is_source<Source>::value, "Source requirements not met");
 
-    if(!is_tagged(s)) { return {}; }
+    if(!is_tagged(s)) { return {parse_errc::not_tagged, 0}; }
 
+    detail::parse_probe probe(instrumentation::format::flac);
     // https://xiph.org/flac/format.html#metadata_block
-    tag tag;
     // Skip ahead by 4 to skip the 4 byte FLAC tag ID.
-    for(auto i = 4; i + 4 < int(s.size());)
+    bool has_streaminfo = false;
+    bool has_vorbis_comment = false;
+    auto i = 4;
+    while(i + 4 < int(s.size()))
     {
         const auto block_header = parse_block_header(&s[i]);
+        probe.visit(4);
         if(block_header.length <= 0)
         {
 #ifdef ATAG_ENABLE_DEBUGGING
@@ -192,7 +136,7 @@ tag parse(const Source& s)
                    ATAG_BYTE_TO_BINARY(s[i]), ATAG_BYTE_TO_BINARY(s[i+1]),
                    ATAG_BYTE_TO_BINARY(s[i+2]), ATAG_BYTE_TO_BINARY(s[i+3]));
 #endif
-            break;
+            return probe.fail({parse_errc::invalid_frame, std::size_t(i)});
         }
 
 #ifdef ATAG_ENABLE_DEBUGGING
@@ -201,11 +145,26 @@ tag parse(const Source& s)
 # define ATAG_FLAC_BLOCK(block_name) (void)0
 #endif
         // Advance past the block header to the body.
+        const std::size_t block_offset = i;
         i += 4;
+        // Only the bodies of the parsed blocks are accessed, the rest are skipped by
+        // their length alone (and need not be in `s`, see `flac_blocks::parsed`).
+        const auto take_body = [&s, i, &block_header](auto& body)
+        {
+            body = detail::make_cursor(s, i, block_header.length);
+            return body.size() == std::size_t(block_header.length);
+        };
+        detail::source_cursor<Source> body;
+        const parse_error truncated{parse_errc::truncated, block_offset};
+        const parse_error invalid{parse_errc::invalid_frame, block_offset};
         switch(block_header.type) {
         case block_header::type::streaminfo:
             ATAG_FLAC_BLOCK("streaminfo");
-            parse_streaminfo(&s[i], tag);
+            if(block_header.length < 34) { return probe.fail(invalid); }
+            if(!take_body(body)) { return probe.fail(truncated); }
+            parse_streaminfo(body.data(), tag.streaminfo);
+            probe.decode(body.size());
+            has_streaminfo = true;
             break;
         case block_header::type::padding:
             ATAG_FLAC_BLOCK("padding");
@@ -218,7 +177,10 @@ tag parse(const Source& s)
             break;
         case block_header::type::vorbis_comment:
             ATAG_FLAC_BLOCK("vorbis comment");
-            parse_vorbis_comment(&s[i], tag);
+            if(!take_body(body)) { return probe.fail(truncated); }
+            parse_vorbis_comment(body.data(), block_header.length, tag);
+            probe.decode(body.size());
+            has_vorbis_comment = true;
             break;
         case block_header::type::cuesheet:
             ATAG_FLAC_BLOCK("cuesheet");
@@ -228,17 +190,75 @@ tag parse(const Source& s)
             break;
         default:
             ATAG_FLAC_BLOCK("unknown");
-            return tag;
+            return probe.fail(invalid);
         }
 
-        if(block_header.is_last_block)
-            break;
+        if(block_header.is_last_block || (has_streaminfo && has_vorbis_comment))
+            return {};
         else
             i += block_header.length;
     }
+    // The source ended before the last block (possibly in the middle of a skipped one).
+    return probe.fail({parse_errc::truncated, std::min(std::size_t(i), s.size())});
+}
+
+template<typename Source>
+vorbis::comment_view make_comment_view(const Source& s)
+{
+    static_assert(detail::is_source<Source>::value, "Source requirements not met");
+
+    vorbis::comment_view view;
+    if(!is_tagged(s)) { return view; }
+
+    for(auto i = 4; i + 4 < int(s.size());)
+    {
+        const auto block_header = parse_block_header(&s[i]);
+        if(block_header.length <= 0) { break; }
+        i += 4;
+        if(block_header.type == block_header::type::vorbis_comment)
+        {
+            const auto body = detail::make_cursor(s, i, block_header.length);
+            if(body.size() == std::size_t(block_header.length))
+                view.parse(reinterpret_cast<const char*>(body.data()), body.size());
+            break;
+        }
+        if(block_header.is_last_block) { break; }
+        i += block_header.length;
+    }
+    return view;
+}
+
+template<typename Source>
+tag parse(const Source& s)
+{
+    tag tag{};
+    parse_into(s, tag);
     return tag;
 }
 
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept
+{
+    return detail::make_parse_result(tag{},
+        [&s](tag& tag) { return parse_into(s, tag); });
+}
+
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept
+{
+    return detail::make_parse_result(pmr::tag(resource),
+        [&s](pmr::tag& tag) { return parse_into(s, tag); });
+}
+
 } // namespace flac
 } // namespace atag
 
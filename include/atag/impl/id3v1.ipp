@@ -2,7 +2,9 @@
 #define ATAG_ID3V1_IMPL_HEADER
 
 #include "../detail/type_traits.hpp"
+#include "../detail/io_util.hpp"
 #include "../id3v1.hpp"
+#include "../instrumentation.hpp"
 
 #include <algorithm>
 
@@ -20,32 +22,76 @@ template<typename Source> bool is_tagged(const Source& s)
     return std::equal(tag_begin, tag_begin + 3, "TAG");
 }
 
-template<typename Source> tag parse(const Source& s)
+/**
+ * Since an ID3v1 tag has a fixed size and layout, it's either there or not, and that's
+ * the only error.
+ */
+template<typename Source, typename Tag> parse_error parse_into(const Source& s, Tag& tag)
 {
     static_assert(detail::is_source<Source>::value, "Source requirements not met");
 
-    if(!is_tagged(s)) { return {}; }
+    if(!is_tagged(s)) { return {parse_errc::not_tagged, 0}; }
 
+    // The whole tag is a single frame.
+    detail::parse_probe probe(instrumentation::format::id3v1);
+    probe.visit(3);
+    probe.decode(tag_size - 3);
     auto pos = &s[s.size() - tag_size] + 3;
-    tag tag;
 
-    tag.title = std::string(pos, std::find(pos, pos + 30, 0));
+    tag.title.assign(pos, std::find(pos, pos + 30, 0));
     pos += 30;
-    tag.artist = std::string(pos, std::find(pos, pos + 30, 0));
+    tag.artist.assign(pos, std::find(pos, pos + 30, 0));
     pos += 30;
-    tag.album = std::string(pos, std::find(pos, pos + 30, 0));
+    tag.album.assign(pos, std::find(pos, pos + 30, 0));
     pos += 30;
-    tag.comment = std::string(pos, std::find(pos, pos + 28, 0));
-    pos += 29;
-    tag.track_number = *pos;
-    pos += 1;
-    tag.year = std::atoi(pos);
+    tag.year = detail::parse_number(pos, 4);
     pos += 4;
-    tag.genre = *pos;
+    // In ID3v1.1 the last byte of the comment is the track number, if the one before it
+    // is a null byte.
+    if((pos[28] == 0) && (pos[29] != 0))
+    {
+        tag.comment.assign(pos, std::find(pos, pos + 28, 0));
+        tag.track_number = uint8_t(pos[29]);
+    }
+    else
+    {
+        tag.comment.assign(pos, std::find(pos, pos + 30, 0));
+    }
+    pos += 30;
+    tag.genre = uint8_t(*pos);
+    return {};
+}
 
+template<typename Source> tag parse(const Source& s)
+{
+    tag tag{};
+    parse_into(s, tag);
     return tag;
 }
 
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept
+{
+    return detail::make_parse_result(tag{},
+        [&s](tag& tag) { return parse_into(s, tag); });
+}
+
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept
+{
+    return detail::make_parse_result(pmr::tag(resource),
+        [&s](pmr::tag& tag) { return parse_into(s, tag); });
+}
+
 } // namespace id3v1
 } // namespace atag
 
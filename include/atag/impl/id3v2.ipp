@@ -2,16 +2,17 @@
 #define ATAG_ID3_IMPL_HEADER
 
 #include "../detail/type_traits.hpp"
+#include "../detail/cursor.hpp"
 #include "../detail/io_util.hpp"
+#include "../detail/key_hash.hpp"
 #include "../encoding.hpp"
 #include "../id3v2.hpp"
+#include "../instrumentation.hpp"
 
 #include <cassert>
 #include <algorithm>
 #include <iterator>
 #include <array>
-#include <locale>
-#include <codecvt>
 #ifdef ATAG_ENABLE_DEBUGGING
 # include <cstdio>
 # define ATAG_BYTE_BINARY_PATTERN "%c%c%c%c %c%c%c%c"
@@ -29,15 +30,6 @@
 namespace atag {
 namespace id3v2 {
 
-struct tag_header
-{
-    char version;
-    char revision;
-    unsigned char flags;
-    int size;
-    int extended_header_size;
-};
-
 struct frame_header
 {
     char id;
@@ -45,7 +37,10 @@ struct frame_header
     int size;
 };
 
-/** `s` must be a buffer or a pointer to a buffer starting at the tag header. */
+/**
+ * `s` must be a buffer or a pointer to a buffer starting at the 10 byte tag header. The
+ * extended header, which may follow it, is not read (see `take_frames`).
+ */
 template<typename Ptr>
 tag_header parse_tag_header(Ptr s) noexcept
 {
@@ -60,23 +55,24 @@ tag_header parse_tag_header(Ptr s) noexcept
         ATAG_BYTE_BINARY_PATTERN")\n", h.version, h.revision, h.size,
         ATAG_BYTE_TO_BINARY(h.flags));
 #endif // ATAG_ENABLE_DEBUGGING
-    if(h.flags & tag::flags::extended)
-        h.extended_header_size = detail::parse_syncsafe<int>(&s[10]);
-    else
-        h.extended_header_size = 0;
+    h.extended_header_size = 0;
     return h;
 }
 
-/** `s` must be a buffer or a pointer to a buffer starting at the frame header. */
+/**
+ * `s` must be a buffer or a pointer to a buffer starting at the frame header.
+ * `version` is that of the tag, as frame sizes are only syncsafe as of ID3v2.4.
+ */
 template<typename Ptr>
-frame_header parse_frame_header(Ptr s) noexcept
+frame_header parse_frame_header(Ptr s, const int version) noexcept
 {
     frame_header h;
     h.id = frame_id_from_string(s);
-    h.flags = 0;
-    h.flags |= s[8] << 8;
-    h.flags |= s[9];
-    h.size = detail::parse_syncsafe<int>(&s[4]);
+    h.flags = (uint8_t(s[8]) << 8) | uint8_t(s[9]);
+    if(version >= 4)
+        h.size = detail::parse_syncsafe<int>(&s[4]);
+    else
+        h.size = detail::parse_be<int>(&s[4]);
 #ifdef ATAG_ENABLE_DEBUGGING
     if((h.id != -1) && (h.size > 0))
         std::printf("frame header:: id: %s(%s), size: %i, flags: ("
@@ -87,56 +83,137 @@ frame_header parse_frame_header(Ptr s) noexcept
     return h;
 }
 
-/** `s` must be a buffer or a pointer to a buffer starting at the frame body. */
-template<typename Ptr>
-tag::frame parse_frame_body(const frame_header& header, Ptr s)
+/**
+ * Converts `length` bytes of text in the given ID3v2 encoding (i.e. the text of a frame
+ * following its encoding byte) to UTF-8, and stores it in `utf8`.
+ */
+template<typename String>
+void decode_text(const int text_encoding, const char* s, const int length, String& utf8)
 {
-    // TODO FIXME we'll need a lot more branching here depending on the frame's type
-    tag::frame frame;
-    frame.id = header.id;
-    frame.flags = header.flags;
-    // TODO we need to find all frames that have encoding and apply the same conv (as
-    // frames other than text frames may have text in them, such as `comments`).
-    if(is_text_frame(header.id) || (frame.id == comments))
+    namespace enc = atag::encoding;
+    if(length <= 0)
+    {
+        utf8.clear();
+        return;
+    }
+    switch(text_encoding) {
+    case encoding::iso_8859_1:
+        utf8.resize(enc::max_utf8_length_of_iso_8859_1(length));
+        utf8.resize(enc::iso_8859_1_to_utf8(s, length, &utf8[0]));
+        break;
+    case encoding::utf16:
+        // The spec requires UTF-16 text to start with a BOM, but not all taggers
+        // adhere to it, in which case little endian is the likelier.
+        utf8.resize(enc::max_utf8_length_of_utf16(length));
+        utf8.resize(enc::utf16_bom_to_utf8(s, length,
+            enc::byte_order::little_endian, &utf8[0]));
+        break;
+    case encoding::utf16be:
+        utf8.resize(enc::max_utf8_length_of_utf16(length));
+        utf8.resize(enc::utf16be_to_utf8(s, length, &utf8[0]));
+        break;
+    case encoding::utf8:
+    default:
+        utf8.assign(s, length);
+        break;
+    }
+}
+
+/**
+ * Same as `decode_text`, but for text made up of several null terminated strings (such
+ * as the values of a multi-valued text frame, or a description and its value), which
+ * are converted one by one, as in UTF-16 each starts with its own BOM. The strings are
+ * separated by a null byte in `utf8`, and the terminator of the last one is dropped.
+ */
+template<typename String>
+void decode_strings(const int text_encoding, const char* s, const int length,
+    String& utf8)
+{
+    const int unit = (text_encoding == encoding::utf16)
+        || (text_encoding == encoding::utf16be) ? 2 : 1;
+    // Returns the end of the string at `pos`, i.e. its terminator or the end of `s`.
+    const auto find_end = [s, length, unit](int pos)
+    {
+        while((pos + unit <= length) && ((s[pos] != 0) || (s[pos+unit-1] != 0)))
+            pos += unit;
+        return pos + unit <= length ? pos : length;
+    };
+    int end = find_end(0);
+    decode_text(text_encoding, s, end, utf8);
+    String value(utf8.get_allocator());
+    for(int pos = end + unit; pos < length; pos = end + unit)
+    {
+        end = find_end(pos);
+        decode_text(text_encoding, s + pos, end - pos, value);
+        utf8 += '\0';
+        utf8 += value;
+    }
+}
+
+/** Whether the text of the frame is preceded by a 3 byte language code. */
+inline bool has_language(const int id) noexcept
+{
+    return (id == comments) || (id == unsynced_lyrics);
+}
+
+/** Whether the frame holds a description, followed by the text it describes. */
+inline bool has_description(const int id) noexcept
+{
+    return has_language(id) || (id == user_defined_text);
+}
+
+inline bool is_encoded_frame(const int id) noexcept
+{
+    return is_text_frame(id) || has_language(id);
+}
+
+/**
+ * Stores the frame's body in `data`, converted to UTF-8 if it's text. `s` must be a
+ * buffer or a pointer to a buffer starting at the frame body.
+ *
+ * The strings of a text frame are separated by null bytes. Comments and lyrics start
+ * with their language code, and they, as well as user defined text frames, always hold
+ * the description, a null byte, and the text itself.
+ */
+template<typename Ptr, typename String>
+void parse_frame_data(const frame_header& header, Ptr s, String& data)
+{
+    if(is_encoded_frame(header.id))
     {
-        // Textual information.
-        frame.encoding = s[0];
 #ifdef ATAG_ENABLE_DEBUGGING
-        std::printf("\ttext frame encoding: %s\n", frame.encoding == iso_8859_1
-                ? "ISO-8859-1" : frame.encoding == utf16
-                    ? "UTF-16" : frame.encoding == utf16be
+        std::printf("\ttext frame encoding: %s\n", s[0] == iso_8859_1
+                ? "ISO-8859-1" : s[0] == utf16
+                    ? "UTF-16" : s[0] == utf16be
                         ? "UTF-16BE" : "UTF8");
 #endif // ATAG_ENABLE_DEBUGGING
-        switch(frame.encoding) {
-        case encoding::iso_8859_1:
-            frame.data = atag::encoding::iso_8859_1_to_utf8(s + 1, header.size - 1);
-            //frame.data = std::string(s + 1, header.size - 1);
-            break;
-        case encoding::utf16:
-        {
-            // header.size is the number of bytes while UTF-16 is at least 2 bytes wide.
-            // Also, we must start at the fourth byte, since the first is the encoding
-            // identifier, the second and third the BOM, which the spec requires.
-            frame.data = atag::encoding::utf16le_to_utf8(
-                reinterpret_cast<const char16_t*>(s + 3), (header.size >> 1) - 1);
-            break;
-        }
-        case encoding::utf16be:
-        {
-            frame.data = atag::encoding::utf16be_to_utf8(
-                reinterpret_cast<const char16_t*>(s + 3), (header.size >> 1) - 1);
-            break;
-        }
-        case encoding::utf8:
-            frame.data = std::string(s + 1, header.size - 1);
-            break;
-        }
+        const char* text = reinterpret_cast<const char*>(&s[1]);
+        const int language_length = has_language(header.id)
+            ? std::min(3, header.size - 1) : 0;
+        decode_strings(s[0], text + language_length,
+            header.size - 1 - language_length, data);
+        data.insert(0, text, language_length);
+        if(has_description(header.id) && (data.find('\0') == String::npos))
+            data += '\0';
     }
     else
     {
-        frame.data = std::string(s, header.size);
+        data.assign(reinterpret_cast<const char*>(&s[0]), header.size);
     }
-    return frame;
+}
+
+/**
+ * `s` must be a buffer or a pointer to a buffer starting at the frame body. `frame` is
+ * filled in place, so that its data is allocated with the tag's allocator.
+ */
+template<typename Ptr, typename Frame>
+void parse_frame_body(const frame_header& header, Ptr s, Frame& frame)
+{
+    // TODO FIXME we'll need a lot more branching here depending on the frame's type
+    frame.id = header.id;
+    frame.flags = header.flags;
+    // Textual information is converted to UTF-8, but its original encoding is kept.
+    frame.encoding = is_encoded_frame(header.id) ? s[0] : 0;
+    parse_frame_data(header, s, frame.data);
 }
 
 inline bool is_frame_header_valid(const frame_header& header) noexcept
@@ -145,28 +222,44 @@ inline bool is_frame_header_valid(const frame_header& header) noexcept
     return (header.id != -1) && (header.size > 0);
 }
 
+/**
+ * Tests whether the 10 bytes at `p` are a tag header (if `magic` is "ID3") or footer (if
+ * it's "3DI").
+ */
+template<typename Byte>
+bool matches_tag_header(const Byte* p, const char* magic) noexcept
+{
+    return std::equal(p, p + 3, magic)
+        && (p[3] <= 4) && (p[4] < 0xff)
+        && (p[6] < 0x80) && (p[7] < 0x80) && (p[8] < 0x80) && (p[9] < 0x80);
+}
+
+/**
+ * Returns the start of the appended tag whose footer is at `footer_offset`, or -1 if
+ * the tag's size doesn't fit before it. `Offset` is `int`, or a wider type for offsets
+ * into files larger than 2 GiB (see `detect`).
+ */
+template<typename Source, typename Offset>
+Offset appended_tag_start(const Source& s, const Offset footer_offset) noexcept
+{
+    const auto tag_size = detail::parse_syncsafe<int>(&s[footer_offset+6]);
+    // Since there is a header and a footer, subtract the 10 byte header size as well.
+    const Offset tag_start = footer_offset - tag_size - 10;
+    return tag_start >= 0 ? tag_start : -1;
+}
+
 template<typename Source>
 inline int find_tag_start(const Source& s) noexcept
 {
-    const auto matches = [&s](const auto* p, const char* magic)
-    {
-        return std::equal(p, p + 3, magic)
-            && (p[3] <= 4) && (p[4] < 0xff)
-            && (p[6] < 0x80) && (p[7] < 0x80) && (p[8] < 0x80) && (p[9] < 0x80);
-    };
+    const int n = s.size();
+    if(n < 10) { return -1; }
 
     // Most ID3v2 tags will be prepended to the file, so start with that.
-    if(matches(&s[0], "ID3")) { return 0; }
+    if(matches_tag_header(&s[0], "ID3")) { return 0; }
 
     // See if the tag is appended (in which case it must have a footer at the very end
     // of the file).
-    const int n = s.size();
-    if(matches(&s[n-10], "3DI"))
-    {
-        const auto tag_size = detail::parse_syncsafe<int>(&s[n-4]);
-        // Since there is a header and a footer, subtract the 10 byte header size twice.
-        return n - tag_size - 20;
-    }
+    if(matches_tag_header(&s[n-10], "3DI")) { return appended_tag_start(s, n - 10); }
 
     // No tag could be found.
     return -1;
@@ -179,110 +272,397 @@ bool is_tagged(const Source& s) noexcept
     return find_tag_start(s) != -1;
 }
 
+/**
+ * Whether the tag ending at `tag_end` (as declared by the tag header) extends past the
+ * end of its `frames`, i.e. past the end of the source, or of the range fetched from it
+ * (see `detail::make_cursor`).
+ */
+template<typename Cursor>
+bool is_tag_truncated(const Cursor& frames, const int tag_end) noexcept
+{
+    return frames.offset() + frames.size() < std::size_t(tag_end);
+}
+
+/**
+ * Returns the error of the frame at `offset`, which has a negative size or doesn't fit
+ * in the tag ending at `tag_end` (as declared by the tag header). If it only doesn't fit
+ * because the tag extends past the end of `frames`, the tag is truncated.
+ */
+template<typename Cursor>
+parse_error frame_error(const Cursor& frames, const frame_header& header,
+    const std::size_t offset, const int tag_end) noexcept
+{
+    const bool is_truncated = (header.size >= 0) && is_tag_truncated(frames, tag_end);
+    return {is_truncated ? parse_errc::truncated : parse_errc::invalid_frame, offset};
+}
+
+/**
+ * Parses the header of the tag at `tag_start` into `header`, and sets `frames` to the
+ * frames of the tag, i.e. the bytes after the header and the extended header up to the
+ * end of the tag, or of `s` if the tag is truncated. Returns false if the extended header
+ * doesn't fit in the tag.
+ */
+template<typename Source>
+bool take_frames(const Source& s, const int tag_start, tag_header& header,
+    detail::source_cursor<Source>& frames) noexcept
+{
+    header = parse_tag_header(&s[tag_start]);
+    frames = detail::make_cursor(s, tag_start + 10, header.size);
+    if(header.flags & tag::flags::extended)
+    {
+        if(!frames.has(4)) { return false; }
+        header.extended_header_size = detail::parse_syncsafe<int>(frames.data());
+        return frames.skip(header.extended_header_size);
+    }
+    return true;
+}
+
+/**
+ * Parses the frames of the tag at `tag_start` for which `pred` returns true into `tag`,
+ * and stops as soon as `done` returns true (which is tested after each parsed frame).
+ * Returns the error at which parsing stopped before the end of the tag, if any.
+ */
+template<typename Source, typename Predicate, typename Done, typename Tag>
+parse_error parse_frames(const Source& s, const int tag_start, Predicate pred,
+    Done done, Tag& tag)
+{
+    detail::parse_probe probe(instrumentation::format::id3v2);
+    tag_header tag_header;
+    detail::source_cursor<Source> frames;
+    if(!take_frames(s, tag_start, tag_header, frames))
+        return probe.fail({parse_errc::invalid_header, std::size_t(tag_start)});
+    tag.version = tag_header.version;
+    tag.revision = tag_header.revision;
+    tag.flags = tag_header.flags;
+    const int declared_end = tag_start + 10 + tag_header.size;
+    while(frames.has(10))
+    {
+        // A null byte in place of a frame id means we've reached the padding.
+        if(frames[0] == 0) { return {}; }
+        const auto frame_header = parse_frame_header(frames.data(), tag_header.version);
+        const std::size_t frame_offset = frames.offset();
+        frames.advance(10);
+        probe.visit(10);
+        detail::source_cursor<Source> body;
+        if((frame_header.size < 0) || !frames.take(frame_header.size, body))
+        {
+            return probe.fail(frame_error(frames, frame_header, frame_offset,
+                declared_end));
+        }
+        if(is_frame_header_valid(frame_header) && pred(frame_header.id))
+        {
+            // The frame is constructed in place, so that with a scoped allocator (such
+            // as `std::pmr::polymorphic_allocator`) its data ends up in the same arena.
+            tag.frames.emplace_back();
+            parse_frame_body(frame_header, body.data(), tag.frames.back());
+            probe.decode(body.size());
+#ifdef ATAG_ENABLE_DEBUGGING
+            std::printf("frame body:: %s\n", tag.frames.back().data.c_str());
+#endif // ATAG_ENABLE_DEBUGGING
+            if(done()) { return {}; }
+        }
+    }
+    if(is_tag_truncated(frames, declared_end))
+        return probe.fail({parse_errc::truncated, frames.offset()});
+    return {};
+}
+
+/**
+ * Same as above, but the tag is first located in `s`. Throws if `s` is shorter than 10
+ * bytes, which the `std::nothrow` overloads test beforehand.
+ */
+template<typename Source, typename Predicate, typename Done, typename Tag>
+parse_error parse_frames(const Source& s, Predicate pred, Done done, Tag& tag)
+{
+    static_assert(detail::is_source<Source>::value, "Source requirements not met");
+
+    if(s.size() < 10) { throw "source must be at least 10 bytes long"; }
+
+    const int tag_start = find_tag_start(s);
+    if(tag_start == -1) { return {parse_errc::not_tagged, 0}; }
+    return parse_frames(s, tag_start, pred, done, tag);
+}
+
+template<typename Source, typename Tag>
+void parse_frames(const Source& s, const frame_set& wanted_frames, Tag& tag)
+{
+    frame_set seen;
+    parse_frames(s,
+        [&wanted_frames, &seen](const int id)
+        {
+            if(!wanted_frames.contains(id)) { return false; }
+            seen.insert(id);
+            return true;
+        },
+        [&wanted_frames, &seen] { return seen.contains_all(wanted_frames); },
+        tag);
+}
+
 template<typename Source>
 tag parse(const Source& s)
 {
-    return parse(s, [](int _) { return true; });
+    return parse(s, [](int) { return true; });
+}
+
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_frames(s, [](int) { return true; }, [] { return false; }, tag);
+    return tag;
 }
 
 template<typename Source>
 tag parse(const Source& s, const std::initializer_list<int>& wanted_frames)
 {
-    return parse(s, [&wanted_frames](const int id)
-        {
-            return std::find(wanted_frames.begin(), wanted_frames.end(), id)
-                    != wanted_frames.end();
-        });
+    const frame_set wanted(wanted_frames);
+    return parse(s, [&wanted](const int id) { return wanted.contains(id); });
 }
 
-template<typename Source, typename Predicate>
+template<typename Source>
+tag parse(const Source& s, const frame_set& wanted_frames)
+{
+    tag tag{};
+    parse_frames(s, wanted_frames, tag);
+    return tag;
+}
+
+template<typename Source>
+pmr::tag parse(const Source& s, const frame_set& wanted_frames,
+    std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_frames(s, wanted_frames, tag);
+    return tag;
+}
+
+template<int Frame, int... Frames, typename Source>
+tag parse(const Source& s)
+{
+    constexpr frame_set wanted_frames{Frame, Frames...};
+    return parse(s, wanted_frames);
+}
+
+template<typename Source, typename Predicate, typename>
 tag parse(const Source& s, Predicate pred)
+{
+    tag tag{};
+    parse_frames(s, pred, [] { return false; }, tag);
+    return tag;
+}
+
+inline tag_view::tag_view(const char* tag_begin, const tag_header& header,
+    std::vector<frame> frames)
+    : tag_begin_(tag_begin)
+    , header_(header)
+    , frames_(std::move(frames))
+{}
+
+inline const tag_view::frame* tag_view::find(const int id) const noexcept
+{
+    const auto it = std::find_if(frames_.begin(), frames_.end(),
+        [id](const frame& f) { return f.id == id; });
+    return it != frames_.end() ? &*it : nullptr;
+}
+
+inline std::string_view tag_view::data(const frame& f) const noexcept
+{
+    return std::string_view(tag_begin_ + f.offset, f.size);
+}
+
+inline std::string tag_view::text(const frame& f) const
+{
+    frame_header header;
+    header.id = f.id;
+    header.flags = f.flags;
+    header.size = f.size;
+    std::string text;
+    parse_frame_data(header, tag_begin_ + f.offset, text);
+    return text;
+}
+
+template<typename Source>
+tag_view make_view(const Source& s)
 {
     static_assert(detail::is_source<Source>::value, "Source requirements not met");
 
-    // TODO consider using std::error_code instead
-    if(s.size() < 10) { throw "source must be at least 10 bytes long"; }
+    if(s.size() < 10) { return {}; }
 
     const int tag_start = find_tag_start(s);
     if(tag_start == -1) { return {}; }
 
-    const auto tag_header = parse_tag_header(&s[tag_start]);
-    tag tag;
-    tag.version = tag_header.version;
-    tag.revision = tag_header.revision;
-    tag.flags = tag_header.flags;
-    // Now parse the frames, starting after the header + extended header.
-    for(auto i = tag_start + 10 + tag_header.extended_header_size,
-             n = tag_start + std::min(int(s.size()), tag_header.size); i < n;)
+    const char* tag_begin = reinterpret_cast<const char*>(&s[tag_start]);
+    tag_header tag_header;
+    detail::source_cursor<Source> cursor;
+    if(!take_frames(s, tag_start, tag_header, cursor)) { return {}; }
+    std::vector<tag_view::frame> frames;
+    while(cursor.has(10))
     {
-        const auto frame_header = parse_frame_header(&s[i]);
-        if(is_frame_header_valid(frame_header) && pred(frame_header.id))
+        // A null byte in place of a frame id means we've reached the padding.
+        if(cursor[0] == 0) { break; }
+        const auto frame_header = parse_frame_header(cursor.data(), tag_header.version);
+        cursor.advance(10);
+        detail::source_cursor<Source> body;
+        if((frame_header.size <= 0) || !cursor.take(frame_header.size, body)) { break; }
+        if(is_frame_header_valid(frame_header))
         {
-            tag.frames.emplace_back(parse_frame_body(frame_header, &s[i+10]));
-#ifdef ATAG_ENABLE_DEBUGGING
-            std::printf("frame body:: %s\n", tag.frames.back().data.c_str());
-#endif // ATAG_ENABLE_DEBUGGING
+            frames.push_back(tag_view::frame{uint32_t(body.offset() - tag_start),
+                uint32_t(frame_header.size), frame_header.flags,
+                uint8_t(frame_header.id)});
         }
-        i += frame_header.size + 10;
     }
-    return tag;
+    return tag_view(tag_begin, tag_header, std::move(frames));
 }
 
-/** `s` must be a buffer or a pointer to a buffer starting at the frame body. */
-template<typename Source>
-void simple_parse_dispatch(const Source& s,
-    const frame_header& header, simple_tag& tag)
+/**
+ * `s` must be a buffer or a pointer to a buffer starting at the frame body, which is
+ * `size` bytes long. Returns whether the frame was parsed into `tag`.
+ */
+template<typename Source, typename SimpleTag>
+bool simple_parse_dispatch(const Source& s, const int size,
+    const frame_header& header, SimpleTag& tag)
 {
+    // All frames parsed here start with their encoding byte.
+    if(size <= 0) { return false; }
+    // Only the first value of a multi-valued text frame is kept.
+    const auto parse_text = [&header, &s](auto& field)
+    {
+        parse_frame_data(header, s, field);
+        field.resize(std::min(field.find('\0'), field.size()));
+    };
     switch(header.id) {
     case hrid::title: case hrid::original_title:
-        if(tag.title.empty())
-            tag.title = std::move(parse_frame_body(header, s).data);
-        break;
+        if(!tag.title.empty()) { return false; }
+        parse_text(tag.title);
+        return true;
     case hrid::album:
-        if(tag.album.empty())
-            tag.album = std::move(parse_frame_body(header, s).data);
-        break;
+        if(!tag.album.empty()) { return false; }
+        parse_text(tag.album);
+        return true;
     case hrid::lead_artist: case hrid::composer: case hrid::original_performer:
-        if(tag.artist.empty())
-            tag.artist = std::move(parse_frame_body(header, s).data);
-        break;
+        if(!tag.artist.empty()) { return false; }
+        parse_text(tag.artist);
+        return true;
     case hrid::year:
-        tag.year = std::atoi(&s[1]);
-        break;
+        tag.year = detail::parse_number(&s[1], size - 1);
+        return true;
     case hrid::track_number:
-        tag.track_number = std::atoi(&s[1]);
-        break;
+        tag.track_number = detail::parse_number(&s[1], size - 1);
+        return true;
     case hrid::length:
-        tag.length = std::atoi(&s[1]);
-        break;
+        tag.length = detail::parse_number(&s[1], size - 1);
+        return true;
     }
+    return false;
 }
 
-template<typename Source>
-simple_tag simple_parse(const Source& s)
+/** Parses the fields of `tag` from the tag at `tag_start`. */
+template<typename Source, typename SimpleTag>
+parse_error simple_parse_into(const Source& s, const int tag_start, SimpleTag& tag)
+{
+    detail::parse_probe probe(instrumentation::format::id3v2);
+    tag_header tag_header;
+    detail::source_cursor<Source> frames;
+    if(!take_frames(s, tag_start, tag_header, frames))
+        return probe.fail({parse_errc::invalid_header, std::size_t(tag_start)});
+    const int declared_end = tag_start + 10 + tag_header.size;
+    while(frames.has(10))
+    {
+        if(frames[0] == 0) { return {}; }
+        const auto frame_header = parse_frame_header(frames.data(), tag_header.version);
+        const std::size_t frame_offset = frames.offset();
+        frames.advance(10);
+        probe.visit(10);
+        detail::source_cursor<Source> body;
+        if((frame_header.size < 0) || !frames.take(frame_header.size, body))
+        {
+            return probe.fail(frame_error(frames, frame_header, frame_offset,
+                declared_end));
+        }
+        if(is_frame_header_valid(frame_header)
+           && simple_parse_dispatch(body.data(), int(body.size()), frame_header, tag))
+        {
+            probe.decode(body.size());
+        }
+    }
+    if(is_tag_truncated(frames, declared_end))
+        return probe.fail({parse_errc::truncated, frames.offset()});
+    return {};
+}
+
+/** Same as above, but the tag is first located in `s` (see `parse_frames`). */
+template<typename Source, typename SimpleTag>
+parse_error simple_parse_into(const Source& s, SimpleTag& tag)
 {
     static_assert(detail::is_source<Source>::value, "Source requirements not met");
 
     if(s.size() < 10) { throw "source must be at least 10 bytes long"; }
 
     const int tag_start = find_tag_start(s);
-    if(tag_start == -1) { return {}; }
+    if(tag_start == -1) { return {parse_errc::not_tagged, 0}; }
+    return simple_parse_into(s, tag_start, tag);
+}
 
-    const auto tag_header = parse_tag_header(&s[tag_start]);
-    simple_tag tag;
-    // Now parse the frames, starting after the header + extended header.
-    for(auto i = tag_start + 10 + tag_header.extended_header_size; i < tag_header.size;)
-    {
-        const auto frame_header = parse_frame_header(&s[i]);
-        if(is_frame_header_valid(frame_header))
-        {
-            simple_parse_dispatch(&s[i+10], frame_header, tag);
-        }
-        i += frame_header.size + 10;
-    }
+template<typename Source>
+simple_tag simple_parse(const Source& s)
+{
+    simple_tag tag{};
+    simple_parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+atag::pmr::simple_tag simple_parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    atag::pmr::simple_tag tag(resource);
+    simple_parse_into(s, tag);
     return tag;
 }
 
+template<typename Source>
+parse_result<simple_tag> simple_parse(const Source& s, std::nothrow_t) noexcept
+{
+    return detail::make_parse_result(simple_tag{}, [&s](simple_tag& tag) -> parse_error
+        {
+            if(s.size() < 10) { return {parse_errc::not_tagged, 0}; }
+            return simple_parse_into(s, tag);
+        });
+}
+
+template<typename Source>
+parse_result<atag::pmr::simple_tag> simple_parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept
+{
+    return detail::make_parse_result(atag::pmr::simple_tag(resource),
+        [&s](atag::pmr::simple_tag& tag) -> parse_error
+        {
+            if(s.size() < 10) { return {parse_errc::not_tagged, 0}; }
+            return simple_parse_into(s, tag);
+        });
+}
+
+template<typename Source>
+parse_result<tag> parse(const Source& s, std::nothrow_t) noexcept
+{
+    return detail::make_parse_result(tag{}, [&s](tag& tag) -> parse_error
+        {
+            if(s.size() < 10) { return {parse_errc::not_tagged, 0}; }
+            return parse_frames(s, [](int) { return true; }, [] { return false; }, tag);
+        });
+}
+
+template<typename Source>
+parse_result<pmr::tag> parse(const Source& s, std::nothrow_t,
+    std::pmr::memory_resource* resource) noexcept
+{
+    return detail::make_parse_result(pmr::tag(resource),
+        [&s](pmr::tag& tag) -> parse_error
+        {
+            if(s.size() < 10) { return {parse_errc::not_tagged, 0}; }
+            return parse_frames(s, [](int) { return true; }, [] { return false; }, tag);
+        });
+}
+
 // NOTE: this _must_ be kept in the same order as the tag::frame::id values.
 constexpr static const struct {
     int id;
@@ -372,13 +752,54 @@ constexpr static const struct {
     {tag::frame::wxxx, "WXXX", "user defined link"}
 };
 
+/**
+ * A perfect hash table over the four character frame ids in `frame_ids_`, generated at
+ * compile time: an id is hashed by multiplying its integer representation with
+ * `multiplier` and taking the top `bits` bits, which is guaranteed to map each known id
+ * to a distinct slot. The slots store the frame id + 1, so that 0 denotes an empty slot.
+ */
+struct frame_id_table
+{
+    enum { bits = 9, num_slots = 1 << bits };
+
+    uint32_t multiplier;
+    uint8_t slots[num_slots];
+
+    constexpr int slot_of(const uint32_t id) const noexcept
+    {
+        return (id * multiplier) >> (32 - bits);
+    }
+};
+
+constexpr frame_id_table make_frame_id_table() noexcept
+{
+    // Start from Knuth's multiplicative hash constant and try successive odd
+    // multipliers until there are no collisions (which takes a few dozen tries).
+    for(uint32_t multiplier = 2654435761u;; multiplier += 2)
+    {
+        frame_id_table table{multiplier, {}};
+        bool collision = false;
+        for(const auto& f : frame_ids_)
+        {
+            auto& slot = table.slots[table.slot_of(detail::fourcc(f.raw))];
+            if(slot != 0) { collision = true; break; }
+            slot = f.id + 1;
+        }
+        if(!collision) { return table; }
+    }
+}
+
+constexpr frame_id_table frame_id_table_ = make_frame_id_table();
+
 template<typename String>
 int frame_id_from_string(const String& s) noexcept
 {
-    const auto it = std::find_if(std::begin(frame_ids_), std::end(frame_ids_),
-        [&s](const auto& f) { return std::equal(f.raw, f.raw + 4, &s[0]); });
-    if(it != std::end(frame_ids_))
-        return it->id;
+    // Rather than scanning frame_ids_, look up the id's only candidate in O(1) and
+    // confirm that it's indeed the same id.
+    const auto id = detail::parse_be<uint32_t>(&s[0]);
+    const int slot = frame_id_table_.slots[frame_id_table_.slot_of(id)];
+    if((slot != 0) && (detail::fourcc(frame_ids_[slot - 1].raw) == id))
+        return slot - 1;
     else
         return -1;
 }
@@ -0,0 +1,195 @@
+#ifndef ATAG_INSTRUMENTATION_IMPL_HEADER
+#define ATAG_INSTRUMENTATION_IMPL_HEADER
+
+#include "../instrumentation.hpp"
+
+namespace atag {
+namespace detail {
+
+inline std::atomic<instrumentation::observer*>& observer_slot() noexcept
+{
+    static std::atomic<instrumentation::observer*> observer{nullptr};
+    return observer;
+}
+
+#ifdef ATAG_ENABLE_INSTRUMENTATION
+
+using instrumentation_clock = std::chrono::steady_clock;
+
+inline std::chrono::nanoseconds elapsed_since(
+    const instrumentation_clock::time_point start) noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        instrumentation_clock::now() - start);
+}
+
+/**
+ * Collects the `parse_stats` of a parser as it goes, and reports them to the observer
+ * when it goes out of scope, i.e. when the parser returns. The clock is only read if
+ * there is an observer.
+ */
+class parse_probe
+{
+    instrumentation::observer* observer_;
+    instrumentation::parse_stats stats_;
+    instrumentation_clock::time_point start_;
+
+public:
+    explicit parse_probe(const instrumentation::format f) noexcept
+        : observer_(instrumentation::get_observer())
+    {
+        stats_.tag_format = f;
+        if(observer_) { start_ = instrumentation_clock::now(); }
+    }
+
+    parse_probe(const parse_probe&) = delete;
+    parse_probe& operator=(const parse_probe&) = delete;
+
+    ~parse_probe()
+    {
+        if(observer_ == nullptr) { return; }
+        stats_.duration = elapsed_since(start_);
+        observer_->on_parse(stats_);
+    }
+
+    /** Counts a frame whose `header_size` byte header was read. */
+    void visit(const std::size_t header_size) noexcept
+    {
+        ++stats_.frames_visited;
+        stats_.bytes_read += header_size;
+    }
+
+    /** Counts a frame whose `body_size` byte body was parsed. */
+    void decode(const std::size_t body_size) noexcept
+    {
+        ++stats_.frames_decoded;
+        stats_.bytes_read += body_size;
+    }
+
+    /** Records `error` as the one at which the parser stopped, and returns it. */
+    parse_error fail(const parse_error& error) noexcept
+    {
+        stats_.error = error;
+        return error;
+    }
+};
+
+/** Reports a read of `num_bytes` from a file, which takes as long as its lifetime. */
+class read_probe
+{
+    instrumentation::observer* observer_;
+    std::size_t num_bytes_;
+    instrumentation_clock::time_point start_;
+
+public:
+    explicit read_probe(const std::size_t num_bytes) noexcept
+        : observer_(instrumentation::get_observer())
+        , num_bytes_(num_bytes)
+    {
+        if(observer_) { start_ = instrumentation_clock::now(); }
+    }
+
+    read_probe(const read_probe&) = delete;
+    read_probe& operator=(const read_probe&) = delete;
+
+    ~read_probe()
+    {
+        if(observer_) { observer_->on_read(num_bytes_, elapsed_since(start_)); }
+    }
+};
+
+/** Same as `read_probe`, but reports a conversion of `num_bytes` of text. */
+class conversion_probe
+{
+    instrumentation::observer* observer_;
+    instrumentation::conversion conversion_;
+    std::size_t num_bytes_;
+    instrumentation_clock::time_point start_;
+
+public:
+    conversion_probe(const instrumentation::conversion c,
+        const std::size_t num_bytes) noexcept
+        : observer_(instrumentation::get_observer())
+        , conversion_(c)
+        , num_bytes_(num_bytes)
+    {
+        if(observer_) { start_ = instrumentation_clock::now(); }
+    }
+
+    conversion_probe(const conversion_probe&) = delete;
+    conversion_probe& operator=(const conversion_probe&) = delete;
+
+    ~conversion_probe()
+    {
+        if(observer_)
+            observer_->on_convert(conversion_, num_bytes_, elapsed_since(start_));
+    }
+};
+
+#else // ATAG_ENABLE_INSTRUMENTATION
+
+// Without instrumentation the probes do nothing, and are optimized away entirely.
+
+struct parse_probe
+{
+    explicit parse_probe(const instrumentation::format) noexcept {}
+    void visit(const std::size_t) noexcept {}
+    void decode(const std::size_t) noexcept {}
+    parse_error fail(const parse_error& error) noexcept { return error; }
+};
+
+struct read_probe
+{
+    explicit read_probe(const std::size_t) noexcept {}
+};
+
+struct conversion_probe
+{
+    conversion_probe(const instrumentation::conversion, const std::size_t) noexcept {}
+};
+
+#endif // ATAG_ENABLE_INSTRUMENTATION
+
+} // namespace detail
+
+namespace instrumentation {
+
+inline const char* format_name(const format f) noexcept
+{
+    switch(f) {
+    case format::id3v2: return "id3v2";
+    case format::flac: return "flac";
+    case format::ape: return "ape";
+    case format::id3v1: return "id3v1";
+    case format::ogg: return "ogg";
+    case format::mp4: return "mp4";
+    case format::riff: return "riff";
+    case format::mpeg: return "mpeg";
+    default: return "unknown";
+    }
+}
+
+inline const char* conversion_name(const conversion c) noexcept
+{
+    switch(c) {
+    case conversion::iso_8859_1_to_utf8: return "iso_8859_1_to_utf8";
+    case conversion::utf16_to_utf8: return "utf16_to_utf8";
+    case conversion::utf8_to_utf16: return "utf8_to_utf16";
+    default: return "unknown";
+    }
+}
+
+inline observer* set_observer(observer* o) noexcept
+{
+    return detail::observer_slot().exchange(o, std::memory_order_acq_rel);
+}
+
+inline observer* get_observer() noexcept
+{
+    return detail::observer_slot().load(std::memory_order_acquire);
+}
+
+} // namespace instrumentation
+} // namespace atag
+
+#endif // ATAG_INSTRUMENTATION_IMPL_HEADER
@@ -0,0 +1,317 @@
+#ifndef ATAG_LIBRARY_IMPL_HEADER
+#define ATAG_LIBRARY_IMPL_HEADER
+
+#include "../library.hpp"
+#include "../../atag.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+namespace atag {
+
+inline string_pool::string_pool() : offsets_{0, 0} {}
+
+inline uint32_t string_pool::intern(const std::string_view s)
+{
+    // The empty string isn't in the hash table, as its id is fixed.
+    if(s.empty()) { return 0; }
+    if(2 * (size() + 1) > slots_.size()) { grow(); }
+    const std::size_t mask = slots_.size() - 1;
+    for(std::size_t i = std::hash<std::string_view>()(s) & mask;; i = (i + 1) & mask)
+    {
+        const uint32_t slot = slots_[i];
+        if(slot == 0)
+        {
+            const uint32_t id = size();
+            data_.insert(data_.end(), s.begin(), s.end());
+            offsets_.push_back(data_.size());
+            slots_[i] = id + 1;
+            return id;
+        }
+        if((*this)[slot-1] == s) { return slot - 1; }
+    }
+}
+
+inline void string_pool::grow()
+{
+    std::vector<uint32_t> slots(std::max<std::size_t>(16, 2 * slots_.size()));
+    const std::size_t mask = slots.size() - 1;
+    for(uint32_t id = 1; id < size(); ++id)
+    {
+        std::size_t i = std::hash<std::string_view>()((*this)[id]) & mask;
+        while(slots[i] != 0) { i = (i + 1) & mask; }
+        slots[i] = id + 1;
+    }
+    slots_ = std::move(slots);
+}
+
+inline std::vector<uint32_t> string_pool::ranks() const
+{
+    std::vector<uint32_t> ids(size());
+    std::iota(ids.begin(), ids.end(), 0);
+    std::sort(ids.begin(), ids.end(),
+        [this](const uint32_t a, const uint32_t b) { return (*this)[a] < (*this)[b]; });
+    std::vector<uint32_t> ranks(size());
+    for(uint32_t rank = 0; rank < ids.size(); ++rank) { ranks[ids[rank]] = rank; }
+    return ranks;
+}
+
+inline std::vector<uint32_t> string_pool::ranks(const collation_options& options) const
+{
+    // The keys are stored back to back, like the strings.
+    std::string keys;
+    keys.reserve(num_bytes());
+    std::vector<uint32_t> offsets(size() + 1);
+    for(uint32_t id = 0; id < size(); ++id)
+    {
+        append_sort_key((*this)[id], options, keys);
+        offsets[id+1] = keys.size();
+    }
+    const auto key = [&keys, &offsets](const uint32_t id)
+    {
+        return std::string_view(keys.data() + offsets[id], offsets[id+1] - offsets[id]);
+    };
+
+    std::vector<uint32_t> ids(size());
+    std::iota(ids.begin(), ids.end(), 0);
+    std::sort(ids.begin(), ids.end(), [&key](const uint32_t a, const uint32_t b)
+        { return compare_sort_keys(key(a), key(b)) < 0; });
+    std::vector<uint32_t> ranks(size());
+    uint32_t rank = 0;
+    for(std::size_t i = 0; i < ids.size(); ++i)
+    {
+        if((i > 0) && (compare_sort_keys(key(ids[i-1]), key(ids[i])) != 0)) { ++rank; }
+        ranks[ids[i]] = rank;
+    }
+    return ranks;
+}
+
+inline void string_pool::clear()
+{
+    data_.clear();
+    offsets_.assign({0, 0});
+    slots_.clear();
+}
+
+namespace detail {
+
+/** Maps `n` to an unsigned integer, such that the order of the integers is kept. */
+constexpr uint32_t order_preserving(const int n) noexcept
+{
+    return uint32_t(n) ^ 0x80000000u;
+}
+
+// The number of rows from which they are radix sorted rather than compared.
+enum { radix_sort_threshold = 1 << 16 };
+
+/**
+ * Sorts `keys` by their upper 32 bits with a least significant digit radix sort, one
+ * byte at a time. Since the sort is stable, and the keys are ordered by their lower 32
+ * bits to begin with (see `library::make_sort_keys`), the keys end up fully sorted.
+ */
+inline void radix_sort_upper_half(std::vector<uint64_t>& keys)
+{
+    std::vector<uint64_t> sorted(keys.size());
+    for(int shift = 32; shift < 64; shift += 8)
+    {
+        std::size_t offsets[257] = {};
+        for(const auto k : keys) { ++offsets[((k >> shift) & 0xff) + 1]; }
+        // If all keys have the same digit (e.g. the upper bytes of small ranks), they
+        // would stay where they are.
+        if(std::find(offsets + 1, offsets + 257, keys.size()) != offsets + 257)
+            continue;
+        std::partial_sum(offsets, offsets + 257, offsets);
+        for(const auto k : keys) { sorted[offsets[(k >> shift) & 0xff]++] = k; }
+        keys.swap(sorted);
+    }
+}
+
+/** Reorders `column` so that its `i`th element is the one at `rows[i]`. */
+template<typename T>
+void gather(std::vector<T>& column, const std::vector<uint32_t>& rows)
+{
+    std::vector<T> gathered(rows.size());
+    for(std::size_t i = 0; i < rows.size(); ++i) { gathered[i] = column[rows[i]]; }
+    column = std::move(gathered);
+}
+
+/** Groups the rows of the id column `ids` whose strings are in `pool` by id. */
+inline library::groups group_by_id(const std::vector<uint32_t>& ids,
+    const string_pool& pool)
+{
+    const std::vector<uint32_t> ranks = pool.ranks();
+    // Count the rows of each string, in the order of the strings, and turn the counts
+    // into the offsets of the groups.
+    std::vector<uint32_t> offsets(pool.size() + 1, 0);
+    for(const auto id : ids) { ++offsets[ranks[id] + 1]; }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    library::groups groups;
+    groups.rows.resize(ids.size());
+    std::vector<uint32_t> ends(offsets.begin(), offsets.end() - 1);
+    for(uint32_t row = 0; row < ids.size(); ++row)
+        groups.rows[ends[ranks[ids[row]]]++] = row;
+
+    // Strings that no row refers to (such as the empty string, usually) make no group.
+    std::vector<uint32_t> by_rank(ranks.size());
+    for(uint32_t id = 0; id < ranks.size(); ++id) { by_rank[ranks[id]] = id; }
+    for(uint32_t rank = 0; rank < ranks.size(); ++rank)
+    {
+        if(offsets[rank+1] == offsets[rank]) { continue; }
+        groups.ids.push_back(by_rank[rank]);
+        groups.offsets.push_back(offsets[rank]);
+    }
+    groups.offsets.push_back(ids.size());
+    return groups;
+}
+
+} // namespace detail
+
+inline void library::reserve(const std::size_t n)
+{
+    title_ids_.reserve(n);
+    album_ids_.reserve(n);
+    artist_ids_.reserve(n);
+    genres_.reserve(n);
+    track_numbers_.reserve(n);
+    lengths_.reserve(n);
+    years_.reserve(n);
+}
+
+inline void library::clear()
+{
+    titles_.clear();
+    albums_.clear();
+    artists_.clear();
+    title_ids_.clear();
+    album_ids_.clear();
+    artist_ids_.clear();
+    genres_.clear();
+    track_numbers_.clear();
+    lengths_.clear();
+    years_.clear();
+}
+
+template<typename Allocator>
+void library::push_back(const basic_simple_tag<Allocator>& tag)
+{
+    title_ids_.push_back(titles_.intern(tag.title));
+    album_ids_.push_back(albums_.intern(tag.album));
+    artist_ids_.push_back(artists_.intern(tag.artist));
+    genres_.push_back(tag.genre);
+    track_numbers_.push_back(tag.track_number);
+    lengths_.push_back(tag.length);
+    years_.push_back(tag.year);
+}
+
+inline std::vector<uint64_t> library::make_sort_keys(const std::vector<uint32_t>& ids,
+    const string_pool& pool, const collation_options* options) const
+{
+    const std::vector<uint32_t> ranks = options ? pool.ranks(*options) : pool.ranks();
+    std::vector<uint64_t> keys(size());
+    for(uint32_t row = 0; row < keys.size(); ++row)
+        keys[row] = (uint64_t(ranks[ids[row]]) << 32) | row;
+    return keys;
+}
+
+inline std::vector<uint64_t> library::make_sort_keys(
+    const std::vector<int>& numbers) const
+{
+    std::vector<uint64_t> keys(size());
+    for(uint32_t row = 0; row < keys.size(); ++row)
+        keys[row] = (uint64_t(detail::order_preserving(numbers[row])) << 32) | row;
+    return keys;
+}
+
+inline std::vector<uint64_t> library::make_sort_keys(const order::track_number&,
+    const collation_options*) const
+{
+    return make_sort_keys(track_numbers_);
+}
+
+inline std::vector<uint64_t> library::make_sort_keys(const order::title&,
+    const collation_options* options) const
+{
+    return make_sort_keys(title_ids_, titles_, options);
+}
+
+inline std::vector<uint64_t> library::make_sort_keys(const order::album&,
+    const collation_options* options) const
+{
+    return make_sort_keys(album_ids_, albums_, options);
+}
+
+inline std::vector<uint64_t> library::make_sort_keys(const order::year&,
+    const collation_options*) const
+{
+    return make_sort_keys(years_);
+}
+
+inline std::vector<uint64_t> library::make_sort_keys(const order::artist&,
+    const collation_options* options) const
+{
+    return make_sort_keys(artist_ids_, artists_, options);
+}
+
+inline std::vector<uint32_t> library::sort_rows(std::vector<uint64_t> keys)
+{
+    // Since the row is part of the key, ties are broken by row, i.e. the sort is stable.
+    if(keys.size() >= detail::radix_sort_threshold)
+        detail::radix_sort_upper_half(keys);
+    else
+        std::sort(keys.begin(), keys.end());
+    std::vector<uint32_t> rows(keys.size());
+    for(std::size_t i = 0; i < keys.size(); ++i) { rows[i] = uint32_t(keys[i]); }
+    return rows;
+}
+
+template<typename Order>
+std::vector<uint32_t> library::sorted_rows(Order order) const
+{
+    return sort_rows(make_sort_keys(order, nullptr));
+}
+
+template<typename Order>
+std::vector<uint32_t> library::sorted_rows(Order order,
+    const collation_options& options) const
+{
+    return sort_rows(make_sort_keys(order, &options));
+}
+
+template<typename Order>
+void library::sort(Order order)
+{
+    permute(sorted_rows(order));
+}
+
+template<typename Order>
+void library::sort(Order order, const collation_options& options)
+{
+    permute(sorted_rows(order, options));
+}
+
+inline void library::permute(const std::vector<uint32_t>& rows)
+{
+    detail::gather(title_ids_, rows);
+    detail::gather(album_ids_, rows);
+    detail::gather(artist_ids_, rows);
+    detail::gather(genres_, rows);
+    detail::gather(track_numbers_, rows);
+    detail::gather(lengths_, rows);
+    detail::gather(years_, rows);
+}
+
+inline library::groups library::group_by_artist() const
+{
+    return detail::group_by_id(artist_ids_, artists_);
+}
+
+inline library::groups library::group_by_album() const
+{
+    return detail::group_by_id(album_ids_, albums_);
+}
+
+} // namespace atag
+
+#endif // ATAG_LIBRARY_IMPL_HEADER
@@ -0,0 +1,211 @@
+#ifndef ATAG_METRICS_IMPL_HEADER
+#define ATAG_METRICS_IMPL_HEADER
+
+#include "../metrics.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+namespace atag {
+namespace detail {
+
+/** Returns the number of bits needed to represent `v`, i.e. 0 for 0. */
+inline int bit_width(uint64_t v) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return v == 0 ? 0 : 64 - __builtin_clzll(v);
+#else
+    int n = 0;
+    for(; v != 0; v >>= 1) { ++n; }
+    return n;
+#endif
+}
+
+} // namespace detail
+
+namespace instrumentation {
+
+// -- histogram --
+
+inline void histogram::record(const uint64_t value) noexcept
+{
+    const int i = std::min(detail::bit_width(value), num_buckets - 1);
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline uint64_t histogram::quantile(const double q) const noexcept
+{
+    // The buckets are summed rather than trusting `count_`, which may be ahead of them
+    // while values are being recorded.
+    uint64_t total = 0;
+    for(const auto& b : buckets_) { total += b.load(std::memory_order_relaxed); }
+    if(total == 0) { return 0; }
+    const uint64_t rank = std::max(uint64_t(1), uint64_t(q * double(total) + 0.5));
+    uint64_t n = 0;
+    for(auto i = 0; i < num_buckets - 1; ++i)
+    {
+        n += bucket(i);
+        if(n >= rank) { return bucket_bound(i); }
+    }
+    return std::numeric_limits<uint64_t>::max();
+}
+
+// -- metrics --
+
+inline uint64_t metrics::format_metrics::num_errors() const noexcept
+{
+    uint64_t n = 0;
+    for(const auto& e : errors) { n += e.load(std::memory_order_relaxed); }
+    return n;
+}
+
+inline void metrics::on_parse(const parse_stats& stats) noexcept
+{
+    auto& m = formats_[int(stats.tag_format)];
+    m.duration_ns.record(stats.duration.count());
+    m.bytes_read.record(stats.bytes_read);
+    m.frames_visited.fetch_add(stats.frames_visited, std::memory_order_relaxed);
+    m.frames_decoded.fetch_add(stats.frames_decoded, std::memory_order_relaxed);
+    if(stats.error)
+    {
+        const auto& code = stats.error.code;
+        const int i = (code.category() == parse_category())
+            && (code.value() > 0) && (code.value() < int(m.errors.size()))
+            ? code.value() : 0;
+        m.errors[i].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void metrics::on_read(const std::size_t num_bytes,
+    const std::chrono::nanoseconds duration) noexcept
+{
+    read_duration_ns_.record(duration.count());
+    read_bytes_.fetch_add(num_bytes, std::memory_order_relaxed);
+}
+
+inline void metrics::on_convert(const conversion c, const std::size_t num_bytes,
+    const std::chrono::nanoseconds duration) noexcept
+{
+    auto& m = conversions_[int(c)];
+    m.duration_ns.record(duration.count());
+    m.bytes.fetch_add(num_bytes, std::memory_order_relaxed);
+}
+
+template<typename Function>
+void metrics::for_each(Function f) const
+{
+    // The metrics of the same name are visited one after the other, as some formats
+    // (e.g. Prometheus) want them grouped.
+    const auto label = [](const char* key, const char* value)
+    { return std::string(key) + "=\"" + value + '"'; };
+    const auto relaxed = std::memory_order_relaxed;
+
+    std::string labels[num_formats];
+    for(auto i = 0; i < num_formats; ++i)
+        labels[i] = label("format", format_name(format(i)));
+
+    for(auto i = 0; i < num_formats; ++i)
+        f(std::string_view("atag_parse_duration_ns"), std::string_view(labels[i]),
+            formats_[i].duration_ns);
+    for(auto i = 0; i < num_formats; ++i)
+        f(std::string_view("atag_parse_bytes_read"), std::string_view(labels[i]),
+            formats_[i].bytes_read);
+    for(auto i = 0; i < num_formats; ++i)
+        f(std::string_view("atag_frames_visited_total"), std::string_view(labels[i]),
+            formats_[i].frames_visited.load(relaxed));
+    for(auto i = 0; i < num_formats; ++i)
+        f(std::string_view("atag_frames_decoded_total"), std::string_view(labels[i]),
+            formats_[i].frames_decoded.load(relaxed));
+    const char* error_names[] = {
+        "other", "not_tagged", "invalid_header", "invalid_frame", "truncated"
+    };
+    for(auto i = 0; i < num_formats; ++i)
+    {
+        for(auto e = 0; e < int(formats_[i].errors.size()); ++e)
+        {
+            const std::string l = labels[i] + ',' + label("error", error_names[e]);
+            f(std::string_view("atag_parse_errors_total"), std::string_view(l),
+                formats_[i].errors[e].load(relaxed));
+        }
+    }
+
+    f(std::string_view("atag_read_duration_ns"), std::string_view(),
+        read_duration_ns_);
+    f(std::string_view("atag_read_bytes_total"), std::string_view(),
+        read_bytes_.load(relaxed));
+
+    std::string conversion_labels[num_conversions];
+    for(auto i = 0; i < num_conversions; ++i)
+        conversion_labels[i] = label("conversion", conversion_name(conversion(i)));
+    for(auto i = 0; i < num_conversions; ++i)
+        f(std::string_view("atag_conversion_duration_ns"),
+            std::string_view(conversion_labels[i]), conversions_[i].duration_ns);
+    for(auto i = 0; i < num_conversions; ++i)
+        f(std::string_view("atag_conversion_bytes_total"),
+            std::string_view(conversion_labels[i]), conversions_[i].bytes.load(relaxed));
+}
+
+inline std::string metrics::to_prometheus() const
+{
+    std::string text;
+    std::string_view last_name;
+    const auto append_sample = [&text](const std::string_view name,
+        const std::string_view labels, const uint64_t value)
+    {
+        text.append(name.data(), name.size());
+        if(!labels.empty())
+        {
+            text += '{';
+            text.append(labels.data(), labels.size());
+            text += '}';
+        }
+        text += ' ';
+        text += std::to_string(value);
+        text += '\n';
+    };
+    for_each([&](const std::string_view name, const std::string_view labels,
+        const auto& value)
+    {
+        constexpr bool is_histogram = std::is_same<
+            std::decay_t<decltype(value)>, histogram>::value;
+        if(name != last_name)
+        {
+            text += "# TYPE ";
+            text.append(name.data(), name.size());
+            text += is_histogram ? " histogram\n" : " counter\n";
+            last_name = name;
+        }
+        if constexpr(is_histogram)
+        {
+            const std::string name_(name);
+            const std::string prefix = labels.empty()
+                ? std::string() : std::string(labels) + ',';
+            uint64_t n = 0;
+            for(auto i = 0; i < histogram::num_buckets - 1; ++i)
+            {
+                n += value.bucket(i);
+                append_sample(name_ + "_bucket",
+                    prefix + "le=\"" + std::to_string(histogram::bucket_bound(i)) + '"',
+                    n);
+            }
+            n += value.bucket(histogram::num_buckets - 1);
+            append_sample(name_ + "_bucket", prefix + "le=\"+Inf\"", n);
+            append_sample(name_ + "_sum", labels, value.sum());
+            // The count must agree with the +Inf bucket.
+            append_sample(name_ + "_count", labels, n);
+        }
+        else
+        {
+            append_sample(name, labels, value);
+        }
+    });
+    return text;
+}
+
+} // namespace instrumentation
+} // namespace atag
+
+#endif // ATAG_METRICS_IMPL_HEADER
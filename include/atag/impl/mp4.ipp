@@ -0,0 +1,252 @@
+#ifndef ATAG_MP4_IMPL_HEADER
+#define ATAG_MP4_IMPL_HEADER
+
+#include "../detail/type_traits.hpp"
+#include "../detail/io_util.hpp"
+#include "../detail/key_hash.hpp"
+#include "../instrumentation.hpp"
+#include "../mp4.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace atag {
+namespace mp4 {
+
+template<typename Byte>
+bool parse_box_header(const Byte* p, const std::size_t length, box_header& h) noexcept
+{
+    if(length < 8) { return false; }
+    h.size = atag::detail::parse_be<uint32_t>(p);
+    h.type = atag::detail::parse_be<uint32_t>(p + 4);
+    h.header_size = 8;
+    // A size of 1 means that the actual size follows the type as a 64-bit integer.
+    if(h.size == 1)
+    {
+        if(length < 16) { return false; }
+        h.size = atag::detail::parse_be<uint64_t>(p + 8);
+        h.header_size = 16;
+    }
+    return (h.size == 0) || (h.size >= uint64_t(h.header_size));
+}
+
+template<typename Source>
+bool is_tagged(const Source& s) noexcept
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+    return (s.size() >= 8) && std::equal(&s[4], &s[8], "ftyp");
+}
+
+namespace detail {
+
+using atag::detail::fourcc;
+
+// The most that is read of a box to parse its header and, for a meta box, to tell
+// where its children start (see `children_offset`).
+enum { max_header_size = 24 };
+
+/**
+ * Parses the header of the box at `offset` in `s`, which must end by `end`, the end of
+ * its parent box (or of the file), and resolves a size of 0 to `end`. Returns false if
+ * the header is invalid.
+ */
+template<typename Source>
+bool parse_box_header(const Source& s, const uint64_t offset, const uint64_t end,
+    box_header& h)
+{
+    if((offset >= end) || !mp4::parse_box_header(&s[offset], end - offset, h))
+        return false;
+    if(h.size == 0) { h.size = end - offset; }
+    return h.size <= end - offset;
+}
+
+/**
+ * Returns the offset of the first child of the box at `offset`. This is right after its
+ * header, except for iTunes style meta boxes, which are full boxes, i.e. their header
+ * is followed by 4 bytes of version and flags (unlike QuickTime style meta boxes, whose
+ * first child is the handler box).
+ */
+template<typename Source>
+uint64_t children_offset(const Source& s, const uint64_t offset, const box_header& h)
+{
+    uint64_t first = offset + h.header_size;
+    if((h.type == fourcc("meta")) && (h.size >= uint64_t(h.header_size) + 8))
+    {
+        if(atag::detail::parse_be<uint32_t>(&s[first+4]) != fourcc("hdlr"))
+            first += 4;
+    }
+    return first;
+}
+
+/**
+ * Returns the offset of the first box of `type` among the sibling boxes in
+ * [begin, end), or -1 if there is none. Only the headers of the boxes before it are
+ * read.
+ */
+template<typename Source>
+int64_t find_box(const Source& s, const uint64_t begin, const uint64_t end,
+    const uint32_t type, box_header& h)
+{
+    for(uint64_t offset = begin; offset + 8 <= end; offset += h.size)
+    {
+        if(!parse_box_header(s, offset, end, h)) { return -1; }
+        if(h.type == type) { return offset; }
+    }
+    return -1;
+}
+
+/** Finds the box at the end of `path`, starting with the children of `parent`. */
+template<typename Source, std::size_t N>
+int64_t find_path(const Source& s, uint64_t offset, const box_header& parent,
+    const uint32_t (&path)[N], box_header& h)
+{
+    uint64_t begin = children_offset(s, offset, parent);
+    uint64_t end = offset + parent.size;
+    for(const auto type : path)
+    {
+        const int64_t child = find_box(s, begin, end, type, h);
+        if(child == -1) { return -1; }
+        offset = child;
+        begin = children_offset(s, offset, h);
+        end = offset + h.size;
+    }
+    return offset;
+}
+
+/**
+ * Parses the body of the movie header (mvhd) box, of which `length` bytes are at `p`,
+ * and returns the duration of the movie in ms.
+ */
+inline int64_t parse_movie_header(const char* p, const uint64_t length) noexcept
+{
+    // Version 1 boxes have 64-bit creation and modification times and durations.
+    if(length < 20) { return 0; }
+    const bool is_64_bit = p[0] == 1;
+    if(is_64_bit && (length < 32)) { return 0; }
+    const uint32_t timescale
+        = atag::detail::parse_be<uint32_t>(p + (is_64_bit ? 20 : 12));
+    const uint64_t duration = is_64_bit ? atag::detail::parse_be<uint64_t>(p + 24)
+        : atag::detail::parse_be<uint32_t>(p + 16);
+    if(timescale == 0) { return 0; }
+    // Divided before multiplied, as a 64-bit duration times 1000 may overflow.
+    const uint64_t seconds = duration / timescale;
+    if(seconds > uint64_t(std::numeric_limits<int64_t>::max()) / 1000)
+        return std::numeric_limits<int64_t>::max();
+    return int64_t(seconds * 1000 + duration % timescale * 1000 / timescale);
+}
+
+/**
+ * Parses the items of the ilst box body of `length` bytes at `p`, which is at `offset`
+ * in the source, into `tag`.
+ */
+template<typename Tag>
+void parse_items(const char* p, const uint64_t offset, const uint64_t length, Tag& tag,
+    atag::detail::parse_probe& probe)
+{
+    box_header item;
+    for(uint64_t i = 0; i + 8 <= length; i += item.size)
+    {
+        if(!mp4::parse_box_header(p + i, length - i, item)
+           || (item.size == 0) || (item.size > length - i))
+        {
+            probe.fail({parse_errc::invalid_frame, std::size_t(offset + i)});
+            break;
+        }
+        probe.visit(item.header_size);
+        // The value is in the item's data box, after its 4 byte type indicator and 4
+        // byte locale.
+        box_header data;
+        const char* body = p + i + item.header_size;
+        const uint64_t body_length = item.size - item.header_size;
+        if(!mp4::parse_box_header(body, body_length, data)
+           || (data.type != fourcc("data")) || (data.size > body_length)
+           || (data.size < uint64_t(data.header_size) + 8))
+        {
+            continue;
+        }
+        const char* value = body + data.header_size + 8;
+        const int value_length = data.size - data.header_size - 8;
+        probe.decode(body_length);
+        switch(item.type) {
+        case fourcc("\xa9" "nam"):
+            tag.title.assign(value, value_length);
+            break;
+        case fourcc("\xa9" "alb"):
+            tag.album.assign(value, value_length);
+            break;
+        case fourcc("\xa9" "ART"):
+            tag.artist.assign(value, value_length);
+            break;
+        case fourcc("aART"):
+            tag.album_artist.assign(value, value_length);
+            break;
+        case fourcc("\xa9" "gen"):
+            tag.genre.assign(value, value_length);
+            break;
+        case fourcc("\xa9" "day"):
+            // This is usually just the year, but may be a full date.
+            tag.year = atag::detail::parse_number(value, std::min(value_length, 4));
+            break;
+        case fourcc("trkn"):
+            // Two reserved bytes, the track number and the total number of tracks.
+            if(value_length >= 4)
+                tag.track_number = atag::detail::parse_be<uint16_t>(value + 2);
+            break;
+        }
+    }
+}
+
+} // namespace detail
+
+template<typename Source, typename Tag>
+void parse_into(const Source& s, Tag& tag)
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+
+    if(!is_tagged(s)) { return; }
+
+    atag::detail::parse_probe probe(instrumentation::format::mp4);
+    using detail::fourcc;
+    box_header moov;
+    const int64_t moov_offset = detail::find_box(s, 0, s.size(), fourcc("moov"), moov);
+    if(moov_offset == -1) { return; }
+
+    box_header h;
+    const int64_t mvhd = detail::find_path(s, moov_offset, moov, {fourcc("mvhd")}, h);
+    if(mvhd != -1)
+    {
+        tag.length = detail::parse_movie_header(
+            reinterpret_cast<const char*>(&s[mvhd + h.header_size]),
+            h.size - h.header_size);
+    }
+
+    const int64_t ilst = detail::find_path(s, moov_offset, moov,
+        {fourcc("udta"), fourcc("meta"), fourcc("ilst")}, h);
+    if(ilst != -1)
+    {
+        const uint64_t body_offset = ilst + h.header_size;
+        detail::parse_items(reinterpret_cast<const char*>(&s[body_offset]), body_offset,
+            h.size - h.header_size, tag, probe);
+    }
+}
+
+template<typename Source>
+tag parse(const Source& s)
+{
+    tag tag{};
+    parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_into(s, tag);
+    return tag;
+}
+
+} // namespace mp4
+} // namespace atag
+
+#endif // ATAG_MP4_IMPL_HEADER
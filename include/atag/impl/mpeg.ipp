@@ -0,0 +1,335 @@
+#ifndef ATAG_MPEG_IMPL_HEADER
+#define ATAG_MPEG_IMPL_HEADER
+
+#include "../mpeg.hpp"
+#include "../detail/io_util.hpp"
+#include "../detail/simd.hpp"
+#include "../instrumentation.hpp"
+#include "../../atag.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace atag {
+namespace mpeg {
+
+template<typename Byte>
+bool parse_frame_header(const Byte* p, frame_header& h) noexcept
+{
+    // Indexed by [version == mpeg1 ? layer - 1 : 3 + (layer == 1 ? 0 : 1)].
+    constexpr static const uint16_t bitrates[5][15] = {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+    };
+    constexpr static const uint16_t sample_rates[3][3] = {
+        {44100, 48000, 32000},
+        {22050, 24000, 16000},
+        {11025, 12000, 8000},
+    };
+
+    const auto b1 = uint8_t(p[1]);
+    const auto b2 = uint8_t(p[2]);
+    const auto b3 = uint8_t(p[3]);
+    if((uint8_t(p[0]) != 0xff) || ((b1 & 0xe0) != 0xe0)) { return false; }
+
+    const int version_bits = (b1 >> 3) & 0b11;
+    const int layer_bits = (b1 >> 1) & 0b11;
+    const int bitrate_index = b2 >> 4;
+    const int sample_rate_index = (b2 >> 2) & 0b11;
+    // Reject the reserved values, which also rules out most false syncs. A bitrate index
+    // of 0 means free format.
+    if((version_bits == 0b01) || (layer_bits == 0) || (bitrate_index == 0)
+       || (bitrate_index == 0b1111) || (sample_rate_index == 0b11)
+       || ((b3 & 0b11) == 0b10))
+    {
+        return false;
+    }
+
+    h.version = version_bits == 0b11 ? frame_header::mpeg1
+        : version_bits == 0b10 ? frame_header::mpeg2 : frame_header::mpeg2_5;
+    h.layer = 4 - layer_bits;
+    h.bitrate = bitrates[h.version == frame_header::mpeg1
+        ? h.layer - 1 : (h.layer == 1 ? 3 : 4)][bitrate_index];
+    h.sample_rate = sample_rates[h.version][sample_rate_index];
+    h.num_channels = (b3 >> 6) == 0b11 ? 1 : 2;
+    h.samples_per_frame = h.layer == 1 ? 384
+        : (h.layer == 3) && (h.version != frame_header::mpeg1) ? 576 : 1152;
+
+    const int padding = (b2 >> 1) & 1;
+    if(h.layer == 1)
+        h.size = (12 * h.bitrate * 1000 / h.sample_rate + padding) * 4;
+    else
+        h.size = h.samples_per_frame / 8 * h.bitrate * 1000 / h.sample_rate + padding;
+    return true;
+}
+
+inline int find_sync(const char* p, const int length) noexcept
+{
+    int i = 0;
+    // Compare each byte with 0xff and, shifted by one, the next byte's top 3 bits with
+    // 0xe0. As soon as a block has a match, the scalar loop below pinpoints it.
+#if defined(ATAG_HAS_AVX2)
+    const __m256i ff32 = _mm256_set1_epi8(char(0xff));
+    const __m256i e0_32 = _mm256_set1_epi8(char(0xe0));
+    for(; i + 33 <= length; i += 32)
+    {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 1));
+        const __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(a, ff32),
+            _mm256_cmpeq_epi8(_mm256_and_si256(b, e0_32), e0_32));
+        if(_mm256_movemask_epi8(match) != 0) { break; }
+    }
+#endif
+#if defined(ATAG_HAS_SSE2)
+    const __m128i ff = _mm_set1_epi8(char(0xff));
+    const __m128i e0 = _mm_set1_epi8(char(0xe0));
+    for(; i + 17 <= length; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+        const __m128i match = _mm_and_si128(_mm_cmpeq_epi8(a, ff),
+            _mm_cmpeq_epi8(_mm_and_si128(b, e0), e0));
+        if(_mm_movemask_epi8(match) != 0) { break; }
+    }
+#endif
+    for(; i + 1 < length; ++i)
+    {
+        if((uint8_t(p[i]) == 0xff) && ((uint8_t(p[i+1]) & 0xe0) == 0xe0)) { return i; }
+    }
+    return -1;
+}
+
+namespace detail {
+
+// The most data that is fetched at once while looking for or walking frames.
+enum { window_size = 64 * 1024 };
+
+/** Returns the size of the side information, which follows the frame header. */
+inline int side_info_size(const frame_header& h) noexcept
+{
+    if(h.version == frame_header::mpeg1) { return h.num_channels == 1 ? 17 : 32; }
+    return h.num_channels == 1 ? 9 : 17;
+}
+
+/**
+ * Tests whether the first frame, at `frame` in a contiguous buffer of `length` bytes,
+ * holds a Xing/Info or VBRI header, and if so, sets the total number of frames and bytes
+ * of the stream (the latter to 0 if it's not given).
+ */
+inline bool parse_vbr_header(const char* frame, const int length, const frame_header& h,
+    int& num_frames, int& num_bytes) noexcept
+{
+    // Xing (VBR) and Info (CBR) headers are written by LAME and most other encoders in
+    // place of the audio data of an empty Layer III frame.
+    const int xing = 4 + side_info_size(h);
+    if((h.layer == 3) && (xing + 16 <= length)
+       && (std::equal(frame + xing, frame + xing + 4, "Xing")
+           || std::equal(frame + xing, frame + xing + 4, "Info")))
+    {
+        enum { has_frames = 1, has_bytes = 2 };
+        const auto flags = atag::detail::parse_be<uint32_t>(frame + xing + 4);
+        if(!(flags & has_frames)) { return false; }
+        num_frames = atag::detail::parse_be<int>(frame + xing + 8);
+        num_bytes = (flags & has_bytes)
+            ? atag::detail::parse_be<int>(frame + xing + 12) : 0;
+        return num_frames > 0;
+    }
+    // VBRI headers (written by the Fraunhofer encoder) are always 32 bytes after the
+    // frame header.
+    const int vbri = 4 + 32;
+    if((vbri + 18 <= length) && std::equal(frame + vbri, frame + vbri + 4, "VBRI"))
+    {
+        num_bytes = atag::detail::parse_be<int>(frame + vbri + 10);
+        num_frames = atag::detail::parse_be<int>(frame + vbri + 14);
+        return num_frames > 0;
+    }
+    return false;
+}
+
+/**
+ * Finds the byte range of the audio in `s`, which follows the ID3v2 tag, if any, and
+ * precedes the tags at the end of the file.
+ */
+template<typename Source>
+bool find_audio(Source& s, std::size_t& begin, std::size_t& end, std::error_code& error)
+{
+    const std::size_t size = s.size();
+    if(size < 14) { return false; }
+    // An ID3v2 header (with the size of its extended header) and the tags at the end,
+    // i.e. an ID3v1 tag preceded by an APE footer or an ID3v2 footer.
+    const std::size_t tail_size = std::min<std::size_t>(size, 128 + 32);
+    if((!atag::detail::fetch(s, 0, 14, error)
+        || !atag::detail::fetch(s, size - tail_size, tail_size, error)) && error)
+    {
+        return false;
+    }
+
+    const tag_layout layout = detect(s);
+    begin = 0;
+    end = size;
+    if(layout.id3v2 == 0)
+    {
+        const auto header = id3v2::parse_tag_header(&s[0]);
+        begin = 10 + std::max(header.size, 0);
+        if(header.flags & id3v2::tag::has_footer) { begin += 10; }
+    }
+    else if(layout.id3v2 > 0)
+    {
+        end = layout.id3v2;
+    }
+    if(layout.id3v1 != -1) { end = std::min<std::size_t>(end, layout.id3v1); }
+    if(layout.ape > 0)
+    {
+        // The footer tells where the tag begins.
+        const auto h = ape::parse_header(&s[layout.ape]);
+        const int64_t items = ape::items_offset(h, layout.ape);
+        const int64_t ape_start = items
+            - ((h.flags & ape::header::contains_header) ? ape::header::size : 0);
+        if(ape_start >= 0) { end = std::min<std::size_t>(end, ape_start); }
+    }
+    return begin < end;
+}
+
+/**
+ * Returns the offset of the first frame in [begin, end), or -1 if none is found within
+ * the first `window_size` bytes. To tell a frame from a false sync, the frame following
+ * it must also be valid (if it's within the window).
+ */
+template<typename Source>
+int find_first_frame(Source& s, const std::size_t begin, const std::size_t end,
+    frame_header& h, std::error_code& error)
+{
+    const int length = std::min<std::size_t>(end - begin, window_size);
+    if(!atag::detail::fetch(s, begin, length, error) && error) { return -1; }
+    const char* window = &s[begin];
+    for(int i = 0; i + 4 <= length; ++i)
+    {
+        const int sync = find_sync(window + i, length - i);
+        if(sync == -1) { break; }
+        i += sync;
+        if(i + 4 > length) { break; }
+        if(!parse_frame_header(window + i, h)) { continue; }
+        frame_header next;
+        const int n = i + h.size;
+        if((n + 4 > length) || (parse_frame_header(window + n, next)
+            && (next.version == h.version) && (next.layer == h.layer)
+            && (next.sample_rate == h.sample_rate)))
+        {
+            return begin + i;
+        }
+    }
+    return -1;
+}
+
+} // namespace detail
+
+template<typename Source>
+bool read_properties(Source& s, properties& p, std::error_code& error,
+    const scan_options& options)
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+
+    atag::detail::parse_probe probe(instrumentation::format::mpeg);
+    std::size_t begin;
+    std::size_t end;
+    if(!detail::find_audio(s, begin, end, error))
+    {
+        if(error) { probe.fail({error, 0}); }
+        return false;
+    }
+
+    frame_header first;
+    const int first_offset = detail::find_first_frame(s, begin, end, first, error);
+    if(first_offset == -1)
+    {
+        if(error) { probe.fail({error, begin}); }
+        return false;
+    }
+    // The audio is assumed to extend from the first frame to the end.
+    const std::size_t audio_size = end - first_offset;
+
+    p.sample_rate = first.sample_rate;
+    p.num_channels = first.num_channels;
+
+    int num_frames = 0;
+    int num_bytes = 0;
+    const int first_length = std::min<std::size_t>(first.size, end - first_offset);
+    if(!atag::detail::fetch(s, first_offset, first_length, error) && error)
+    {
+        probe.fail({error, std::size_t(first_offset)});
+        return false;
+    }
+    if(detail::parse_vbr_header(&s[first_offset], first_length, first,
+        num_frames, num_bytes))
+    {
+        probe.visit(4);
+        probe.decode(first_length);
+        const int64_t length = int64_t(num_frames) * first.samples_per_frame * 1000
+            / first.sample_rate;
+        p.length = atag::detail::clamp_length(length);
+        if(num_bytes <= 0) { num_bytes = audio_size; }
+        p.bitrate = length > 0 ? int64_t(num_bytes) * 8 / length : 0;
+        p.is_exact = true;
+        return true;
+    }
+
+    // Walk the frames, fetching a window at a time, and resynchronize on the next frame
+    // sync if the stream is corrupt.
+    const bool is_exact = options.mode == scan_mode::exact;
+    int64_t num_samples = 0;
+    int64_t bitrate_sum = 0;
+    num_frames = 0;
+    std::size_t window_end = first_offset;
+    for(std::size_t offset = first_offset;
+        (offset + 4 <= end) && (is_exact || (num_frames < options.num_frames));)
+    {
+        if(offset + 4 > window_end)
+        {
+            const std::size_t length = std::min<std::size_t>(end - offset,
+                detail::window_size);
+            if(!atag::detail::fetch(s, offset, length, error) && error)
+            {
+                probe.fail({error, offset});
+                return false;
+            }
+            window_end = offset + length;
+        }
+        frame_header h;
+        if(parse_frame_header(&s[offset], h))
+        {
+            probe.visit(4);
+            ++num_frames;
+            num_samples += h.samples_per_frame;
+            bitrate_sum += h.bitrate;
+            offset += h.size;
+            continue;
+        }
+        const int sync = find_sync(&s[offset+1], window_end - offset - 1);
+        // Without a sync in the window, its last byte may still start one.
+        offset = sync == -1 ? std::max(offset + 1, window_end - 1) : offset + 1 + sync;
+    }
+    if(num_frames == 0) { return false; }
+
+    if(is_exact)
+    {
+        const int64_t length = num_samples * 1000 / first.sample_rate;
+        p.length = atag::detail::clamp_length(length);
+        p.bitrate = length > 0 ? int64_t(audio_size) * 8 / length : 0;
+    }
+    else
+    {
+        // bytes * 8 / kbit/s gives ms.
+        p.bitrate = bitrate_sum / num_frames;
+        p.length = atag::detail::clamp_length(int64_t(audio_size) * 8 / p.bitrate);
+    }
+    p.is_exact = is_exact;
+    return true;
+}
+
+} // namespace mpeg
+} // namespace atag
+
+#endif // ATAG_MPEG_IMPL_HEADER
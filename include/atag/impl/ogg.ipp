@@ -0,0 +1,265 @@
+#ifndef ATAG_OGG_IMPL_HEADER
+#define ATAG_OGG_IMPL_HEADER
+
+#include "../detail/type_traits.hpp"
+#include "../detail/io_util.hpp"
+#include "../instrumentation.hpp"
+#include "../ogg.hpp"
+#include "../vorbis.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace atag {
+namespace ogg {
+
+template<typename Byte>
+bool parse_page_header(const Byte* p, const std::size_t length, page_header& h) noexcept
+{
+    // The stream structure version, after the capture pattern, must be 0.
+    if((length < page_header::min_size) || !std::equal(p, p + 4, "OggS") || (p[4] != 0))
+        return false;
+
+    h.flags = uint8_t(p[5]);
+    h.granule_position = atag::detail::parse_le<int64_t>(p + 6);
+    h.serial_number = atag::detail::parse_le<uint32_t>(p + 14);
+    h.sequence_number = atag::detail::parse_le<uint32_t>(p + 18);
+    h.num_segments = uint8_t(p[26]);
+    if(length < std::size_t(h.size())) { return false; }
+
+    h.body_size = 0;
+    for(auto i = 0; i < h.num_segments; ++i) { h.body_size += uint8_t(p[27 + i]); }
+    return true;
+}
+
+template<typename Source>
+bool is_tagged(const Source& s) noexcept
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+    return (s.size() >= page_header::min_size) && std::equal(&s[0], &s[4], "OggS");
+}
+
+namespace detail {
+
+/**
+ * Walks the pages of the logical bitstream whose first page starts `s` (skipping the
+ * pages of any other bitstream multiplexed with it), and reassembles its first
+ * `num_packets` packets: `f(packet, data, length)` is invoked with each part of a packet
+ * that is on a single page, in order, where `packet` is the index of the packet. No
+ * pages are read past the end of the last packet.
+ *
+ * Returns false if `s` ends, or a page is invalid, before the last packet is complete.
+ */
+template<typename Source, typename Function>
+bool read_packets(const Source& s, const int num_packets, Function f)
+{
+    const std::size_t size = s.size();
+    page_header h;
+    if(!parse_page_header(&s[0], size, h)) { return false; }
+    const uint32_t serial_number = h.serial_number;
+    int packet = 0;
+    for(std::size_t offset = 0;;)
+    {
+        const std::size_t body_offset = offset + h.size();
+        if(body_offset + h.body_size > size) { return false; }
+        if(h.serial_number == serial_number)
+        {
+            const char* body = reinterpret_cast<const char*>(&s[body_offset]);
+            // A packet ends with the first lacing value that is less than 255.
+            int begin = 0;
+            int end = 0;
+            for(auto i = 0; i < h.num_segments; ++i)
+            {
+                const int lacing = uint8_t(s[offset + page_header::min_size + i]);
+                end += lacing;
+                if(lacing < 255)
+                {
+                    f(packet, body + begin, end - begin);
+                    begin = end;
+                    if(++packet == num_packets) { return true; }
+                }
+            }
+            if(begin < end) { f(packet, body + begin, end - begin); }
+        }
+        offset = body_offset + h.body_size;
+        if((offset >= size) || !parse_page_header(&s[offset], size - offset, h))
+            return false;
+    }
+}
+
+/**
+ * Returns the offset of the last page of the bitstream identified by `serial_number`
+ * on which a packet ends, and parses its header into `h`, or returns -1 if there is no
+ * such page in the last `search_length` bytes of `s`. Pages with a negative or
+ * implausibly large granule position are skipped. Only the bytes from the found page to
+ * the end of `s` are read.
+ */
+template<typename Source>
+int64_t find_last_page(const Source& s, const uint32_t serial_number,
+    const std::size_t search_length, page_header& h)
+{
+    const std::size_t size = s.size();
+    if(size < page_header::min_size) { return -1; }
+    const std::size_t begin = size - std::min(size, search_length);
+    for(std::size_t i = size - page_header::min_size + 1; i-- > begin;)
+    {
+        if((s[i] == 'O') && parse_page_header(&s[i], size - i, h)
+           && (h.serial_number == serial_number) && (h.granule_position >= 0)
+           && (h.granule_position <= page_header::max_granule_position))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Parses the identification header, i.e. the first packet, of a Vorbis or Opus stream,
+ * of which `length` bytes are at `p`.
+ */
+template<typename Tag>
+void parse_identification_header(const char* p, const int length, Tag& tag,
+    int& pre_skip) noexcept
+{
+    pre_skip = 0;
+    // https://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-630004.2.2
+    if((length >= 16) && std::equal(p, p + 7, "\x01vorbis"))
+    {
+        tag.codec = codec::vorbis;
+        tag.num_channels = uint8_t(p[11]);
+        tag.sample_rate = atag::detail::parse_le<uint32_t>(p + 12);
+    }
+    // https://datatracker.ietf.org/doc/html/rfc7845#section-5.1
+    else if((length >= 16) && std::equal(p, p + 8, "OpusHead"))
+    {
+        tag.codec = codec::opus;
+        tag.num_channels = uint8_t(p[9]);
+        pre_skip = atag::detail::parse_le<uint16_t>(p + 10);
+        tag.sample_rate = atag::detail::parse_le<uint32_t>(p + 12);
+        if(tag.sample_rate == 0) { tag.sample_rate = 48000; }
+    }
+}
+
+/**
+ * Strips the packet type and magic signature of the comment header packet in `packet`,
+ * and returns its codec, or `codec::unknown` if it's not a Vorbis or Opus comment
+ * header.
+ */
+template<typename String>
+codec strip_comment_header(String& packet)
+{
+    if((packet.size() >= 7) && (packet.compare(0, 7, "\x03vorbis") == 0))
+    {
+        packet.erase(0, 7);
+        return codec::vorbis;
+    }
+    if((packet.size() >= 8) && (packet.compare(0, 8, "OpusTags") == 0))
+    {
+        packet.erase(0, 8);
+        return codec::opus;
+    }
+    packet.clear();
+    return codec::unknown;
+}
+
+} // namespace detail
+
+template<typename Source, typename String>
+codec read_comments(const Source& s, String& comments)
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+
+    comments.clear();
+    if(!is_tagged(s)) { return codec::unknown; }
+    const bool is_complete = detail::read_packets(s, 2,
+        [&comments](const int packet, const char* data, const int length)
+        { if(packet == 1) { comments.append(data, length); } });
+    if(!is_complete)
+    {
+        comments.clear();
+        return codec::unknown;
+    }
+    return detail::strip_comment_header(comments);
+}
+
+template<typename Source, typename Tag>
+void parse_into(const Source& s, Tag& tag)
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+
+    if(!is_tagged(s)) { return; }
+
+    atag::detail::parse_probe probe(instrumentation::format::ogg);
+    // Only the first few bytes of the identification header are needed, but all of the
+    // comment header, which is copied as it may be split across pages.
+    std::array<char, 16> identification;
+    int identification_length = 0;
+    typename Tag::string_type comments(tag.title.get_allocator());
+    int num_packets = 0;
+    const bool is_complete = detail::read_packets(s, 2,
+        [&](const int packet, const char* data, const int length)
+        {
+            // Packets have no header of their own, their lacing values are the page's.
+            if(packet == num_packets)
+            {
+                ++num_packets;
+                probe.visit(0);
+            }
+            if(packet == 1)
+            {
+                comments.append(data, length);
+                return;
+            }
+            const int n = std::min<int>(length,
+                identification.size() - identification_length);
+            std::copy(data, data + n, identification.begin() + identification_length);
+            identification_length += n;
+        });
+
+    if(!is_complete) { probe.fail({parse_errc::truncated, s.size()}); }
+
+    int pre_skip;
+    detail::parse_identification_header(identification.data(), identification_length,
+        tag, pre_skip);
+    if(tag.codec == codec::unknown) { return; }
+    probe.decode(identification_length);
+
+    if(is_complete && (detail::strip_comment_header(comments) == tag.codec))
+    {
+        probe.decode(comments.size());
+        vorbis::detail::parse_fields(comments.data(), comments.size(), tag);
+    }
+
+    // Both Vorbis and Opus granule positions count samples, at 48 kHz for Opus.
+    const uint32_t serial_number = atag::detail::parse_le<uint32_t>(&s[14]);
+    const int sample_rate = tag.codec == codec::opus ? 48000 : tag.sample_rate;
+    page_header last;
+    if((sample_rate > 0) && (detail::find_last_page(s, serial_number,
+        page_header::max_page_size, last) != -1))
+    {
+        // Divided before multiplied, so that even the largest granule can't overflow.
+        const int64_t n = std::max<int64_t>(last.granule_position - pre_skip, 0);
+        tag.length = n / sample_rate * 1000 + n % sample_rate * 1000 / sample_rate;
+    }
+}
+
+template<typename Source>
+tag parse(const Source& s)
+{
+    tag tag{};
+    parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_into(s, tag);
+    return tag;
+}
+
+} // namespace ogg
+} // namespace atag
+
+#endif // ATAG_OGG_IMPL_HEADER
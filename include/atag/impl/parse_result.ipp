@@ -0,0 +1,55 @@
+#ifndef ATAG_PARSE_RESULT_IMPL_HEADER
+#define ATAG_PARSE_RESULT_IMPL_HEADER
+
+#include "../parse_result.hpp"
+
+#include <new>
+#include <string>
+
+namespace atag {
+namespace detail {
+
+struct parse_category_impl : public std::error_category
+{
+    const char* name() const noexcept override { return "atag"; }
+
+    std::string message(const int e) const override
+    {
+        switch(parse_errc(e)) {
+        case parse_errc::not_tagged: return "source is not tagged";
+        case parse_errc::invalid_header: return "invalid tag header";
+        case parse_errc::invalid_frame: return "invalid frame";
+        case parse_errc::truncated: return "tag is truncated";
+        default: return "unknown error";
+        }
+    }
+};
+
+template<typename Tag, typename Parse>
+parse_result<Tag> make_parse_result(Tag tag, Parse parse) noexcept
+{
+    // The tag is moved into the result, which doesn't allocate, so only the parsing
+    // itself may throw.
+    try
+    {
+        const parse_error error = parse(tag);
+        return parse_result<Tag>(std::move(tag), error);
+    }
+    catch(const std::bad_alloc&)
+    {
+        return parse_result<Tag>(std::move(tag),
+            {std::make_error_code(std::errc::not_enough_memory), 0});
+    }
+}
+
+} // namespace detail
+
+inline const std::error_category& parse_category() noexcept
+{
+    static const detail::parse_category_impl category;
+    return category;
+}
+
+} // namespace atag
+
+#endif // ATAG_PARSE_RESULT_IMPL_HEADER
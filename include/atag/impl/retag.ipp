@@ -0,0 +1,142 @@
+#ifndef ATAG_RETAG_IMPL_HEADER
+#define ATAG_RETAG_IMPL_HEADER
+
+#include "../retag.hpp"
+#include "../file_source.hpp"
+#include "../detail/key_hash.hpp"
+#include "../detail/thread_pool.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace atag {
+namespace detail {
+
+/**
+ * Replaces the frames with `id` in `tag` with a text frame holding `value`, if any,
+ * unless `is_unchanged` returns true for the data of the first of them, i.e. it already
+ * holds `value` as read by `simple_parse`, so that e.g. the other values of a
+ * multi-valued frame are kept.
+ */
+template<typename Predicate>
+void set_text_frame(id3v2::tag& tag, const int id, const std::string& value,
+    Predicate is_unchanged)
+{
+    const auto it = std::find_if(tag.frames.begin(), tag.frames.end(),
+        [id](const id3v2::tag::frame& f) { return f.id == id; });
+    if((it != tag.frames.end()) ? is_unchanged(it->data) : value.empty()) { return; }
+    tag.frames.erase(std::remove_if(tag.frames.begin(), tag.frames.end(),
+        [id](const id3v2::tag::frame& f) { return f.id == id; }), tag.frames.end());
+    if(value.empty()) { return; }
+    tag.frames.emplace_back();
+    auto& frame = tag.frames.back();
+    frame.id = id;
+    frame.flags = 0;
+    frame.encoding = id3v2::utf8;
+    frame.data = value;
+}
+
+inline void set_text_frame(id3v2::tag& tag, const int id, const std::string& value)
+{
+    set_text_frame(tag, id, value, [&value](const std::string& data)
+        { return data.compare(0, data.find('\0'), value) == 0; });
+}
+
+/** Same as above, but for a numeric frame, such as the track number "3/12". */
+inline void set_number_frame(id3v2::tag& tag, const int id, const int n)
+{
+    set_text_frame(tag, id, n > 0 ? std::to_string(n) : std::string(),
+        [n](const std::string& data)
+        { return detail::parse_number(data.data(), int(data.size())) == n; });
+}
+
+inline void apply_simple_tag(const simple_tag& from, id3v2::tag& to)
+{
+    set_text_frame(to, id3v2::title, from.title);
+    set_text_frame(to, id3v2::album, from.album);
+    set_text_frame(to, id3v2::lead_artist, from.artist);
+    set_number_frame(to, id3v2::year, from.year);
+    set_number_frame(to, id3v2::track_number, from.track_number);
+}
+
+inline void apply_simple_tag(const simple_tag& from, flac::tag& to)
+{
+    to.title = from.title;
+    to.album = from.album;
+    to.artist = from.artist;
+    to.year = from.year;
+    to.track_number = from.track_number;
+}
+
+} // namespace detail
+
+inline retag_result retag(const retag_job& job, const padding_policy& policy)
+{
+    retag_result result;
+    result.path = job.path;
+
+    file_source source;
+    source.open(job.path, result.error);
+    if(result.error || !prefetch_tags(source, result.error, flac_blocks::parsed))
+    {
+        return result;
+    }
+
+    const std::string& path = job.path;
+    const auto is_mp3 = [&path]
+    {
+        const std::size_t dot = path.rfind('.');
+        return (dot != std::string::npos)
+            && detail::key_equals(&path[dot], path.size() - dot, ".mp3");
+    };
+    try
+    {
+        const bool has_id3v2 = (source.size() >= 10) && id3v2::is_tagged(source);
+        if(flac::is_tagged(source))
+        {
+            flac::tag tag = flac::parse(source);
+            detail::apply_simple_tag(job.tag, tag);
+            source.close();
+            result.in_place = flac::write(path, tag, policy, result.error);
+        }
+        else if(has_id3v2 || is_mp3())
+        {
+            id3v2::tag tag{};
+            if(has_id3v2) { tag = id3v2::parse(source); }
+            detail::apply_simple_tag(job.tag, tag);
+            source.close();
+            result.in_place = id3v2::write(path, tag, policy, result.error);
+        }
+        else
+        {
+            result.error = std::make_error_code(std::errc::operation_not_supported);
+        }
+    }
+    catch(...)
+    {
+        // The existing tag is malformed, and overwriting it could lose data.
+        result.error = std::make_error_code(std::errc::illegal_byte_sequence);
+    }
+    return result;
+}
+
+template<typename Callback>
+void retag(const std::vector<retag_job>& jobs, const retag_options& options,
+    Callback callback)
+{
+    const std::size_t num_workers = options.concurrency > 0
+        ? options.concurrency : std::max(1u, std::thread::hardware_concurrency());
+    // Jobs are only referred to, and a worker picks up the next one as soon as it's
+    // done, so at most `num_workers` files are in flight.
+    detail::work_stealing_pool<const retag_job*> pool(num_workers, num_workers,
+        [&callback, &options](const retag_job*& job, const std::size_t)
+        {
+            callback(retag(*job, options.padding));
+        });
+    for(const auto& job : jobs) { pool.submit(&job); }
+    pool.finish();
+}
+
+} // namespace atag
+
+#endif // ATAG_RETAG_IMPL_HEADER
@@ -0,0 +1,248 @@
+#ifndef ATAG_RIFF_IMPL_HEADER
+#define ATAG_RIFF_IMPL_HEADER
+
+#include "../detail/type_traits.hpp"
+#include "../detail/io_util.hpp"
+#include "../detail/key_hash.hpp"
+#include "../instrumentation.hpp"
+#include "../riff.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace atag {
+namespace riff {
+
+template<typename Source>
+bool is_tagged(const Source& s) noexcept
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+    if(s.size() < 12) { return false; }
+    if(std::equal(&s[0], &s[4], "RIFF")) { return std::equal(&s[8], &s[12], "WAVE"); }
+    return std::equal(&s[0], &s[4], "FORM")
+        && (std::equal(&s[8], &s[12], "AIFF") || std::equal(&s[8], &s[12], "AIFC"));
+}
+
+namespace detail {
+
+using atag::detail::fourcc;
+
+/** Tests whether `s`, which must be tagged, is an AIFF file, i.e. big endian. */
+template<typename Source>
+bool is_big_endian(const Source& s) noexcept { return s[0] == 'F'; }
+
+/**
+ * Returns the end of the chunks of `s`, which must be tagged, i.e. the end of its
+ * outermost (RIFF or FORM) chunk, or of `s`, if that's sooner.
+ */
+template<typename Source>
+uint64_t chunks_end(const Source& s) noexcept
+{
+    const uint64_t size = is_big_endian(s) ? atag::detail::parse_be<uint32_t>(&s[4])
+        : atag::detail::parse_le<uint32_t>(&s[4]);
+    return std::min<uint64_t>(s.size(), 8 + size);
+}
+
+/**
+ * Parses the header of the chunk at `offset` in `s`. Returns false if it's not before
+ * `end` (see `chunks_end`).
+ */
+template<typename Source>
+bool parse_chunk_header(const Source& s, const uint64_t offset, const uint64_t end,
+    chunk_header& h) noexcept
+{
+    if(offset + 8 > end) { return false; }
+    h.id = atag::detail::parse_be<uint32_t>(&s[offset]);
+    h.size = is_big_endian(s) ? atag::detail::parse_be<uint32_t>(&s[offset+4])
+        : atag::detail::parse_le<uint32_t>(&s[offset+4]);
+    return true;
+}
+
+/** Returns the offset of the chunk that follows the chunk at `offset`. */
+inline uint64_t next_chunk(const uint64_t offset, const chunk_header& h) noexcept
+{
+    return offset + 8 + h.size + (h.size & 1);
+}
+
+/**
+ * Tests whether the body of a chunk is read, i.e. whether it holds metadata, the
+ * format of the audio, or an embedded ID3v2 tag.
+ */
+constexpr bool is_metadata_chunk(const uint32_t id) noexcept
+{
+    switch(id) {
+    case fourcc("LIST"): case fourcc("bext"): case fourcc("fmt "): case fourcc("COMM"):
+    case fourcc("NAME"): case fourcc("AUTH"): case fourcc("ANNO"):
+    case fourcc("id3 "): case fourcc("ID3 "):
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** Assigns the text of `length` bytes at `p`, up to the first null byte, to `s`. */
+template<typename String>
+void assign_text(String& s, const char* p, const std::size_t length)
+{
+    s.assign(p, std::find(p, p + length, '\0'));
+}
+
+/** Parses the subchunks of an INFO list, which follow the list type, into `tag`. */
+template<typename Tag>
+void parse_info(const char* p, const uint64_t length, Tag& tag)
+{
+    for(uint64_t i = 0; i + 8 <= length;)
+    {
+        const uint32_t id = atag::detail::parse_be<uint32_t>(p + i);
+        const uint32_t size = atag::detail::parse_le<uint32_t>(p + i + 4);
+        if(size > length - i - 8) { break; }
+        const char* text = p + i + 8;
+        switch(id) {
+        case fourcc("INAM"): assign_text(tag.title, text, size); break;
+        case fourcc("IPRD"): assign_text(tag.album, text, size); break;
+        case fourcc("IART"): assign_text(tag.artist, text, size); break;
+        case fourcc("IGNR"): assign_text(tag.genre, text, size); break;
+        case fourcc("ICMT"): assign_text(tag.comment, text, size); break;
+        case fourcc("ICRD"):
+            // Usually a full date, starting with the year.
+            tag.year = atag::detail::parse_number(text, std::min<int>(size, 4));
+            break;
+        case fourcc("ITRK"): case fourcc("IPRT"):
+            tag.track_number = atag::detail::parse_number(text, size);
+            break;
+        }
+        i += 8 + size + (size & 1);
+    }
+}
+
+/** Parses the body of a broadcast audio extension (bext) chunk into `tag`. */
+template<typename Tag>
+void parse_bext(const char* p, const uint64_t length, Tag& tag)
+{
+    // https://tech.ebu.ch/docs/tech/tech3285.pdf
+    if(length < 346) { return; }
+    assign_text(tag.description, p, 256);
+    assign_text(tag.originator, p + 256, 32);
+    assign_text(tag.originator_reference, p + 288, 32);
+    assign_text(tag.origination_date, p + 320, 10);
+    assign_text(tag.origination_time, p + 330, 8);
+    tag.time_reference = atag::detail::parse_le<uint64_t>(p + 338);
+}
+
+/** Parses the body of a WAV fmt chunk into `tag`, and returns the byte rate. */
+template<typename Tag>
+uint32_t parse_format(const char* p, const uint64_t length, Tag& tag)
+{
+    if(length < 16) { return 0; }
+    tag.num_channels = atag::detail::parse_le<uint16_t>(p + 2);
+    tag.sample_rate = atag::detail::parse_le<uint32_t>(p + 4);
+    tag.bits_per_sample = atag::detail::parse_le<uint16_t>(p + 14);
+    return atag::detail::parse_le<uint32_t>(p + 8);
+}
+
+/** Parses the body of an AIFF COMM chunk into `tag`. */
+template<typename Tag>
+void parse_common(const char* p, const uint64_t length, Tag& tag)
+{
+    if(length < 18) { return; }
+    tag.num_channels = atag::detail::parse_be<uint16_t>(p);
+    const uint32_t num_frames = atag::detail::parse_be<uint32_t>(p + 2);
+    tag.bits_per_sample = atag::detail::parse_be<uint16_t>(p + 6);
+    // The sample rate is an 80-bit IEEE 754 extended precision number: a sign bit and a
+    // 15-bit exponent, followed by a 64-bit mantissa with an explicit integer bit.
+    const int exponent = (atag::detail::parse_be<uint16_t>(p + 8) & 0x7fff) - 16383;
+    const uint64_t mantissa = atag::detail::parse_be<uint64_t>(p + 10);
+    const double sample_rate = std::ldexp(double(mantissa), exponent - 63);
+    // A rate outside of this range is corrupt, and might not even fit in an int.
+    if((sample_rate < 1) || (sample_rate > 1e7)) { return; }
+    tag.sample_rate = int(sample_rate);
+    tag.length = int64_t(num_frames * 1000.0 / sample_rate);
+}
+
+} // namespace detail
+
+template<typename Source, typename Tag>
+void parse_into(const Source& s, Tag& tag)
+{
+    static_assert(atag::detail::is_source<Source>::value, "Source requirements not met");
+
+    if(!is_tagged(s)) { return; }
+
+    atag::detail::parse_probe probe(instrumentation::format::riff);
+    using detail::fourcc;
+    const uint64_t end = detail::chunks_end(s);
+    uint32_t byte_rate = 0;
+    uint64_t data_size = 0;
+    chunk_header h;
+    for(uint64_t offset = 12; detail::parse_chunk_header(s, offset, end, h);
+        offset = detail::next_chunk(offset, h))
+    {
+        probe.visit(8);
+        const uint64_t body_offset = offset + 8;
+        if(h.id == fourcc("data"))
+        {
+            // Only the size of the audio data is needed, which may be truncated.
+            data_size = std::min<uint64_t>(h.size, end - body_offset);
+            continue;
+        }
+        if(!detail::is_metadata_chunk(h.id)) { continue; }
+        if(h.size > end - body_offset)
+        {
+            probe.fail({parse_errc::truncated, std::size_t(offset)});
+            continue;
+        }
+
+        probe.decode(h.size);
+        const char* body = reinterpret_cast<const char*>(&s[body_offset]);
+        switch(h.id) {
+        case fourcc("LIST"):
+            if((h.size >= 4) && std::equal(body, body + 4, "INFO"))
+                detail::parse_info(body + 4, h.size - 4, tag);
+            break;
+        case fourcc("bext"):
+            detail::parse_bext(body, h.size, tag);
+            break;
+        case fourcc("fmt "):
+            byte_rate = detail::parse_format(body, h.size, tag);
+            break;
+        case fourcc("COMM"):
+            detail::parse_common(body, h.size, tag);
+            break;
+        case fourcc("NAME"):
+            detail::assign_text(tag.title, body, h.size);
+            break;
+        case fourcc("AUTH"):
+            detail::assign_text(tag.artist, body, h.size);
+            break;
+        case fourcc("ANNO"):
+            detail::assign_text(tag.comment, body, h.size);
+            break;
+        case fourcc("id3 "): case fourcc("ID3 "):
+            tag.id3v2_offset = body_offset;
+            tag.id3v2_length = h.size;
+            break;
+        }
+    }
+    if(byte_rate > 0) { tag.length = data_size * 1000 / byte_rate; }
+}
+
+template<typename Source>
+tag parse(const Source& s)
+{
+    tag tag{};
+    parse_into(s, tag);
+    return tag;
+}
+
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource)
+{
+    pmr::tag tag(resource);
+    parse_into(s, tag);
+    return tag;
+}
+
+} // namespace riff
+} // namespace atag
+
+#endif // ATAG_RIFF_IMPL_HEADER
@@ -0,0 +1,171 @@
+#ifndef ATAG_SCAN_IMPL_HEADER
+#define ATAG_SCAN_IMPL_HEADER
+
+#include "../scan.hpp"
+#include "../file_source.hpp"
+#include "../tag_cache.hpp"
+#include "../detail/key_hash.hpp"
+#include "../detail/thread_pool.hpp"
+#include "../../atag.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+namespace atag {
+
+template<typename T>
+bool bounded_queue<T>::push(T item)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return (items_.size() < capacity_) || is_closed_; });
+    if(is_closed_) { return false; }
+    items_.emplace_back(std::move(item));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+}
+
+template<typename T>
+bool bounded_queue<T>::pop(T& item)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !items_.empty() || is_closed_; });
+    if(items_.empty()) { return false; }
+    item = std::move(items_.front());
+    items_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+}
+
+template<typename T>
+void bounded_queue<T>::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_closed_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+}
+
+namespace detail {
+
+inline bool has_extension(const std::filesystem::path& path,
+    const std::vector<std::string>& extensions)
+{
+    if(extensions.empty()) { return true; }
+    const std::string ext = path.extension().string();
+    return std::any_of(extensions.begin(), extensions.end(), [&ext](const auto& e)
+        { return key_equals(ext.data(), ext.length(), e.c_str()); });
+}
+
+/**
+ * Parses the file at `path`, reusing `source`'s buffers, unless its tag is in `cache`
+ * (if set).
+ */
+inline scan_result parse_file(std::string path, file_source& source, tag_cache* cache)
+{
+    scan_result result;
+    result.path = std::move(path);
+
+    tag_cache::key key;
+    const bool has_key = cache && tag_cache::make_key(result.path, key, result.error);
+    if(has_key && cache->find(key, result.tag))
+    {
+        result.is_cached = true;
+        return result;
+    }
+    result.error.clear();
+
+    source.open(result.path, result.error);
+    // Files that are too small to hold a tag are not worth looking at.
+    if(!result.error && (source.size() >= 10)
+       && prefetch_tags(source, result.error, flac_blocks::parsed))
+    {
+        try
+        {
+            result.tag = atag::parse(source);
+        }
+        catch(...)
+        {
+            // Some of the parsers throw on malformed input, but that must not bring
+            // down the worker.
+            result.error = std::make_error_code(std::errc::illegal_byte_sequence);
+        }
+    }
+    source.close();
+    if(has_key && !result.error)
+    {
+        // Failing to cache the tag is not an error for this file.
+        std::error_code ec;
+        cache->insert(key, result.path, result.tag, ec);
+    }
+    return result;
+}
+
+} // namespace detail
+
+template<typename Callback>
+std::size_t scan(const std::string& directory, const scan_options& options,
+    Callback callback, std::error_code& error)
+{
+    namespace fs = std::filesystem;
+
+    error.clear();
+    auto flags = fs::directory_options::skip_permission_denied;
+    if(options.follow_symlinks)
+        flags |= fs::directory_options::follow_directory_symlink;
+    fs::recursive_directory_iterator it(directory, flags, error);
+    if(error) { return 0; }
+
+    const std::size_t num_workers = options.concurrency > 0
+        ? options.concurrency : std::max(1u, std::thread::hardware_concurrency());
+    // Each worker reuses the same source (and thus its buffers) for all its files.
+    std::vector<file_source> sources(num_workers);
+    std::size_t num_files = 0;
+    {
+        detail::work_stealing_pool<std::string> pool(num_workers, options.max_pending,
+            [&sources, &callback, &options](std::string& path, const std::size_t worker)
+            {
+                callback(detail::parse_file(std::move(path), sources[worker],
+                    options.cache));
+            });
+
+        const fs::recursive_directory_iterator end;
+        for(std::error_code ec; it != end; it.increment(ec))
+        {
+            if(ec)
+            {
+                // Skip the entry that could not be read, but carry on with the rest.
+                ec.clear();
+                continue;
+            }
+            const auto& entry = *it;
+            std::error_code status_error;
+            if(!entry.is_regular_file(status_error) || status_error
+                || !detail::has_extension(entry.path(), options.extensions))
+            {
+                continue;
+            }
+            pool.submit(entry.path().string());
+            ++num_files;
+        }
+        pool.finish();
+    }
+    return num_files;
+}
+
+inline std::size_t scan(const std::string& directory, const scan_options& options,
+    bounded_queue<scan_result>& queue, std::error_code& error)
+{
+    const auto num_files = scan(directory, options,
+        [&queue](scan_result&& result) { queue.push(std::move(result)); }, error);
+    queue.close();
+    return num_files;
+}
+
+} // namespace atag
+
+#endif // ATAG_SCAN_IMPL_HEADER
@@ -0,0 +1,429 @@
+#ifndef ATAG_TAG_CACHE_IMPL_HEADER
+#define ATAG_TAG_CACHE_IMPL_HEADER
+
+#include "../tag_cache.hpp"
+#include "../file_source.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace atag {
+namespace detail {
+
+/**
+ * The layout of the cache file is:
+ *
+ * cache_header
+ * record_header, path, title, album, artist, padding to a multiple of 8 bytes
+ * record_header, ...
+ *
+ * where all integers are in the host's byte order and strings are not null terminated.
+ * Records are only ever appended, and the last record of a file supersedes all others.
+ */
+struct cache_header
+{
+    char magic[8];
+    uint32_t version;
+    // Written as 0x01020304 so that files of a different byte order are recognized.
+    uint32_t byte_order_mark;
+};
+
+struct cache_record_header
+{
+    // The size of the whole record, including this header and the padding.
+    uint32_t size;
+    uint32_t flags;
+    uint64_t device;
+    uint64_t inode;
+    uint64_t file_size;
+    int64_t mtime_ns;
+    int32_t genre;
+    int32_t track_number;
+    int32_t length;
+    int32_t year;
+    uint32_t path_length;
+    uint32_t title_length;
+    uint32_t album_length;
+    uint32_t artist_length;
+};
+
+enum cache_record_flags : uint32_t
+{
+    // The record marks the removal of the file from the cache.
+    erased = 1,
+};
+
+constexpr char cache_magic[8] = { 'a', 't', 'a', 'g', 'c', 'a', 'c', 'h' };
+constexpr uint32_t cache_version = 1;
+constexpr uint32_t cache_byte_order_mark = 0x01020304;
+
+inline bool is_cache_header_valid(const cache_header& h) noexcept
+{
+    return (std::memcmp(h.magic, cache_magic, sizeof h.magic) == 0)
+        && (h.version == cache_version)
+        && (h.byte_order_mark == cache_byte_order_mark);
+}
+
+inline bool write_cache_header(const int fd, std::error_code& error) noexcept
+{
+    cache_header h;
+    std::memcpy(h.magic, cache_magic, sizeof h.magic);
+    h.version = cache_version;
+    h.byte_order_mark = cache_byte_order_mark;
+    return pwrite_all(fd, reinterpret_cast<const char*>(&h), sizeof h, 0, error);
+}
+
+/**
+ * Returns the header of the record at the start of `data`, which is `size` bytes long,
+ * or false if the record is incomplete or corrupt.
+ */
+inline bool read_cache_record_header(const char* data, const std::size_t size,
+    cache_record_header& h) noexcept
+{
+    if(size < sizeof h) { return false; }
+    std::memcpy(&h, data, sizeof h);
+    const uint64_t strings_length = uint64_t(h.path_length) + h.title_length
+        + h.album_length + h.artist_length;
+    return (h.size >= sizeof h) && (h.size % 8 == 0) && (h.size <= size)
+        && (strings_length <= h.size - sizeof h);
+}
+
+inline void encode_cache_record(const tag_cache::key& k, const std::string& path,
+    const simple_tag& tag, const uint32_t flags, std::vector<char>& record)
+{
+    cache_record_header h;
+    const std::size_t size = sizeof h + path.length() + tag.title.length()
+        + tag.album.length() + tag.artist.length();
+    h.size = (size + 7) & ~std::size_t(7);
+    h.flags = flags;
+    h.device = k.device;
+    h.inode = k.inode;
+    h.file_size = k.size;
+    h.mtime_ns = k.mtime_ns;
+    h.genre = static_cast<int32_t>(tag.genre);
+    h.track_number = tag.track_number;
+    h.length = tag.length;
+    h.year = tag.year;
+    h.path_length = path.length();
+    h.title_length = tag.title.length();
+    h.album_length = tag.album.length();
+    h.artist_length = tag.artist.length();
+
+    record.assign(h.size, 0);
+    char* p = record.data();
+    std::memcpy(p, &h, sizeof h);
+    p += sizeof h;
+    for(const std::string* s : { &path, &tag.title, &tag.album, &tag.artist })
+    {
+        std::memcpy(p, s->data(), s->length());
+        p += s->length();
+    }
+}
+
+} // namespace detail
+
+inline tag_cache::~tag_cache()
+{
+    close();
+}
+
+inline void tag_cache::open(const std::string& path, std::error_code& error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_locked();
+    open_locked(path, error);
+}
+
+inline void tag_cache::open_locked(const std::string& path, std::error_code& error)
+{
+    error.clear();
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd == -1)
+    {
+        error = detail::last_error();
+        return;
+    }
+    struct stat st;
+    if(::fstat(fd, &st) == -1)
+    {
+        error = detail::last_error();
+        ::close(fd);
+        return;
+    }
+
+    std::size_t size = st.st_size;
+    detail::cache_header h;
+    if((size < sizeof h)
+        || !detail::pread_all(fd, reinterpret_cast<char*>(&h), sizeof h, 0, error)
+        || !detail::is_cache_header_valid(h))
+    {
+        // This is a new file or one we can't make sense of (e.g. it was written by a
+        // different version), so start afresh.
+        error.clear();
+        if((::ftruncate(fd, 0) == -1) || !detail::write_cache_header(fd, error))
+        {
+            if(!error) { error = detail::last_error(); }
+            ::close(fd);
+            return;
+        }
+        size = sizeof h;
+    }
+
+    if(size > sizeof h)
+    {
+        void* p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED)
+        {
+            error = detail::last_error();
+            ::close(fd);
+            return;
+        }
+        mapping_ = static_cast<const char*>(p);
+        mapping_size_ = size;
+    }
+
+    // Index the records, stopping at the first one that is incomplete.
+    std::size_t offset = sizeof h;
+    detail::cache_record_header rh;
+    while(mapping_
+        && detail::read_cache_record_header(mapping_ + offset, size - offset, rh))
+    {
+        const file_id id{rh.device, rh.inode};
+        if(rh.flags & detail::cache_record_flags::erased)
+        {
+            num_dead_records_ += 1 + index_.erase(id);
+        }
+        else
+        {
+            auto r = index_.emplace(id, offset);
+            if(!r.second)
+            {
+                r.first->second = offset;
+                ++num_dead_records_;
+            }
+        }
+        offset += rh.size;
+    }
+    if(offset < size)
+    {
+        // Discard the garbage so that new records can be appended after the valid ones.
+        if(::ftruncate(fd, offset) == -1)
+        {
+            error = detail::last_error();
+            fd_ = fd;
+            close_locked();
+            return;
+        }
+    }
+
+    fd_ = fd;
+    path_ = path;
+    mapped_end_ = offset;
+    file_size_ = offset;
+}
+
+inline void tag_cache::close() noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_locked();
+}
+
+inline void tag_cache::close_locked() noexcept
+{
+    if(mapping_) { ::munmap(const_cast<char*>(mapping_), mapping_size_); }
+    if(fd_ != -1) { ::close(fd_); }
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+    mapped_end_ = 0;
+    fd_ = -1;
+    appended_.clear();
+    appended_.shrink_to_fit();
+    file_size_ = 0;
+    index_.clear();
+    num_dead_records_ = 0;
+}
+
+inline void tag_cache::remap_locked() noexcept
+{
+    void* p = ::mmap(nullptr, file_size_, PROT_READ, MAP_SHARED, fd_, 0);
+    // The appended records are still valid, they just take up memory.
+    if(p == MAP_FAILED) { return; }
+    if(mapping_) { ::munmap(const_cast<char*>(mapping_), mapping_size_); }
+    mapping_ = static_cast<const char*>(p);
+    mapping_size_ = file_size_;
+    mapped_end_ = file_size_;
+    appended_.clear();
+    appended_.shrink_to_fit();
+}
+
+inline std::size_t tag_cache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
+
+inline std::size_t tag_cache::num_dead_records() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_dead_records_;
+}
+
+inline bool tag_cache::make_key(const std::string& path, key& k, std::error_code& error)
+{
+    struct stat st;
+    if(::stat(path.c_str(), &st) == -1)
+    {
+        error = detail::last_error();
+        return false;
+    }
+    k.device = st.st_dev;
+    k.inode = st.st_ino;
+    k.size = st.st_size;
+    k.mtime_ns = int64_t(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+inline const char* tag_cache::record_at(const std::size_t offset) const noexcept
+{
+    if(offset < mapped_end_) { return mapping_ + offset; }
+    return appended_.data() + (offset - mapped_end_);
+}
+
+inline bool tag_cache::find(const key& k, simple_tag& tag) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = index_.find(file_id{k.device, k.inode});
+    if(it == index_.end()) { return false; }
+
+    const char* record = record_at(it->second);
+    detail::cache_record_header h;
+    std::memcpy(&h, record, sizeof h);
+    if((h.file_size != k.size) || (h.mtime_ns != k.mtime_ns)) { return false; }
+
+    const char* p = record + sizeof h + h.path_length;
+    tag.title.assign(p, h.title_length);
+    p += h.title_length;
+    tag.album.assign(p, h.album_length);
+    p += h.album_length;
+    tag.artist.assign(p, h.artist_length);
+    tag.genre = static_cast<enum genre>(h.genre);
+    tag.track_number = h.track_number;
+    tag.length = h.length;
+    tag.year = h.year;
+    return true;
+}
+
+inline void tag_cache::insert(const key& k, const std::string& path,
+    const simple_tag& tag, std::error_code& error)
+{
+    std::vector<char> record;
+    detail::encode_cache_record(k, path, tag, 0, record);
+    std::lock_guard<std::mutex> lock(mutex_);
+    append_locked(record, file_id{k.device, k.inode}, false, error);
+}
+
+inline void tag_cache::erase(const key& k, std::error_code& error)
+{
+    std::vector<char> record;
+    detail::encode_cache_record(k, std::string(), simple_tag(),
+        detail::cache_record_flags::erased, record);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(index_.find(file_id{k.device, k.inode}) == index_.end())
+    {
+        error.clear();
+        return;
+    }
+    append_locked(record, file_id{k.device, k.inode}, true, error);
+}
+
+inline void tag_cache::append_locked(const std::vector<char>& record, const file_id& id,
+    const bool is_erasure, std::error_code& error)
+{
+    error.clear();
+    if(!is_open())
+    {
+        error = std::make_error_code(std::errc::bad_file_descriptor);
+        return;
+    }
+    if(!detail::pwrite_all(fd_, record.data(), record.size(), file_size_, error))
+    {
+        // Part of the record may have been written, but as it's at the end of the
+        // file, the next record overwrites it (or it's discarded on the next opening).
+        return;
+    }
+
+    const std::size_t offset = file_size_;
+    file_size_ += record.size();
+    appended_.insert(appended_.end(), record.begin(), record.end());
+    if(is_erasure)
+    {
+        index_.erase(id);
+        num_dead_records_ += 2;
+    }
+    else
+    {
+        auto r = index_.emplace(id, offset);
+        if(!r.second)
+        {
+            r.first->second = offset;
+            ++num_dead_records_;
+        }
+    }
+    if(appended_.size() >= max_appended_size) { remap_locked(); }
+}
+
+inline void tag_cache::compact(std::error_code& error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    error.clear();
+    if(!is_open())
+    {
+        error = std::make_error_code(std::errc::bad_file_descriptor);
+        return;
+    }
+    if(num_dead_records_ == 0) { return; }
+
+    const std::string tmp_path = path_ + ".tmp";
+    const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        0644);
+    if(fd == -1)
+    {
+        error = detail::last_error();
+        return;
+    }
+
+    // Gather the live records into one buffer so that they can be written at once.
+    std::vector<char> records;
+    for(const auto& entry : index_)
+    {
+        const char* record = record_at(entry.second);
+        uint32_t size;
+        std::memcpy(&size, record, sizeof size);
+        records.insert(records.end(), record, record + size);
+    }
+
+    const bool ok = detail::write_cache_header(fd, error)
+        && detail::pwrite_all(fd, records.data(), records.size(),
+            sizeof(detail::cache_header), error);
+    if(!ok || (::fsync(fd) == -1) || (::rename(tmp_path.c_str(), path_.c_str()) == -1))
+    {
+        if(!error) { error = detail::last_error(); }
+        ::close(fd);
+        ::unlink(tmp_path.c_str());
+        return;
+    }
+    ::close(fd);
+
+    const std::string path = path_;
+    close_locked();
+    open_locked(path, error);
+}
+
+} // namespace atag
+
+#endif // ATAG_TAG_CACHE_IMPL_HEADER
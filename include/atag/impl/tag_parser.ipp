@@ -0,0 +1,305 @@
+#ifndef ATAG_TAG_PARSER_IMPL_HEADER
+#define ATAG_TAG_PARSER_IMPL_HEADER
+
+#include "../tag_parser.hpp"
+#include "../../atag.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace atag {
+namespace detail {
+
+template<typename Source>
+bool tag_locator::next(const Source& s, byte_range& r)
+{
+    // The head and tail of a file contain the identifiers of every tag, and they are
+    // usually large enough to contain the tags themselves, so a single read of each is
+    // often all that's needed.
+    enum { probe_size = 4096 };
+    const std::size_t size = s.size();
+    const auto request = [&r, size](const std::size_t offset, const std::size_t length)
+    {
+        r.offset = offset;
+        r.length = std::min(length, size - offset);
+        return true;
+    };
+
+    for(;;)
+    {
+        switch(state_)
+        {
+        case state::head:
+            state_ = state::tail;
+            return request(0, probe_size);
+        case state::tail:
+            state_ = state::tags;
+            return request(size - std::min<std::size_t>(size, probe_size), probe_size);
+        case state::tags:
+        {
+            if(size < 10)
+            {
+                state_ = state::done;
+                return false;
+            }
+            state_ = state::ape;
+            const int id3v2_start = id3v2::find_tag_start(s);
+            if(id3v2_start == 0)
+            {
+                const auto header = id3v2::parse_tag_header(&s[0]);
+                // The size excludes the header and the footer, if there is one.
+                std::size_t tag_size = 10 + std::max(header.size, 0);
+                if(header.flags & id3v2::tag::has_footer) { tag_size += 10; }
+                return request(0, tag_size);
+            }
+            else if(id3v2_start > 0)
+            {
+                // An appended tag ends at the end of the file.
+                return request(id3v2_start, size - id3v2_start);
+            }
+            else if(flac::is_tagged(s))
+            {
+                block_offset_ = 4;
+                state_ = state::flac_block_header;
+                return request(block_offset_, 4);
+            }
+            else if(ogg::is_tagged(s))
+            {
+                page_offset_ = 0;
+                state_ = state::ogg_page_header;
+            }
+            else if(mp4::is_tagged(s))
+            {
+                box_offset_ = 0;
+                box_ends_[0] = size;
+                box_depth_ = 0;
+                state_ = state::mp4_box_header;
+            }
+            else if(riff::is_tagged(s))
+            {
+                chunk_offset_ = 12;
+                state_ = state::riff_chunk_header;
+            }
+            break;
+        }
+        case state::flac_block_header:
+        {
+            // Locate the metadata blocks up to and including the last one.
+            state_ = state::ape;
+            if(block_offset_ + 4 > size) { break; }
+            const auto header = flac::parse_block_header(&s[block_offset_]);
+            if(header.length <= 0) { break; }
+            block_length_ = header.length;
+            is_last_block_ = header.is_last_block;
+            state_ = state::flac_block;
+            if(header.type == flac::block_header::streaminfo)
+                has_streaminfo_ = true;
+            else if(header.type == flac::block_header::vorbis_comment)
+                has_vorbis_comment_ = true;
+            else if(flac_blocks_ == flac_blocks::parsed)
+                break;
+            return request(block_offset_ + 4, block_length_);
+        }
+        case state::flac_block:
+            state_ = state::ape;
+            if(is_last_block_ || (block_offset_ + 4 + block_length_ >= size)) { break; }
+            if((flac_blocks_ == flac_blocks::parsed)
+               && has_streaminfo_ && has_vorbis_comment_)
+            {
+                break;
+            }
+            block_offset_ += 4 + block_length_;
+            state_ = state::flac_block_header;
+            return request(block_offset_, 4);
+        case state::ogg_page_header:
+            // The header is followed by a segment table of at most 255 entries.
+            state_ = state::ogg_page;
+            if(page_offset_ >= size)
+            {
+                state_ = state::ogg_tail;
+                break;
+            }
+            return request(page_offset_, ogg::page_header::min_size + 255);
+        case state::ogg_page:
+        {
+            // Locate the pages up to the end of the comment header, i.e. the stream's
+            // second packet (see `ogg::detail::read_packets`).
+            state_ = state::ogg_tail;
+            ogg::page_header h;
+            if(!ogg::parse_page_header(&s[page_offset_], size - page_offset_, h))
+                break;
+            if(page_offset_ == 0) { serial_number_ = h.serial_number; }
+            const std::size_t body_offset = page_offset_ + h.size();
+            if(h.serial_number != serial_number_)
+            {
+                page_offset_ = body_offset + h.body_size;
+                state_ = state::ogg_page_header;
+                break;
+            }
+            for(auto i = 0; i < h.num_segments; ++i)
+            {
+                if(uint8_t(s[page_offset_ + ogg::page_header::min_size + i]) < 255)
+                    ++num_packets_;
+            }
+            if(num_packets_ < 2)
+            {
+                page_offset_ = body_offset + h.body_size;
+                state_ = state::ogg_page_header;
+            }
+            return request(body_offset, h.body_size);
+        }
+        case state::ogg_tail:
+        {
+            // The duration is given by the stream's last page, which is usually in the
+            // probed tail, but pages may be almost 64 KiB large.
+            state_ = state::ape;
+            ogg::page_header h;
+            if(ogg::detail::find_last_page(s, serial_number_, probe_size, h) != -1)
+                break;
+            const std::size_t tail_size = std::min<std::size_t>(size,
+                ogg::page_header::max_page_size);
+            return request(size - tail_size, tail_size);
+        }
+        case state::mp4_box_header:
+            state_ = state::mp4_box;
+            // Once the children of a box have been located, continue with its sibling,
+            // which starts where it ends. Nothing after the moov box is needed though.
+            while((box_depth_ > 0) && (box_offset_ + 8 > box_ends_[box_depth_]))
+            {
+                box_offset_ = box_ends_[box_depth_--];
+                if(box_depth_ == 0) { state_ = state::ape; }
+            }
+            if((state_ == state::ape) || (box_offset_ + 8 > size))
+            {
+                state_ = state::ape;
+                break;
+            }
+            return request(box_offset_, mp4::detail::max_header_size);
+        case state::mp4_box:
+        {
+            // Only the boxes on the path to the ilst box (moov/udta/meta/ilst) are
+            // descended into, and only the bodies of the ilst and mvhd boxes are read, so
+            // e.g. the mdat box is skipped (see `mp4::parse`).
+            constexpr uint32_t path[] = {detail::fourcc("moov"), detail::fourcc("udta"),
+                detail::fourcc("meta")};
+            state_ = state::ape;
+            mp4::box_header h;
+            if(!mp4::detail::parse_box_header(s, box_offset_, box_ends_[box_depth_], h))
+                break;
+            const uint64_t box_end = box_offset_ + h.size;
+            state_ = state::mp4_box_header;
+            if((box_depth_ < 3) && (h.type == path[box_depth_]))
+            {
+                box_ends_[++box_depth_] = box_end;
+                box_offset_ = mp4::detail::children_offset(s, box_offset_, h);
+                break;
+            }
+            const uint64_t body_offset = box_offset_ + h.header_size;
+            box_offset_ = box_end;
+            if(((box_depth_ == 1) && (h.type == detail::fourcc("mvhd")))
+               || ((box_depth_ == 3) && (h.type == detail::fourcc("ilst"))))
+            {
+                return request(body_offset, box_end - body_offset);
+            }
+            break;
+        }
+        case state::riff_chunk_header:
+            state_ = state::riff_chunk;
+            if(chunk_offset_ + 8 > size)
+            {
+                state_ = state::ape;
+                break;
+            }
+            return request(chunk_offset_, 8);
+        case state::riff_chunk:
+        {
+            // Only the chunk headers and the bodies of the metadata chunks are read, so
+            // the audio data is skipped (see `riff::parse`).
+            state_ = state::ape;
+            riff::chunk_header h;
+            if(!riff::detail::parse_chunk_header(s, chunk_offset_,
+                riff::detail::chunks_end(s), h))
+            {
+                break;
+            }
+            const uint64_t body_offset = chunk_offset_ + 8;
+            chunk_offset_ = riff::detail::next_chunk(chunk_offset_, h);
+            state_ = state::riff_chunk_header;
+            if(riff::detail::is_metadata_chunk(h.id))
+                return request(body_offset, h.size);
+            break;
+        }
+        case state::ape:
+        {
+            state_ = state::done;
+            if(size < ape::header::size) { break; }
+            const int ape_start = ape::find_tag_start(s);
+            if(ape_start == 0)
+            {
+                const auto header = ape::parse_header(&s[0]);
+                return request(0, ape::header::size + std::max(header.tag_size, 0));
+            }
+            else if(ape_start > 0)
+            {
+                return request(ape_start, size - ape_start);
+            }
+            // An ID3v1 tag, if present, is in the last 128 bytes which have been read.
+            break;
+        }
+        case state::done:
+            return false;
+        }
+    }
+}
+
+} // namespace detail
+
+inline void tag_parser::reset(const std::size_t file_size)
+{
+    locator_.reset();
+    buffer_.reset(file_size);
+    pending_ = {0, 0};
+}
+
+inline bool tag_parser::need_bytes(byte_range& r)
+{
+    for(;;)
+    {
+        // Only request the part of the range that hasn't been fed yet.
+        std::size_t begin = pending_.offset;
+        std::size_t end = begin + pending_.length;
+        buffer_.trim(begin, end);
+        if(begin < end)
+        {
+            r = byte_range{begin, end - begin};
+            return true;
+        }
+        if(!locator_.next(buffer_, pending_))
+        {
+            pending_ = {0, 0};
+            return false;
+        }
+    }
+}
+
+inline void tag_parser::feed(const std::size_t offset, const char* data,
+    std::size_t length)
+{
+    if(offset >= buffer_.size()) { return; }
+    length = std::min(length, buffer_.size() - offset);
+    buffer_.insert(offset, offset + length,
+        [data, offset](char* dest, const std::size_t pos, const std::size_t n)
+        {
+            std::memcpy(dest, data + (pos - offset), n);
+            return true;
+        });
+}
+
+inline simple_tag tag_parser::parse() const
+{
+    return atag::parse(buffer_);
+}
+
+} // namespace atag
+
+#endif // ATAG_TAG_PARSER_IMPL_HEADER
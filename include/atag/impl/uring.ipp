@@ -0,0 +1,168 @@
+#ifndef ATAG_URING_IMPL_HEADER
+#define ATAG_URING_IMPL_HEADER
+
+#include "../uring.hpp"
+#include "../file_source.hpp"
+
+#include <cerrno>
+
+#include <unistd.h>
+
+namespace atag {
+
+inline uring_driver::~uring_driver()
+{
+    close();
+}
+
+inline void uring_driver::open(const unsigned queue_depth, std::error_code& error)
+{
+    close();
+    error.clear();
+    const int r = ::io_uring_queue_init(queue_depth > 0 ? queue_depth : 1, &ring_, 0);
+    if(r < 0)
+    {
+        error = std::error_code(-r, std::system_category());
+        return;
+    }
+    is_open_ = true;
+    slots_.resize(queue_depth > 0 ? queue_depth : 1);
+}
+
+inline void uring_driver::close() noexcept
+{
+    if(is_open_) { ::io_uring_queue_exit(&ring_); }
+    is_open_ = false;
+    slots_.clear();
+}
+
+template<typename Callback>
+void uring_driver::finish(slot& s, std::error_code error, Callback& callback)
+{
+    scan_result result;
+    result.path = std::move(s.path);
+    result.error = error;
+    // Files that are too small to hold a tag are not worth looking at.
+    if(!error && (s.parser.file_size() >= 10))
+    {
+        try
+        {
+            result.tag = s.parser.parse();
+        }
+        catch(...)
+        {
+            result.error = std::make_error_code(std::errc::illegal_byte_sequence);
+        }
+    }
+    ::close(s.fd);
+    s.fd = -1;
+    callback(std::move(result));
+}
+
+template<typename Callback>
+void uring_driver::parse(const std::vector<std::string>& paths, Callback callback,
+    std::error_code& error)
+{
+    error.clear();
+    if(!is_open_)
+    {
+        error = std::make_error_code(std::errc::bad_file_descriptor);
+        return;
+    }
+
+    std::size_t next_path = 0;
+    // Queues the next read of the slot's file, moving on to the next file once it's
+    // done. Returns false once there are no files left for the slot.
+    const auto pump = [this, &paths, &next_path, &callback](slot& s)
+    {
+        for(;;)
+        {
+            if(s.fd != -1)
+            {
+                if(s.parser.need_bytes(s.range))
+                {
+                    s.buffer.resize(s.range.length);
+                    io_uring_sqe* sqe = ::io_uring_get_sqe(&ring_);
+                    if(sqe == nullptr)
+                    {
+                        ::io_uring_submit(&ring_);
+                        sqe = ::io_uring_get_sqe(&ring_);
+                    }
+                    ::io_uring_prep_read(sqe, s.fd, s.buffer.data(), s.range.length,
+                        s.range.offset);
+                    ::io_uring_sqe_set_data(sqe, &s);
+                    return true;
+                }
+                finish(s, std::error_code(), callback);
+            }
+            if(next_path == paths.size()) { return false; }
+
+            std::error_code ec;
+            std::size_t size = 0;
+            s.path = paths[next_path++];
+            s.fd = detail::open_file(s.path, size, ec);
+            if(s.fd == -1)
+            {
+                scan_result result;
+                result.path = std::move(s.path);
+                result.error = ec;
+                callback(std::move(result));
+                continue;
+            }
+            s.parser.reset(size);
+        }
+    };
+
+    std::size_t num_in_flight = 0;
+    for(auto& s : slots_)
+    {
+        if(pump(s)) { ++num_in_flight; }
+    }
+    while(num_in_flight > 0)
+    {
+        const int r = ::io_uring_submit_and_wait(&ring_, 1);
+        if((r < 0) && (r != -EINTR))
+        {
+            error = std::error_code(-r, std::system_category());
+            break;
+        }
+
+        io_uring_cqe* cqe;
+        while(::io_uring_peek_cqe(&ring_, &cqe) == 0)
+        {
+            slot& s = *static_cast<slot*>(::io_uring_cqe_get_data(cqe));
+            const int n = cqe->res;
+            ::io_uring_cqe_seen(&ring_, cqe);
+            --num_in_flight;
+            if(n < 0)
+            {
+                finish(s, std::error_code(-n, std::system_category()), callback);
+            }
+            else if(n == 0)
+            {
+                // The file must have been truncated while we were reading it.
+                finish(s, std::make_error_code(std::errc::io_error), callback);
+            }
+            else
+            {
+                s.parser.feed(s.range.offset, s.buffer.data(), n);
+            }
+            if(pump(s)) { ++num_in_flight; }
+        }
+    }
+
+    if(error)
+    {
+        // The reads still in flight keep their files open, and may still complete into
+        // the slots' buffers, so only the descriptors are released here.
+        for(auto& s : slots_)
+        {
+            if(s.fd != -1) { ::close(s.fd); }
+            s.fd = -1;
+        }
+    }
+}
+
+} // namespace atag
+
+#endif // ATAG_URING_IMPL_HEADER
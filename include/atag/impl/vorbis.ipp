@@ -0,0 +1,175 @@
+#ifndef ATAG_VORBIS_IMPL_HEADER
+#define ATAG_VORBIS_IMPL_HEADER
+
+#include "../detail/cursor.hpp"
+#include "../detail/io_util.hpp"
+#include "../detail/key_hash.hpp"
+#include "../vorbis.hpp"
+
+#include <cstring>
+
+namespace atag {
+namespace vorbis {
+namespace detail {
+
+/**
+ * Invokes `f(key, value, hash)` for each comment of the comment block of `length` bytes
+ * at `data` (see https://xiph.org/vorbis/doc/v-comment.html), where `hash` is the
+ * `atag::detail::key_hash` of `key`, and sets `vendor` to the vendor string. None of the
+ * lengths in the block are trusted further than the end of the block: returns false if
+ * any of them points past it. Comments without a '=' separator are skipped.
+ */
+template<typename Function>
+bool for_each_comment(const char* data, const std::size_t length,
+    std::string_view& vendor, Function f)
+{
+    vendor = {};
+    atag::detail::cursor<char> block(data, length);
+    atag::detail::cursor<char> field;
+    if(!block.has(4) || !block.take(block.read_le<uint32_t>(), field)) { return false; }
+    vendor = std::string_view(field.data(), field.size());
+
+    if(!block.has(4)) { return false; }
+    const uint32_t comment_list_size = block.read_le<uint32_t>();
+    // The list size isn't trusted either: a bogus one is caught by running out of the
+    // block, as each comment takes at least 4 bytes.
+    for(uint32_t i = 0; i < comment_list_size; ++i)
+    {
+        if(!block.has(4) || !block.take(block.read_le<uint32_t>(), field))
+            return false;
+
+        const char* comment = field.data();
+        const std::size_t comment_length = field.size();
+        const auto sep = static_cast<const char*>(
+            std::memchr(comment, '=', comment_length));
+        if(sep == nullptr) { continue; }
+
+        const std::size_t key_length = sep - comment;
+        f(std::string_view(comment, key_length),
+            std::string_view(sep + 1, comment_length - key_length - 1),
+            atag::detail::key_hash(comment, key_length));
+    }
+    return true;
+}
+
+/**
+ * Parses the fields of a `simple_tag` (and of the tags of the formats whose tag is a
+ * Vorbis comment block) from the comment block of `length` bytes at `data` into `tag`.
+ */
+template<typename Tag>
+void parse_fields(const char* data, const std::size_t length, Tag& tag)
+{
+    using atag::detail::key_hash;
+    std::string_view vendor;
+    for_each_comment(data, length, vendor,
+        [&tag](std::string_view key, std::string_view value, uint32_t hash)
+    {
+        // Field names are case-insensitive, see
+        // https://xiph.org/vorbis/doc/v-comment.html.
+        switch(hash) {
+#define KEY_EQUALS(s) atag::detail::key_equals(key.data(), key.length(), s)
+        case key_hash("DATE"):
+            // Only parse date if it's 4 chars long representing the year.
+            // TODO more flexibility
+            if(KEY_EQUALS("DATE") && (value.length() == 4))
+                tag.year = atag::detail::parse_number(value.data(), 4);
+            break;
+        case key_hash("ALBUM"):
+            if(KEY_EQUALS("ALBUM"))
+                tag.album.assign(value.data(), value.length());
+            break;
+        case key_hash("GENRE"):
+            if(KEY_EQUALS("GENRE"))
+                tag.genre.assign(value.data(), value.length());
+            break;
+        case key_hash("TITLE"):
+            if(KEY_EQUALS("TITLE"))
+                tag.title.assign(value.data(), value.length());
+            break;
+        // TODO does it make sense to treat 'performer' as 'artist'?
+        case key_hash("ARTIST"): case key_hash("PERFORMER"):
+            if(KEY_EQUALS("ARTIST") || KEY_EQUALS("PERFORMER"))
+            {
+                // Vorbis allows multiple comments with the same key.
+                if(!tag.artist.empty()) { tag.artist += ", "; }
+                tag.artist.append(value.data(), value.length());
+            }
+            break;
+        case key_hash("TRACKNUMBER"):
+            if(KEY_EQUALS("TRACKNUMBER"))
+            {
+                tag.track_number = atag::detail::parse_number(value.data(),
+                    value.length());
+            }
+            break;
+#undef KEY_EQUALS
+        }
+    });
+}
+
+/** Case-insensitively (ASCII only) compares two keys. */
+inline bool keys_equal(const std::string_view a, const std::string_view b) noexcept
+{
+    if(a.length() != b.length()) { return false; }
+    for(std::size_t i = 0; i < a.length(); ++i)
+    {
+        if(atag::detail::ascii_to_upper(a[i]) != atag::detail::ascii_to_upper(b[i]))
+            return false;
+    }
+    return true;
+}
+
+} // namespace detail
+
+inline bool comment_view::parse(const char* data, const std::size_t length)
+{
+    comments_.clear();
+    return detail::for_each_comment(data, length, vendor_,
+        [this](std::string_view key, std::string_view value, uint32_t hash)
+        { comments_.push_back(comment{key, value, hash}); });
+}
+
+inline const comment_view::comment* comment_view::find(
+    const std::string_view key) const noexcept
+{
+    const uint32_t hash = atag::detail::key_hash(key.data(), key.length());
+    for(const auto& c : comments_)
+    {
+        if((c.hash == hash) && detail::keys_equal(c.key, key)) { return &c; }
+    }
+    return nullptr;
+}
+
+inline std::string_view comment_view::value(const std::string_view key) const noexcept
+{
+    const auto c = find(key);
+    return c ? c->value : std::string_view();
+}
+
+template<typename Function>
+void comment_view::for_each(const std::string_view key, Function f) const
+{
+    const uint32_t hash = atag::detail::key_hash(key.data(), key.length());
+    for(const auto& c : comments_)
+    {
+        if((c.hash == hash) && detail::keys_equal(c.key, key)) { f(c.value); }
+    }
+}
+
+template<typename Function>
+void comment_view::for_each_prefixed(const std::string_view prefix, Function f) const
+{
+    for(const auto& c : comments_)
+    {
+        if((c.key.length() >= prefix.length())
+           && detail::keys_equal(c.key.substr(0, prefix.length()), prefix))
+        {
+            f(c);
+        }
+    }
+}
+
+} // namespace vorbis
+} // namespace atag
+
+#endif // ATAG_VORBIS_IMPL_HEADER
@@ -0,0 +1,285 @@
+#ifndef ATAG_WATCHER_IMPL_HEADER
+#define ATAG_WATCHER_IMPL_HEADER
+
+#include "../watcher.hpp"
+#include "../scan.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace atag {
+
+inline watcher::watcher(watch_options options) : options_(std::move(options)) {}
+
+inline watcher::~watcher()
+{
+    if(fd_ != -1) { ::close(fd_); }
+}
+
+inline void watcher::add_root(const std::string& directory, std::error_code& error)
+{
+    error.clear();
+    if(fd_ == -1)
+    {
+        fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(fd_ == -1)
+        {
+            error = detail::last_error();
+            return;
+        }
+        buffer_.resize(64 * 1024);
+    }
+
+    std::string path = directory;
+    while((path.length() > 1) && (path.back() == '/')) { path.pop_back(); }
+    if(!std::filesystem::is_directory(path, error))
+    {
+        if(!error) { error = std::make_error_code(std::errc::not_a_directory); }
+        return;
+    }
+    if(!add_directory(path, false))
+    {
+        error = detail::last_error();
+        return;
+    }
+    roots_.emplace_back(std::move(path));
+}
+
+inline bool watcher::add_directory(const std::string& path, const bool is_new)
+{
+    namespace fs = std::filesystem;
+
+    // The watch must be in place before the directory is listed, otherwise files
+    // created in between would be missed.
+    const uint32_t mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM
+        | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR
+        | IN_DONT_FOLLOW;
+    const int wd = ::inotify_add_watch(fd_, path.c_str(), mask);
+    if(wd == -1) { return false; }
+    directories_[wd] = path;
+
+    std::error_code ec;
+    const fs::directory_iterator end;
+    for(fs::directory_iterator it(path, fs::directory_options::skip_permission_denied, ec);
+        !ec && (it != end); it.increment(ec))
+    {
+        const auto& entry = *it;
+        std::error_code status_error;
+        if(entry.is_symlink(status_error)) { continue; }
+        const std::string entry_path = entry.path().string();
+        if(entry.is_directory(status_error))
+        {
+            add_directory(entry_path, is_new);
+        }
+        else if(entry.is_regular_file(status_error) && has_extension(entry_path))
+        {
+            // The files of a directory that was moved into a watched tree are new,
+            // and they may have been written before the watch was added.
+            if(is_new)
+                mark_changed(entry_path);
+            else
+                files_.insert(entry_path);
+        }
+    }
+    return true;
+}
+
+inline void watcher::remove_directory(const std::string& path)
+{
+    const std::string prefix = path + '/';
+    const auto is_under = [&path, &prefix](const std::string& p)
+    {
+        return (p == path) || (p.compare(0, prefix.length(), prefix) == 0);
+    };
+
+    for(auto it = directories_.begin(); it != directories_.end();)
+    {
+        if(is_under(it->second))
+        {
+            // This fails if the directory was deleted, in which case the kernel has
+            // already removed the watch.
+            ::inotify_rm_watch(fd_, it->first);
+            it = directories_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    // The files are checked once they settle, and reported as removed if they are gone.
+    for(const auto& file : files_)
+    {
+        if(is_under(file)) { mark_changed(file); }
+    }
+}
+
+inline void watcher::mark_changed(const std::string& path)
+{
+    pending_[path] = clock::now() + options_.settle_time;
+}
+
+inline void watcher::resync()
+{
+    // Events were lost, so every file has to be checked.
+    for(const auto& file : files_) { mark_changed(file); }
+    for(const auto& root : roots_) { add_directory(root, true); }
+}
+
+inline bool watcher::has_extension(const std::string& path) const
+{
+    return detail::has_extension(path, options_.extensions);
+}
+
+inline void watcher::read_events(std::error_code& error)
+{
+    for(;;)
+    {
+        const ssize_t n = ::read(fd_, buffer_.data(), buffer_.size());
+        if(n == -1)
+        {
+            if(errno == EINTR) { continue; }
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK)) { error = detail::last_error(); }
+            return;
+        }
+
+        for(const char* p = buffer_.data(); p < buffer_.data() + n;)
+        {
+            const auto& event = *reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event.len;
+
+            if(event.mask & IN_Q_OVERFLOW)
+            {
+                resync();
+                continue;
+            }
+            const auto dir = directories_.find(event.wd);
+            if(dir == directories_.end()) { continue; }
+            if(event.mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                // Subdirectories are removed when their parent reports them gone, but
+                // nothing reports a root's removal other than its own watch.
+                const auto root = std::find(roots_.begin(), roots_.end(), dir->second);
+                if(root != roots_.end())
+                {
+                    remove_directory(*root);
+                    roots_.erase(root);
+                    error = std::make_error_code(std::errc::no_such_file_or_directory);
+                }
+                else if(event.mask & IN_IGNORED)
+                {
+                    directories_.erase(dir);
+                }
+                continue;
+            }
+            if(event.len == 0) { continue; }
+
+            const std::string path = dir->second + '/' + event.name;
+            if(event.mask & IN_ISDIR)
+            {
+                if(event.mask & (IN_CREATE | IN_MOVED_TO))
+                    add_directory(path, true);
+                else if(event.mask & (IN_DELETE | IN_MOVED_FROM))
+                    remove_directory(path);
+            }
+            else if(has_extension(path))
+            {
+                mark_changed(path);
+            }
+        }
+    }
+}
+
+inline bool watcher::settle(const std::string& path, change& c)
+{
+    struct stat st;
+    if((::stat(path.c_str(), &st) == -1) || !S_ISREG(st.st_mode))
+    {
+        if(files_.erase(path) == 0) { return false; }
+        c.kind = change::removed;
+        c.path = path;
+        return true;
+    }
+
+    scan_result result = detail::parse_file(path, source_, options_.cache);
+    const bool is_known = !files_.insert(path).second;
+    // The cache vouches for the file not having been modified since it was last
+    // parsed, so it must only have been touched.
+    if(is_known && result.is_cached) { return false; }
+    c.kind = is_known ? change::updated : change::added;
+    c.path = std::move(result.path);
+    c.tag = std::move(result.tag);
+    c.error = result.error;
+    return true;
+}
+
+template<typename Callback>
+std::size_t watcher::poll(std::chrono::milliseconds timeout, Callback callback,
+    std::error_code& error)
+{
+    error.clear();
+    if(fd_ == -1)
+    {
+        error = std::make_error_code(std::errc::bad_file_descriptor);
+        return 0;
+    }
+
+    const auto deadline = clock::now() + timeout;
+    std::vector<std::string> settled;
+    std::size_t num_changes = 0;
+    for(;;)
+    {
+        const auto now = clock::now();
+        auto wake_up = deadline;
+        for(auto it = pending_.begin(); it != pending_.end();)
+        {
+            if(it->second <= now)
+            {
+                settled.emplace_back(it->first);
+                it = pending_.erase(it);
+            }
+            else
+            {
+                wake_up = std::min(wake_up, it->second);
+                ++it;
+            }
+        }
+        for(const auto& path : settled)
+        {
+            change c;
+            if(settle(path, c))
+            {
+                callback(std::move(c));
+                ++num_changes;
+            }
+        }
+        settled.clear();
+        if((num_changes > 0) || (now >= deadline)) { return num_changes; }
+
+        // Round up so that we don't wake up just before a file settles.
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(wake_up - now);
+        pollfd pfd = { fd_, POLLIN, 0 };
+        const int r = ::poll(&pfd, 1, int(std::min<int64_t>(wait.count(), INT_MAX)));
+        if((r == -1) && (errno != EINTR))
+        {
+            error = detail::last_error();
+            return num_changes;
+        }
+        if(r > 0)
+        {
+            read_events(error);
+            if(error) { return num_changes; }
+        }
+    }
+}
+
+} // namespace atag
+
+#endif // ATAG_WATCHER_IMPL_HEADER
@@ -0,0 +1,759 @@
+#ifndef ATAG_WRITER_IMPL_HEADER
+#define ATAG_WRITER_IMPL_HEADER
+
+#include "../writer.hpp"
+#include "../encoding.hpp"
+#include "../file_source.hpp"
+#include "../detail/io_util.hpp"
+#include "../detail/key_hash.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <linux/fs.h>
+# include <sys/ioctl.h>
+#endif
+
+namespace atag {
+namespace detail {
+
+/** Opens `path` for reading and writing and returns its descriptor, or -1 on error. */
+inline int open_file_for_writing(const std::string& path, std::size_t& size,
+    std::error_code& error)
+{
+    const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if(fd == -1)
+    {
+        error = last_error();
+        return -1;
+    }
+    struct stat st;
+    if(::fstat(fd, &st) == -1)
+    {
+        error = last_error();
+        ::close(fd);
+        return -1;
+    }
+    size = st.st_size;
+    return fd;
+}
+
+/** Copies `length` bytes through a buffer, as a fallback for `copy_file_region`. */
+inline bool copy_file_region_buffered(const int in_fd, std::size_t in_offset,
+    const int out_fd, std::size_t out_offset, std::size_t length, std::error_code& error)
+{
+    std::vector<char> buffer(std::min<std::size_t>(length, 1 << 20));
+    while(length > 0)
+    {
+        const std::size_t n = std::min(buffer.size(), length);
+        if(!pread_all(in_fd, buffer.data(), n, in_offset, error)
+           || !pwrite_all(out_fd, buffer.data(), n, out_offset, error))
+        {
+            return false;
+        }
+        in_offset += n;
+        out_offset += n;
+        length -= n;
+    }
+    return true;
+}
+
+/**
+ * Copies `length` bytes at `in_offset` of `in_fd` to `out_offset` of `out_fd` without
+ * passing them through userspace, using `copy_file_range`, which on file systems that
+ * support it (e.g. NFS, SMB) even copies on the server. Falls back to copying through a
+ * buffer where it's not available.
+ */
+inline bool copy_file_region(const int in_fd, std::size_t in_offset, const int out_fd,
+    std::size_t out_offset, std::size_t length, std::error_code& error)
+{
+#ifdef __linux__
+    while(length > 0)
+    {
+        loff_t in = in_offset;
+        loff_t out = out_offset;
+        const ssize_t n = ::copy_file_range(in_fd, &in, out_fd, &out, length, 0);
+        if(n == -1)
+        {
+            if(errno == EINTR) { continue; }
+            // Not supported by the kernel, or between these two file systems.
+            if((errno == ENOSYS) || (errno == EXDEV) || (errno == EINVAL)
+               || (errno == EOPNOTSUPP))
+            {
+                break;
+            }
+            error = last_error();
+            return false;
+        }
+        else if(n == 0)
+        {
+            // The file must have been truncated since it was opened.
+            error = std::make_error_code(std::errc::io_error);
+            return false;
+        }
+        in_offset += n;
+        out_offset += n;
+        length -= n;
+    }
+#endif
+    return copy_file_region_buffered(in_fd, in_offset, out_fd, out_offset, length, error);
+}
+
+/**
+ * Tries to make the bytes of `in_fd` from `in_offset` to its end share their storage
+ * with `out_fd` at `out_offset` (a reflink), on file systems that support it, such as
+ * Btrfs and XFS, which makes copying them free. Only whole file system blocks may be
+ * shared, so this requires the offsets to be equal modulo the block size: the bytes
+ * preceding the first block boundary are copied. Returns false if the bytes could not
+ * be shared, in which case they are to be copied.
+ */
+inline bool clone_file_tail(const int in_fd, const std::size_t in_offset,
+    const std::size_t in_size, const int out_fd, const std::size_t out_offset,
+    const std::size_t block_size, std::error_code& error)
+{
+#if defined(__linux__) && defined(FICLONERANGE)
+    if((block_size == 0) || (in_offset % block_size != out_offset % block_size))
+    {
+        return false;
+    }
+    const std::size_t head = (block_size - in_offset % block_size) % block_size;
+    if(in_offset + head >= in_size) { return false; }
+
+    // The unaligned bytes are copied first, so that the clone starts at the end of
+    // `out_fd`.
+    if(!copy_file_region(in_fd, in_offset, out_fd, out_offset, head, error))
+    {
+        return false;
+    }
+    file_clone_range range;
+    range.src_fd = in_fd;
+    range.src_offset = in_offset + head;
+    // 0 means up to the end of the source file, which needn't be block aligned.
+    range.src_length = 0;
+    range.dest_offset = out_offset + head;
+    return ::ioctl(out_fd, FICLONERANGE, &range) == 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Returns the file system's block size for `fd` (the granularity at which storage may
+ * be shared between files), or 0 if it can't be determined.
+ */
+inline std::size_t block_size_of(const int fd) noexcept
+{
+    struct stat st;
+    return ::fstat(fd, &st) == 0 ? st.st_blksize : 0;
+}
+
+/**
+ * Returns the padding to give a tag of `head_size` bytes (excluding padding), at least
+ * `padding`, so that the audio following it starts at the same offset within a file
+ * system block as it did at `tail_offset` in the original file, which lets
+ * `rewrite_file` share the audio's storage with the original.
+ */
+inline std::size_t aligned_padding(const std::size_t head_size, const std::size_t padding,
+    const std::size_t tail_offset, const std::size_t block_size) noexcept
+{
+    if(block_size == 0) { return padding; }
+    const std::size_t misalignment = (head_size + padding) % block_size;
+    return padding + (tail_offset % block_size + block_size - misalignment) % block_size;
+}
+
+/**
+ * Replaces the file at `path` (open as `fd`, of `file_size` bytes) with one consisting
+ * of `head`, followed by the original file's contents from `tail_offset` onwards. The
+ * new file is written next to the original and renamed over it once it has been
+ * flushed to disk, so that the original is left intact if anything fails.
+ *
+ * The tail (the audio) is reflinked if possible (see `clone_file_tail`) and otherwise
+ * copied in the kernel (see `copy_file_region`).
+ */
+inline bool rewrite_file(const std::string& path, const int fd,
+    const std::size_t file_size, const std::string& head, std::size_t tail_offset,
+    std::error_code& error)
+{
+    struct stat st;
+    if(::fstat(fd, &st) == -1)
+    {
+        error = last_error();
+        return false;
+    }
+
+    const std::string tmp_path = path + ".atag.tmp";
+    const int tmp_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        st.st_mode & 07777);
+    if(tmp_fd == -1)
+    {
+        error = last_error();
+        return false;
+    }
+
+    bool ok = (::fchmod(tmp_fd, st.st_mode & 07777) == 0)
+        && pwrite_all(tmp_fd, head.data(), head.size(), 0, error);
+    if(ok && (tail_offset < file_size) && !clone_file_tail(fd, tail_offset, file_size,
+        tmp_fd, head.size(), st.st_blksize, error) && !error)
+    {
+        ok = copy_file_region(fd, tail_offset, tmp_fd, head.size(),
+            file_size - tail_offset, error);
+    }
+    ok = ok && !error;
+    if(!ok || (::fsync(tmp_fd) == -1) || (::rename(tmp_path.c_str(), path.c_str()) == -1))
+    {
+        if(!error) { error = last_error(); }
+        ::close(tmp_fd);
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+    ::close(tmp_fd);
+    return true;
+}
+
+inline void put_be32(std::string& out, const uint32_t v)
+{
+    for(int shift = 24; shift >= 0; shift -= 8) { out += char(v >> shift); }
+}
+
+inline void put_le32(std::string& out, const uint32_t v)
+{
+    for(int shift = 0; shift <= 24; shift += 8) { out += char(v >> shift); }
+}
+
+} // namespace detail
+
+namespace id3v2 {
+
+/** The largest size a tag (excluding its header) may have, as it's a 28 bit integer. */
+enum { max_tag_size = (1 << 28) - 1 };
+
+/**
+ * Encodes the UTF-8 `data` of a text frame, comment or lyrics frame (as produced by
+ * `parse_frame_data`) as a frame body with its encoding byte, appending it to `out`.
+ */
+template<typename String>
+void encode_text(const int version, const int id, const String& data, std::string& out)
+{
+    namespace enc = atag::encoding;
+    std::string_view text(data.data(), data.size());
+    const auto is_ascii = [](const char c) { return (c & 0x80) == 0; };
+    const std::string_view language = text.substr(0, has_language(id) ? 3 : 0);
+    text.remove_prefix(language.size());
+    const int text_encoding = version >= 4 ? encoding::utf8
+        : std::all_of(text.begin(), text.end(), is_ascii) ? encoding::iso_8859_1
+        : encoding::utf16;
+    const std::size_t terminator_length = text_encoding == encoding::utf16 ? 2 : 1;
+    // Each string is encoded on its own, so that in UTF-16 each has its own BOM.
+    const auto put = [&out, text_encoding](const std::string_view s)
+    {
+        if(text_encoding != encoding::utf16)
+        {
+            out.append(s.data(), s.size());
+            return;
+        }
+        out += "\xff\xfe";
+        const std::size_t pos = out.size();
+        out.resize(pos + enc::max_utf16_length_of_utf8(s.size()));
+        out.resize(pos + enc::utf8_to_utf16(s.data(), s.size(),
+            enc::byte_order::little_endian, &out[pos]));
+    };
+
+    out += char(text_encoding);
+    // The language is required, so an unknown one is written in its place if missing.
+    out.append(language.data(), language.size());
+    out.append(language.size() < 3 && has_language(id) ? 3 - language.size() : 0, 'X');
+    // As is the description, which if absent is taken to be empty.
+    if(has_description(id) && (text.find('\0') == std::string_view::npos))
+    {
+        put({});
+        out.append(terminator_length, 0);
+    }
+    for(std::size_t pos = 0;;)
+    {
+        const std::size_t end = std::min(text.find('\0', pos), text.size());
+        put(text.substr(pos, end - pos));
+        if(end == text.size()) { break; }
+        out.append(terminator_length, 0);
+        pos = end + 1;
+    }
+}
+
+/** Updates the size field in the header of the serialized tag in `out`. */
+inline void set_tag_size(std::string& out)
+{
+    detail::write_syncsafe(uint32_t(out.size() - 10), &out[6]);
+}
+
+/** Writes `size` to the size field of the frame header at `p`. */
+inline void set_frame_size(const int version, const uint32_t size, char* p)
+{
+    if(version >= 4)
+        detail::write_syncsafe(size, p);
+    else
+        for(int shift = 24; shift >= 0; shift -= 8) { *p++ = char(size >> shift); }
+}
+
+/**
+ * Appends the header of an ID3v2.3 tag if `tag.version` is 3, and of an ID3v2.4 tag
+ * otherwise, to `out`. Its size is left to be set by `set_tag_size`.
+ */
+template<typename Tag>
+int put_tag_header(const Tag& tag, std::string& out)
+{
+    const int version = tag.version == 3 ? 3 : 4;
+    out += "ID3";
+    out += char(version);
+    out += char(0);
+    // Neither an extended header nor a footer is written, nor is the tag
+    // unsynchronised, so only the experimental flag is carried over.
+    out += char(tag.flags & tag::experimental);
+    out.append(4, 0);
+    return version;
+}
+
+/** Appends `frame` to `out`, or nothing if it's not a known frame. */
+template<typename Frame>
+void put_frame(const int version, const Frame& frame, std::string& out)
+{
+    const char* id = frame_id_to_string(frame.id);
+    if(id == nullptr) { return; }
+
+    const std::size_t frame_start = out.size();
+    out.append(id, 4);
+    out.append(4, 0);
+    // Text is re-encoded, so the format flags no longer apply to it, only the
+    // status flags do.
+    const uint16_t flags = is_encoded_frame(frame.id)
+        ? frame.flags & 0xff00 : frame.flags;
+    out += char(flags >> 8);
+    out += char(flags);
+    if(is_encoded_frame(frame.id))
+        encode_text(version, frame.id, frame.data, out);
+    else
+        out.append(frame.data.data(), frame.data.size());
+    set_frame_size(version, out.size() - frame_start - 10, &out[frame_start + 4]);
+}
+
+template<typename Allocator>
+std::string serialize(const basic_tag<Allocator>& tag, const std::size_t padding)
+{
+    std::string out;
+    const int version = put_tag_header(tag, out);
+    for(const auto& frame : tag.frames) { put_frame(version, frame, out); }
+    out.append(padding, 0);
+    set_tag_size(out);
+    return out;
+}
+
+/**
+ * Serializes `tag` as `serialize` does, but copies the frames of `old_tag` (the tag
+ * being replaced, without its footer) that `tag` holds unchanged, as well as those
+ * that `parse` doesn't know and so are not in `tag`, byte for byte, so that what
+ * can't be decoded and encoded again without loss is preserved. The frames of `tag`
+ * that are new or were modified follow them.
+ */
+template<typename Allocator>
+std::string splice_frames(const std::string_view old_tag, const basic_tag<Allocator>& tag)
+{
+    tag_header old_header;
+    detail::source_cursor<std::string_view> frames;
+    // The frames of ID3v2.2 tags are laid out differently, and those of unsynchronised
+    // tags would have to be resynchronised, so they're not copied.
+    if(!take_frames(old_tag, 0, old_header, frames) || (old_header.version < 3)
+       || (old_header.flags & tag::unsynchronisation))
+    {
+        return serialize(tag);
+    }
+
+    std::string out;
+    const int version = put_tag_header(tag, out);
+    std::vector<bool> is_copied(tag.frames.size());
+    std::string data;
+    while(frames.has(10))
+    {
+        if(frames[0] == 0) { break; }
+        const char* frame_begin = frames.data();
+        const auto header = parse_frame_header(frame_begin, old_header.version);
+        frames.advance(10);
+        detail::source_cursor<std::string_view> body;
+        if((header.size <= 0) || !frames.take(header.size, body)) { break; }
+
+        // The status flags are in different bits in ID3v2.3 and ID3v2.4, and the
+        // format flags change how the body is read, so a frame moving to a tag of
+        // another version is only copied if it has no format flags, and without flags.
+        const bool is_same_version = version == old_header.version;
+        if(!is_same_version && ((header.flags & 0xff) != 0)) { continue; }
+        if(is_frame_header_valid(header))
+        {
+            // A known frame is only copied if `tag` still holds it.
+            parse_frame_data(header, body.data(), data);
+            std::size_t i = 0;
+            for(; i < tag.frames.size(); ++i)
+            {
+                const auto& frame = tag.frames[i];
+                if(!is_copied[i] && (frame.id == header.id)
+                   && (frame.flags == header.flags)
+                   && (std::string_view(frame.data.data(), frame.data.size()) == data))
+                {
+                    break;
+                }
+            }
+            if(i == tag.frames.size()) { continue; }
+            is_copied[i] = true;
+        }
+
+        const std::size_t frame_start = out.size();
+        out.append(frame_begin, is_same_version ? 10 + header.size : 8);
+        if(!is_same_version)
+        {
+            out.append(2, 0);
+            out.append(body.data(), header.size);
+            set_frame_size(version, header.size, &out[frame_start + 4]);
+        }
+    }
+
+    for(std::size_t i = 0; i < tag.frames.size(); ++i)
+    {
+        if(!is_copied[i]) { put_frame(version, tag.frames[i], out); }
+    }
+    set_tag_size(out);
+    return out;
+}
+
+template<typename Allocator>
+bool write(const std::string& path, const basic_tag<Allocator>& tag,
+    const padding_policy& policy, std::error_code& error)
+{
+    error.clear();
+    std::size_t file_size;
+    const int fd = detail::open_file_for_writing(path, file_size, error);
+    if(fd == -1) { return false; }
+
+    // Find the space taken up by the tag at the start of the file, if there is one.
+    std::size_t old_size = 0;
+    std::string old_tag(10, 0);
+    if(file_size >= 10)
+    {
+        if(!detail::pread_all(fd, &old_tag[0], 10, 0, error))
+        {
+            ::close(fd);
+            return false;
+        }
+        if(find_tag_start(old_tag) == 0)
+        {
+            const auto h = parse_tag_header(old_tag.data());
+            old_tag.resize(10 + h.size);
+            old_size = old_tag.size() + (h.flags & tag::has_footer ? 10 : 0);
+        }
+    }
+    if(old_size > file_size)
+    {
+        ::close(fd);
+        error = std::make_error_code(std::errc::illegal_byte_sequence);
+        return false;
+    }
+    if((old_size > 0)
+       && !detail::pread_all(fd, &old_tag[10], old_tag.size() - 10, 10, error))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    std::string data = old_size > 0 ? splice_frames(old_tag, tag) : serialize(tag);
+    bool in_place = (data.size() <= old_size)
+        && (old_size - data.size() <= policy.max_padding);
+    // The padding takes up the rest of the old tag's space, or if the file has to be
+    // rewritten, what the policy prescribes (rounded up so that the audio may be
+    // reflinked).
+    data.resize(in_place ? old_size : data.size() + detail::aligned_padding(data.size(),
+        policy.padding, old_size, detail::block_size_of(fd)), 0);
+    if(data.size() - 10 > max_tag_size)
+    {
+        ::close(fd);
+        error = std::make_error_code(std::errc::value_too_large);
+        return false;
+    }
+    set_tag_size(data);
+
+    if(in_place)
+        in_place = detail::pwrite_all(fd, data.data(), data.size(), 0, error);
+    else
+        detail::rewrite_file(path, fd, file_size, data, old_size, error);
+    ::close(fd);
+    return in_place;
+}
+
+} // namespace id3v2
+
+namespace flac {
+
+struct metadata_block
+{
+    std::size_t offset;
+    std::size_t length;
+    int type;
+};
+
+/** A block's length is a 24 bit integer. */
+enum { max_block_length = (1 << 24) - 1 };
+
+inline void put_block_header(std::string& out, const int type, const std::size_t length,
+    const bool is_last)
+{
+    out += char((is_last ? 0x80 : 0) | type);
+    out += char(length >> 16);
+    out += char(length >> 8);
+    out += char(length);
+}
+
+/**
+ * Splits the body of a VORBIS_COMMENT block into the vendor string and the comments.
+ * Returns false if the block is malformed.
+ */
+inline bool split_vorbis_comment(const std::string& body, std::string& vendor,
+    std::vector<std::string>& comments)
+{
+    std::size_t offset = 0;
+    const auto next = [&body, &offset](std::string& s)
+    {
+        if(body.size() - offset < 4) { return false; }
+        const uint32_t length = detail::parse_le<uint32_t>(&body[offset]);
+        offset += 4;
+        if(body.size() - offset < length) { return false; }
+        s.assign(body, offset, length);
+        offset += length;
+        return true;
+    };
+
+    if(!next(vendor) || (body.size() - offset < 4)) { return false; }
+    const uint32_t num_comments = detail::parse_le<uint32_t>(&body[offset]);
+    offset += 4;
+    std::string comment;
+    for(uint32_t i = 0; i < num_comments; ++i)
+    {
+        if(!next(comment)) { return false; }
+        comments.push_back(std::move(comment));
+    }
+    return true;
+}
+
+/** Returns whether the text fields `a` and `b` differ, whatever their string types. */
+template<typename A, typename B>
+bool is_changed(const A& a, const B& b) noexcept
+{
+    return std::string_view(a.data(), a.size()) != std::string_view(b.data(), b.size());
+}
+
+/**
+ * Makes the body of a VORBIS_COMMENT block holding `old_comments`, whose fields are
+ * `old`, with the fields of `tag` that differ from them in place of the comments they
+ * are parsed from. PERFORMER comments, which `parse` adds to the artist, are never
+ * replaced, as only the ARTIST comments are written back.
+ */
+template<typename OldTag, typename Tag>
+std::string make_vorbis_comment(const std::string& vendor,
+    const std::vector<std::string>& old_comments, const OldTag& old, const Tag& tag)
+{
+    struct field
+    {
+        const char* key;
+        bool is_changed;
+        std::string value;
+    };
+    const auto number = [](const int n) { return n > 0 ? std::to_string(n) : ""; };
+    field fields[] = {
+        {"TITLE", is_changed(old.title, tag.title), {tag.title.data(), tag.title.size()}},
+        {"ALBUM", is_changed(old.album, tag.album), {tag.album.data(), tag.album.size()}},
+        {"ARTIST", is_changed(old.artist, tag.artist),
+            {tag.artist.data(), tag.artist.size()}},
+        {"GENRE", is_changed(old.genre, tag.genre), {tag.genre.data(), tag.genre.size()}},
+        {"DATE", old.year != tag.year, number(tag.year)},
+        {"TRACKNUMBER", old.track_number != tag.track_number, number(tag.track_number)},
+    };
+
+    std::vector<std::string> comments;
+    // A changed field takes the place of the first comment it replaces (so that the
+    // order of e.g. the ARTIST and PERFORMER comments is kept), or is added at the end.
+    std::vector<bool> is_written(std::size(fields));
+    const auto put = [&comments, &fields, &is_written](const std::size_t i)
+    {
+        if(!fields[i].value.empty())
+            comments.push_back(fields[i].key + ('=' + fields[i].value));
+        is_written[i] = true;
+    };
+    for(const auto& comment : old_comments)
+    {
+        const std::size_t key_length = std::min(comment.find('='), comment.size());
+        const std::size_t i = std::find_if(std::begin(fields), std::end(fields),
+            [&comment, key_length](const field& f)
+            { return detail::key_equals(comment.data(), key_length, f.key); })
+            - std::begin(fields);
+        if((i == std::size(fields)) || !fields[i].is_changed)
+            comments.push_back(comment);
+        else if(!is_written[i])
+            put(i);
+    }
+    for(std::size_t i = 0; i < std::size(fields); ++i)
+    {
+        if(fields[i].is_changed && !is_written[i]) { put(i); }
+    }
+
+    std::string body;
+    detail::put_le32(body, vendor.size());
+    body += vendor;
+    detail::put_le32(body, comments.size());
+    for(const auto& comment : comments)
+    {
+        detail::put_le32(body, comment.size());
+        body += comment;
+    }
+    return body;
+}
+
+template<typename Allocator>
+bool write(const std::string& path, const basic_tag<Allocator>& tag,
+    const padding_policy& policy, std::error_code& error)
+{
+    error.clear();
+    std::size_t file_size;
+    const int fd = detail::open_file_for_writing(path, file_size, error);
+    if(fd == -1) { return false; }
+
+    const auto fail = [fd, &error](const std::errc e)
+    {
+        ::close(fd);
+        if(!error) { error = std::make_error_code(e); }
+        return false;
+    };
+
+    // https://xiph.org/flac/format.html#metadata_block
+    char header[4];
+    if((file_size < 8) || !detail::pread_all(fd, header, 4, 0, error)
+       || !std::equal(header, header + 4, "fLaC"))
+    {
+        return fail(std::errc::invalid_argument);
+    }
+    std::vector<metadata_block> blocks;
+    std::size_t metadata_end = 4;
+    for(bool is_last = false; !is_last;)
+    {
+        if((file_size - metadata_end < 4)
+           || !detail::pread_all(fd, header, 4, metadata_end, error))
+        {
+            return fail(std::errc::illegal_byte_sequence);
+        }
+        const auto h = parse_block_header(header);
+        if(file_size - metadata_end - 4 < std::size_t(h.length))
+        {
+            return fail(std::errc::illegal_byte_sequence);
+        }
+        blocks.push_back(metadata_block{metadata_end, std::size_t(h.length), h.type});
+        metadata_end += 4 + h.length;
+        is_last = h.is_last_block;
+    }
+
+    // Only the blocks starting from the first VORBIS_COMMENT or PADDING block are
+    // rewritten (which is where the space to edit in place comes from).
+    const auto is_replaced = [](const metadata_block& b)
+    {
+        return (b.type == block_header::vorbis_comment)
+            || (b.type == block_header::padding);
+    };
+    const auto first_replaced = std::find_if(blocks.begin(), blocks.end(), is_replaced);
+    const std::size_t span_offset = first_replaced != blocks.end()
+        ? first_replaced->offset : metadata_end;
+
+    std::string vendor = "atag";
+    std::vector<std::string> comments;
+    basic_tag<> old{};
+    bool has_comments = false;
+    std::string span;
+    for(auto it = first_replaced; it != blocks.end(); ++it)
+    {
+        if(it->type == block_header::padding) { continue; }
+
+        std::string block(4 + it->length, 0);
+        if(!detail::pread_all(fd, &block[0], block.size(), it->offset, error))
+        {
+            return fail(std::errc::io_error);
+        }
+        if(it->type == block_header::vorbis_comment)
+        {
+            // There should only be one, but if there are more, the first one wins.
+            if(!has_comments)
+            {
+                if(!split_vorbis_comment(block.substr(4), vendor, comments))
+                    return fail(std::errc::illegal_byte_sequence);
+                vorbis::detail::parse_fields(&block[4], it->length, old);
+                has_comments = true;
+            }
+            continue;
+        }
+        // The blocks that are moved are no longer the last one.
+        block[0] &= 0x7f;
+        span += block;
+    }
+
+    const std::string comment_body = make_vorbis_comment(vendor, comments, old, tag);
+    if(comment_body.size() > max_block_length)
+    {
+        return fail(std::errc::value_too_large);
+    }
+    put_block_header(span, block_header::vorbis_comment, comment_body.size(), false);
+    span += comment_body;
+
+    // The edit can be done in place if the new blocks exactly fill the old space, or if
+    // what remains fits a PADDING block that is not larger than the policy permits.
+    const std::size_t space = metadata_end - span_offset;
+    const std::size_t max_padding = std::min<std::size_t>(policy.max_padding,
+        max_block_length);
+    const bool in_place = (span.size() == space)
+        || ((span.size() + 4 <= space) && (space - span.size() - 4 <= max_padding));
+    std::size_t padding = in_place ? space - std::min(space, span.size() + 4)
+        : detail::aligned_padding(span_offset + span.size() + 4, policy.padding,
+            metadata_end, detail::block_size_of(fd));
+    if(padding > max_block_length)
+    {
+        padding = std::min<std::size_t>(policy.padding, max_block_length);
+    }
+    if(!in_place || (span.size() < space))
+    {
+        put_block_header(span, block_header::padding, padding, true);
+        span.append(padding, 0);
+    }
+    else
+    {
+        // The VORBIS_COMMENT block is the last one.
+        span[span.size() - comment_body.size() - 4] |= 0x80;
+    }
+
+    bool ok;
+    if(in_place)
+    {
+        ok = detail::pwrite_all(fd, span.data(), span.size(), span_offset, error);
+    }
+    else
+    {
+        // Keep the blocks preceding the rewritten ones as they are.
+        std::string head(span_offset, 0);
+        ok = detail::pread_all(fd, &head[0], span_offset, 0, error);
+        // If none of the blocks was rewritten, the new ones follow what was the last.
+        if(ok && (first_replaced == blocks.end())) { head[blocks.back().offset] &= 0x7f; }
+        head += span;
+        ok = ok && detail::rewrite_file(path, fd, file_size, head, metadata_end, error);
+    }
+    ::close(fd);
+    return ok && in_place;
+}
+
+} // namespace flac
+} // namespace atag
+
+#endif // ATAG_WRITER_IMPL_HEADER
@@ -0,0 +1,112 @@
+#ifndef ATAG_INSTRUMENTATION_HEADER
+#define ATAG_INSTRUMENTATION_HEADER
+
+#include "parse_result.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+/**
+ * If the library is compiled with ATAG_ENABLE_INSTRUMENTATION defined, the parsers (and
+ * `mpeg::read_properties`), the reads of `file_source` and the conversions of
+ * `atag::encoding` report what they did to the observer installed with
+ * `instrumentation::set_observer`, if any. Otherwise the hooks compile to nothing, and
+ * an installed observer is never called.
+ *
+ * The macro must be defined the same way in all translation units of a program. The
+ * `instrumentation::metrics` observer (in `atag/metrics.hpp`) aggregates the events
+ * into histograms and counters.
+ */
+
+namespace atag {
+namespace instrumentation {
+
+/** The formats whose parsers report to the observer. */
+enum class format
+{
+    id3v2,
+    flac,
+    ape,
+    id3v1,
+    ogg,
+    mp4,
+    riff,
+    // The audio frames walked by `mpeg::read_properties`.
+    mpeg,
+};
+
+constexpr int num_formats = 8;
+
+inline const char* format_name(const format f) noexcept;
+
+/**
+ * What a parser did to parse a tag. Frames stand for FLAC metadata blocks, APE items,
+ * Ogg header packets, MP4 metadata items, RIFF chunks and MPEG audio frames as well. A
+ * frame is visited when its header is read, and decoded when its body is parsed into the
+ * tag, so the difference between the two is the number of frames that were skipped.
+ */
+struct parse_stats
+{
+    format tag_format = format::id3v2;
+    std::chrono::nanoseconds duration{0};
+    // The bytes of the tag that were read, i.e. the headers of the visited frames and the
+    // bodies of the decoded ones (which excludes the bytes that were only skipped).
+    std::size_t bytes_read = 0;
+    int frames_visited = 0;
+    int frames_decoded = 0;
+    // The error at which the parser stopped, if the tag is malformed or truncated.
+    parse_error error;
+};
+
+/** The conversions of `atag::encoding` that report to the observer. */
+enum class conversion
+{
+    iso_8859_1_to_utf8,
+    utf16_to_utf8,
+    utf8_to_utf16,
+};
+
+constexpr int num_conversions = 3;
+
+inline const char* conversion_name(const conversion c) noexcept;
+
+/**
+ * Receives the events of the instrumented library. The hooks are called on the thread
+ * that did the work (e.g. on the worker threads of `atag::scan`), so an observer must be
+ * thread-safe, and as they are on the hot path, they should return quickly.
+ *
+ * Sources that are not tagged are not reported as parses, as the parsers only look at
+ * the few bytes where a tag would be.
+ */
+class observer
+{
+public:
+    virtual ~observer() = default;
+
+    /** Called once a parser stopped parsing a tag, successfully or not. */
+    virtual void on_parse(const parse_stats&) noexcept {}
+
+    /** Called after `file_source::fetch` read `num_bytes` from its file. */
+    virtual void on_read(std::size_t /*num_bytes*/,
+        std::chrono::nanoseconds /*duration*/) noexcept {}
+
+    /** Called after a conversion of `num_bytes` bytes of text. */
+    virtual void on_convert(conversion /*c*/, std::size_t /*num_bytes*/,
+        std::chrono::nanoseconds /*duration*/) noexcept {}
+};
+
+/**
+ * Installs `o` as the observer of the library (or none, if it's null), and returns the
+ * one it replaced. `o` must outlive its installation, including the calls already
+ * underway on other threads when it's replaced.
+ */
+inline observer* set_observer(observer* o) noexcept;
+inline observer* get_observer() noexcept;
+
+} // namespace instrumentation
+} // namespace atag
+
+#include "impl/instrumentation.ipp"
+
+#endif // ATAG_INSTRUMENTATION_HEADER
@@ -0,0 +1,222 @@
+#ifndef ATAG_LIBRARY_HEADER
+#define ATAG_LIBRARY_HEADER
+
+#include "collation.hpp"
+#include "simple_tag.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace atag {
+
+// See atag.hpp.
+namespace order {
+struct track_number;
+struct title;
+struct album;
+struct year;
+struct artist;
+} // namespace order
+
+/**
+ * A set of deduplicated strings, each identified by a dense 32-bit id in the order in
+ * which it was first interned. The strings are stored back to back in a single buffer,
+ * so a string that occurs many times (such as the artist of every track of an album)
+ * is only stored once. The empty string is always interned, with id 0.
+ */
+class string_pool
+{
+    // The strings, back to back, and where each one starts. The last offset is the end
+    // of the last string.
+    std::vector<char> data_;
+    std::vector<uint32_t> offsets_;
+    // An open addressing hash table of the ids (plus one, so that 0 marks an empty slot).
+    // Its size is a power of two, and it's kept at most half full.
+    std::vector<uint32_t> slots_;
+
+public:
+    string_pool();
+
+    /**
+     * Returns the id of `s`, storing it first if it's not yet in the pool. `s` must not
+     * refer to a string of the pool itself.
+     */
+    uint32_t intern(const std::string_view s);
+
+    /** Returns the string with `id`, which is valid until the next call to `intern`. */
+    std::string_view operator[](const uint32_t id) const noexcept
+    {
+        return {data_.data() + offsets_[id], offsets_[id+1] - offsets_[id]};
+    }
+
+    /** Returns the number of distinct strings. */
+    std::size_t size() const noexcept { return offsets_.size() - 1; }
+
+    /** Returns the number of bytes taken up by the strings themselves. */
+    std::size_t num_bytes() const noexcept { return data_.size(); }
+
+    /**
+     * Returns the rank of each string (indexed by id) when they are sorted byte-wise,
+     * i.e. in the same order as `std::string`'s comparison operators. Since the strings
+     * are distinct, so are their ranks. This compares each distinct string only a few
+     * times, rather than every occurrence of it on every comparison of a sort.
+     */
+    std::vector<uint32_t> ranks() const;
+
+    /**
+     * Same as above, but the strings are ranked by their sort keys (see
+     * `append_sort_key`), which are made once per string. Strings with the same key
+     * (e.g. "The Beatles" and "the beatles") have the same rank.
+     */
+    std::vector<uint32_t> ranks(const collation_options& options) const;
+
+    void clear();
+
+private:
+    void grow();
+};
+
+/**
+ * A collection of `basic_simple_tag`s that is stored column-wise: each field of the
+ * tags is in an array of its own, and the strings are interned into a `string_pool`
+ * per field, so that each of their columns is an array of ids. With millions of tracks
+ * this takes a fraction of the memory of a vector of tags, and it lets sorting and
+ * grouping run on dense integer arrays instead of on strings spread across the heap.
+ *
+ * Rows are identified by their 32-bit index.
+ */
+class library
+{
+public:
+    /** The fields of a row, with the strings referring into the pools of the library. */
+    struct entry
+    {
+        std::string_view title;
+        std::string_view album;
+        std::string_view artist;
+        enum genre genre;
+        int track_number;
+        int length; // in ms
+        int year;
+    };
+
+    /**
+     * The rows that share an artist or album. The rows of the `i`th group are
+     * `rows[offsets[i]]` up to `rows[offsets[i+1]]`, in their order in the library.
+     */
+    struct groups
+    {
+        // The id of the artist or album of each group. Groups are in the byte-wise order
+        // of their strings, so the group of rows without one (with id 0) is first.
+        std::vector<uint32_t> ids;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> rows;
+
+        std::size_t size() const noexcept { return ids.size(); }
+    };
+
+private:
+    string_pool titles_;
+    string_pool albums_;
+    string_pool artists_;
+    std::vector<uint32_t> title_ids_;
+    std::vector<uint32_t> album_ids_;
+    std::vector<uint32_t> artist_ids_;
+    std::vector<enum genre> genres_;
+    std::vector<int> track_numbers_;
+    std::vector<int> lengths_;
+    std::vector<int> years_;
+
+public:
+    std::size_t size() const noexcept { return title_ids_.size(); }
+    bool empty() const noexcept { return title_ids_.empty(); }
+
+    /** Reserves room for `n` rows (but not for their strings). */
+    void reserve(const std::size_t n);
+    void clear();
+
+    template<typename Allocator>
+    void push_back(const basic_simple_tag<Allocator>& tag);
+
+    entry operator[](const std::size_t row) const noexcept
+    {
+        return {titles_[title_ids_[row]], albums_[album_ids_[row]],
+            artists_[artist_ids_[row]], genres_[row], track_numbers_[row],
+            lengths_[row], years_[row]};
+    }
+
+    const string_pool& title_pool() const noexcept { return titles_; }
+    const string_pool& album_pool() const noexcept { return albums_; }
+    const string_pool& artist_pool() const noexcept { return artists_; }
+
+    const std::vector<uint32_t>& title_ids() const noexcept { return title_ids_; }
+    const std::vector<uint32_t>& album_ids() const noexcept { return album_ids_; }
+    const std::vector<uint32_t>& artist_ids() const noexcept { return artist_ids_; }
+    const std::vector<enum genre>& genres() const noexcept { return genres_; }
+    const std::vector<int>& track_numbers() const noexcept { return track_numbers_; }
+    const std::vector<int>& lengths() const noexcept { return lengths_; }
+    const std::vector<int>& years() const noexcept { return years_; }
+
+    /**
+     * Returns the rows in the order given by `order`, which must be one of the
+     * comparators in `atag::order`, e.g. `lib.sorted_rows(atag::order::artist())`. The
+     * result is the same as stable sorting the tags with that comparator, but the
+     * strings are only compared once per distinct string (see `string_pool::ranks`),
+     * after which the rows are sorted by integer keys alone. Large libraries are radix
+     * sorted.
+     */
+    template<typename Order>
+    std::vector<uint32_t> sorted_rows(Order order) const;
+
+    /**
+     * Same as above, but strings are ordered by their sort keys (as `collated` tags are),
+     * which are made once per distinct string.
+     */
+    template<typename Order>
+    std::vector<uint32_t> sorted_rows(Order order,
+        const collation_options& options) const;
+
+    /** Reorders the rows themselves by `order` (see `sorted_rows`). */
+    template<typename Order>
+    void sort(Order order);
+    template<typename Order>
+    void sort(Order order, const collation_options& options);
+
+    /**
+     * Groups the rows by artist or by album. Since the ids are dense, this is a
+     * counting sort of the id column, which touches no strings but those of the pool.
+     * Albums are grouped by title only, so albums of different artists with the same
+     * title (e.g. "Greatest Hits") are in the same group.
+     */
+    groups group_by_artist() const;
+    groups group_by_album() const;
+
+private:
+    // The sort key of each row is the rank of its string or its number (see
+    // `detail::order_preserving`) in the upper 32 bits, and the row in the lower 32.
+    // Strings are ranked byte-wise if `options` is null.
+    std::vector<uint64_t> make_sort_keys(const order::track_number&,
+        const collation_options*) const;
+    std::vector<uint64_t> make_sort_keys(const order::title&,
+        const collation_options* options) const;
+    std::vector<uint64_t> make_sort_keys(const order::album&,
+        const collation_options* options) const;
+    std::vector<uint64_t> make_sort_keys(const order::year&,
+        const collation_options*) const;
+    std::vector<uint64_t> make_sort_keys(const order::artist&,
+        const collation_options* options) const;
+    std::vector<uint64_t> make_sort_keys(const std::vector<uint32_t>& ids,
+        const string_pool& pool, const collation_options* options) const;
+    std::vector<uint64_t> make_sort_keys(const std::vector<int>& numbers) const;
+    static std::vector<uint32_t> sort_rows(std::vector<uint64_t> keys);
+
+    void permute(const std::vector<uint32_t>& rows);
+};
+
+} // namespace atag
+
+#include "impl/library.ipp"
+
+#endif // ATAG_LIBRARY_HEADER
@@ -0,0 +1,140 @@
+#ifndef ATAG_METRICS_HEADER
+#define ATAG_METRICS_HEADER
+
+#include "instrumentation.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace atag {
+namespace instrumentation {
+
+/**
+ * A histogram of unsigned integers with power of two buckets, which may be recorded
+ * into and read from several threads at once. Bucket 0 counts the zeros, and bucket `i`
+ * the values in [2^(i-1), 2^i), save the last one, which counts everything above.
+ */
+class histogram
+{
+public:
+    static constexpr int num_buckets = 40;
+
+private:
+    std::array<std::atomic<uint64_t>, num_buckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+
+public:
+    void record(const uint64_t value) noexcept;
+
+    uint64_t count() const noexcept { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const noexcept { return sum_.load(std::memory_order_relaxed); }
+
+    uint64_t bucket(const int i) const noexcept
+    {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    /** Returns the largest value counted by bucket `i` (except for the last one). */
+    static constexpr uint64_t bucket_bound(const int i) noexcept
+    {
+        return (uint64_t(1) << i) - 1;
+    }
+
+    /**
+     * Returns the upper bound of the bucket holding the `q`th quantile, with `q` in
+     * [0, 1], which overestimates the actual value by less than 2x. Returns 0 if the
+     * histogram is empty.
+     */
+    uint64_t quantile(const double q) const noexcept;
+};
+
+/**
+ * An observer that aggregates the events into counters and histograms, for export to a
+ * metrics system. It may be read while being recorded into, from any thread, e.g.:
+ *
+ * ```
+ * namespace instr = atag::instrumentation;
+ * instr::metrics metrics;
+ * instr::set_observer(&metrics);
+ * // ... scan the library ...
+ * uint64_t p99 = metrics[instr::format::flac].duration_ns.quantile(0.99);
+ * std::string text = metrics.to_prometheus();
+ * ```
+ */
+class metrics : public observer
+{
+public:
+    struct format_metrics
+    {
+        histogram duration_ns;
+        histogram bytes_read;
+        std::atomic<uint64_t> frames_visited{0};
+        std::atomic<uint64_t> frames_decoded{0};
+        // The number of tags that failed to parse, indexed by their `parse_errc`. Other
+        // errors (i.e. allocation failures) are counted at index 0.
+        std::array<std::atomic<uint64_t>, 5> errors{};
+
+        uint64_t num_parses() const noexcept { return duration_ns.count(); }
+        uint64_t num_errors() const noexcept;
+    };
+
+    struct conversion_metrics
+    {
+        histogram duration_ns;
+        std::atomic<uint64_t> bytes{0};
+    };
+
+private:
+    std::array<format_metrics, num_formats> formats_;
+    std::array<conversion_metrics, num_conversions> conversions_;
+    histogram read_duration_ns_;
+    std::atomic<uint64_t> read_bytes_{0};
+
+public:
+    void on_parse(const parse_stats& stats) noexcept override;
+    void on_read(std::size_t num_bytes, std::chrono::nanoseconds duration)
+        noexcept override;
+    void on_convert(conversion c, std::size_t num_bytes,
+        std::chrono::nanoseconds duration) noexcept override;
+
+    const format_metrics& operator[](const format f) const noexcept
+    {
+        return formats_[int(f)];
+    }
+
+    const conversion_metrics& operator[](const conversion c) const noexcept
+    {
+        return conversions_[int(c)];
+    }
+
+    const histogram& read_duration_ns() const noexcept { return read_duration_ns_; }
+    uint64_t read_bytes() const noexcept
+    {
+        return read_bytes_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Invokes `f(name, labels, value)` for each counter, where `value` is a `uint64_t`,
+     * and `f(name, labels, histogram)` for each histogram, with `name` and `labels` as
+     * `std::string_view`s, the latter in the Prometheus format (e.g. `format="flac"`),
+     * or empty. This is the means to export the metrics to any metrics system.
+     */
+    template<typename Function>
+    void for_each(Function f) const;
+
+    /** Returns the metrics in the Prometheus text exposition format. */
+    std::string to_prometheus() const;
+};
+
+} // namespace instrumentation
+} // namespace atag
+
+#include "impl/metrics.ipp"
+
+#endif // ATAG_METRICS_HEADER
@@ -0,0 +1,106 @@
+#ifndef ATAG_MP4_HEADER
+#define ATAG_MP4_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+namespace atag {
+namespace mp4 {
+
+/** The header of an ISO base media file format box (also known as an atom). */
+struct box_header
+{
+    // The box type as a big endian four character code (see `detail::fourcc`).
+    uint32_t type;
+    // The size of the entire box, including the header, or 0 if it extends to the end of
+    // the enclosing box (or the file).
+    uint64_t size;
+    // 8, or 16 if the size doesn't fit into 32 bits.
+    int header_size;
+};
+
+/**
+ * Parses the box header at `p`, of which `length` bytes are available. Returns false
+ * if not all of it is available, or if its size is invalid.
+ */
+template<typename Byte>
+bool parse_box_header(const Byte* p, const std::size_t length, box_header& h) noexcept;
+
+/**
+ * The strings are allocated with `Allocator` (see `basic_simple_tag`).
+ */
+template<typename Allocator = std::allocator<char>>
+struct basic_tag
+{
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
+    string_type title;
+    string_type album;
+    string_type artist;
+    string_type album_artist;
+    string_type genre;
+    int year;
+    int track_number;
+    // The duration in ms, as given by the movie header (mvhd), or 0 if it's unknown.
+    int64_t length;
+
+    basic_tag() = default;
+    basic_tag(const basic_tag&) = default;
+    basic_tag(basic_tag&&) = default;
+    basic_tag& operator=(const basic_tag&) = default;
+    basic_tag& operator=(basic_tag&&) = default;
+
+    explicit basic_tag(const Allocator& alloc)
+        : title(alloc), album(alloc), artist(alloc), album_artist(alloc), genre(alloc)
+        , year(), track_number(), length()
+    {}
+
+    basic_tag(const basic_tag& other, const Allocator& alloc)
+        : title(other.title, alloc), album(other.album, alloc)
+        , artist(other.artist, alloc), album_artist(other.album_artist, alloc)
+        , genre(other.genre, alloc), year(other.year), track_number(other.track_number)
+        , length(other.length)
+    {}
+
+    basic_tag(basic_tag&& other, const Allocator& alloc)
+        : title(std::move(other.title), alloc), album(std::move(other.album), alloc)
+        , artist(std::move(other.artist), alloc)
+        , album_artist(std::move(other.album_artist), alloc)
+        , genre(std::move(other.genre), alloc), year(other.year)
+        , track_number(other.track_number), length(other.length)
+    {}
+};
+
+using tag = basic_tag<>;
+
+namespace pmr {
+using tag = basic_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
+/** Tests whether `s` is an MP4 (e.g. M4A) file, which starts with an ftyp box. */
+template<typename Source>
+bool is_tagged(const Source& s) noexcept;
+
+/**
+ * Parses the iTunes metadata items (moov/udta/meta/ilst) of `s`, and its duration from
+ * the movie header (moov/mvhd). Boxes are skipped by their size, so only the headers of
+ * the boxes on the way and the bodies of the ilst and mvhd boxes are read, which means
+ * the media data (mdat) isn't read, wherever the moov box is (see `prefetch_tags`).
+ */
+template<typename Source>
+tag parse(const Source& s);
+
+/** Same as above, but the strings of the returned tag are allocated from `resource`. */
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource);
+
+} // namespace mp4
+} // namespace atag
+
+#include "impl/mp4.ipp"
+
+#endif // ATAG_MP4_HEADER
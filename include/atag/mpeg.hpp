@@ -0,0 +1,107 @@
+#ifndef ATAG_MPEG_HEADER
+#define ATAG_MPEG_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+
+namespace atag {
+namespace mpeg {
+
+/** The fields of an MPEG audio (e.g. MP3) frame header. */
+struct frame_header
+{
+    enum version
+    {
+        mpeg1,
+        mpeg2,
+        mpeg2_5,
+    };
+
+    enum version version;
+    int layer; // 1, 2 or 3
+    int bitrate; // in kbit/s
+    int sample_rate; // in Hz
+    int num_channels;
+    int samples_per_frame;
+    int size; // in bytes, including the header
+};
+
+/**
+ * Parses the 4 byte frame header at `p` into `h`. Returns false if `p` doesn't point to
+ * a valid frame header, which includes free format frames, as their size can't be
+ * determined from the header.
+ */
+template<typename Byte>
+bool parse_frame_header(const Byte* p, frame_header& h) noexcept;
+
+/**
+ * Returns the offset of the first frame sync (a 0xff byte followed by a byte with its
+ * top 3 bits set) in the `length` bytes at `p`, or -1 if there is none. On x86-64 it
+ * tests 16 (SSE2) or 32 (AVX2) bytes at a time.
+ */
+inline int find_sync(const char* p, const int length) noexcept;
+
+enum class scan_mode
+{
+    /**
+     * Extrapolates the duration from the average bitrate of the first few frames, which
+     * is exact for constant bitrate streams.
+     */
+    estimate,
+    /** Counts every frame, which reads the entire stream. */
+    exact,
+};
+
+struct scan_options
+{
+    /**
+     * Only used if the stream doesn't start with a Xing, Info or VBRI header (as written
+     * by most encoders), which tells the exact number of frames without scanning.
+     */
+    scan_mode mode = scan_mode::estimate;
+
+    /** The number of frames whose bitrate is averaged by `scan_mode::estimate`. */
+    int num_frames = 32;
+};
+
+struct properties
+{
+    int length; // in ms
+    int bitrate; // average, in kbit/s
+    int sample_rate; // in Hz
+    int num_channels;
+    // Whether `length` is exact, i.e. it was read from a Xing/Info/VBRI header or all
+    // frames were counted, rather than estimated.
+    bool is_exact;
+};
+
+/**
+ * Reads the audio properties of the MPEG audio stream in `s` (which is expected to
+ * follow the ID3v2 tag, if any), most importantly its duration, which is otherwise
+ * only known if the tag has a TLEN frame. This is meant to fill in
+ * `simple_tag::length` at about the cost of parsing the tag:
+ * ```
+ * if(tag.length <= 0 && atag::mpeg::read_properties(source, properties, error)) {
+ *     tag.length = properties.length;
+ * }
+ * ```
+ *
+ * As with `prefetch_tags`, only what's needed is fetched from sources that fetch data
+ * on demand: the first frame, which usually holds a Xing, Info or VBRI header, and
+ * otherwise the first `options.num_frames` frames, or with `scan_mode::exact`, all of
+ * them.
+ *
+ * Returns false if no MPEG audio frame could be found, or if an I/O error occurred, which
+ * is reported in `error`.
+ */
+template<typename Source>
+bool read_properties(Source& s, properties& p, std::error_code& error,
+    const scan_options& options = scan_options());
+
+} // namespace mpeg
+} // namespace atag
+
+#include "impl/mpeg.ipp"
+
+#endif // ATAG_MPEG_HEADER
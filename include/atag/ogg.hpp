@@ -0,0 +1,160 @@
+#ifndef ATAG_OGG_HEADER
+#define ATAG_OGG_HEADER
+
+#include "vorbis.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+namespace atag {
+namespace ogg {
+
+/** The fields of an Ogg page header (see https://xiph.org/ogg/doc/framing.html). */
+struct page_header
+{
+    enum
+    {
+        // The page's first packet is continued from the previous page.
+        continued = 1,
+        // The first page of a logical bitstream.
+        first = 2,
+        // The last page of a logical bitstream.
+        last = 4,
+    };
+
+    enum
+    {
+        // The size of the fixed part of the header, which is followed by the segment
+        // table of `num_segments` lacing values.
+        min_size = 27,
+        max_page_size = min_size + 255 + 255 * 255,
+    };
+
+    // Larger granule positions, which would be centuries of audio at 48 kHz, are taken
+    // to be corrupt.
+    static constexpr int64_t max_granule_position = int64_t(1) << 48;
+
+    int flags;
+    // The codec specific position of the last packet that ends on this page (for both
+    // Vorbis and Opus, the number of samples per channel decoded so far), or -1 if no
+    // packet ends on this page.
+    int64_t granule_position;
+    uint32_t serial_number;
+    uint32_t sequence_number;
+    int num_segments;
+    int body_size;
+
+    /** Returns the size of the header, including the segment table. */
+    int size() const noexcept { return min_size + num_segments; }
+};
+
+/**
+ * Parses the page header starting at `p`, of which `length` bytes are available. Returns
+ * false if `p` doesn't point to a page header, or if its segment table isn't available.
+ */
+template<typename Byte>
+bool parse_page_header(const Byte* p, const std::size_t length, page_header& h) noexcept;
+
+/** The codecs whose comment headers are parsed. */
+enum class codec
+{
+    unknown,
+    vorbis,
+    opus,
+};
+
+/**
+ * The strings are allocated with `Allocator` (see `basic_simple_tag`).
+ */
+template<typename Allocator = std::allocator<char>>
+struct basic_tag
+{
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
+    string_type title;
+    string_type album;
+    string_type artist;
+    string_type genre;
+    int year;
+    int track_number;
+    enum codec codec;
+    // For Opus streams this is the sample rate of the encoder's input, as Opus always
+    // decodes at 48 kHz.
+    int sample_rate; // in Hz
+    int num_channels;
+    // The duration in ms, as given by the position of the stream's last page, or 0 if
+    // that couldn't be found.
+    int64_t length;
+
+    basic_tag() = default;
+    basic_tag(const basic_tag&) = default;
+    basic_tag(basic_tag&&) = default;
+    basic_tag& operator=(const basic_tag&) = default;
+    basic_tag& operator=(basic_tag&&) = default;
+
+    explicit basic_tag(const Allocator& alloc)
+        : title(alloc), album(alloc), artist(alloc), genre(alloc)
+        , year(), track_number(), codec(), sample_rate(), num_channels(), length()
+    {}
+
+    basic_tag(const basic_tag& other, const Allocator& alloc)
+        : title(other.title, alloc), album(other.album, alloc)
+        , artist(other.artist, alloc), genre(other.genre, alloc)
+        , year(other.year), track_number(other.track_number), codec(other.codec)
+        , sample_rate(other.sample_rate), num_channels(other.num_channels)
+        , length(other.length)
+    {}
+
+    basic_tag(basic_tag&& other, const Allocator& alloc)
+        : title(std::move(other.title), alloc), album(std::move(other.album), alloc)
+        , artist(std::move(other.artist), alloc), genre(std::move(other.genre), alloc)
+        , year(other.year), track_number(other.track_number), codec(other.codec)
+        , sample_rate(other.sample_rate), num_channels(other.num_channels)
+        , length(other.length)
+    {}
+};
+
+using tag = basic_tag<>;
+
+namespace pmr {
+using tag = basic_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
+/** Tests whether `s` is an Ogg file, i.e. whether it starts with an Ogg page. */
+template<typename Source>
+bool is_tagged(const Source& s) noexcept;
+
+/**
+ * Reassembles the comment header packet of the first logical bitstream in `s` (which
+ * may span several pages), and copies the Vorbis comment block in it, i.e. without the
+ * packet type and magic signature, to `comments`, which can then be viewed with a
+ * `vorbis::comment_view`. Only the pages up to the end of the packet are read.
+ *
+ * Returns the codec of the stream, or `codec::unknown` (in which case `comments` is
+ * empty) if it's neither Vorbis nor Opus, or the packet isn't complete.
+ */
+template<typename Source, typename String>
+codec read_comments(const Source& s, String& comments);
+
+/**
+ * Parses the identification and comment headers of the first Vorbis or Opus stream in
+ * `s`, and its duration from the granule position of its last page. So only the first
+ * few pages and the last page of the file are read (see `prefetch_tags`).
+ */
+template<typename Source>
+tag parse(const Source& s);
+
+/** Same as above, but the strings of the returned tag are allocated from `resource`. */
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource);
+
+} // namespace ogg
+} // namespace atag
+
+#include "impl/ogg.ipp"
+
+#endif // ATAG_OGG_HEADER
@@ -0,0 +1,103 @@
+#ifndef ATAG_PARSE_RESULT_HEADER
+#define ATAG_PARSE_RESULT_HEADER
+
+#include <cstddef>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+namespace atag {
+
+/** Why a parser stopped before the end of a tag. */
+enum class parse_errc
+{
+    // The source has no tag of the format (which includes sources too short to hold
+    // one), so an empty tag is not an error.
+    not_tagged = 1,
+    // The header (or footer) describing the tag is malformed.
+    invalid_header,
+    // A frame, block or item is malformed, or extends past the end of its tag.
+    invalid_frame,
+    // The tag extends past the end of the source.
+    truncated,
+};
+
+inline const std::error_category& parse_category() noexcept;
+
+inline std::error_code make_error_code(const parse_errc e) noexcept
+{
+    return std::error_code(int(e), parse_category());
+}
+
+/** An error, and the offset in the source at which it was found. */
+struct parse_error
+{
+    std::error_code code;
+    std::size_t offset = 0;
+
+    explicit operator bool() const noexcept { return bool(code); }
+};
+
+/**
+ * The result of the `noexcept` overloads of the parsers, which take `std::nothrow` in
+ * place of throwing, e.g.:
+ *
+ * ```
+ * auto result = atag::id3v2::simple_parse(source, std::nothrow);
+ * if(!result) {
+ *     // result.error().code, result.error().offset
+ * }
+ * ```
+ *
+ * Unlike `std::expected`, the value is there even if there is an error: it holds what
+ * was parsed before the parser stopped at `error().offset`, so a truncated file still
+ * yields the frames in front of where it was cut off. Allocation failures are reported
+ * as `std::errc::not_enough_memory`.
+ */
+template<typename T>
+class parse_result
+{
+    T value_;
+    parse_error error_;
+
+public:
+    explicit parse_result(T value, parse_error error = {})
+        noexcept(std::is_nothrow_move_constructible<T>::value)
+        : value_(std::move(value)), error_(error)
+    {}
+
+    bool has_value() const noexcept { return !error_; }
+    explicit operator bool() const noexcept { return has_value(); }
+
+    const parse_error& error() const noexcept { return error_; }
+
+    T& value() & noexcept { return value_; }
+    const T& value() const & noexcept { return value_; }
+    T&& value() && noexcept { return std::move(value_); }
+
+    T& operator*() & noexcept { return value_; }
+    const T& operator*() const & noexcept { return value_; }
+    T&& operator*() && noexcept { return std::move(value_); }
+    T* operator->() noexcept { return &value_; }
+    const T* operator->() const noexcept { return &value_; }
+};
+
+namespace detail {
+
+/**
+ * Parses `tag` with `parse`, which returns the error at which it stopped (if any). No
+ * exception escapes, as an allocation failure is turned into an error.
+ */
+template<typename Tag, typename Parse>
+parse_result<Tag> make_parse_result(Tag tag, Parse parse) noexcept;
+
+} // namespace detail
+} // namespace atag
+
+namespace std {
+template<> struct is_error_code_enum<atag::parse_errc> : true_type {};
+} // namespace std
+
+#include "impl/parse_result.ipp"
+
+#endif // ATAG_PARSE_RESULT_HEADER
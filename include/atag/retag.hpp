@@ -0,0 +1,79 @@
+#ifndef ATAG_RETAG_HEADER
+#define ATAG_RETAG_HEADER
+
+#include "simple_tag.hpp"
+#include "writer.hpp"
+
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace atag {
+
+struct retag_job
+{
+    std::string path;
+    /**
+     * The title, album, artist, year and track number to give the file. Empty strings
+     * and zero numbers remove the corresponding fields, while the fields the file
+     * already has (as read by `atag::parse`) are left untouched, as is the rest of the
+     * file's tag (e.g. pictures, comments, other frames).
+     */
+    simple_tag tag;
+};
+
+struct retag_result
+{
+    std::string path;
+    // Set if the file could not be read or written, or if it's not of a supported
+    // format, in which case it's left as it was.
+    std::error_code error;
+    // Whether the tag was edited in place, as opposed to the file being rewritten.
+    bool in_place = false;
+};
+
+struct retag_options
+{
+    // The maximum number of files being retagged at once, which bounds the I/O
+    // depth. 0 means one per hardware thread.
+    int concurrency = 0;
+    padding_policy padding;
+};
+
+/**
+ * Writes the tags of `jobs` to their files on a pool of `options.concurrency` worker
+ * threads, and invokes `callback` with each `retag_result&&` on the worker threads, i.e.
+ * concurrently, in the order the files complete. Blocks until all files are done. If
+ * `callback` throws, the rest of the files are still written, and the first exception is
+ * rethrown once they are.
+ *
+ * FLAC files are written with `flac::write`, and files with an ID3v2 tag (or, lacking
+ * any tag, an .mp3 extension) with `id3v2::write`. Each file is thus edited in place
+ * if its tag fits in the existing padding, and otherwise rewritten: the new tag is
+ * written to a temporary file, followed by the untouched audio, which is reflinked on
+ * file systems that support it (e.g. Btrfs, XFS) and otherwise copied in the kernel
+ * with `copy_file_range`, then the temporary file is flushed and atomically renamed
+ * over the original.
+ *
+ * Example:
+ * ```
+ * std::vector<atag::retag_job> jobs;
+ * // ...
+ * atag::retag(jobs, atag::retag_options(), [](atag::retag_result&& result) {
+ *     // result.path, result.error, result.in_place
+ * });
+ * ```
+ */
+template<typename Callback>
+void retag(const std::vector<retag_job>& jobs, const retag_options& options,
+    Callback callback);
+
+/** Retags a single file, as described above. */
+inline retag_result retag(const retag_job& job, const padding_policy& policy);
+
+} // namespace atag
+
+#include "impl/retag.ipp"
+
+#endif // ATAG_RETAG_HEADER
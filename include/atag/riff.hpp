@@ -0,0 +1,142 @@
+#ifndef ATAG_RIFF_HEADER
+#define ATAG_RIFF_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+namespace atag {
+namespace riff {
+
+/**
+ * The header of a chunk of a RIFF (e.g. WAV) or an AIFF file. The two only differ in the
+ * byte order of the size field, which is little endian in RIFF and big endian in AIFF.
+ */
+struct chunk_header
+{
+    // The chunk id as a big endian four character code (see `detail::fourcc`).
+    uint32_t id;
+    // The size of the body (excluding the 8 byte header), which is followed by a pad
+    // byte if it's odd.
+    uint32_t size;
+};
+
+/**
+ * The strings are allocated with `Allocator` (see `basic_simple_tag`).
+ */
+template<typename Allocator = std::allocator<char>>
+struct basic_tag
+{
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
+    // From the LIST/INFO chunk of WAV files, or the NAME, AUTH and ANNO chunks of AIFF
+    // files.
+    string_type title;
+    string_type album;
+    string_type artist;
+    string_type genre;
+    string_type comment;
+    int year;
+    int track_number;
+
+    // From the broadcast audio extension (bext) chunk of Broadcast Wave files.
+    string_type description;
+    string_type originator;
+    string_type originator_reference;
+    string_type origination_date; // yyyy-mm-dd
+    string_type origination_time; // hh-mm-ss
+    // The number of samples since midnight of the first sample.
+    uint64_t time_reference;
+
+    // From the fmt (WAV) or COMM (AIFF) chunk.
+    int sample_rate; // in Hz
+    int num_channels;
+    int bits_per_sample;
+    int64_t length; // in ms, 0 if unknown
+
+    // The byte range of the ID3v2 tag in an "id3 " or "ID3 " chunk, which many taggers
+    // add. Its length is 0 if there is none. It can be parsed in place through a
+    // `source_view`.
+    uint64_t id3v2_offset;
+    uint64_t id3v2_length;
+
+    basic_tag() = default;
+    basic_tag(const basic_tag&) = default;
+    basic_tag(basic_tag&&) = default;
+    basic_tag& operator=(const basic_tag&) = default;
+    basic_tag& operator=(basic_tag&&) = default;
+
+    explicit basic_tag(const Allocator& alloc)
+        : title(alloc), album(alloc), artist(alloc), genre(alloc), comment(alloc)
+        , year(), track_number(), description(alloc), originator(alloc)
+        , originator_reference(alloc), origination_date(alloc), origination_time(alloc)
+        , time_reference(), sample_rate(), num_channels(), bits_per_sample(), length()
+        , id3v2_offset(), id3v2_length()
+    {}
+
+    basic_tag(const basic_tag& other, const Allocator& alloc)
+        : title(other.title, alloc), album(other.album, alloc)
+        , artist(other.artist, alloc), genre(other.genre, alloc)
+        , comment(other.comment, alloc), year(other.year)
+        , track_number(other.track_number), description(other.description, alloc)
+        , originator(other.originator, alloc)
+        , originator_reference(other.originator_reference, alloc)
+        , origination_date(other.origination_date, alloc)
+        , origination_time(other.origination_time, alloc)
+        , time_reference(other.time_reference), sample_rate(other.sample_rate)
+        , num_channels(other.num_channels), bits_per_sample(other.bits_per_sample)
+        , length(other.length), id3v2_offset(other.id3v2_offset)
+        , id3v2_length(other.id3v2_length)
+    {}
+
+    basic_tag(basic_tag&& other, const Allocator& alloc)
+        : title(std::move(other.title), alloc), album(std::move(other.album), alloc)
+        , artist(std::move(other.artist), alloc), genre(std::move(other.genre), alloc)
+        , comment(std::move(other.comment), alloc), year(other.year)
+        , track_number(other.track_number)
+        , description(std::move(other.description), alloc)
+        , originator(std::move(other.originator), alloc)
+        , originator_reference(std::move(other.originator_reference), alloc)
+        , origination_date(std::move(other.origination_date), alloc)
+        , origination_time(std::move(other.origination_time), alloc)
+        , time_reference(other.time_reference), sample_rate(other.sample_rate)
+        , num_channels(other.num_channels), bits_per_sample(other.bits_per_sample)
+        , length(other.length), id3v2_offset(other.id3v2_offset)
+        , id3v2_length(other.id3v2_length)
+    {}
+};
+
+using tag = basic_tag<>;
+
+namespace pmr {
+using tag = basic_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
+/** Tests whether `s` is a RIFF WAVE (WAV) or an AIFF (or AIFF-C) file. */
+template<typename Source>
+bool is_tagged(const Source& s) noexcept;
+
+/**
+ * Walks the chunks of `s` and parses its metadata chunks. Chunks are skipped by their
+ * size, so only the chunk headers and the bodies of the metadata chunks are read, and
+ * never the audio data (see `prefetch_tags`). An embedded ID3v2 tag isn't parsed, only
+ * located (see `basic_tag::id3v2_offset`).
+ *
+ * RF64 files, i.e. WAV files larger than 4 GiB, are not supported.
+ */
+template<typename Source>
+tag parse(const Source& s);
+
+/** Same as above, but the strings of the returned tag are allocated from `resource`. */
+template<typename Source>
+pmr::tag parse(const Source& s, std::pmr::memory_resource* resource);
+
+} // namespace riff
+} // namespace atag
+
+#include "impl/riff.ipp"
+
+#endif // ATAG_RIFF_HEADER
@@ -0,0 +1,118 @@
+#ifndef ATAG_SCAN_HEADER
+#define ATAG_SCAN_HEADER
+
+#include "simple_tag.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace atag {
+
+class tag_cache;
+
+struct scan_options
+{
+    // The number of threads that parse files. 0 means one per hardware thread.
+    int concurrency = 0;
+    // The maximum number of files that may be waiting to be parsed. Once reached, the
+    // directory walk blocks until the workers catch up.
+    int max_pending = 1024;
+    bool follow_symlinks = false;
+    // Only files with these extensions (which are compared case-insensitively) are
+    // parsed. If empty, every regular file is.
+    std::vector<std::string> extensions = {
+        ".mp3", ".flac", ".ape", ".mpc", ".wv", ".aac", ".mp2", ".ogg", ".oga", ".opus",
+        ".m4a", ".m4b", ".wav", ".aif", ".aiff",
+    };
+    // If set, files whose tags are in the cache and which have not been modified since
+    // are not opened, and the tags of the rest are added to it once parsed.
+    tag_cache* cache = nullptr;
+};
+
+struct scan_result
+{
+    std::string path;
+    simple_tag tag;
+    // Set if the file could not be read or its tag is malformed.
+    std::error_code error;
+    // Whether the tag was taken from `scan_options::cache`.
+    bool is_cached = false;
+};
+
+/**
+ * A queue with a fixed capacity, which may be used to pass scan results from the worker
+ * threads to a consumer: pushing blocks while the queue is full, so a slow consumer
+ * throttles the scan rather than results piling up in memory.
+ */
+template<typename T>
+class bounded_queue
+{
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    std::size_t capacity_;
+    bool is_closed_ = false;
+
+public:
+    explicit bounded_queue(const std::size_t capacity) : capacity_(capacity) {}
+
+    /** Blocks while the queue is full. Returns false if the queue was closed. */
+    bool push(T item);
+
+    /**
+     * Blocks until an item is available and moves it into `item`. Returns false once
+     * the queue is closed and all its items have been popped.
+     */
+    bool pop(T& item);
+
+    /** Wakes up all waiting consumers once the remaining items have been popped. */
+    void close();
+};
+
+/**
+ * Recursively walks `directory` and parses the tag of every matching file with
+ * `atag::parse` on a pool of worker threads, reading only the regions of the files that
+ * may hold tags. The workers reuse their buffers across files.
+ *
+ * `callback` is invoked with each `scan_result&&` on the worker threads, i.e.
+ * concurrently, so it must synchronize access to any shared state itself. If it throws,
+ * the rest of the files are still parsed, and the first exception is rethrown once the
+ * scan is over.
+ *
+ * Blocks until all files have been parsed, and returns the number of files parsed.
+ * Entries that can't be accessed during the walk are skipped; if `directory` itself
+ * can't be opened, `error` is set.
+ *
+ * Example:
+ * ```
+ * std::mutex mutex;
+ * std::vector<atag::scan_result> results;
+ * std::error_code error;
+ * atag::scan("/music", {}, [&](atag::scan_result&& result) {
+ *     std::lock_guard<std::mutex> lock(mutex);
+ *     results.emplace_back(std::move(result));
+ * }, error);
+ * ```
+ */
+template<typename Callback>
+std::size_t scan(const std::string& directory, const scan_options& options,
+    Callback callback, std::error_code& error);
+
+/**
+ * Same as above, but the results are pushed to `queue`, which is closed once the scan is
+ * over. Since this blocks until then, `queue` must be consumed on another thread.
+ */
+inline std::size_t scan(const std::string& directory, const scan_options& options,
+    bounded_queue<scan_result>& queue, std::error_code& error);
+
+} // namespace atag
+
+#include "impl/scan.ipp"
+
+#endif // ATAG_SCAN_HEADER
@@ -3,7 +3,10 @@
 
 #include "genres.hpp"
 
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <utility>
 
 namespace atag {
 
@@ -12,19 +15,60 @@ namespace atag {
  * information, but this does not mean they will. Thus, if any of the values listed
  * here are empty (empty string or -1 for the integer types), it means no such value was
  * found in the tag.
+ *
+ * The strings are allocated with `Allocator`. Usually this is the default allocator
+ * (see `simple_tag`), but when parsing many files in a batch, `pmr::simple_tag` allows
+ * placing all tags of the batch in a single arena (e.g. a
+ * `std::pmr::monotonic_buffer_resource`) and releasing them in one go.
  */
-struct simple_tag
+template<typename Allocator = std::allocator<char>>
+struct basic_simple_tag
 {
-    std::string title;
-    std::string album;
-    std::string artist;
+    using allocator_type = Allocator;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+
+    string_type title;
+    string_type album;
+    string_type artist;
     enum genre genre;
     int track_number;
     int length; // in ms
     int year;
+
+    basic_simple_tag() = default;
+    basic_simple_tag(const basic_simple_tag&) = default;
+    basic_simple_tag(basic_simple_tag&&) = default;
+    basic_simple_tag& operator=(const basic_simple_tag&) = default;
+    basic_simple_tag& operator=(basic_simple_tag&&) = default;
+
+    explicit basic_simple_tag(const Allocator& alloc)
+        : title(alloc), album(alloc), artist(alloc)
+        , genre(), track_number(), length(), year()
+    {}
+
+    // So that tags may be stored in allocator-aware containers using the same
+    // allocator (such as a `std::pmr::vector`).
+    basic_simple_tag(const basic_simple_tag& other, const Allocator& alloc)
+        : title(other.title, alloc), album(other.album, alloc)
+        , artist(other.artist, alloc), genre(other.genre)
+        , track_number(other.track_number), length(other.length), year(other.year)
+    {}
+
+    basic_simple_tag(basic_simple_tag&& other, const Allocator& alloc)
+        : title(std::move(other.title), alloc), album(std::move(other.album), alloc)
+        , artist(std::move(other.artist), alloc), genre(other.genre)
+        , track_number(other.track_number), length(other.length), year(other.year)
+    {}
 };
 
-inline bool is_valid_tag(const simple_tag& t)
+using simple_tag = basic_simple_tag<>;
+
+namespace pmr {
+using simple_tag = basic_simple_tag<std::pmr::polymorphic_allocator<char>>;
+} // namespace pmr
+
+template<typename Allocator>
+bool is_valid_tag(const basic_simple_tag<Allocator>& t)
 {
     return !t.title.empty() || !t.album.empty() || !t.artist.empty();
 }
@@ -0,0 +1,54 @@
+#ifndef ATAG_SOURCE_VIEW_HEADER
+#define ATAG_SOURCE_VIEW_HEADER
+
+#include <cstddef>
+#include <utility>
+
+namespace atag {
+
+/**
+ * A window of `length` bytes at `offset` in another source, which satisfies the source
+ * requirements itself. This way a tag embedded in a container format, such as an ID3v2
+ * tag in a chunk of a WAV or AIFF file, can be handed to its parser as is, without
+ * copying it out of the file first. The viewed source must outlive the view.
+ *
+ * Example:
+ * ```
+ * const atag::riff::tag tag = atag::riff::parse(source);
+ * if(tag.id3v2_length > 0) {
+ *     atag::source_view<Source> id3(source, tag.id3v2_offset, tag.id3v2_length);
+ *     atag::id3v2::tag id3v2 = atag::id3v2::parse(id3);
+ * }
+ * ```
+ */
+template<typename Source>
+class source_view
+{
+    const Source* source_;
+    std::size_t offset_;
+    std::size_t length_;
+
+public:
+    source_view(const Source& s, const std::size_t offset, const std::size_t length)
+        : source_(&s), offset_(offset), length_(length)
+    {}
+
+    std::size_t size() const noexcept { return length_; }
+
+    decltype(auto) operator[](const std::size_t i) const noexcept
+    {
+        return (*source_)[offset_ + i];
+    }
+
+    /** Only available if the viewed source has it (see `detail::is_partial_source`). */
+    template<typename S = Source>
+    auto stored_length(const std::size_t offset, const std::size_t length) const noexcept
+        -> decltype(std::declval<const S&>().stored_length(offset, length))
+    {
+        return source_->stored_length(offset_ + offset, length);
+    }
+};
+
+} // namespace atag
+
+#endif // ATAG_SOURCE_VIEW_HEADER
@@ -0,0 +1,135 @@
+#ifndef ATAG_TAG_CACHE_HEADER
+#define ATAG_TAG_CACHE_HEADER
+
+#include "simple_tag.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace atag {
+
+/**
+ * A persistent cache of the `simple_tag`s of files, so that after a restart only the
+ * files that changed since they were last parsed have to be opened.
+ *
+ * Files are identified by their device and inode numbers, and a cached tag is only
+ * considered valid if the file's size and modification time are also the same as when
+ * it was parsed, which is all that `stat(2)` is needed to verify.
+ *
+ * The cache is an append-only log of records: opening it maps the file into memory and
+ * indexes the records in a single pass, inserting (or erasing) a tag appends a record,
+ * and `compact` rewrites the file with only the live records. A record that was only
+ * partially written (e.g. due to a crash) is discarded on opening.
+ *
+ * The file is in the host's byte order, so it's not portable between architectures
+ * (opening such a file simply starts a new cache). It's only available on POSIX
+ * systems. All member functions are thread-safe.
+ */
+class tag_cache
+{
+public:
+    struct key
+    {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_ns;
+    };
+
+private:
+    struct file_id
+    {
+        uint64_t device;
+        uint64_t inode;
+
+        bool operator==(const file_id& other) const noexcept
+        {
+            return (device == other.device) && (inode == other.inode);
+        }
+    };
+
+    struct file_id_hash
+    {
+        std::size_t operator()(const file_id& id) const noexcept
+        {
+            return std::hash<uint64_t>()(id.inode * 31 + id.device);
+        }
+    };
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    int fd_ = -1;
+    // The cache file as it was when it was opened.
+    const char* mapping_ = nullptr;
+    std::size_t mapping_size_ = 0;
+    // The end of the last valid record in the mapping.
+    std::size_t mapped_end_ = 0;
+    // The records appended since the file was mapped. Once they outgrow
+    // `max_appended_size`, the file is mapped again in full and they are dropped.
+    std::vector<char> appended_;
+    std::size_t file_size_ = 0;
+    // Maps each file to the offset of its most recent record.
+    std::unordered_map<file_id, std::size_t, file_id_hash> index_;
+    std::size_t num_dead_records_ = 0;
+
+    static constexpr std::size_t max_appended_size = 1024 * 1024;
+
+public:
+    tag_cache() = default;
+    tag_cache(const tag_cache&) = delete;
+    tag_cache& operator=(const tag_cache&) = delete;
+    ~tag_cache();
+
+    /** Opens the cache at `path`, creating it if it doesn't exist. */
+    void open(const std::string& path, std::error_code& error);
+    void close() noexcept;
+
+    bool is_open() const noexcept { return fd_ != -1; }
+
+    /** Returns the number of files in the cache. */
+    std::size_t size() const;
+
+    /** Returns the number of records that have been superseded or erased. */
+    std::size_t num_dead_records() const;
+
+    /** `stat`s the file at `path` and produces its key. */
+    static bool make_key(const std::string& path, key& k, std::error_code& error);
+
+    /**
+     * If there is a tag for the file identified by `k` and it's still valid (i.e. the
+     * file has not been modified since), it's copied into `tag` and true is returned.
+     */
+    bool find(const key& k, simple_tag& tag) const;
+
+    /** Stores `tag` for the file identified by `k`, superseding any previous one. */
+    void insert(const key& k, const std::string& path, const simple_tag& tag,
+        std::error_code& error);
+
+    /** Removes the file identified by `k` (only its device and inode are used). */
+    void erase(const key& k, std::error_code& error);
+
+    /**
+     * Rewrites the cache without the dead records, by writing a new file and atomically
+     * renaming it over the old one.
+     */
+    void compact(std::error_code& error);
+
+private:
+    void open_locked(const std::string& path, std::error_code& error);
+    void close_locked() noexcept;
+    void remap_locked() noexcept;
+    const char* record_at(const std::size_t offset) const noexcept;
+    void append_locked(const std::vector<char>& record, const file_id& id,
+        const bool is_erasure, std::error_code& error);
+};
+
+} // namespace atag
+
+#include "impl/tag_cache.ipp"
+
+#endif // ATAG_TAG_CACHE_HEADER
@@ -0,0 +1,164 @@
+#ifndef ATAG_TAG_PARSER_HEADER
+#define ATAG_TAG_PARSER_HEADER
+
+#include "simple_tag.hpp"
+#include "detail/segment_buffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace atag {
+
+struct byte_range
+{
+    std::size_t offset;
+    std::size_t length;
+};
+
+/** Which of a FLAC file's metadata blocks are located, and thus read. */
+enum class flac_blocks
+{
+    /** Every metadata block, e.g. pictures and cue sheets as well. */
+    all,
+    /**
+     * Only the STREAMINFO and VORBIS_COMMENT blocks, which are all that the parsers read.
+     * The headers of the blocks before them are read to skip their bodies, while nothing
+     * after them is read, so e.g. no picture bytes are read.
+     */
+    parsed,
+};
+
+namespace detail {
+
+/**
+ * Finds the byte ranges of a file that may hold tags, one range at a time, without
+ * doing any I/O itself: each call to `next` inspects the bytes of `s` that were
+ * requested by the previous calls (so the caller must have made those available in `s`
+ * in the meantime), and returns the next range that needs to be read, if any.
+ *
+ * All ranges are within [0, s.size()).
+ */
+class tag_locator
+{
+    enum class state
+    {
+        head,
+        tail,
+        tags,
+        flac_block_header,
+        flac_block,
+        ogg_page_header,
+        ogg_page,
+        ogg_tail,
+        mp4_box_header,
+        mp4_box,
+        riff_chunk_header,
+        riff_chunk,
+        ape,
+        done,
+    };
+
+    state state_ = state::head;
+    flac_blocks flac_blocks_ = flac_blocks::all;
+    // The offset and length of the FLAC metadata block being located.
+    std::size_t block_offset_ = 0;
+    std::size_t block_length_ = 0;
+    bool is_last_block_ = false;
+    bool has_streaminfo_ = false;
+    bool has_vorbis_comment_ = false;
+    // The offset of the Ogg page being located, the serial number of the stream whose
+    // headers are located, and the number of its packets located so far.
+    std::size_t page_offset_ = 0;
+    uint32_t serial_number_ = 0;
+    int num_packets_ = 0;
+    // The offset of the MP4 box being located, the ends of the boxes on the path to it
+    // (the first being the end of the file), and the index of its parent in the latter.
+    uint64_t box_offset_ = 0;
+    uint64_t box_ends_[4] = {};
+    int box_depth_ = 0;
+    // The offset of the WAV or AIFF chunk being located.
+    uint64_t chunk_offset_ = 0;
+
+public:
+    explicit tag_locator(const flac_blocks b = flac_blocks::all) noexcept
+        : flac_blocks_(b)
+    {}
+
+    void reset() noexcept { *this = tag_locator(flac_blocks_); }
+
+    /** Returns false once there is nothing more to read. */
+    template<typename Source>
+    bool next(const Source& s, byte_range& r);
+};
+
+} // namespace detail
+
+/**
+ * A parser that does no I/O, so that it can be driven by any means of reading files
+ * (e.g. an event loop, coroutines or io_uring): it tells the caller which byte ranges
+ * of the file it needs, and the caller feeds them to it as they arrive. Only the
+ * regions that may hold tags are requested, i.e. usually the first and last few KiB.
+ *
+ * Example:
+ * ```
+ * atag::tag_parser parser(file_size);
+ * atag::byte_range r;
+ * while(parser.need_bytes(r)) {
+ *     // Read r.length bytes at r.offset into buffer, possibly asynchronously.
+ *     parser.feed(r.offset, buffer, r.length);
+ * }
+ * atag::simple_tag tag = parser.parse();
+ * ```
+ *
+ * A parser may be `reset` and reused for another file, in which case it reuses its
+ * buffers.
+ */
+class tag_parser
+{
+    // Only what's parsed is needed.
+    detail::tag_locator locator_{flac_blocks::parsed};
+    detail::segment_buffer buffer_;
+    // The range last returned by `need_bytes`.
+    byte_range pending_ = {0, 0};
+
+public:
+    /** The type of `source()`, which satisfies the source requirements. */
+    using source_type = detail::segment_buffer;
+
+    explicit tag_parser(const std::size_t file_size = 0) { reset(file_size); }
+
+    /** Starts parsing a file of `file_size` bytes. */
+    void reset(const std::size_t file_size);
+
+    std::size_t file_size() const noexcept { return buffer_.size(); }
+
+    /**
+     * If more bytes are needed, returns true and sets `r` to the range to read next.
+     * What's left of the same range is returned until it has been fed in full.
+     * Returns false once everything that's needed has been fed, after which the tag
+     * may be parsed.
+     */
+    bool need_bytes(byte_range& r);
+
+    /**
+     * Feeds the `length` bytes at `offset` in the file. These are usually the range
+     * returned by `need_bytes`, but a prefix of it (a short read) is also accepted.
+     */
+    void feed(const std::size_t offset, const char* data, std::size_t length);
+
+    /**
+     * Returns the bytes fed so far, as a source that any of the parsers (e.g.
+     * `id3v2::parse` or `flac::parse`) can be used with once `need_bytes` returned
+     * false.
+     */
+    const source_type& source() const noexcept { return buffer_; }
+
+    /** Same as `atag::parse(source())`. */
+    simple_tag parse() const;
+};
+
+} // namespace atag
+
+#include "impl/tag_parser.ipp"
+
+#endif // ATAG_TAG_PARSER_HEADER
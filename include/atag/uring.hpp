@@ -0,0 +1,88 @@
+#ifndef ATAG_URING_HEADER
+#define ATAG_URING_HEADER
+
+#if !__has_include(<liburing.h>)
+# error "atag/uring.hpp requires liburing"
+#endif
+
+#include "scan.hpp"
+#include "tag_parser.hpp"
+
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <liburing.h>
+
+namespace atag {
+
+/**
+ * Parses the tags of many files on a single thread with io_uring, keeping up to
+ * `queue_depth` files in flight at a time: each file is driven by a `tag_parser`, and
+ * as soon as one of its reads completes, its next read (or the first read of the next
+ * file) is queued. On a cold cache or a high latency disk, this gets about as much
+ * parallelism out of the disk as a pool of `queue_depth` threads blocking on reads,
+ * without the threads.
+ *
+ * Files are opened synchronously, only the reads are asynchronous.
+ *
+ * Example:
+ * ```
+ * std::error_code error;
+ * atag::uring_driver driver;
+ * driver.open(256, error);
+ * driver.parse(paths, [](atag::scan_result&& result) {
+ *     // result.path, result.tag, result.error
+ * }, error);
+ * ```
+ *
+ * This requires Linux and linking with liburing (-luring).
+ */
+class uring_driver
+{
+    struct slot
+    {
+        int fd = -1;
+        std::string path;
+        tag_parser parser;
+        std::vector<char> buffer;
+        byte_range range;
+    };
+
+    io_uring ring_;
+    bool is_open_ = false;
+    std::vector<slot> slots_;
+
+public:
+    uring_driver() = default;
+    uring_driver(const uring_driver&) = delete;
+    uring_driver& operator=(const uring_driver&) = delete;
+    ~uring_driver();
+
+    /** Sets up a ring for `queue_depth` files in flight. */
+    void open(const unsigned queue_depth, std::error_code& error);
+    void close() noexcept;
+
+    bool is_open() const noexcept { return is_open_; }
+
+    /**
+     * Parses the files at `paths` and invokes `callback` with each `scan_result&&` on
+     * the calling thread, in the order the files complete. Blocks until all files have
+     * been parsed. Errors of individual files are reported in their results; `error` is
+     * only set if the ring itself fails, in which case the remaining files are skipped.
+     */
+    template<typename Callback>
+    void parse(const std::vector<std::string>& paths, Callback callback,
+        std::error_code& error);
+
+private:
+    template<typename Callback>
+    void finish(slot& s, std::error_code error, Callback& callback);
+};
+
+} // namespace atag
+
+#include "impl/uring.ipp"
+
+#endif // ATAG_URING_HEADER
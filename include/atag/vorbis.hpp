@@ -0,0 +1,95 @@
+#ifndef ATAG_VORBIS_HEADER
+#define ATAG_VORBIS_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace atag {
+namespace vorbis {
+
+/**
+ * A view of a Vorbis comment block, the tag format of FLAC (its VORBIS_COMMENT block)
+ * and of Ogg Vorbis and Opus streams (their comment headers, after the packet type and
+ * magic signature). Every comment is exposed as a key and a value referring into the
+ * viewed block, which must thus outlive the view, and nothing is copied or decoded
+ * (values are UTF-8 by definition).
+ *
+ * Keys are case-insensitive, so each comment also stores the case-insensitive hash of
+ * its key (see `detail::key_hash`), which makes looking up a key a scan over integers.
+ * Neither lookups nor iterating over the values of a key allocate, and a view may be
+ * reused for another block (with `parse`), in which case it reuses its memory as well.
+ *
+ * Example:
+ * ```
+ * const atag::vorbis::comment_view view = atag::flac::make_comment_view(source);
+ * if(const auto* c = view.find("MUSICBRAINZ_TRACKID")) {
+ *     // c->value
+ * }
+ * view.for_each("ARTIST", [](std::string_view artist) {
+ *     // ...
+ * });
+ * ```
+ */
+class comment_view
+{
+public:
+    struct comment
+    {
+        std::string_view key;
+        std::string_view value;
+        uint32_t hash;
+    };
+
+    comment_view() = default;
+
+    /** Same as default constructing the view and calling `parse`. */
+    comment_view(const char* data, const std::size_t length) { parse(data, length); }
+
+    /**
+     * Parses the `length` bytes at `data`, which start with the length of the vendor
+     * string. Returns false if the block is malformed (e.g. a comment's length points
+     * past the end of the block), in which case the view holds the comments preceding
+     * the error. Comments without a '=' separator are ignored.
+     */
+    bool parse(const char* data, const std::size_t length);
+
+    std::string_view vendor() const noexcept { return vendor_; }
+
+    /** Returns all comments, in the order in which they appear in the block. */
+    const std::vector<comment>& comments() const noexcept { return comments_; }
+
+    bool empty() const noexcept { return comments_.empty(); }
+
+    /** Returns the first comment with `key`, or nullptr if there is none. */
+    const comment* find(const std::string_view key) const noexcept;
+
+    /** Returns the value of the first comment with `key`, or an empty string. */
+    std::string_view value(const std::string_view key) const noexcept;
+
+    /**
+     * Invokes `f` with the value of each comment with `key`, e.g. every artist, as keys
+     * may be repeated.
+     */
+    template<typename Function>
+    void for_each(const std::string_view key, Function f) const;
+
+    /**
+     * Invokes `f` with each comment whose key starts with `prefix`, e.g. all
+     * "REPLAYGAIN_" comments.
+     */
+    template<typename Function>
+    void for_each_prefixed(const std::string_view prefix, Function f) const;
+
+private:
+    std::string_view vendor_;
+    std::vector<comment> comments_;
+};
+
+} // namespace vorbis
+} // namespace atag
+
+#include "impl/vorbis.ipp"
+
+#endif // ATAG_VORBIS_HEADER
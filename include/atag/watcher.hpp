@@ -0,0 +1,136 @@
+#ifndef ATAG_WATCHER_HEADER
+#define ATAG_WATCHER_HEADER
+
+#include "simple_tag.hpp"
+#include "file_source.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace atag {
+
+class tag_cache;
+
+struct watch_options
+{
+    // How long a file must go without changes before it's parsed. Taggers often rewrite
+    // a file several times in a row, so this coalesces those writes into one change.
+    std::chrono::milliseconds settle_time{1000};
+    // Only files with these extensions (which are compared case-insensitively) are
+    // watched. If empty, every regular file is.
+    std::vector<std::string> extensions = {
+        ".mp3", ".flac", ".ape", ".mpc", ".wv", ".aac", ".mp2", ".ogg", ".oga", ".opus",
+        ".m4a", ".m4b", ".wav", ".aif", ".aiff",
+    };
+    // If set, the tags of changed files are added to it, and a file that turns out to be
+    // unchanged according to the cache (e.g. it was only touched) is not reported.
+    tag_cache* cache = nullptr;
+};
+
+struct change
+{
+    enum kind_type { added, updated, removed };
+
+    kind_type kind;
+    std::string path;
+    // Not set for removed files.
+    simple_tag tag;
+    // Set if the file could not be read or its tag is malformed.
+    std::error_code error;
+};
+
+/**
+ * Watches directory trees for changes with inotify(7), and reports the files that were
+ * added, updated or removed since the trees were added, so that a library can be kept
+ * up to date without rescanning it. Files that are moved within the watched trees are
+ * reported as removed from their old path and added at the new one.
+ *
+ * The watcher does nothing on its own: the owner must call `poll` regularly (e.g. in a
+ * loop on a dedicated thread, or when `native_handle` becomes readable in an event
+ * loop), which reads the pending events and reports the files that have settled.
+ *
+ * Example:
+ * ```
+ * std::error_code error;
+ * atag::watcher watcher;
+ * watcher.add_root("/music", error);
+ * for(;;) {
+ *     watcher.poll(std::chrono::seconds(10), [](atag::change&& c) {
+ *         // c.kind, c.path, c.tag
+ *     }, error);
+ * }
+ * ```
+ *
+ * If the kernel's event queue overflows, the watched trees are walked again and every
+ * file is checked, which is what would otherwise be a full rescan (though with a cache,
+ * only the files that actually changed are parsed).
+ *
+ * This is only available on Linux. It is not thread-safe.
+ */
+class watcher
+{
+    using clock = std::chrono::steady_clock;
+
+    watch_options options_;
+    int fd_ = -1;
+    std::vector<std::string> roots_;
+    // Maps watch descriptors to the path of the directory they watch.
+    std::unordered_map<int, std::string> directories_;
+    // The files that are known to exist, i.e. that were present when their directory
+    // was added or were reported as added since.
+    std::unordered_set<std::string> files_;
+    // The files that changed, mapped to the time after which they are considered settled.
+    std::unordered_map<std::string, clock::time_point> pending_;
+    file_source source_;
+    std::vector<char> buffer_;
+
+public:
+    explicit watcher(watch_options options = watch_options());
+    watcher(const watcher&) = delete;
+    watcher& operator=(const watcher&) = delete;
+    ~watcher();
+
+    /**
+     * Starts watching `directory` and all its subdirectories. The files already in it
+     * are taken as the starting point, i.e. they are not reported as added.
+     */
+    void add_root(const std::string& directory, std::error_code& error);
+
+    /** Returns the inotify descriptor, which becomes readable when there are events. */
+    int native_handle() const noexcept { return fd_; }
+
+    /** Returns the number of files under the watched trees. */
+    std::size_t num_files() const noexcept { return files_.size(); }
+
+    /**
+     * Waits at most `timeout` for changes, and invokes `callback` with each
+     * `change&&` that has settled. Returns the number of changes reported.
+     *
+     * If a root was deleted or moved away, it's no longer watched and `error` is set to
+     * `std::errc::no_such_file_or_directory`. Its files are reported as removed by the
+     * following polls.
+     */
+    template<typename Callback>
+    std::size_t poll(std::chrono::milliseconds timeout, Callback callback,
+        std::error_code& error);
+
+private:
+    bool add_directory(const std::string& path, const bool is_new);
+    void remove_directory(const std::string& path);
+    void read_events(std::error_code& error);
+    void mark_changed(const std::string& path);
+    void resync();
+    bool has_extension(const std::string& path) const;
+    bool settle(const std::string& path, change& c);
+};
+
+} // namespace atag
+
+#include "impl/watcher.ipp"
+
+#endif // ATAG_WATCHER_HEADER
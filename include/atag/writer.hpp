@@ -0,0 +1,102 @@
+#ifndef ATAG_WRITER_HEADER
+#define ATAG_WRITER_HEADER
+
+#include "id3v2.hpp"
+#include "flac.hpp"
+
+#include <cstddef>
+#include <string>
+#include <system_error>
+
+namespace atag {
+
+/**
+ * Determines how much padding is left after a tag, which is what allows a tag to
+ * be edited in place: as long as the edited tag fits in the space taken up by the old
+ * one (including its padding), only the tag is overwritten. Otherwise the whole file
+ * has to be rewritten, which for a large file costs far more than the tag itself.
+ */
+struct padding_policy
+{
+    /** The padding a tag is given when the file has to be rewritten. */
+    std::size_t padding = 4096;
+
+    /**
+     * If an in place edit would leave more than this much padding (e.g. because the tag
+     * shrank a lot, such as when a picture was removed), the file is rewritten instead,
+     * to reclaim the space.
+     */
+    std::size_t max_padding = 1024 * 1024;
+};
+
+namespace id3v2 {
+
+/**
+ * Serializes `tag` followed by `padding` null bytes, as an ID3v2.3 tag if
+ * `tag.version` is 3, and as an ID3v2.4 tag otherwise.
+ *
+ * Text frames, comments and lyrics are expected to be in UTF-8, laid out as produced
+ * by `parse` (i.e. with null bytes between the strings of a frame). They are written
+ * as UTF-8 in ID3v2.4 tags, while in ID3v2.3 tags, which don't support UTF-8, they are
+ * written as ISO-8859-1 if they're ASCII and as UTF-16 otherwise. All other frames are
+ * written as is.
+ *
+ * Neither an extended header, nor a footer is written, nor is the tag unsynchronised.
+ */
+template<typename Allocator>
+std::string serialize(const basic_tag<Allocator>& tag, const std::size_t padding = 0);
+
+/**
+ * Replaces the ID3v2 tag at the start of the file at `path` with `tag` (or prepends
+ * it, if there is none).
+ *
+ * If the new tag fits in the space taken up by the old one, including its padding,
+ * only that region is overwritten, and the rest of the file is not touched. Otherwise,
+ * or if that would leave more than `policy.max_padding` bytes of padding, the file is
+ * rewritten with `policy.padding` bytes of padding after the tag, into a temporary
+ * file that then replaces the original, so a failure never leaves behind a half
+ * written file.
+ *
+ * The frames of the old tag that `tag` still holds unchanged, as well as those that
+ * `parse` doesn't know, are copied over byte for byte, while the others are replaced by
+ * the frames of `tag`. So `tag` should hold every known frame that is to be kept, e.g.
+ * by being the result of `parse` with modifications.
+ *
+ * Returns true if the tag was written in place, and false if the file was rewritten or
+ * if an error occurred, in which case `error` is set.
+ */
+template<typename Allocator>
+bool write(const std::string& path, const basic_tag<Allocator>& tag,
+    const padding_policy& policy, std::error_code& error);
+
+} // namespace id3v2
+
+namespace flac {
+
+/**
+ * Updates the metadata of the FLAC file at `path` with the fields of `tag`. Only the
+ * Vorbis comments of the fields that differ from what `parse` reads from the file are
+ * replaced (TITLE, ALBUM, ARTIST, GENRE, DATE and TRACKNUMBER), so that e.g. several
+ * ARTIST comments are kept as they are unless the artist changed: empty fields and
+ * zero numbers remove their comments. PERFORMER comments, which `parse` adds to the
+ * artist, are always kept, as are all other comments and metadata blocks.
+ *
+ * Edits are done in place when the metadata fits in the space of the old VORBIS_COMMENT
+ * and PADDING blocks (and the blocks between them), as described for `id3v2::write`.
+ * To keep future edits small, the new VORBIS_COMMENT block is placed right before the
+ * PADDING block, so that once the blocks preceding it have been moved there, only these
+ * two blocks are overwritten.
+ *
+ * Returns true if the metadata was written in place, and false if the file was
+ * rewritten or if an error occurred, in which case `error` is set.
+ */
+template<typename Allocator>
+bool write(const std::string& path, const basic_tag<Allocator>& tag,
+    const padding_policy& policy, std::error_code& error);
+
+} // namespace flac
+} // namespace atag
+
+#include "impl/writer.ipp"
+
+#endif // ATAG_WRITER_HEADER
@@ -1,7 +1,6 @@
 #include <atag.hpp>
+#include <atag/file_source.hpp>
 
-#include <fstream>
-#include <sstream>
 #include <cstdio>
 #include <cstring>
 
@@ -17,14 +16,14 @@ int main(int argc, const char** argv)
         detailed = true;
     }
 
-    // Read in the file.
-    const std::string source = [path = argv[1]] {
-        std::ifstream file(path);
-        if (!file) { throw std::runtime_error(std::string("could not open file ") + path); }
-        std::stringstream ss;
-        ss << file.rdbuf();
-        return ss.str();
-    }();
+    // Open the file, but only read in the parts of it that may contain a tag.
+    atag::file_source source;
+    std::error_code error;
+    source.open(argv[1], error);
+    if (error || !atag::prefetch_tags(source, error)) {
+        std::printf("could not read file %s: %s\n", argv[1], error.message().c_str());
+        return -1;
+    }
 
     using namespace atag;
     if (id3v2::is_tagged(source)) {
@@ -54,8 +53,9 @@ int main(int argc, const char** argv)
         std::printf("FLAC tag:\n");
         flac::tag tag = atag::flac::parse(source);
         std::printf("title: %s\nalbum: %s\nartist: %s\nyear: %i\ntrack#: %i\n"
-            "sample rate: %i Hz\n#channels: %i\n#samples: %i\n",
+            "sample rate: %i Hz\n#channels: %i\n#samples: %llu\n",
             tag.title.c_str(), tag.album.c_str(), tag.artist.c_str(), tag.year,
-            tag.track_number, tag.sample_rate, tag.num_channels, tag.num_samples);
+            tag.track_number, tag.streaminfo.sample_rate, tag.streaminfo.num_channels,
+            (unsigned long long)tag.streaminfo.num_samples);
     }
 }
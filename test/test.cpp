@@ -1,11 +1,41 @@
 #include "../include/atag.hpp"
 #include "../include/atag/detail/io_util.hpp"
+#include "../include/atag/detail/segment_buffer.hpp"
+#include "../include/atag/detail/thread_pool.hpp"
+#include "../include/atag/file_source.hpp"
+#include "../include/atag/library.hpp"
+#include "../include/atag/metrics.hpp"
+#include "../include/atag/mpeg.hpp"
+#include "../include/atag/retag.hpp"
+#include "../include/atag/scan.hpp"
+#include "../include/atag/tag_cache.hpp"
+#include "../include/atag/tag_parser.hpp"
+#include "../include/atag/writer.hpp"
+#ifdef __linux__
+# include "../include/atag/watcher.hpp"
+# include <cstdlib>
+#endif
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+# include "../include/atag/async.hpp"
+#endif
+// Where liburing is installed, the tests must be linked with -luring.
+#if defined(__linux__) && __has_include(<liburing.h>)
+# include "../include/atag/uring.hpp"
+#endif
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <memory_resource>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
 
 #define println(m) do std::cout << m << '\n'; while(0)
 
@@ -24,17 +54,1136 @@ std::string read_file_data(const String& path)
     return ss.str();
 }
 
+std::string le32(const uint32_t n)
+{
+    return std::string{char(n), char(n >> 8), char(n >> 16), char(n >> 24)};
+}
+
+std::string be32(const uint32_t n)
+{
+    return std::string{char(n >> 24), char(n >> 16), char(n >> 8), char(n)};
+}
+
+/** Makes an ID3v2.4 frame, whose `body` must be shorter than 128 bytes. */
+std::string make_id3v2_frame(const char* id, const std::string& body)
+{
+    return std::string(id, 4) + std::string(3, 0) + char(body.size()) + std::string(2, 0)
+        + body;
+}
+
+/** Makes an MP3 file with an ID3v2.4 tag holding `frames`, and 1000 bytes of audio. */
+std::string make_id3v2_file(const std::string& frames)
+{
+    std::string header("ID3\4\0\0", 6);
+    header.resize(10);
+    atag::detail::write_syncsafe(uint32_t(frames.size()), &header[6]);
+    return header + frames + std::string(1000, '\xff');
+}
+
+/**
+ * Makes a FLAC file with a VORBIS_COMMENT block holding `comments` (of "vendor"),
+ * 128 bytes of padding, and 1000 bytes of audio.
+ */
+std::string make_flac_file(const std::vector<std::string>& comments)
+{
+    std::string body = le32(6) + "vendor" + le32(comments.size());
+    for(const auto& comment : comments)
+        body += le32(comment.size()) + comment;
+    return "fLaC" + std::string("\0\0\0\42", 4) + std::string(34, 0) + char(4)
+        + std::string(2, 0) + char(body.size()) + body + std::string("\x81\0\0\x80", 4)
+        + std::string(128, 0) + std::string(1000, '\xff');
+}
+
+#ifdef ATAG_ASYNC_HEADER
+/**
+ * A read that suspends the awaiting coroutine until `loop` resumes it, as an event loop
+ * would once the read completes.
+ */
+struct deferred_read
+{
+    std::vector<std::coroutine_handle<>>* loop;
+    std::size_t num_bytes;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) const { loop->push_back(h); }
+    std::size_t await_resume() const noexcept { return num_bytes; }
+};
+#endif // ATAG_ASYNC_HEADER
+
 int main(int argc, const char** argv)
 {
     char src[4] = {0,0,0b1,0b0111'1111};
     assert(atag::detail::parse_syncsafe_int(src) == 255);
     assert(atag::detail::parse_syncsafe<int>(src) == 255);
 
-    const std::string source = read_file_data(argc > 1 ? argv[1] : "sample.mp3");
+    assert(atag::id3v2::frame_id_from_string("TIT2") == atag::id3v2::title);
+    assert(atag::id3v2::frame_id_from_string("WXXX") == atag::id3v2::user_defined_link);
+    assert(atag::id3v2::frame_id_from_string("XXXX") == -1);
+    assert(atag::ape::item_key_from_string("Album") == atag::ape::tag::item::album);
+    assert(atag::ape::item_key_from_string("DEBUT ALBUM") == atag::ape::tag::item::debut_album);
+    assert(atag::ape::item_key_from_string("ALBUMS") == -1);
+
+    {
+        namespace enc = atag::encoding;
+        char buffer[64];
+        // "Aé" in ISO-8859-1, then in UTF-16 with a BOM of either byte order, and a
+        // surrogate pair.
+        assert(enc::iso_8859_1_to_utf8("A\xe9\0B", 4, buffer) == 3);
+        assert(std::string(buffer, 3) == "A\xc3\xa9");
+        assert(enc::utf16_bom_to_utf8("\xff\xfe" "A\0\xe9\0", 6,
+            enc::byte_order::big_endian, buffer) == 3);
+        assert(std::string(buffer, 3) == "A\xc3\xa9");
+        assert(enc::utf16_bom_to_utf8("\xfe\xff" "\xd8\x3d\xde\x00", 6,
+            enc::byte_order::little_endian, buffer) == 4);
+        assert(std::string(buffer, 4) == "\xf0\x9f\x98\x80");
+        assert(enc::is_valid_utf8("A\xc3\xa9\xf0\x9f\x98\x80", 7));
+        assert(!enc::is_valid_utf8("\xc0\xaf", 2));
+        assert(!enc::is_valid_utf8("\xed\xa0\x80", 3));
+        assert(enc::utf16le_to_utf8(enc::utf8_to_utf16le("\xf0\x9f\x98\x80 a"))
+            == "\xf0\x9f\x98\x80 a");
+    }
+
+    {
+        // An ID3v2 tag, then the audio, then an APE tag without a header, and an ID3v1
+        // tag must all be found in one go.
+        const std::string id3v2 = std::string("ID3\4\0\0\0\0\0\20", 10)
+            + std::string("TIT2\0\0\0\6\0\0\3Title", 16);
+        const std::string items = le32(4) + le32(0) + std::string("Year\0" "2003", 9)
+            + le32(3) + le32(0) + std::string("Album\0" "Ape", 9);
+        const std::string ape = items + "APETAGEX" + le32(2000) + le32(items.size() + 32)
+            + le32(2) + le32(0) + std::string(8, 0);
+        std::string id3v1 = "TAG" + std::string(90, 0) + "1999" + std::string(31, 0);
+        id3v1[3] = 'T';
+        id3v1[126] = 7;
+        id3v1[127] = 17;
+        const std::string file = id3v2 + std::string(1000, '\xff') + ape + id3v1;
+
+        const auto layout = atag::detect(file);
+        assert((layout.id3v2 == 0) && (layout.flac == -1));
+        assert(layout.ape == int(file.size() - 128 - 32));
+        assert(layout.id3v1 == int(file.size() - 128));
+        const auto tags = atag::parse_all(file);
+        assert(tags.id3v2 && (tags.id3v2->frames.size() == 1)
+            && (tags.id3v2->frames[0].data == "Title"));
+        assert(tags.ape && (tags.ape->items.size() == 2)
+            && (tags.ape->items[1].key == atag::ape::tag::item::album)
+            && (tags.ape->items[1].data == "Ape"));
+        assert(tags.id3v1 && (tags.id3v1->title == "T") && (tags.id3v1->year == 1999)
+            && (tags.id3v1->track_number == 7) && (tags.id3v1->genre == 17));
+        assert(!tags.flac);
+        assert(atag::parse(file).title == "Title");
+        assert(atag::parse(file.substr(id3v2.size())).album == "Ape");
+        assert(atag::parse(file.substr(id3v2.size())).year == 2003);
+
+        // In a file larger than 4 GiB, of which only the first and last few bytes are
+        // backed here, the offsets of the tags at its end must not wrap around. The APE
+        // tag lies beyond what its parser can address, so ID3v1 is fallen back to.
+        struct large_source
+        {
+            std::string head = std::string(4096, 0);
+            std::string tail;
+
+            std::size_t size() const noexcept { return (std::size_t(1) << 32) + 1000; }
+            const char& operator[](const std::size_t i) const noexcept
+            {
+                static const char zero = 0;
+                if(i < head.size()) { return head[i]; }
+                const std::size_t tail_start = size() - tail.size();
+                return i >= tail_start ? tail[i - tail_start] : zero;
+            }
+        };
+        large_source large;
+        large.tail = ape + id3v1;
+        const auto large_layout = atag::detect(large);
+        assert(large_layout.ape == int64_t(large.size() - 128 - 32));
+        assert(large_layout.id3v1 == int64_t(large.size() - 128));
+        assert(!atag::parse_all(large).ape && (atag::parse(large).title == "T"));
+    }
+
+    {
+        // MPEG-1 Layer III frames at 128 kbit/s and 44.1 kHz are 417 bytes long. The
+        // first one holds a Xing header, which gives the exact duration right away,
+        // while without one the duration is extrapolated from the frames' bitrate.
+        std::string frame(417, 0);
+        frame[0] = char(0xff);
+        frame[1] = char(0xfb);
+        frame[2] = char(0x90);
+        std::string xing = frame;
+        xing.replace(36, 12, std::string("Xing\0\0\0\1\0\0\3\xe8", 12));
+        std::string stream = "junk" + xing;
+        for(int i = 0; i < 100; ++i) { stream += frame; }
+
+        atag::mpeg::properties properties;
+        std::error_code error;
+        assert(atag::mpeg::read_properties(stream, properties, error));
+        assert(properties.is_exact && (properties.length == 1000 * 1152 * 1000 / 44100));
+        assert((properties.sample_rate == 44100) && (properties.num_channels == 2));
+        // A corrupt frame count makes for a duration that doesn't fit an int.
+        stream.replace(4 + 36 + 8, 4, "\x7f\xff\xff\xff");
+        assert(atag::mpeg::read_properties(stream, properties, error));
+        assert((properties.length == std::numeric_limits<int>::max())
+            && (properties.bitrate == 0));
+        stream.replace(4 + 36, 4, "none");
+        assert(atag::mpeg::read_properties(stream, properties, error));
+        assert(!properties.is_exact && (properties.bitrate == 128));
+        assert(properties.length == 101 * 417 * 8 / 128);
+        assert(atag::mpeg::find_sync(stream.data(), stream.size()) == 4);
+    }
+
+    {
+        // Vorbis comment keys are case-insensitive and may be repeated, and none of the
+        // lengths may be trusted.
+        std::string body = le32(6) + "vendor" + le32(4);
+        for(const std::string c : {"artist=A", "ARTIST=B", "Date=2001", "REPLAYGAIN_X=-1"})
+            body += le32(c.size()) + c;
+        const std::string flac = "fLaC" + std::string("\0\0\0\42", 4) + std::string(34, 0)
+            + char(0x84) + std::string{0, 0, char(body.size())} + body;
+
+        const auto view = atag::flac::make_comment_view(flac);
+        assert((view.vendor() == "vendor") && (view.comments().size() == 4));
+        assert(view.value("Artist") == "A");
+        assert(view.value("replaygain_x") == "-1");
+        assert(!view.find("ALBUM"));
+        std::string artists;
+        view.for_each("ARTIST", [&artists](std::string_view a) { artists += a; });
+        assert(artists == "AB");
+        int num_replaygain = 0;
+        view.for_each_prefixed("ReplayGain_", [&](const auto&) { ++num_replaygain; });
+        assert(num_replaygain == 1);
+        const auto tag = atag::flac::parse(flac);
+        assert((tag.artist == "A, B") && (tag.year == 2001));
+
+        atag::vorbis::comment_view truncated;
+        assert(!truncated.parse(body.data(), body.size() - 1));
+        assert(truncated.comments().size() == 3);
+        assert(!truncated.parse(body.data(), 13));
+    }
+
+    {
+        // An Ogg Vorbis stream whose comment header spans two pages, followed by the
+        // audio, of which the last page tells the duration.
+        const auto page = [](const int flags, const int64_t granule,
+            const std::string& lacing, const std::string& body)
+        {
+            return "OggS" + std::string(1, 0) + char(flags) + le32(granule)
+                + le32(granule >> 32) + le32(7) + le32(0) + le32(0) + char(lacing.size())
+                + lacing + body;
+        };
+        const std::string identification = "\1vorbis" + le32(0) + char(2) + le32(44100)
+            + std::string(14, 0);
+        const std::string comments = "\3vorbis" + le32(6) + "vendor" + le32(2)
+            + le32(9) + "TITLE=Ogg" + le32(608) + "COMMENT=" + std::string(600, 'x')
+            + '\1';
+        // 510 bytes on the second page and the rest on the third.
+        const std::string rest = comments.substr(510);
+        const std::string file = page(2, 0, "\x1e", identification)
+            + page(0, -1, "\xff\xff", comments.substr(0, 510))
+            + page(1, 0, std::string(rest.size() / 255, '\xff') + char(rest.size() % 255),
+                rest)
+            + page(0, 1000, "\x10", std::string(16, 0))
+            + page(4, 441000, "\x10", std::string(16, 0));
+
+        assert(atag::detect(file).ogg == 0);
+        const auto tag = atag::ogg::parse(file);
+        assert((tag.codec == atag::ogg::codec::vorbis) && (tag.title == "Ogg"));
+        assert((tag.sample_rate == 44100) && (tag.num_channels == 2));
+        assert(tag.length == 10000);
+        assert(atag::parse(file).length == 10000);
+        std::string block;
+        assert(atag::ogg::read_comments(file, block) == atag::ogg::codec::vorbis);
+        const atag::vorbis::comment_view view(block.data(), block.size());
+        assert(view.value("comment").size() == 600);
+        assert(atag::ogg::parse(file.substr(0, 600)).title.empty());
+        // A corrupt last page is skipped in favour of the one before.
+        const std::string corrupt = file + page(4, int64_t(72057594042122248), "\x10",
+            std::string(16, 0));
+        assert(atag::ogg::parse(corrupt).length == 10000);
+        // A plausible granule of 2^40 samples, which lasts longer than an int holds.
+        const std::string long_file = file + page(4, int64_t(1) << 40, "\x10",
+            std::string(16, 0));
+        assert(atag::ogg::parse(long_file).length == 24932236457);
+        assert(atag::parse(long_file).length == std::numeric_limits<int>::max());
+
+        atag::tag_parser parser(file.size());
+        for(atag::byte_range r; parser.need_bytes(r);)
+            parser.feed(r.offset, &file[r.offset], r.length);
+        assert((parser.parse().title == "Ogg") && (parser.parse().length == 10000));
+    }
+
+    {
+        // An M4A file with its moov box after the media data, which mustn't be read.
+        const auto box = [](const std::string& type, const std::string& body)
+            { return be32(8 + body.size()) + type + body; };
+        const auto item = [&box](const std::string& type, const std::string& value)
+            { return box(type, box("data", be32(1) + be32(0) + value)); };
+        const std::string mvhd = std::string(12, 0) + be32(1000) + be32(12345)
+            + std::string(80, 0);
+        const std::string ilst = item("\xa9nam", "Title")
+            + item("\xa9" "day", "2004-01-01") + item("trkn", std::string("\0\0\0\5\0\7\0\0", 8));
+        const std::string meta = std::string(4, 0) + box("hdlr", std::string(25, 0))
+            + box("ilst", ilst);
+        const std::string file = box("ftyp", "M4A " + be32(0))
+            + box("mdat", std::string(100000, 0)) + box("moov", box("mvhd", mvhd)
+                + box("trak", std::string(20000, 0)) + box("udta", box("meta", meta)));
+
+        assert(atag::detect(file).mp4 == 0);
+        const auto tag = atag::mp4::parse(file);
+        assert((tag.title == "Title") && (tag.year == 2004) && (tag.track_number == 5));
+        assert(tag.length == 12345);
+
+        atag::tag_parser parser(file.size());
+        std::size_t num_bytes = 0;
+        for(atag::byte_range r; parser.need_bytes(r); num_bytes += r.length)
+            parser.feed(r.offset, &file[r.offset], r.length);
+        assert((parser.parse().title == "Title") && (parser.parse().length == 12345));
+        // The head and tail probes, and the headers and bodies in between.
+        assert(num_bytes < 2 * 4096 + 1000);
+
+        // A version 1 movie header has a 64-bit duration, here 2^56 at 48 kHz.
+        const std::string mvhd64 = std::string("\1\0\0\0", 4) + std::string(16, 0)
+            + be32(48000) + be32(0x01000000) + be32(0) + std::string(80, 0);
+        const std::string file64 = box("ftyp", "M4A " + be32(0))
+            + box("moov", box("mvhd", mvhd64));
+        assert(atag::mp4::parse(file64).length == 1501199875790165);
+        // Which the simple tag's length can only hold as much of as fits an int.
+        assert(atag::parse(file64).length == std::numeric_limits<int>::max());
+    }
+
+    {
+        // A Broadcast Wave file with INFO and bext chunks, and an ID3v2 tag in a chunk
+        // after the audio data, which mustn't be read.
+        const auto chunk = [](const std::string& id, const std::string& body)
+            { return id + le32(body.size()) + body + std::string(body.size() & 1, 0); };
+        // 2 channels, 44.1 kHz, 16 bits per sample, i.e. 176400 bytes per second.
+        const std::string fmt = std::string("\1\0\2\0", 4) + le32(44100) + le32(176400)
+            + std::string("\4\0\20\0", 4);
+        const std::string info = "INFO" + chunk("INAM", "Info title")
+            + chunk("IART", "Artist") + chunk("ICRD", "2005-06-07")
+            + chunk("ITRK", std::string("9\0", 2));
+        std::string bext(602, 0);
+        bext.replace(0, 11, "Description");
+        bext.replace(320, 10, "2005-06-07");
+        bext[338] = 1;
+        const std::string id3 = std::string("ID3\4\0\0\0\0\0\20", 10)
+            + std::string("TIT2\0\0\0\6\0\0\3Title", 16);
+        const std::string body = "WAVE" + chunk("fmt ", fmt) + chunk("LIST", info)
+            + chunk("bext", bext) + chunk("data", std::string(352800, 0))
+            + chunk("id3 ", id3);
+        const std::string file = "RIFF" + le32(body.size()) + body;
+
+        assert(atag::detect(file).riff == 0);
+        const auto tag = atag::riff::parse(file);
+        assert((tag.title == "Info title") && (tag.artist == "Artist"));
+        assert((tag.year == 2005) && (tag.track_number == 9));
+        assert(tag.description == "Description");
+        assert(tag.origination_date == "2005-06-07");
+        assert(tag.time_reference == 1);
+        assert((tag.sample_rate == 44100) && (tag.num_channels == 2));
+        assert(tag.length == 2000);
+        assert(tag.id3v2_length == id3.size());
+        assert(file.compare(tag.id3v2_offset, tag.id3v2_length, id3) == 0);
+
+        // The ID3v2 tag takes precedence, and is parsed where it is.
+        const auto tags = atag::parse_all(file);
+        assert(tags.riff && tags.id3v2 && (tags.id3v2->frames.size() == 1)
+            && (tags.id3v2->frames[0].data == "Title"));
+        atag::tag_parser parser(file.size());
+        std::size_t num_bytes = 0;
+        for(atag::byte_range r; parser.need_bytes(r); num_bytes += r.length)
+            parser.feed(r.offset, &file[r.offset], r.length);
+        const auto simple = parser.parse();
+        assert((simple.title == "Title") && (simple.artist == "Artist"));
+        assert(simple.length == 2000);
+        assert(num_bytes < 2 * 4096 + 1000);
+
+        // An AIFF file, whose sample rate is an 80-bit float (0xac44 * 2^(15 - 15)).
+        const std::string comm = std::string("\0\1", 2) + be32(88200)
+            + std::string("\0\20\x40\x0e\xac\x44\0\0\0\0\0\0", 12);
+        const std::string aiff = "AIFF" + std::string("COMM") + be32(comm.size()) + comm
+            + "NAME" + be32(5) + "Name" + std::string(2, 0);
+        const std::string aiff_file = "FORM" + be32(aiff.size()) + aiff;
+        const auto aiff_tag = atag::riff::parse(aiff_file);
+        assert((aiff_tag.sample_rate == 44100) && (aiff_tag.num_channels == 1));
+        assert((aiff_tag.length == 2000) && (aiff_tag.title == "Name"));
+        assert(atag::parse(aiff_file).title == "Name");
+        // A corrupt exponent, which makes the rate some 10^38 Hz, is ignored.
+        std::string corrupt_aiff = aiff_file;
+        corrupt_aiff.replace(12 + 8 + 8, 2, "\x40\x7e");
+        const auto corrupt_tag = atag::riff::parse(corrupt_aiff);
+        assert((corrupt_tag.sample_rate == 0) && (corrupt_tag.length == 0));
+        assert(corrupt_tag.title == "Name");
+    }
+
+    {
+        // A library must order and group the rows as the comparators order the tags.
+        std::vector<atag::simple_tag> tags;
+        const char* artists[] = {"b", "a", "", "c", "a"};
+        const char* albums[] = {"y", "x", "z", "x"};
+        for(int i = 0; i < 40; ++i)
+        {
+            atag::simple_tag t{};
+            t.title = std::to_string(i * 7 % 13);
+            t.artist = artists[i % 5];
+            t.album = albums[i % 4];
+            t.track_number = i % 3 - 1;
+            t.year = 2000 - i % 6;
+            tags.push_back(t);
+        }
+        atag::library lib;
+        for(const auto& t : tags) { lib.push_back(t); }
+        assert((lib.size() == tags.size()) && (lib[5].artist == "b"));
+        assert((lib.artist_pool().size() == 4) && (lib.album_pool().size() == 4));
+
+        const auto check_order = [&](auto order)
+        {
+            std::vector<uint32_t> rows(tags.size());
+            std::iota(rows.begin(), rows.end(), 0);
+            std::stable_sort(rows.begin(), rows.end(),
+                [&](const uint32_t a, const uint32_t b) { return order(tags[a], tags[b]); });
+            assert(lib.sorted_rows(order) == rows);
+        };
+        check_order(atag::order::title());
+        check_order(atag::order::artist());
+        check_order(atag::order::album());
+        check_order(atag::order::year());
+        check_order(atag::order::track_number());
+
+        const auto groups = lib.group_by_artist();
+        assert((groups.size() == 4) && (groups.ids[0] == 0));
+        assert(lib.artist_pool()[groups.ids[1]] == "a");
+        assert(groups.offsets[2] - groups.offsets[1] == 16);
+        for(uint32_t i = groups.offsets[2]; i < groups.offsets[3]; ++i)
+            assert(lib[groups.rows[i]].artist == "b");
+
+        lib.sort(atag::order::artist());
+        assert((lib[0].artist == "") && (lib[lib.size()-1].artist == "c"));
+        assert((lib[0].title == tags[2].title) && (lib[1].title == tags[7].title));
+
+        // Large libraries are radix sorted, which must also be stable.
+        atag::library large;
+        for(int i = 0; i < 70000; ++i)
+        {
+            atag::simple_tag t{};
+            t.year = i * 7919 % 97 - 40;
+            large.push_back(t);
+        }
+        std::vector<uint32_t> rows(large.size());
+        std::iota(rows.begin(), rows.end(), 0);
+        std::stable_sort(rows.begin(), rows.end(), [&](const uint32_t a, const uint32_t b)
+            { return large.years()[a] < large.years()[b]; });
+        assert(large.sorted_rows(atag::order::year()) == rows);
+    }
+
+    {
+        // Sort keys ignore case, accents and, optionally, leading articles.
+        atag::collation_options options;
+        options.skip_articles = true;
+        assert(atag::make_sort_key("Beyonc\xc3\xa9") == "beyonce");
+        assert(atag::make_sort_key("Stra\xc3\x9f" "e \xd0\x96") == "strasse \xd0\xb6");
+        assert(atag::make_sort_key("The Beatles") == "the beatles");
+        assert(atag::make_sort_key("The Beatles", options) == "beatles");
+        assert(atag::make_sort_key("The", options) == "the");
+
+        std::vector<atag::collated<atag::simple_tag>> tags;
+        atag::library lib;
+        const char* artists[] = {"the Beatles", "\xc3\x89mile", "abba", "The Beatles", "Zz"};
+        for(const char* artist : artists)
+        {
+            atag::simple_tag t{};
+            t.artist = artist;
+            lib.push_back(t);
+            tags.push_back(atag::collate(t, options));
+        }
+        std::stable_sort(tags.begin(), tags.end(), atag::order::artist());
+        assert((tags[0].tag.artist == "abba") && (tags[1].tag.artist == "the Beatles"));
+        assert((tags[2].tag.artist == "The Beatles") && (tags[3].keys.artist == "emile"));
+        const std::vector<uint32_t> rows{2, 0, 3, 1, 4};
+        assert(lib.sorted_rows(atag::order::artist(), options) == rows);
+        assert(lib.sorted_rows(atag::order::artist())[0] == 3);
+    }
+
+    {
+        // The std::nothrow overloads tell an untagged source from a malformed one, and
+        // where the latter went wrong, rather than throwing or returning an empty tag.
+        const std::string id3 = std::string("ID3\4\0\0\0\0\0\40", 10)
+            + std::string("TIT2\0\0\0\6\0\0\3Title", 16)
+            + std::string("TALB\0\0\0\6\0\0\3Album", 16);
+        auto result = atag::id3v2::simple_parse(id3, std::nothrow);
+        assert(result && (result->title == "Title") && (result->album == "Album"));
+        result = atag::id3v2::simple_parse(std::string("ID3"), std::nothrow);
+        assert(result.error().code == atag::parse_errc::not_tagged);
+        const auto truncated = atag::id3v2::parse(id3.substr(0, 36), std::nothrow);
+        assert((truncated.error().code == atag::parse_errc::truncated)
+            && (truncated.error().offset == 26) && (truncated->frames.size() == 1));
+        std::string malformed = id3;
+        malformed[26+7] = 0x7f;
+        result = atag::id3v2::simple_parse(malformed, std::nothrow);
+        assert((result.error().code == atag::parse_errc::invalid_frame)
+            && (result.error().offset == 26) && (result->title == "Title"));
+
+        std::string flac = "fLaC" + std::string("\0\0\0\42", 4) + std::string(34, 0)
+            + std::string("\x84\0\0\x10", 4) + std::string(8, 0);
+        assert(atag::flac::parse(flac, std::nothrow).error().code
+            == atag::parse_errc::truncated);
+        flac[42] = 0x7f;
+        assert(atag::flac::parse(flac, std::nothrow).error().offset == 42);
+        assert(atag::ape::parse(id3, std::nothrow).error().code
+            == atag::parse_errc::not_tagged);
+        assert(atag::id3v1::parse(id3, std::nothrow).error().code
+            == atag::parse_errc::not_tagged);
+
+        // The same goes for a tag of which only the start was fetched, which mustn't be
+        // read past the fetched range, even though the file itself is large enough.
+        atag::detail::segment_buffer fetched;
+        const auto fetch_start = [&fetched](const std::string& data, const std::size_t n)
+        {
+            fetched.reset(data.size() + 1000);
+            fetched.insert(0, n, [&data](char* dest, const std::size_t offset,
+                const std::size_t length)
+            {
+                std::copy_n(&data[offset], length, dest);
+                return true;
+            });
+        };
+        fetch_start(id3, 36);
+        const auto partial = atag::id3v2::parse(fetched, std::nothrow);
+        assert((partial.error().code == atag::parse_errc::truncated)
+            && (partial.error().offset == 26) && (partial->frames.size() == 1));
+        flac[42] = char(0x84);
+        fetch_start(flac, 50);
+        assert(atag::flac::parse(fetched, std::nothrow).error().code
+            == atag::parse_errc::truncated);
+    }
+
+    {
+        // Length fields are only trusted as far as the tag goes, and tiny sources are
+        // not read past their end.
+        assert(!atag::id3v2::is_tagged(std::string_view("ID3\4", 4)));
+        // An extended header claiming more than the whole tag.
+        const std::string id3 = std::string("ID3\4\0\x40\0\0\0\20", 10)
+            + std::string("\0\0\x7f\x7f", 4) + std::string(12, 'x');
+        assert(atag::id3v2::parse(id3, std::nothrow).error().code
+            == atag::parse_errc::invalid_header);
+        assert(atag::id3v2::make_view(id3).frames().empty());
+        // An APE item whose value size is negative when taken as signed.
+        const std::string items = le32(0xfffffff0) + le32(0)
+            + std::string("Title\0ab", 8);
+        const std::string ape = items + "APETAGEX" + le32(2000) + le32(items.size() + 32)
+            + le32(1) + le32(0) + std::string(8, 0);
+        const auto result = atag::ape::parse(ape, std::nothrow);
+        assert((result.error().code == atag::parse_errc::invalid_frame)
+            && (result->items.size() == 1) && (result->items[0].data == "ab"));
+
+        // A number frame that ends the source, which is copied to a buffer of its exact
+        // size so that a read past its end isn't stopped by a null terminator.
+        const std::string trck = std::string("ID3\4\0\0\0\0\0\15", 10)
+            + std::string("TRCK\0\0\0\3\0\0\0" "12", 13);
+        const std::unique_ptr<char[]> exact(new char[trck.size()]);
+        std::copy(trck.begin(), trck.end(), exact.get());
+        const auto simple = atag::id3v2::simple_parse(
+            std::string_view(exact.get(), trck.size()), std::nothrow);
+        assert(simple && (simple->track_number == 12));
+    }
+
+    {
+        // The metrics sink is fed by hand here, as the parsers only report to it if built
+        // with ATAG_ENABLE_INSTRUMENTATION.
+        namespace instr = atag::instrumentation;
+        instr::histogram h;
+        for(const uint64_t v : {0, 1, 3, 4, 1000}) { h.record(v); }
+        assert((h.count() == 5) && (h.sum() == 1008));
+        assert((h.bucket(0) == 1) && (h.bucket(2) == 1) && (h.bucket(10) == 1));
+        assert((h.quantile(0.5) == 3) && (h.quantile(1) == 1023));
+
+        instr::metrics metrics;
+        instr::parse_stats stats;
+        stats.tag_format = instr::format::flac;
+        stats.frames_visited = 3;
+        stats.frames_decoded = 2;
+        stats.error = {atag::parse_errc::truncated, 42};
+        metrics.on_parse(stats);
+        const auto& flac = metrics[instr::format::flac];
+        assert((flac.num_parses() == 1) && (flac.num_errors() == 1)
+            && (flac.errors[int(atag::parse_errc::truncated)] == 1));
+        const std::string text = metrics.to_prometheus();
+        assert(text.find("atag_frames_visited_total{format=\"flac\"} 3\n")
+            != std::string::npos);
+        assert(text.find(
+            "atag_parse_errors_total{format=\"flac\",error=\"truncated\"} 1\n")
+            != std::string::npos);
+        assert(text.find("atag_frames_visited_total{format=\"mpeg\"} 0\n")
+            != std::string::npos);
+
+#ifdef ATAG_ENABLE_INSTRUMENTATION
+        // A TIT2 frame, which is decoded, and a PRIV frame, which is only visited.
+        const std::string id3 = std::string("ID3\4\0\0\0\0\0\34", 10)
+            + std::string("TIT2\0\0\0\6\0\0\0Title", 16)
+            + std::string("PRIV\0\0\0\2\0\0ab", 12);
+        instr::metrics live;
+        instr::set_observer(&live);
+        atag::id3v2::simple_parse(id3);
+        instr::set_observer(nullptr);
+        const auto& id3v2 = live[instr::format::id3v2];
+        assert((id3v2.num_parses() == 1) && (id3v2.num_errors() == 0));
+        assert((id3v2.frames_visited == 2) && (id3v2.frames_decoded == 1));
+        assert(id3v2.bytes_read.sum() == 26);
+        assert(live[instr::conversion::iso_8859_1_to_utf8].bytes == 5);
+
+        // A WAV file with an INFO list, the only chunk, which is decoded.
+        const std::string wav = std::string("RIFF\34\0\0\0WAVELIST\20\0\0\0", 20)
+            + std::string("INFOINAM\4\0\0\0Name", 16);
+        instr::set_observer(&live);
+        assert(atag::riff::parse(wav).title == "Name");
+        instr::set_observer(nullptr);
+        const auto& riff = live[instr::format::riff];
+        assert((riff.num_parses() == 1) && (riff.num_errors() == 0));
+        assert((riff.frames_visited == 1) && (riff.frames_decoded == 1));
+        assert(riff.bytes_read.sum() == 24);
+#endif // ATAG_ENABLE_INSTRUMENTATION
+    }
+
+    {
+        // A FLAC stream of 2^36 - 1 samples at 1 kHz lasts longer than an int holds.
+        std::string streaminfo(34, 0);
+        const uint64_t packed = (uint64_t(1000) << 44) | (uint64_t(1) << 41)
+            | (uint64_t(15) << 36) | 0xf'ffff'ffffull;
+        for(int i = 0; i < 8; ++i) { streaminfo[10 + i] = char(packed >> (56 - 8 * i)); }
+        const std::string file = "fLaC" + std::string("\x80\0\0\42", 4) + streaminfo;
+        assert(atag::flac::parse(file).streaminfo.length() == 68719476735);
+        assert(atag::parse(file).length == std::numeric_limits<int>::max());
+    }
+
+    {
+        // A FLAC file with neither a VORBIS_COMMENT nor a PADDING block has the new ones
+        // appended, after its last block, which thus must no longer be marked last.
+        const std::string audio(5000, '\xff');
+        std::ofstream("test_flac_edit", std::ios::binary) << "fLaC"
+            << std::string("\x80\0\0\42", 4) << std::string(34, 0) << audio;
+        atag::flac::tag tag;
+        tag.title = "Title";
+        tag.artist = "Artist";
+        std::error_code error;
+        assert(!atag::flac::write("test_flac_edit", tag, atag::padding_policy(), error)
+            && !error);
+        std::string edited = read_file_data("test_flac_edit");
+        assert(edited[4] == 0);
+        auto parsed = atag::flac::parse(edited);
+        assert((parsed.title == "Title") && (parsed.artist == "Artist"));
+        assert(edited.compare(edited.size() - audio.size(), audio.size(), audio) == 0);
+
+        // Now there is room to edit in place.
+        tag.title = "Edited";
+        assert(atag::flac::write("test_flac_edit", tag, atag::padding_policy(), error)
+            && !error);
+        const std::string reedited = read_file_data("test_flac_edit");
+        parsed = atag::flac::parse(reedited);
+        assert((reedited.size() == edited.size()) && (parsed.title == "Edited"));
+        std::remove("test_flac_edit");
+    }
+
+    {
+        // Only the comments of the fields that changed are replaced: the multi-valued
+        // artist, the performer and the full date are kept as they are.
+        std::ofstream("test_flac_comments", std::ios::binary) << make_flac_file({
+            "TITLE=Old", "ARTIST=A", "ARTIST=B", "PERFORMER=P", "DATE=2001-05-03"});
+        auto tag = atag::flac::parse(read_file_data("test_flac_comments"));
+        assert((tag.artist == "A, B, P") && (tag.year == 0));
+        tag.title = "New";
+        std::error_code error;
+        assert(atag::flac::write("test_flac_comments", tag, atag::padding_policy(),
+            error) && !error);
+        const std::string edited = read_file_data("test_flac_comments");
+        const auto has = [&edited](const std::string& comment)
+            { return edited.find(le32(comment.size()) + comment) != std::string::npos; };
+        assert(has("TITLE=New") && !has("TITLE=Old"));
+        assert(has("ARTIST=A") && has("ARTIST=B") && has("PERFORMER=P")
+            && has("DATE=2001-05-03") && has("vendor"));
+        const auto parsed = atag::flac::parse(edited);
+        assert((parsed.title == "New") && (parsed.artist == "A, B, P"));
+
+        // A changed artist replaces the ARTIST comments, but not the performer.
+        tag.artist = "C";
+        atag::flac::write("test_flac_comments", tag, atag::padding_policy(), error);
+        assert(!error && (atag::flac::parse(read_file_data("test_flac_comments")).artist
+            == "C, P"));
+        std::remove("test_flac_comments");
+    }
+
+    {
+        // Editing a tag keeps the frames that weren't changed, and those that aren't
+        // known (TDRC), byte for byte, while the UTF-16 comment's description and value
+        // each keep their own BOM.
+        const std::string tdrc = make_id3v2_frame("TDRC", std::string("\0" "2020", 5));
+        const std::string comm = make_id3v2_frame("COMM", std::string("\1" "eng"
+            "\xff\xfe" "d\0" "\0\0" "\xff\xfe" "c\0a\0f\0\xe9\0", 20));
+        const std::string txxx = make_id3v2_frame("TXXX",
+            std::string("\0" "KEY\0value", 11));
+        std::ofstream("test_id3_edit", std::ios::binary) << make_id3v2_file(
+            make_id3v2_frame("TIT2", std::string("\0Title", 6)) + tdrc + comm + txxx);
+        auto tag = atag::id3v2::parse(read_file_data("test_id3_edit"));
+        assert(tag.frames.size() == 3);
+        assert(tag.frames[1].data == std::string("engd\0caf\xc3\xa9", 10));
+        assert(tag.frames[2].data == std::string("KEY\0value", 9));
+        tag.frames[0].data = "Edited";
+        std::error_code error;
+        atag::id3v2::write("test_id3_edit", tag, atag::padding_policy(), error);
+        const std::string edited = read_file_data("test_id3_edit");
+        assert(!error && (atag::id3v2::simple_parse(edited).title == "Edited"));
+        assert((edited.find(tdrc) != std::string::npos)
+            && (edited.find(comm) != std::string::npos)
+            && (edited.find(txxx) != std::string::npos));
+        std::remove("test_id3_edit");
+
+        // Re-encoded as UTF-16 in an ID3v2.3 tag, they come back the same.
+        tag.version = 3;
+        const auto reparsed = atag::id3v2::parse(atag::id3v2::serialize(tag));
+        assert(reparsed.frames.size() == 3);
+        assert((reparsed.frames[0].data == "Edited")
+            && (reparsed.frames[1].data == tag.frames[1].data)
+            && (reparsed.frames[2].data == tag.frames[2].data));
+    }
+
+    {
+        // Retagging a file with the fields it already has, but for the title, keeps
+        // everything else as it was: multi-valued frames and comments, the track count,
+        // and the frames and comments that aren't read.
+        std::vector<std::string> frames = {
+            make_id3v2_frame("TPE1", std::string("\0A\0B", 4)),
+            make_id3v2_frame("TRCK", std::string("\0" "3/12", 5)),
+            make_id3v2_frame("TDRC", std::string("\0" "2020", 5)),
+            make_id3v2_frame("COMM", std::string("\1" "eng" "\xff\xfe" "d\0" "\0\0"
+                "\xff\xfe" "c\0a\0f\0\xe9\0", 20)),
+            make_id3v2_frame("TXXX", std::string("\0" "KEY\0value", 11)),
+        };
+        std::ofstream("test_retag.mp3", std::ios::binary) << make_id3v2_file(
+            make_id3v2_frame("TIT2", std::string("\0Title", 6)) + frames[0] + frames[1]
+            + frames[2] + frames[3] + frames[4]);
+        const std::vector<std::string> comments = {"TITLE=Old", "ARTIST=A", "ARTIST=B",
+            "PERFORMER=P", "DATE=2001-05-03", "TRACKNUMBER=3/12", "MOOD=calm"};
+        std::ofstream("test_retag.flac", std::ios::binary) << make_flac_file(comments);
+
+        std::vector<atag::retag_job> jobs(2);
+        jobs[0].path = "test_retag.mp3";
+        jobs[1].path = "test_retag.flac";
+        for(auto& job : jobs)
+        {
+            job.tag = atag::parse(read_file_data(job.path));
+            job.tag.title = "New";
+        }
+        std::vector<atag::retag_result> results;
+        atag::retag(jobs, atag::retag_options(), [&results](atag::retag_result&& r) {
+            results.push_back(std::move(r));
+        });
+        assert((results.size() == 2) && !results[0].error && !results[1].error);
+
+        const std::string mp3 = read_file_data("test_retag.mp3");
+        assert(atag::parse(mp3).title == "New");
+        for(const auto& frame : frames) { assert(mp3.find(frame) != std::string::npos); }
+        const std::string flac = read_file_data("test_retag.flac");
+        assert(atag::parse(flac).title == "New");
+        for(auto it = comments.begin() + 1; it != comments.end(); ++it)
+            assert(flac.find(le32(it->size()) + *it) != std::string::npos);
+        std::remove("test_retag.mp3");
+        std::remove("test_retag.flac");
+    }
+
+    {
+        // Every submitted task must be handled once, even with a single pending slot.
+        std::atomic<int> sum{0};
+        std::atomic<int> max_worker{0};
+        atag::detail::work_stealing_pool<int> pool(4, 1,
+            [&sum, &max_worker](int& task, const std::size_t worker) {
+                sum += task;
+                if(int(worker) > max_worker) { max_worker = int(worker); }
+            });
+        assert(pool.num_workers() == 4);
+        for(int i = 1; i <= 1000; ++i) { pool.submit(i); }
+        pool.finish();
+        assert((sum == 500500) && (max_worker < 4));
+        pool.finish();
+
+        // A throwing handler must not stop the other tasks, and is rethrown by finish.
+        std::atomic<int> num_handled{0};
+        atag::detail::work_stealing_pool<int> throwing_pool(2, 2,
+            [&num_handled](int& task, const std::size_t) {
+                ++num_handled;
+                if(task % 10 == 0) { throw std::runtime_error("task"); }
+            });
+        for(int i = 1; i <= 100; ++i) { throwing_pool.submit(i); }
+        bool has_thrown = false;
+        try { throwing_pool.finish(); } catch(const std::runtime_error&) { has_thrown = true; }
+        assert(has_thrown && (num_handled == 100));
+    }
+
+    {
+        // A bounded queue hands over its items in order, and drains before closing.
+        atag::bounded_queue<int> queue(2);
+        std::thread producer([&queue] {
+            for(int i = 0; i < 100; ++i) { assert(queue.push(i)); }
+            queue.close();
+        });
+        int expected = 0;
+        for(int item; queue.pop(item); ++expected) { assert(item == expected); }
+        producer.join();
+        assert((expected == 100) && !queue.push(100));
+    }
+
+    {
+        // A scan must parse every file with a matching extension in the tree, once.
+        namespace fs = std::filesystem;
+        const fs::path directory = fs::temp_directory_path() / "atag_test_scan";
+        fs::remove_all(directory);
+        fs::create_directories(directory / "sub");
+        const char* names[] = { "a.mp3", "b.MP3", "sub/c.mp3", "sub/d.txt" };
+        for(const char* name : names)
+        {
+            // An ID3v1 tag titled after the file, with no genre.
+            std::string id3v1 = std::string("TAG") + name;
+            id3v1.resize(127);
+            std::ofstream(directory / name, std::ios::binary) << id3v1 << char(255);
+        }
+        atag::scan_options options;
+        options.concurrency = 2;
+        options.max_pending = 1;
+        atag::bounded_queue<atag::scan_result> results(1);
+        std::error_code error;
+        std::size_t num_files = 0;
+        std::thread scanner([&] {
+            num_files = atag::scan(directory.string(), options, results, error);
+        });
+        std::vector<std::string> titles;
+        for(atag::scan_result result; results.pop(result);)
+        {
+            assert(!result.error && !result.is_cached);
+            titles.push_back(result.tag.title);
+        }
+        scanner.join();
+        std::sort(titles.begin(), titles.end());
+        assert(!error && (num_files == 3));
+        assert(titles == std::vector<std::string>({ "a.mp3", "b.MP3", "sub/c.mp3" }));
+
+        // The callback's exceptions are rethrown once the scan is over.
+        std::atomic<int> num_results{0};
+        bool has_thrown = false;
+        try
+        {
+            atag::scan(directory.string(), options, [&num_results](atag::scan_result&&) {
+                ++num_results;
+                throw std::runtime_error("callback");
+            }, error);
+        }
+        catch(const std::runtime_error&)
+        {
+            has_thrown = true;
+        }
+        assert(has_thrown && (num_results == 3));
+
+        atag::scan((directory / "missing").string(), options,
+            [](atag::scan_result&&) { assert(false); }, error);
+        assert(error);
+        fs::remove_all(directory);
+    }
+
+#ifdef ATAG_ASYNC_HEADER
+    {
+        // The coroutine only needs the bytes it asks for, and resumes once they arrive.
+        const std::string id3 = std::string("ID3\4\0\0\0\0\0\34", 10)
+            + std::string("TIT2\0\0\0\6\0\0\0Title", 16)
+            + std::string("PRIV\0\0\0\2\0\0ab", 12) + std::string(1000, '\xff');
+        std::vector<std::coroutine_handle<>> loop;
+        std::size_t num_reads = 0;
+        const auto read = [&](const std::size_t offset, const std::size_t length,
+            char* buffer, std::error_code&)
+        {
+            ++num_reads;
+            const std::size_t n = std::min(length, id3.size() - offset);
+            std::copy_n(id3.data() + offset, n, buffer);
+            return deferred_read{&loop, n};
+        };
+        std::error_code error;
+        auto task = atag::async_parse(id3.size(), read, error);
+        task.start();
+        while(!task.is_ready())
+        {
+            assert(loop.size() == 1);
+            const auto h = loop.back();
+            loop.pop_back();
+            h.resume();
+        }
+        assert(!error && (num_reads > 0) && (task.get().title == "Title"));
+
+        // A failed read ends the parse with its error.
+        auto failed = atag::async_parse(id3.size(),
+            [&loop](std::size_t, std::size_t, char*, std::error_code& ec)
+            {
+                ec = std::make_error_code(std::errc::io_error);
+                return deferred_read{&loop, 0};
+            }, error);
+        failed.start();
+        loop.back().resume();
+        loop.pop_back();
+        assert(failed.is_ready() && (error == std::errc::io_error));
+        assert(failed.get().title.empty());
+    }
+#endif // ATAG_ASYNC_HEADER
+
+#ifdef ATAG_URING_HEADER
+    {
+        // More files than the queue depth, one of which is missing, must all complete.
+        std::vector<std::string> paths;
+        for(int i = 0; i < 5; ++i)
+        {
+            paths.push_back("test_uring" + std::to_string(i) + ".mp3");
+            std::string id3v1 = "TAG" + paths.back();
+            id3v1.resize(127);
+            std::ofstream(paths.back(), std::ios::binary)
+                << std::string(4096, '\xff') << id3v1 << char(255);
+        }
+        paths.push_back("test_uring_missing.mp3");
+        std::error_code error;
+        atag::uring_driver driver;
+        driver.open(2, error);
+        // io_uring may be disabled, e.g. in containers.
+        if(!error)
+        {
+            std::vector<atag::scan_result> results;
+            driver.parse(paths, [&results](atag::scan_result&& result)
+                { results.push_back(std::move(result)); }, error);
+            assert(!error && (results.size() == paths.size()));
+            for(const auto& result : results)
+            {
+                if(result.path == paths.back())
+                    assert(result.error == std::errc::no_such_file_or_directory);
+                else
+                    assert(!result.error && (result.tag.title == result.path));
+            }
+        }
+        for(const auto& path : paths) { std::remove(path.c_str()); }
+    }
+#endif // ATAG_URING_HEADER
+
+    {
+        // Enough records to be remapped a few times must all be found, and survive
+        // erasing, compacting and reopening the cache.
+        std::error_code error;
+        atag::tag_cache cache;
+        std::remove("test_cache_log.bin");
+        cache.open("test_cache_log.bin", error);
+        assert(!error);
+        const auto key_of = [](const int i)
+            { return atag::tag_cache::key{1, uint64_t(i), 100, 5}; };
+        atag::simple_tag tag;
+        tag.artist = std::string(1000, 'A');
+        for(int i = 0; i < 4000; ++i)
+        {
+            tag.title = std::to_string(i);
+            cache.insert(key_of(i % 3000), "path", tag, error);
+            assert(!error);
+        }
+        assert((cache.size() == 3000) && (cache.num_dead_records() == 1000));
+        for(int i = 0; i < 3000; i += 2) { cache.erase(key_of(i), error); }
+        assert(!error && (cache.size() == 1500) && (cache.num_dead_records() == 4000));
+
+        const auto check = [&cache, &key_of] {
+            atag::simple_tag found;
+            for(int i = 0; i < 3000; ++i)
+            {
+                const bool is_found = cache.find(key_of(i), found);
+                assert(is_found == (i % 2 == 1));
+                const int last = i < 1000 ? i + 3000 : i;
+                assert(!is_found || ((found.title == std::to_string(last))
+                    && (found.artist.length() == 1000)));
+            }
+        };
+        check();
+        cache.compact(error);
+        assert(!error && (cache.size() == 1500) && (cache.num_dead_records() == 0));
+        check();
+        cache.close();
+        cache.open("test_cache_log.bin", error);
+        assert(!error && (cache.size() == 1500) && (cache.num_dead_records() == 0));
+        check();
+        cache.close();
+        std::remove("test_cache_log.bin");
+    }
+
+    const char* path = argc > 1 ? argv[1] : "sample.mp3";
+    const std::string source = read_file_data(path);
+
+    {
+        // Only the regions of the file that may hold a tag should be read.
+        std::error_code error;
+        atag::file_source file;
+        file.open(path, error);
+        assert(!error && (file.size() == source.size()));
+        assert(atag::prefetch_tags(file, error));
+        const auto a = atag::parse(file);
+        const auto b = atag::parse(source);
+        assert((a.title == b.title) && (a.album == b.album) && (a.artist == b.artist));
+        println("fetched " << file.num_bytes_fetched() << " of " << file.size() << " bytes");
+    }
+
+    if(atag::flac::is_tagged(source))
+    {
+        // Fetching only the parsed blocks must not change what's parsed.
+        std::error_code error;
+        atag::file_source file;
+        file.open(path, error);
+        assert(atag::prefetch_tags(file, error, atag::flac_blocks::parsed));
+        const auto a = atag::flac::parse(file);
+        const auto b = atag::flac::parse(source);
+        assert((a.title == b.title) && (a.streaminfo.md5 == b.streaminfo.md5));
+        assert((a.streaminfo.num_samples > 0) && (a.streaminfo.bits_per_sample >= 4));
+        assert(atag::parse(file).length == a.streaminfo.length());
+        println("fetched " << file.num_bytes_fetched() << " bytes of the parsed blocks");
+    }
+
+    {
+        // The sans-IO parser must accept short reads, and end up with the same tag.
+        atag::tag_parser parser(source.size());
+        for(atag::byte_range r; parser.need_bytes(r);)
+        {
+            assert(r.offset + r.length <= source.size());
+            parser.feed(r.offset, &source[r.offset], r.length / 2 + 1);
+        }
+        assert(parser.parse().title == atag::parse(source).title);
+    }
+
+    {
+        // Parsing into an arena must produce the same tag as parsing onto the heap. As
+        // the arena has no upstream resource, any allocation outside of it would throw.
+        static char buffer[1 << 20];
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof buffer,
+            std::pmr::null_memory_resource());
+        std::pmr::vector<atag::pmr::simple_tag> tags(&arena);
+        tags.push_back(atag::parse(source, &arena));
+        const auto tag = atag::parse(source);
+        assert(std::string_view(tags[0].title) == tag.title);
+        assert(std::string_view(tags[0].artist) == tag.artist);
+        assert(tags[0].year == tag.year);
+    }
+
+    if(atag::id3v2::is_tagged(source) || atag::flac::is_tagged(source))
+    {
+        // An edit that fits in the old tag's padding must not move the audio.
+        std::error_code error;
+        std::ofstream("test_edit", std::ios::binary) << source;
+        bool in_place;
+        if(atag::id3v2::is_tagged(source))
+        {
+            auto tag = atag::id3v2::parse(source);
+            tag.frames.erase(std::remove_if(tag.frames.begin(), tag.frames.end(),
+                [](const auto& f) { return f.id == atag::id3v2::title; }),
+                tag.frames.end());
+            tag.frames.emplace_back();
+            tag.frames.back().id = atag::id3v2::title;
+            tag.frames.back().flags = 0;
+            tag.frames.back().data = "Edited";
+            in_place = atag::id3v2::write("test_edit", tag, atag::padding_policy(),
+                error);
+        }
+        else
+        {
+            auto tag = atag::flac::parse(source);
+            tag.title = "Edited";
+            in_place = atag::flac::write("test_edit", tag, atag::padding_policy(), error);
+        }
+        const std::string edited = read_file_data("test_edit");
+        assert(!error && (atag::parse(edited).title == "Edited"));
+        assert(!in_place || (edited.size() == source.size()));
+        assert(edited.compare(edited.size() - 4096, 4096,
+            source, source.size() - 4096) == 0);
+        std::remove("test_edit");
+    }
+
+    if(atag::id3v2::is_tagged(source) || atag::flac::is_tagged(source))
+    {
+        // A retag that outgrows the padding rewrites the file, keeping the audio intact.
+        std::ofstream("test_retag", std::ios::binary) << source;
+        std::vector<atag::retag_job> jobs(1);
+        jobs[0].path = "test_retag";
+        jobs[0].tag.title = std::string(20000, 'T');
+        jobs[0].tag.year = 1999;
+        std::vector<atag::retag_result> results;
+        atag::retag(jobs, atag::retag_options(), [&results](atag::retag_result&& r) {
+            results.push_back(std::move(r));
+        });
+        assert((results.size() == 1) && !results[0].error && !results[0].in_place);
+        const std::string retagged = read_file_data("test_retag");
+        const auto tag = atag::parse(retagged);
+        assert((tag.title == jobs[0].tag.title) && (tag.year == 1999));
+        assert(retagged.compare(retagged.size() - 4096, 4096,
+            source, source.size() - 4096) == 0);
+        std::remove("test_retag");
+    }
+
+    {
+        // A cached tag must survive reopening the cache, but not a modification.
+        std::error_code error;
+        atag::tag_cache cache;
+        atag::tag_cache::key key;
+        std::remove("test_cache.bin");
+        cache.open("test_cache.bin", error);
+        assert(!error && atag::tag_cache::make_key(path, key, error));
+        cache.insert(key, path, atag::parse(source), error);
+        cache.close();
+        cache.open("test_cache.bin", error);
+        atag::simple_tag tag;
+        assert(!error && cache.find(key, tag) && (tag.title == atag::parse(source).title));
+        ++key.mtime_ns;
+        assert(!cache.find(key, tag));
+        cache.close();
+        std::remove("test_cache.bin");
+    }
+
+#ifdef __linux__
+    {
+        // A file written to a watched directory must be reported once it settles.
+        char directory[] = "/tmp/atag_testXXXXXX";
+        assert(mkdtemp(directory));
+        atag::watch_options options;
+        options.settle_time = std::chrono::milliseconds(10);
+        options.extensions.clear();
+        atag::watcher watcher(options);
+        std::error_code error;
+        watcher.add_root(directory, error);
+        assert(!error && (watcher.num_files() == 0));
+        const std::string copy = std::string(directory) + "/copy";
+        std::ofstream(copy, std::ios::binary) << source;
+        std::vector<atag::change> changes;
+        const auto on_change = [&changes](atag::change&& c) { changes.push_back(c); };
+        for(int i = 0; (i < 5) && changes.empty() && !error; ++i)
+            watcher.poll(std::chrono::seconds(1), on_change, error);
+        assert((changes.size() == 1) && (changes[0].kind == atag::change::added));
+        assert(changes[0].tag.title == atag::parse(source).title);
+        std::remove(copy.c_str());
+        changes.clear();
+        for(int i = 0; (i < 5) && changes.empty() && !error; ++i)
+            watcher.poll(std::chrono::seconds(1), on_change, error);
+        assert((changes.size() == 1) && (changes[0].kind == atag::change::removed));
+
+        // Removing the root itself must be reported, rather than going unnoticed.
+        std::ofstream(copy, std::ios::binary) << source;
+        changes.clear();
+        for(int i = 0; (i < 5) && changes.empty() && !error; ++i)
+            watcher.poll(std::chrono::seconds(1), on_change, error);
+        assert(!error && (changes.size() == 1) && (watcher.num_files() == 1));
+        std::remove(copy.c_str());
+        std::remove(directory);
+        changes.clear();
+        for(int i = 0; (i < 5) && !error; ++i)
+            watcher.poll(std::chrono::seconds(1), on_change, error);
+        assert(error == std::errc::no_such_file_or_directory);
+        for(int i = 0; (i < 5) && changes.empty(); ++i)
+            watcher.poll(std::chrono::milliseconds(100), on_change, error);
+        assert((changes.size() == 1) && (changes[0].kind == atag::change::removed));
+        assert(watcher.num_files() == 0);
+    }
+#endif
 
     // Make sure this compiles.
     std::vector<atag::simple_tag> dummy_tags;
-    std::sort(dummy_tags.begin(), dummy_tags.end(), atag::order::track_number);
+    std::sort(dummy_tags.begin(), dummy_tags.end(), atag::order::track_number());
 
     using namespace atag;
     if(id3v2::is_tagged(source))
@@ -50,6 +1199,27 @@ int main(int argc, const char** argv)
                 tag.flags & id3v2::tag::unsynchronisation, tag.frames.size());
             for(const auto& frame : tag.frames) { print_frame(frame); }
         }
+        {
+            // Parsing stops as soon as both frames have been found.
+            const auto tag = id3v2::parse<id3v2::title, id3v2::album>(source);
+            assert(std::all_of(tag.frames.begin(), tag.frames.end(), [](const auto& f)
+                { return (f.id == id3v2::title) || (f.id == id3v2::album); }));
+            constexpr id3v2::frame_set wanted{id3v2::title, id3v2::album};
+            static_assert(wanted.contains(id3v2::title), "");
+            static_assert(!wanted.contains(id3v2::year), "");
+            assert(id3v2::parse(source, wanted).frames.size() == tag.frames.size());
+        }
+        {
+            // This only indexes the frames, their bodies are decoded on demand.
+            const id3v2::tag_view view = id3v2::make_view(source);
+            for(const auto& frame : view.frames())
+            {
+                assert(view.data(frame).data() >= source.data());
+                assert(view.data(frame).size() == frame.size);
+            }
+            if(const auto* title = view.find(id3v2::title))
+                println("title (view): " << view.text(*title));
+        }
         {
             // While this produces a simpler tag with only a few key fields, such as
             // title, album, artist etc.
@@ -65,9 +1235,10 @@ int main(int argc, const char** argv)
 
         flac::tag tag = atag::flac::parse(source);
         std::printf("title: %s, album: %s, artist: %s, year: %i, track#: %i,"
-            " sample rate: %i Hz, #channels: %i, #samples: %i\n",
+            " sample rate: %i Hz, #channels: %i, #samples: %llu\n",
             tag.title.c_str(), tag.album.c_str(), tag.artist.c_str(), tag.year,
-            tag.track_number, tag.sample_rate, tag.num_channels, tag.num_samples);
+            tag.track_number, tag.streaminfo.sample_rate, tag.streaminfo.num_channels,
+            (unsigned long long)tag.streaminfo.num_samples);
     }
     // TODO test idv1, ape
 }